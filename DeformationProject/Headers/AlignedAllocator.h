@@ -0,0 +1,92 @@
+//--------------------------------------------------------------------------------------
+// File: AlignedAllocator.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Aligned allocator for SIMD-friendly std::vectors
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _ALIGNEDALLOCATOR_H_
+#define _ALIGNEDALLOCATOR_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+/// alignment of SoA arrays: one cache line, also enough for AVX-512 loads
+#define SIMD_ALIGNMENT          64
+
+
+/// std::allocator replacement returning Alignment-aligned blocks
+template <typename T, size_t Alignment = SIMD_ALIGNMENT>
+class AlignedAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+    AlignedAllocator() {}
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    pointer address(reference r) const { return &r; }
+    const_pointer address(const_reference r) const { return &r; }
+    size_type max_size() const { return ((size_t)-1) / sizeof(T); }
+
+    pointer allocate(size_type n, const void* = nullptr){
+        if (n == 0)
+            return nullptr;
+        // round up, aligned_alloc needs a multiple of the alignment
+        size_t bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+#if defined(_MSC_VER)
+        void* p = _aligned_malloc(bytes, Alignment);
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, Alignment, bytes) != 0)
+            p = nullptr;
+#endif
+        if (!p)
+            throw std::bad_alloc();
+        return static_cast<pointer>(p);
+    }
+
+    void deallocate(pointer p, size_type){
+#if defined(_MSC_VER)
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args){ ::new((void*)p) U(std::forward<Args>(args)...); }
+    template <typename U>
+    void destroy(U* p){ p->~U(); }
+};
+
+template <typename T, typename U, size_t A>
+inline bool operator==(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&){ return true; }
+template <typename T, typename U, size_t A>
+inline bool operator!=(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&){ return false; }
+
+/// std::vector with aligned storage
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+#endif
@@ -0,0 +1,60 @@
+//--------------------------------------------------------------------------------------
+// File: BVHRefit.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Level-parallel refit of the collision trees (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _BVHREFIT_H_
+#define _BVHREFIT_H_
+
+#include <vector>
+#include "Constants.h"
+#include "MasspointStore.h"
+#include "ThreadPool.h"
+
+
+/// Refit of the collision trees of every object, one tree level at a time
+/// The trees are aligned at their deepest level: pass 0 refits the deepest level of
+/// every tree (boxes around the masspoints), pass p the level p above it, so the nodes
+/// of a pass only read nodes of the previous pass and are refitted in parallel over all
+/// objects at once. The number of passes is the depth of the deepest tree.
+/// The refit list holds the nodes pass after pass, object after object, in tree order:
+/// neighbouring threads of a pass read neighbouring children. The D3D11 backend uploads
+/// it as is and runs one CSBVHRefit dispatch per pass.
+/// Swept refits (continuous collision) grow the masspoint boxes to the position of the next
+/// step extrapolated from the last displacement (2 * new - old), every box above follows.
+class BVHRefit
+{
+private:
+    // nodes of every pass
+    std::vector<REFITNODE> nodes;
+    // pass p refits nodes [passOffsets[p], passOffsets[p + 1])
+    std::vector<uint> passOffsets;
+
+public:
+    BVHRefit();
+    ~BVHRefit();
+
+    // refit list of the trees of the catalogue
+    void build(const BVHDESC* catalogue, uint objectCount);
+    // refit the trees to the current masspoint positions, then the bounds of the catalogue
+    // (range = collision range, the margin of the masspoint boxes; swept: boxes of the whole next step)
+    void refit(BVHDESC* catalogue, uint objectCount, BVBOX* bvhdata, const MASSVIEW& volcube1, const MASSVIEW& volcube2,
+               float range, ThreadPool& pool, bool swept = false) const;
+
+    // number of passes
+    uint passCount() const { return passOffsets.empty() ? 0 : (uint)passOffsets.size() - 1; }
+    // first node of pass p in the refit list
+    uint passFirst(uint p) const { return passOffsets[p]; }
+    // number of nodes in pass p
+    uint passSize(uint p) const { return passOffsets[p + 1] - passOffsets[p]; }
+    // refit list, every pass
+    const std::vector<REFITNODE>& list() const { return nodes; }
+};
+
+#endif
@@ -0,0 +1,205 @@
+//--------------------------------------------------------------------------------------
+// File: Benchmark.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Headless benchmarks of the CPU solver (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Constants.h"
+#include "DeformableBase.h"
+#include "DeformableOBJ.h"
+#include "BroadPhase.h"
+#include "CPUSimulation.h"
+
+
+/// Timing of one benchmark configuration
+struct BENCHRESULT
+{
+    // worker threads, the calling thread included
+    uint threads;
+    // average wall time of one step
+    double msPerStep;
+    // single thread time / this time
+    double speedup;
+};
+
+/// Cost of simulating with one integrator and timestep
+struct INTEGRATORRESULT
+{
+    // CPUSimulation::Integrator
+    int integrator;
+    // timestep
+    float dt;
+    // average wall time of one step
+    double msPerStep;
+    // wall time of one simulated second
+    double msPerSecond;
+    // average CG iterations per step (implicit only)
+    double iterations;
+    // steps where CG stopped at CPU_CG_ITERATIONS (implicit only)
+    uint capped;
+    // every position stayed finite and in range
+    bool stable;
+};
+
+/// Broad phase counters of a run, summed over its steps
+struct BROADPHASERESULT
+{
+    // number of steps
+    uint steps;
+    // object pairs of every step, overlapping pairs and pruned pairs
+    double pairs;
+    double candidates;
+    double pruned;
+    // endpoint swaps of the incremental sort
+    double swaps;
+    // average wall time of one step
+    double msPerStep;
+};
+
+/// Cost of the contact search of one scene with both collision modes
+struct COLLISIONRESULT
+{
+    // number of objects, distance of neighbouring objects (object widths)
+    uint objects;
+    float spacing;
+    // average wall time of one step with collision trees and with the hash grid
+    double bvhMs;
+    double hashMs;
+};
+
+/// Contact cache counters of a run, summed over its steps
+struct CONTACTCACHERESULT
+{
+    // number of steps
+    uint steps;
+    // collision tree queries, answered from the cache, full traversals, nodes they visited
+    double queries;
+    double hits;
+    double traversals;
+    double nodes;
+    // average wall time of one step without and with the cache
+    double uncachedMs;
+    double cachedMs;
+};
+
+/// Contact queries of a run with per-masspoint traversals and with packets, summed over its steps
+struct CONTACTQUERYRESULT
+{
+    // number of steps
+    uint steps;
+    // queries that reached a collision tree
+    double queries;
+    // tree nodes fetched per-masspoint and per-packet (the node fetches stand for the cache misses)
+    double pointNodes;
+    double packetNodes;
+    // average wall time of one step per-masspoint and per-packet
+    double pointMs;
+    double packetMs;
+    // both runs ended with the same masspoint positions
+    bool identical;
+};
+
+/// Throughput of the .OBJ parser on one file, one thread and every thread
+struct IMPORTRESULT
+{
+    // file size, vertices and triangles read
+    size_t bytes;
+    size_t vertices;
+    size_t triangles;
+    // threads of the parallel runs
+    uint threads;
+    // best wall time of a parse with one thread and with every thread
+    double serialMs;
+    double parallelMs;
+};
+
+/// Spawn latency of an object: full build against the prebuilt cache
+struct SPAWNRESULT
+{
+    // masspoints and springs of the object
+    uint masspoints;
+    uint springs;
+    // threads of the parallel builds
+    uint threads;
+    // best wall time of a full build on one thread, on every thread and of a build from the cache file
+    double buildMs;
+    double parallelMs;
+    double cachedMs;
+    // the cache could be written and read back
+    bool cached;
+    // every build produced the same masscubes, indexer, springs and collision tree
+    bool identical;
+};
+
+/// Memory and query cost of the binary and the 4-wide collision trees
+struct TREERESULT
+{
+    // collision masspoints of the scene
+    uint masspoints;
+    // memory of the binary trees, the built 4-wide trees and the 4-wide trees converted from the binary ones
+    size_t binaryBytes;
+    size_t wideBytes;
+    size_t convertedBytes;
+    // average wall time of one step with each layout
+    double bvhMs;
+    double wideMs;
+};
+
+// CB_CS with the current physics constants, for headless stepping
+CB_CS benchmarkConstants(std::vector<std::unique_ptr<DeformableBase>>& objects, float dt);
+// scaling curve: step the objects with 1 ... maxThreads threads (0 = hardware cores)
+std::vector<BENCHRESULT> benchmarkScaling(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps, uint maxThreads = 0);
+// results as "threads:ms/step(speedup)" items
+std::wstring formatBenchmark(const std::vector<BENCHRESULT>& results);
+// cost per simulated second of the Verlet, implicit and XPBD integrators at the same stiffness,
+// timesteps from 1/960 s to 1/60 s, seconds of simulated time each
+std::vector<INTEGRATORRESULT> benchmarkIntegrators(std::vector<std::unique_ptr<DeformableBase>>& objects, float stiffness, float seconds = 1.0f);
+// results as "integrator@Hz:ms/s" items, unstable runs marked
+std::wstring formatIntegrators(const std::vector<INTEGRATORRESULT>& results);
+// broad phase counters while stepping the scene (CPU solver)
+BROADPHASERESULT benchmarkBroadPhase(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps);
+// counters per step as "name:value" items
+std::wstring formatBroadPhase(const BROADPHASERESULT& result);
+// contact cache counters while stepping the scene, step times without and with the cache
+CONTACTCACHERESULT benchmarkContactCache(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps);
+// hit rate, nodes visited and saved per step (saved: hits * nodes per traversal), step times
+std::wstring formatContactCache(const CONTACTCACHERESULT& result);
+// contact queries while stepping the scene with per-masspoint traversals and with packets
+CONTACTQUERYRESULT benchmarkContactQueries(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps);
+// queries per step, nodes and step time per query of both runs
+std::wstring formatContactQueries(const CONTACTQUERYRESULT& result);
+// parse the .OBJ file repeats times with one thread and with every hardware thread
+IMPORTRESULT benchmarkImport(const std::string& file, uint repeats);
+// sizes, best times and throughput (MB/s) of both runs
+std::wstring formatImport(const IMPORTRESULT& result);
+// build the .OBJ model repeats times without its cache file on one and on every hardware thread,
+// and with its cache file in DFM_CACHE_DIR (written by the first build)
+SPAWNRESULT benchmarkSpawn(const std::string& file, uint repeats);
+// sizes and best build times of both paths
+std::wstring formatSpawn(const SPAWNRESULT& result);
+// tree memory of the scene, step times with the binary and the 4-wide trees
+TREERESULT benchmarkTrees(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps);
+// memory as "layout:KB(share of binary)" items, step times
+std::wstring formatTrees(const TREERESULT& result);
+// average stage times of steps of the scene, with or without self-collision
+STEPTIMES benchmarkStages(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps, bool selfCollision);
+// stage times as "stage:ms" items
+std::wstring formatStages(const STEPTIMES& times);
+// collision trees against the hash grid: copies of the prototype on a cubic grid, 2, 4, ... maxObjects
+// objects, 0.75, 1 and 1.5 object widths apart, steps each
+std::vector<COLLISIONRESULT> benchmarkCollision(const DeformableOBJ& prototype, uint maxObjects, uint steps);
+// results as "objects@spacing:bvh/hash ms" items, the faster mode marked
+std::wstring formatCollision(const std::vector<COLLISIONRESULT>& results);
+
+#endif
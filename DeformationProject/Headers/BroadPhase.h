@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// File: BroadPhase.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Sweep-and-prune broad phase of the CPU solver (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _BROADPHASE_H_
+#define _BROADPHASE_H_
+
+#include <vector>
+#include "Constants.h"
+
+
+/// Counters of the last broad phase update
+struct BROADPHASESTATS
+{
+    // number of objects
+    uint objects;
+    // object pairs without a broad phase, n * (n - 1) / 2
+    uint pairs;
+    // overlapping pairs, visited by the narrow phase
+    uint candidates;
+    // pairs - candidates
+    uint pruned;
+    // endpoint swaps of the incremental sort
+    uint swaps;
+};
+
+
+/// Sweep and prune over the bounding boxes of the objects
+/// The min and max x of every box are kept in one endpoint list, sorted by insertion
+/// sort at every update: the objects move little between two steps, so the list is
+/// nearly sorted and the sort is close to linear. The sweep keeps the boxes open at
+/// the current endpoint; a box opening tests y and z against the open boxes only.
+/// The overlapping pairs are stored per object, in increasing object order (the order
+/// of the loop over every object they replace).
+class BroadPhase
+{
+private:
+    /// Min or max x of a box
+    struct ENDPOINT
+    {
+        float value;
+        // object index * 2 + 1 for the max endpoint
+        uint code;
+    };
+
+    // endpoints of every box, sorted by value (min before max at equal values)
+    std::vector<ENDPOINT> endpoints;
+    // boxes of the last update
+    std::vector<XMFLOAT3> boxMin;
+    std::vector<XMFLOAT3> boxMax;
+    // candidates of object o: pairObjects[pairOffsets[o]] ... pairObjects[pairOffsets[o + 1] - 1]
+    std::vector<uint> pairOffsets;
+    std::vector<uint> pairObjects;
+    // boxes open during the sweep
+    std::vector<uint> open;
+    // pairs found by the sweep (a < b)
+    std::vector<uint> pairA;
+    std::vector<uint> pairB;
+    // next free slot of every object in pairObjects
+    std::vector<uint> fill;
+    BROADPHASESTATS counters;
+
+public:
+    BroadPhase();
+    ~BroadPhase();
+
+    // new set of objects, every object overlaps every other until the first update
+    void reset(uint objectCount);
+    // sort the boxes of the objects (min and max corners), find the overlapping pairs
+    void update(const XMFLOAT3* minCorner, const XMFLOAT3* maxCorner);
+
+    // objects whose box overlaps the box of object o
+    const uint* candidates(uint o) const { return pairObjects.data() + pairOffsets[o]; }
+    uint candidateCount(uint o) const { return pairOffsets[o + 1] - pairOffsets[o]; }
+    // counters of the last update
+    const BROADPHASESTATS& stats() const { return counters; }
+};
+
+#endif
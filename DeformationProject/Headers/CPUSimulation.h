@@ -0,0 +1,272 @@
+//--------------------------------------------------------------------------------------
+// File: CPUSimulation.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Portable CPU simulation backend (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _CPUSIMULATION_H_
+#define _CPUSIMULATION_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <memory>
+#include "Constants.h"
+#include "DeformableBase.h"
+#include "MasspointStore.h"
+#include "SpringGraph.h"
+#include "SpringKernel.h"
+#include "ImplicitSolver.h"
+#include "XPBDSolver.h"
+#include "BVHRefit.h"
+#include "BroadPhase.h"
+#include "SpatialHash.h"
+#include "ContactCache.h"
+#include "WideBVH.h"
+#include "StaticColliders.h"
+#include "ThreadPool.h"
+#include "SimulationBackend.h"
+
+
+/// Wall time of the stages of the last step (ms)
+struct STEPTIMES
+{
+    // hash grid rebuild (collision mode or self-collision)
+    double hash;
+    // self-collision of the surface masspoints
+    double selfCollision;
+    // batched contact queries
+    double queries;
+    // masscube tasks: springs, contacts, Verlet or accelerations
+    double masscubes;
+    // implicit or XPBD solve
+    double solver;
+    // particle update
+    double particles;
+    // collision tree refit and broad phase
+    double trees;
+};
+
+/// CPU equivalent of the compute shader pipeline, no graphics device needed
+/// CSMain1/CSMain2 (masscube update), CSPosUpdate (particles), CSBVHRefit/CSBVHUpdate (collision trees)
+/// Masspoints are kept in one SoA store with the layout of the GPU buffers: object o starts at
+/// the offsets of its BVHDESC, only active masspoints are stored
+/// A step is split into tasks per object and per CPU_SLAB_DEPTH z-slices of each masscube;
+/// every task reads state t and writes state t+1, so no locks are needed
+/// Springs, time integration and contact search are chosen at run time (SpringMode, Integrator,
+/// CollisionMode), contacts only between the objects paired by the broad phase (BroadPhase)
+/// Besides the table, masspoints are pushed out of the static colliders of the scene (planes,
+/// boxes, meshes) through their signed distance grid (StaticColliders)
+/// Picking is not supported, the picked masspoint IDs only exist in the picking texture
+class CPUSimulation final : public SimulationBackend
+{
+public:
+    // spring evaluation: masks + SIMD rows, CSR list per masspoint, or CSR edges + gather
+    enum SpringMode { SPRINGS_ROWS = 0, SPRINGS_VERTEX = 1, SPRINGS_EDGE = 2 };
+    // time integration: explicit Verlet (same as the shaders), backward Euler + PCG, XPBD constraints
+    enum Integrator { INTEGRATOR_VERLET = 0, INTEGRATOR_IMPLICIT = 1, INTEGRATOR_XPBD = 2 };
+    // contact search: collision trees of the candidate objects, the hash grid of the scene,
+    // or the quantized 4-wide trees of the candidate objects
+    enum CollisionMode { COLLISION_BVH = 0, COLLISION_HASH = 1, COLLISION_WIDE = 2 };
+
+private:
+    /// Run of active masspoints with consecutive x in one lattice row
+    struct SPRINGROW
+    {
+        uint object;
+        // 1 or 2
+        uint cube;
+        // first masspoint in the view of its masscube, number of masspoints
+        uint base;
+        uint count;
+        // neighbour offsets: same cube relative to the masspoint, other cube relative to its lane
+        SPRINGLAYOUT layout;
+        // every neighbour at a constant offset, the row kernel can be used
+        bool uniform;
+    };
+
+    /// Runs of CPU_SLAB_DEPTH z-slices of one masscube of an object
+    struct SLABTASK
+    {
+        // first and last + 1 run
+        uint row0;
+        uint row1;
+    };
+
+    // number of simulated objects
+    uint objectCount;
+    // masspoint states of all objects
+    MasspointStore masspoints;
+    // number of masscube1 masspoints, masscube2 starts here
+    uint mass1Count;
+    // views of the current step: masscube1 (from 0, so graph IDs index it too), masscube2
+    MASSVIEW view1;
+    MASSVIEW view2;
+    // springs of all objects, global masspoint IDs
+    SpringGraph springs;
+    // selected spring evaluation
+    SpringMode springMode;
+    // rest length of every edge, cell size of its object (SPRINGS_EDGE)
+    AlignedVector<float> edgeRest;
+    // accelerations along the edges (SPRINGS_EDGE)
+    AlignedVector<float> edgeX;
+    AlignedVector<float> edgeY;
+    AlignedVector<float> edgeZ;
+    // selected time integration
+    Integrator integrator;
+    // backward Euler solver (INTEGRATOR_IMPLICIT)
+    ImplicitSolver implicit;
+    // constraint solver (INTEGRATOR_XPBD)
+    XPBDSolver xpbd;
+    // explicit accelerations of every masspoint by graph ID (INTEGRATOR_IMPLICIT, INTEGRATOR_XPBD:
+    // without the springs)
+    std::vector<XMFLOAT3> accel;
+    // spring force kernel (widest ISA of the CPU)
+    SpringKernel kernel;
+    // runs of active masspoints, per object, masscube and z-slice
+    std::vector<SPRINGROW> rows;
+    // lattice -> masscube index tables of every object (BVHDESC::remapOffset)
+    std::vector<int> remap;
+    // spring constants of every object in the current step
+    std::vector<SPRINGPARAMS> objectParams;
+    // masscube tasks of a step
+    std::vector<SLABTASK> slabs;
+    // worker threads
+    ThreadPool pool;
+    // particles of all objects
+    std::vector<PARTICLE> particles;
+    // indexer entries of all objects
+    std::vector<INDEXER> indexer;
+    // masscube1 and masscube2 indices of the 8 + 8 corners of every indexer entry
+    std::vector<uint> corners;
+    // collision tree catalogue, lattice of every object
+    std::vector<BVHDESC> bvhdesc;
+    // collision trees of all objects
+    BVBoxVector bvhdata;
+    // refit passes of the collision trees
+    BVHRefit refit;
+    // objects whose boxes overlap, visited by the collision detection
+    BroadPhase broadPhase;
+    // box of every object: its masspoints and its collision tree
+    std::vector<XMFLOAT3> objectMin;
+    std::vector<XMFLOAT3> objectMax;
+    // selected contact search
+    CollisionMode collisionMode;
+    // surface masspoints of all objects (COLLISION_HASH, self-collision)
+    SpatialHash hash;
+    // 4-wide collision trees of all objects (COLLISION_WIDE)
+    WideBVH wide;
+    // continuous collision: swept trees, contacts at the closest approach (COLLISION_BVH, COLLISION_WIDE)
+    bool continuous;
+    // leaf contacts of the last traversals (COLLISION_BVH), an entry is only written by
+    // the task of its masspoint
+    bool caching;
+    mutable ContactCache contacts;
+    // self-collision, excluded lattice distance (cells, at least 2)
+    bool selfCollision;
+    uint selfCells;
+    // lattice position of every masspoint by graph ID, half cells: x | y << 10 | z << 20
+    // (masscube1 at odd, masscube2 at even coordinates)
+    std::vector<uint> lattice;
+    // self-collision accelerations by graph ID, only surface masspoints are written
+    std::vector<XMFLOAT3> selfAccel;
+    // batched contact queries (COLLISION_BVH without the contact cache)
+    bool batching;
+    // graph IDs of every object in Morton order of their lattice positions, packet p holds
+    // [packetStart[p], packetStart[p + 1]) of packetObject[p]
+    std::vector<uint> queryOrder;
+    std::vector<uint> packetStart;
+    std::vector<uint> packetObject;
+    // collision accelerations of the packets by graph ID
+    std::vector<XMFLOAT3> packetAccel;
+    // contact query counters by graph ID (COLLISION_BVH): 0 no tree reached, else 1 + nodes fetched
+    // (a packet counts its nodes at its first query)
+    mutable std::vector<uint> queryNodes;
+    // static environment, baked in load() (cache file of the grid, empty: none)
+    StaticColliders colliders;
+    std::string colliderCache;
+    // stage times of the last step
+    STEPTIMES times;
+
+    // point the views to the current step
+    void updateViews();
+    // find the runs of active masspoints in a z-slice of one masscube of an object
+    void buildRows(uint objnum, uint cube, int z);
+    // spring accelerations of the masspoints of a run
+    void springForces(const SPRINGPARAMS& params, const SPRINGROW& row, float* ax, float* ay, float* az) const;
+    // update the runs of a slab (CSMain1 / CSMain2)
+    void stepSlab(const CB_CS& cb, const SLABTASK& task);
+    // integrate one masspoint (graph ID id): collision, table, Verlet into v.next (accel holds springs and gravity)
+    void integrate(const CB_CS& cb, uint ind, uint id, uint objnum, XMFLOAT3 accel, const MASSVIEW& v) const;
+    // add the collision and table accelerations of masspoint ind of v (graph ID id) to accel
+    void contactForces(const CB_CS& cb, const MASSVIEW& v, uint ind, uint id, uint objnum, XMFLOAT3& accel) const;
+    // repulsive collision forces affecting masspoint id at cpos, moving to cnext (continuous collision)
+    XMFLOAT3 collisionDetection(const XMFLOAT3& cpos, const XMFLOAT3& cnext, uint id, uint objnum, const CB_CS& cb) const;
+    // collision forces of the queries of packet p into packetAccel
+    void contactPacket(const CB_CS& cb, uint p);
+    // contact queries run in packets this step
+    bool batched() const { return batching && collisionMode == COLLISION_BVH && !caching; }
+    // update particle positions from the masscubes (CSPosUpdate)
+    void updateParticles();
+    // refit collision trees to the current masspoint positions (CSBVHRefit, CSBVHUpdate)
+    void updateBVH(const CB_CS& cb);
+    // boxes of the objects, overlapping pairs for the next step
+    void updateBroadPhase();
+    // repulsion between the surface masspoints of each object (hash grid of the current step)
+    void updateSelfCollision(const CB_CS& cb);
+
+public:
+    // threads == 0: one thread per hardware core, load() fills the buffers
+    explicit CPUSimulation(uint threads = 0);
+    // default destructor
+    ~CPUSimulation();
+
+    // SimulationBackend
+    void load(std::vector<std::unique_ptr<DeformableBase>>& objects) override;
+    void step(const CB_CS& cb) override;
+    void exportSnapshot(MassVector& masscube1, MassVector& masscube2, std::vector<PARTICLE>& particles) override;
+    void exportParticles(std::vector<PARTICLE>& particles) override { particles = this->particles; }
+    const char* name() const override { return "CPU"; }
+    // number of worker threads, the calling thread included
+    uint threads() const { return pool.size(); }
+    // select the spring evaluation
+    void setSpringMode(SpringMode mode) { springMode = mode; }
+    // select the time integration
+    void setIntegrator(Integrator mode) { integrator = mode; }
+    Integrator currentIntegrator() const { return integrator; }
+    // select the contact search
+    void setCollisionMode(CollisionMode mode) { collisionMode = mode; }
+    CollisionMode currentCollisionMode() const { return collisionMode; }
+    // enable continuous collision (collision trees of either layout): the trees hold every masspoint
+    // at both ends of the step, a pair that would get within range during the step is pushed back
+    // by the part of its approach that crosses the range (speculative contact)
+    void setContinuousCollision(bool enable) { continuous = enable; }
+    // keep the leaf contacts between steps (collision trees only)
+    void setContactCache(bool enable) { caching = enable; }
+    // memory of the collision trees: binary (CSBVHRefit layout) and 4-wide
+    size_t treeBytes() const { return bvhdata.size() * sizeof(BVBOX); }
+    size_t wideTreeBytes() const { return wide.bytes(); }
+    // static colliders of the scene, baked by the next load() unless the cache file matches
+    void setStaticColliders(const StaticColliders& environment, const std::string& cacheFile = "") { colliders = environment; colliderCache = cacheFile; }
+    // traverse the collision trees in packets of neighbouring masspoints (COLLISION_BVH, no contact cache)
+    void setBatchedQueries(bool enable) { batching = enable; }
+    // contact queries of the last step and the tree nodes they fetched (COLLISION_BVH)
+    void contactQueryStats(uint& queries, uint& nodes) const;
+    // contact cache counters of the last step
+    const CONTACTCACHESTATS& contactCacheStats() const { return contacts.stats(); }
+    // enable self-collision, pairs within cells lattice cells (2 at least) are skipped
+    void setSelfCollision(bool enable, uint cells = 2) { selfCollision = enable; selfCells = std::max(2u, cells); }
+    // stage times of the last step
+    const STEPTIMES& stepTimes() const { return times; }
+    // CG iterations of the last implicit step
+    uint solverIterations() const { return implicit.iterations(); }
+    // broad phase counters of the last step
+    const BROADPHASESTATS& broadPhaseStats() const { return broadPhase.stats(); }
+};
+
+#endif
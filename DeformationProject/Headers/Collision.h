@@ -12,13 +12,33 @@
 #ifndef _COLLISION_H_
 #define _COLLISION_H_
 
+#include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <vector>
 #include "DeformableBase.h"
 #include "Constants.h"
 
+class ThreadPool;
+
+
+/// Collision masspoint: masscube index, masscube (1 or 2) and position
+struct BVHLEAF
+{
+    int id;
+    int type;
+    XMFLOAT3 pos;
+};
+typedef std::vector<BVHLEAF> BVHLeafVector;
+
 
 /// Class representing a Bounding Volume Hierarchy
+/// Flat complete binary tree in level order (children of node i: 2i+1, 2i+2), the layout
+/// read by CSBVHUpdate and collision_detection: the masspoints are padded to a power of 2,
+/// the deepest level holds two masspoints per node, padding children have type -1.
+/// The masspoints are ordered along a Morton curve (30-bit codes in the bounds of the
+/// masspoints, LSD radix sort), then the tree is built bottom-up over that order, so every
+/// subtree holds a compact run of the curve. Linear apart from the sort.
 class BVHierarchy final{
 
 public:
@@ -27,15 +47,32 @@ public:
 
     // no default constructor
     BVHierarchy() = delete;
-    // construct BVBox from given masspoints+IDs
-    BVHierarchy(MassIDTypeVector masspoints);
+    // build from the collision masspoints, pool: parallel radix sort (nullptr: serial)
+    explicit BVHierarchy(const BVHLeafVector& masspoints, ThreadPool* pool = nullptr);
     // destructor
     ~BVHierarchy();
-    // sort masspoints in order, add IDs
-    BVBoxVector sort(MassIDTypeVector masspoints, uint mode);
-    // merge two binary trees into one array
-    BVBoxVector merge(BVBoxVector a, BVBoxVector b);
+
+    // 30-bit Morton code of a point of the unit cube
+    static uint morton(float x, float y, float z);
+    // stable sort of order by codes (both permuted), 8 bits per pass
+    static void radixSort(std::vector<uint>& codes, std::vector<uint>& order, ThreadPool* pool = nullptr);
 };
 
 
-#endif
\ No newline at end of file
+// repulsion along d = base point - colliding neighbour: direction * weight_from_distance
+// (exponential), the force of the collision shaders; none for coinciding masspoints
+inline XMFLOAT3 repel(const XMFLOAT3& d, float collisionRange){
+    float dist = sqrtf(d.x * d.x + d.y * d.y + d.z * d.z);
+    if (dist == 0.0f)
+        return XMFLOAT3(0, 0, 0);
+    float w = std::min(EXP_MAX, 1000.0f * exp2f(collisionRange - dist)) / dist;
+    return XMFLOAT3(d.x * w, d.y * w, d.z * w);
+}
+
+// collide to points in space (cpos = base point, xpos = colliding neighbour)
+inline XMFLOAT3 collide(const XMFLOAT3& cpos, const XMFLOAT3& xpos, float collisionRange){
+    return repel(XMFLOAT3(cpos.x - xpos.x, cpos.y - xpos.y, cpos.z - xpos.z), collisionRange);
+}
+
+
+#endif
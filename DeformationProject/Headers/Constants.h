@@ -16,7 +16,9 @@
 #include <vector>
 #include <atomic>
 #include <tuple>
+#include <string>
 #include <DirectXMath.h>
+#include "AlignedAllocator.h"
 
 using namespace DirectX;
 
@@ -28,14 +30,73 @@ using namespace DirectX;
 /// enable DeformationConsole communication
 #define IPCENABLED              0
 
+/// simulation backend: 0 = D3D11 compute shaders, 1 = CPU solver
+#define CPUSIMULATION           0
+
 
 /// DEFORMATION defines
-// n*n*n inner cube, (n+1)*(n+1)*(n+1) outer cube
-#define VCUBEWIDTH              13
+// n*n*n inner cube, (n+1)*(n+1)*(n+1) outer cube: lattice width range of an object,
+// chosen at build time from its vertex count and bounds
+#define VCUBEWIDTH_MIN          4
+#define VCUBEWIDTH_MAX          32
+// model vertices per lattice cross-section cell, sets the width from the vertex count
+#define VCUBE_VERTEX_DENSITY    216
 // particle update CS threadgroup size
 #define PARTICLE_TGSIZE         256
 // masspoint update CS threadgroup size
 #define MASSPOINT_TGSIZE        256
+// collision tree refit CS threadgroup size (nodes of one refit pass)
+#define REFIT_TGSIZE            256
+// z-slices of a masscube per CPU solver task
+#define CPU_SLAB_DEPTH          4
+// particles per CPU solver task
+#define CPU_PARTICLE_BATCH      1024
+// model vertices per task of a parallel object build (particles, indexer)
+#define CPU_BUILD_BATCH         4096
+// surface masspoints per CPU solver task (hash grid cells)
+#define CPU_HASH_BATCH          4096
+// neighbouring masspoints traversing a collision tree together (batched contact queries, at most 32)
+#define CPU_QUERY_PACKET        16
+// the queries of a packet are bits of a uint lane mask
+static_assert(CPU_QUERY_PACKET >= 1 && CPU_QUERY_PACKET <= 32, "CPU_QUERY_PACKET must be between 1 and 32");
+// query packets per CPU solver task
+#define CPU_PACKET_BATCH        32
+// collision tree nodes per CPU solver task (one refit pass)
+#define CPU_REFIT_BATCH         2048
+// spring edges per CPU solver task (edge-parallel springs)
+#define CPU_EDGE_BATCH          4096
+// masspoints per block of the implicit solver (vector operations and reductions)
+#define CPU_SOLVER_BATCH        2048
+// CG iterations per implicit step at most
+#define CPU_CG_ITERATIONS       50
+// CG stops at |residual| <= CPU_CG_TOLERANCE * |right-hand side|
+#define CPU_CG_TOLERANCE        1e-4
+// width of the exact band around collider meshes in the distance grid (cells)
+#define SDF_BAND                4
+// samples of a collider distance grid at most
+#define SDF_SAMPLES_MAX         (1 << 26)
+// bytes of an .OBJ file per parser task at least (newline-aligned chunks)
+#define OBJ_CHUNK_BYTES         (1 << 20)
+// directory of the prebuilt object caches (.dfm) of enableCache(), created by the first save
+#define DFM_CACHE_DIR           "dfmcache"
+// leaf contacts cached per masspoint at most
+#define CONTACT_CACHE_SLOTS     8
+// steps a cached contact entry is reused before the next full traversal
+#define CONTACT_CACHE_FRAMES    8
+// XPBD constraint iterations of an object per step (default of DeformableBase::solverIterations)
+#define XPBD_ITERATIONS         10
+// repulsion multiplier below the table (exp_mul in the shaders)
+#define EXP_MUL                 0.05f
+// upper bound of exponential repulsion forces (exp_max in the shaders)
+#define EXP_MAX                 1000000.0f
+// substeps per frame at most (timestepConstant long each)
+#define SIM_MAX_SUBSTEPS        16
+// time per frame the substeps may take (ms; CPU wall time or GPU time), sets the substep limit
+#define SIM_FRAME_BUDGET_MS     10.0
+// longest frame time fed into the timestep accumulator (s), longer frames are not simulated
+#define SIM_MAX_FRAME_TIME      0.1f
+// timestamp query sets of the compute shader substeps in flight (frames until their GPU time is read)
+#define SIM_TIMER_FRAMES        4
 
 /// volcube neighbouring data
 #define NB_SAME_LEFT            0x20        // 0010 0000, has left neighbour
@@ -64,6 +125,7 @@ extern std::atomic<float> invMassConstant;
 extern std::atomic<float> collisionRangeConstant;
 extern std::atomic<float> gravityConstant;
 extern std::atomic<float> tablePositionConstant;
+extern std::atomic<float> timestepConstant;
 
 
 /// Helper structures
@@ -91,7 +153,6 @@ struct VECTOR4
     float z;
     float w;
     VECTOR4(float _x = 0.0f, float _y = 0.0f, float _z = 0.0f, float _w = 0.0f) : x(_x), y(_y), z(_z), w(_w) {}
-    VECTOR4(const VECTOR4& v) : x(v.x), y(v.y), z(v.z), w(v.w) {}
     VECTOR4 operator+(const VECTOR4& v) { return VECTOR4(x + v.x, y + v.y, z + v.z, w + v.w); }
     VECTOR4 operator-(const VECTOR4& v) { return VECTOR4(x - v.x, y - v.y, z - v.z, w - v.w); }
     VECTOR4 operator*(const VECTOR4& v) { return VECTOR4(x * v.x, y * v.y, z * v.z, w * v.w); }
@@ -111,13 +172,16 @@ struct CB_GS
     VECTOR4 lightPos;
     // current light colour
     VECTOR4 lightCol;
+    // x: blend factor from the previous to the last substep state
+    XMFLOAT4 interpolation;
 };
 
 struct CB_CS
 {
-    // number of masspoint in the smaller volcube in one row
+    // number of masspoint in the smaller volcube in one row (widest object, the
+    // lattice of every object is described in its BVHDESC)
     unsigned int cubeWidth;
-    // size of one volcube cell
+    // size of one volcube cell (first object)
     unsigned int cubeCellSize;
     // total count of deformable bodies
     unsigned int objectCount;
@@ -185,9 +249,9 @@ struct PARTICLE
 
 struct INDEXER
 {
-    // neighbouring masspoint index in the first volcube
+    // neighbouring masspoint lattice coordinates in the first volcube (masscube index through the remap table)
     XMFLOAT3 vc1index;
-    // neighbouring masspoint index in the second volcube
+    // neighbouring masspoint lattice coordinates in the second volcube
     XMFLOAT3 vc2index;
     // masspoint weights of the first volcube neighbours
     float w1[8];
@@ -197,6 +261,8 @@ struct INDEXER
     float nw1[8];
     // normal weights of the second volcube neighbours
     float nw2[8];
+    // object of the particle, row in the BVHDESC catalogue
+    unsigned int object;
 };
 
 struct FACE
@@ -245,6 +311,7 @@ struct BVBOX {
 };
 
 /// Structure representing a BVBOX hierarchy on the GPU
+/// (and the lattice of its object: objects may have different lattice widths)
 struct BVHDESC {
     // BVBOX-tree starting index in the unified BVBOX-buffer
     unsigned int arrayOffset;
@@ -256,19 +323,44 @@ struct BVHDESC {
     float maxY;
     float minZ;
     float maxZ;
+    // lattice width of the object (n*n*n and (n+1)*(n+1)*(n+1) masscubes)
+    unsigned int cubeWidth;
+    // size of one lattice cell of the object
+    unsigned int cubeCellSize;
+    // first masspoint of the object in the masscube1 and masscube2 buffers
+    unsigned int mass1Offset;
+    unsigned int mass2Offset;
+    // active (stored) masspoints of the object in masscube1 and masscube2
+    unsigned int mass1Count;
+    unsigned int mass2Count;
+    // lattice -> masscube index table of the object in the remap buffer (masscube2 after n*n*n entries)
+    unsigned int remapOffset;
+};
+
+/// Node of a collision tree refit pass: index in the unified BVBOX-buffer, object of the tree
+struct REFITNODE {
+    unsigned int node;
+    unsigned int object;
+};
+
+/// Refit pass of the collision tree update CS
+struct CB_REFIT
+{
+    // first node of the pass in the refit list
+    unsigned int first;
+    // number of nodes in the pass
+    unsigned int count;
+    // 1: deepest level of the trees (boxes around the masspoints)
+    unsigned int leaf;
+    unsigned int dummy;
 };
 
 /// Typedefs 
 typedef unsigned int uint;
-typedef std::vector<float> vec1float;
-typedef std::vector<int> vec1int;
-typedef std::vector<std::vector<float>> vec2float;
-typedef std::vector<std::vector<int>> vec2int;
+typedef AlignedVector<XMFLOAT3> Float3Vector;
+typedef AlignedVector<XMUINT3> Uint3Vector;
 typedef std::vector<MASSPOINT> MassVector;
 typedef std::vector<BVBOX> BVBoxVector;
-// Masspoint ID (index in masscube), Type (1st or 2nd masscube), Masspoint (data)
-typedef std::tuple<int, int, MASSPOINT> MassIDType;
-typedef std::vector<MassIDType> MassIDTypeVector;
 typedef std::tuple<std::wstring, std::wstring> wstuple;
 
 /// More variables
@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// File: ContactCache.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Contacts of the last collision tree traversals, reused between steps (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _CONTACTCACHE_H_
+#define _CONTACTCACHE_H_
+
+#include <vector>
+#include "Constants.h"
+#include "BroadPhase.h"
+
+
+/// Leaf of a collision tree: object, node in its tree
+struct CONTACTLEAF
+{
+    uint object;
+    uint node;
+};
+
+/// Counters of the contact cache in the last step
+struct CONTACTCACHESTATS
+{
+    // masspoints inside the box of another object (collision tree queries)
+    uint queries;
+    // queries answered from the cache
+    uint hits;
+    // full traversals, tree nodes they visited
+    uint traversals;
+    uint nodes;
+};
+
+
+/// Leaf contacts of every masspoint, kept between steps
+/// Objects resting on each other hit the same leaves of the same trees step after step.
+/// A full traversal stores the leaf nodes it reached (in traversal order); the next steps
+/// only check that these leaves still contain the masspoint and collide with them.
+/// The entry is traversed again when a leaf fails the check, when the masspoint is in
+/// the box of another number of objects, when it holds more than CONTACT_CACHE_SLOTS
+/// leaves, when the objects paired with its object by the broad phase change, or after
+/// CONTACT_CACHE_FRAMES steps (staggered by masspoint: a masspoint entering a leaf it
+/// was not in is found by then at the latest, the only contacts the cache may miss).
+class ContactCache
+{
+private:
+    // leaves of every masspoint: leaves[id * CONTACT_CACHE_SLOTS + k], k < count[id]
+    std::vector<CONTACTLEAF> leaves;
+    // number of cached leaves, CONTACT_CACHE_INVALID: traverse
+    std::vector<unsigned char> count;
+    // number of object boxes containing the masspoint at the traversal
+    std::vector<uint> boxes;
+    // steps since the last traversal
+    std::vector<unsigned char> age;
+    // tree nodes visited by the last query, 0 for a hit; CONTACT_CACHE_IDLE: no query
+    std::vector<uint> visited;
+    // candidates of every object at the last update, objects whose candidates changed
+    std::vector<std::vector<uint>> partners;
+    std::vector<bool> changed;
+    CONTACTCACHESTATS counters;
+
+public:
+    ContactCache();
+    ~ContactCache();
+
+    // masspoints (graph IDs) and objects of the scene, every entry traversed first
+    void resize(uint masspointCount, uint objectCount);
+    // compare the broad phase pairs with the last ones, mark the objects whose pairs changed
+    void update(const BroadPhase& broadPhase);
+    // cached leaves of masspoint id of object objnum inside objectBoxes object boxes,
+    // nullptr if it has to be traversed
+    const CONTACTLEAF* lookup(uint id, uint objnum, uint objectBoxes, uint& leafCount) const;
+    // cached leaves were still valid and used
+    void hit(uint id);
+    // store the leaves of a traversal that visited nodes tree nodes (leafCount > CONTACT_CACHE_SLOTS: not cached)
+    void store(uint id, uint objectBoxes, const CONTACTLEAF* leafNodes, uint leafCount, uint nodes);
+    // masspoint outside every object box, nothing to remember
+    void clear(uint id);
+    // sum the queries of the step, clear them
+    void gather();
+
+    // counters of the last gather()
+    const CONTACTCACHESTATS& stats() const { return counters; }
+};
+
+#endif
@@ -15,12 +15,16 @@
 #include <string>
 #include <vector>
 #include <array>
+#include <functional>
 #include <DirectXMath.h>
 #include "Constants.h"
 #include "Collision.h"
+#include "SpringGraph.h"
 
 using namespace DirectX;
 
+class ThreadPool;
+
 
 /// Class representing a deformable object model (vertices, masscubes, helper structures)
 /// Generic, use inherited classes to import concrete file types
@@ -29,60 +33,97 @@ class DeformableBase
 protected:
     // object ID
     int id;
+    // workers of the running build() (nullptr: one thread)
+    ThreadPool* buildPool;
+
+    // run body(0) ... body(count - 1) on the build pool, in order without one
+    void forEach(uint count, const std::function<void(uint)>& body);
 
     // initialize data from file, only available to ctor, redefine in subclasses
     virtual void importFile() = 0;
     // check to see if import was successful
     void checkImport();
-    // initialize variables (cube cell size, cube and model position)
+    // initialize variables (lattice width, cube cell size, cube and model position)
     void initVars();
-    // initialize particle container
-    void initParticles();
-    // initialize masscube data
-    void initMasscubes();
+    // cell size of a lattice of the given width around a model of the given extent
+    static int cellSize(float extent, int width);
+    // initialize particle container and masscube data (independent, tasks of one batch)
+    void initParticlesAndMasscubes();
+    // particles [first, first + count)
+    void initParticles(uint first, uint count);
+    // masspoints of the z-slice of the first (cube = 1) or second masscube
+    void initMasscubes(int cube, int z);
     // init indexer structure
     void initIndexer();
     // set neighbouring data
     void initNeighbouring();
+    // compile the neighbouring data into a spring list
+    void initSprings();
+    // drop the static masspoints outside the model, build the remap tables
+    void compactMasscubes();
     // add offset to picking IDs
     void addOffset();
     // initialize collision detection helper structures
     void initCollisionDetection();
+    // key of the build settings
+    unsigned long long cacheKey() const;
+    // state of build() before addOffset() from the cache file, if its key and source file match
+    bool loadCache(unsigned long long key);
+    // write the state of build() before addOffset() and the stamp of the source file to the cache file
+    void saveCache(unsigned long long key) const;
 
 public:
     // model .obj file
     std::string file;
+    // prebuilt data of build() (.dfm), reused while the model file and the lattice width setting
+    // are the same; empty by default (always build), set before build() or use enableCache()
+    // (a cached object has no vertices and normals, only their counts)
+    std::string cacheFile;
 
     // file import data > model vertices
-    vec2float vertices;
+    Float3Vector vertices;
     uint vertexCount;
-    // file import data > model vertex normals
-    vec2float normals;
+    // file import data > model vertex normals, one per vertex
+    Float3Vector normals;
     uint normalCount;
-    // file import data > model faces (index from 1(?...))
-    vec2int faces;
+    // file import data > model faces (vertex indices from 0)
+    Uint3Vector faces;
     uint faceCount;
+    // heap bytes of the import data and of the built data (particles, masscubes, indexer, tree, springs)
+    size_t geometryBytes() const;
+    size_t builtBytes() const;
 
     // offset vector added to every volumetric masspoint
     XMFLOAT3 cubePos;
+    // lattice width: n*n*n first, (n+1)*(n+1)*(n+1) second masscube
+    // (set before build() to force a width, 0 = chosen from the vertex count and bounds)
+    int cubeWidth;
     // cell size of volcube, initial distance between two neighbouring masspoints
     int cubeCellSize;
+    // constraint iterations per step of the XPBD solver (quality / time knob)
+    uint solverIterations;
 
     // particle (vertex+normal+ID) data
     std::vector<PARTICLE> particles;
-    // masscube1 of model
+    // masscube1 of model, active masspoints only, in lattice order
     std::vector<MASSPOINT> masscube1;
     // masscube2 of model
     std::vector<MASSPOINT> masscube2;
+    // lattice index -> masscube1 index (-1: static masspoint, not stored)
+    std::vector<int> remap1;
+    // lattice index -> masscube2 index
+    std::vector<int> remap2;
     // indexer structure for the model
     std::vector<INDEXER> indexcube;
 
-    // neighbouring data in the first volcube
-    std::array<std::array<std::array<uint, VCUBEWIDTH>, VCUBEWIDTH>, VCUBEWIDTH> nvc1;
-    // ...second volcube
-    std::array<std::array<std::array<uint, VCUBEWIDTH + 1>, VCUBEWIDTH + 1>, VCUBEWIDTH + 1> nvc2;
+    // neighbouring data in the first volcube, index1(x, y, z)
+    std::vector<uint> nvc1;
+    // ...second volcube, index2(x, y, z)
+    std::vector<uint> nvc2;
     // collision detection helper structure for masscube
     BVBoxVector ctree;
+    // springs of both masscubes, masscube2 IDs follow the masscube1 IDs
+    SpringGraph springs;
 
     // no default constructor
     DeformableBase() = delete;
@@ -90,11 +131,18 @@ public:
     ~DeformableBase();
     // construct with file name
     DeformableBase(std::string, int);
-    // execute initializations
-    void build();
+    // execute initializations; pool: per-vertex and per-masspoint stages in parallel
+    // (same result as without one)
+    void build(ThreadPool* pool = nullptr);
+    // cache the build in directory (model file name + ".dfm"), before build()
+    void enableCache(const std::string& directory = DFM_CACHE_DIR);
     // translate model and masscubes in space
     void translate(int, int, int);
 
+    // lattice index in the first and second masscube (masscube index: remap1, remap2)
+    int index1(int x, int y, int z) const { return (z * cubeWidth + y) * cubeWidth + x; }
+    int index2(int x, int y, int z) const { return (z * (cubeWidth + 1) + y) * (cubeWidth + 1) + x; }
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,54 @@
+//--------------------------------------------------------------------------------------
+// File: FixedStepper.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Fixed timestep accumulator of the simulation loop (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _FIXEDSTEPPER_H_
+#define _FIXEDSTEPPER_H_
+
+#include "Constants.h"
+
+
+/// Turns variable frame times into a number of fixed timesteps
+/// begin() adds the frame time to the accumulator and returns the substeps to run,
+/// end() takes their time and sets how many substeps fit into SIM_FRAME_BUDGET_MS: wall time
+/// on the CPU backend, GPU time from timestamp queries (some frames late) on the D3D backend.
+/// If the accumulator holds more steps than that, the excess is dropped: the simulation
+/// slows down instead of taking longer and longer frames.
+/// The leftover time (less than one step) is the interpolation factor between the
+/// last two substeps for rendering.
+class FixedStepper
+{
+private:
+    // simulated time not yet stepped
+    float accumulator;
+    // timestep of the last begin()
+    float dt;
+    // substeps per frame that fit into the budget
+    uint limit;
+    // running average time of one substep, 0 before the first measurement
+    double msPerStep;
+
+public:
+    // empty accumulator, SIM_MAX_SUBSTEPS until the first measurement
+    FixedStepper();
+
+    // add the elapsed frame time, returns the number of timestep-long substeps to run
+    uint begin(float elapsed, float timestep);
+    // time of steps substeps, of this frame or of an earlier one
+    void end(double ms, uint steps);
+    // 0: state of the previous substep, 1: state of the last substep
+    float interpolation() const { return dt > 0.0f ? accumulator / dt : 1.0f; }
+    // substeps per frame allowed at the moment
+    uint substepLimit() const { return limit; }
+    // average time of one substep
+    double stepCost() const { return msPerStep; }
+};
+
+#endif
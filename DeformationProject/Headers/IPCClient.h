@@ -20,6 +20,7 @@
 #include <tuple>
 #include "Constants.h"
 #include "DeformableOBJ.h"
+#include "Benchmark.h"
 
 #define BUFSIZE 512
 
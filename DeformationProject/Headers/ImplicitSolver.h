@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// File: ImplicitSolver.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Backward Euler step of the CPU solver, matrix-free PCG (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _IMPLICITSOLVER_H_
+#define _IMPLICITSOLVER_H_
+
+#include <vector>
+#include "Constants.h"
+#include "MasspointStore.h"
+#include "SpringGraph.h"
+#include "SpringKernel.h"
+#include "ThreadPool.h"
+
+
+/// Linearized backward Euler step of the spring system
+///     (I - h*im*D - h^2*im*K) dv = h * (a + h*im*K*v)
+/// a = explicit accelerations (springs, damping, gravity, collisions), v = (newpos - oldpos) / h,
+/// K, D = spring Jacobians w.r.t. positions and velocities. Every edge a-b contributes
+///     J = h*im*(-damping)*I + h^2*im*stiffness*(s*I + (1 - s)*n*n^T),   s = max(0, 1 - rest/|b - a|)
+/// to the rows of a and b (s clamped at 0 keeps compressed springs positive definite).
+/// The matrix is never assembled: A*p = p + sum of J * (p_a - p_b) over the spring lists.
+/// One-way springs (outside masspoints pulled towards the model, no reverse spring) would
+/// make A non-symmetric: their target is taken as fixed in A (only J * p_a is kept), CG
+/// solves the symmetric rest, then the rows of their sources are solved once more with the
+/// dv of the targets. Nothing pulls on those sources, so this is exact for them.
+/// CG with a 3x3 block Jacobi preconditioner, warm-started with dv of the previous step;
+/// masspoints without neighbours stay in place (dv = 0).
+/// Vectors are indexed by the spring graph IDs, reductions are summed per CPU_SOLVER_BATCH
+/// block in a fixed order, so the result does not depend on the number of threads.
+class ImplicitSolver
+{
+private:
+    // scaled Jacobian of every edge: xx, xy, xz, yy, yz, zz
+    AlignedVector<float> jacobian;
+    // 1 for an edge of a single directed spring
+    std::vector<unsigned char> oneWay;
+    // masspoints with one-way springs, solved after CG
+    std::vector<uint> oneWayRows;
+    // inverse of the diagonal block of every masspoint: xx, xy, xz, yy, yz, zz
+    AlignedVector<float> blockInv;
+    // velocity change, solution of the last step (warm start)
+    std::vector<XMFLOAT3> dv;
+    // velocities at the beginning of the step
+    std::vector<XMFLOAT3> vel;
+    // right-hand side, residual, preconditioned residual, search direction, A * direction
+    std::vector<XMFLOAT3> rhs;
+    std::vector<XMFLOAT3> r;
+    std::vector<XMFLOAT3> z;
+    std::vector<XMFLOAT3> p;
+    std::vector<XMFLOAT3> ap;
+    // partial sums of the dot products, one per block
+    std::vector<double> partial;
+    // CG iterations and relative residual of the last step
+    uint lastIterations;
+    float lastResidual;
+
+    // out = A * in for masspoints [first, first + count)
+    void multiply(const SpringGraph& graph, const MASK* masks, const std::vector<XMFLOAT3>& in, std::vector<XMFLOAT3>& out, uint first, uint count) const;
+    // dv of the masspoints with one-way springs from the CG solution of their targets
+    void solveOneWay(const SpringGraph& graph, const MASK* masks, uint first, uint count);
+    // out = M^-1 * in for masspoints [first, first + count)
+    void precondition(const std::vector<XMFLOAT3>& in, std::vector<XMFLOAT3>& out, uint first, uint count) const;
+    // sum of the block partial sums
+    double total() const;
+
+public:
+    ImplicitSolver();
+    ~ImplicitSolver();
+
+    // allocate for the masspoints and edges of graph, forget the warm start
+    void resize(const SpringGraph& graph);
+    // one step of every masspoint of v into v.next: accel = explicit accelerations by graph ID,
+    // rest = rest length of every edge, returns the CG iterations
+    uint step(const MASSVIEW& v, const SpringGraph& graph, const SPRINGPARAMS& params, const float* rest,
+              const std::vector<XMFLOAT3>& accel, float dt, ThreadPool& pool);
+
+    // CG iterations of the last step
+    uint iterations() const { return lastIterations; }
+    // |b - A*dv| / |b| after the last step
+    float residual() const { return lastResidual; }
+};
+
+#endif
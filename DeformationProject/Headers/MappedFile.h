@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Read-only memory-mapped file (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <string>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+
+/// Read-only view of a whole file (MapViewOfFile / mmap), unmapped by the destructor
+/// The constructor throws if the file cannot be opened or mapped; an empty file has no view.
+class MappedFile
+{
+private:
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int file;
+#endif
+    const char* view;
+    size_t length;
+
+public:
+    explicit MappedFile(const std::string& name);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // contents of the file, nullptr if it is empty
+    const char* data() const { return view; }
+    size_t size() const { return length; }
+    // 64-bit FNV-1a hash of the contents (8 bytes per round)
+    unsigned long long hash() const;
+
+    // size and last modification time of a file without opening it (false: no such file)
+    static bool stamp(const std::string& name, unsigned long long& size, long long& modified);
+};
+
+#endif
@@ -0,0 +1,101 @@
+//--------------------------------------------------------------------------------------
+// File: MasspointStore.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Structure-of-arrays masspoint storage (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _MASSPOINTSTORE_H_
+#define _MASSPOINTSTORE_H_
+
+#include <vector>
+#include "Constants.h"
+#include "AlignedAllocator.h"
+
+
+/// packed neighbour masks: bits 0-7 neighbour_other, bits 8-15 neighbour_same,
+/// bits 16-23 second neighbours in the same cube (NB_SAME_* bits, bounds already checked)
+typedef unsigned int MASK;
+
+inline MASK packMasks(uint same, uint other){ return (MASK)(((same & 0xFF) << 8) | (other & 0xFF)); }
+inline uint sameMask(MASK m){ return (m >> 8) & 0xFF; }
+inline uint otherMask(MASK m){ return m & 0xFF; }
+inline uint secondMask(MASK m){ return (m >> 16) & 0xFF; }
+
+/// x, y and z coordinates of a set of masspoints at one time step
+struct POSARRAY
+{
+    AlignedVector<float> x;
+    AlignedVector<float> y;
+    AlignedVector<float> z;
+};
+
+/// View of a masspoint store during a step: reads t-1 (old) and t (new), writes t+1 (next)
+struct MASSVIEW
+{
+    const float* oldX;
+    const float* oldY;
+    const float* oldZ;
+    const float* newX;
+    const float* newY;
+    const float* newZ;
+    const MASK* masks;
+    float* nextX;
+    float* nextY;
+    float* nextZ;
+};
+
+
+/// Masspoint storage of the solver: only the data read by the spring loop
+/// Positions live in a ring of three time steps (t-1, t, t+1): a step reads
+/// the first two and writes the third, advance() rotates the ring, so the
+/// oldpos = newpos copy of the AoS update disappears.
+/// acc, color and localID stay in the AoS records, which are only touched
+/// when data enters (load) and leaves (exportTo) the solver.
+class MasspointStore
+{
+private:
+    // position ring
+    POSARRAY pos[3];
+    // slot holding the positions at t
+    uint head;
+    // packed neighbour masks
+    AlignedVector<MASK> maskdata;
+    // AoS records for the fields the solver never reads
+    MassVector records;
+
+public:
+    MasspointStore();
+    ~MasspointStore();
+
+    // remove every masspoint
+    void clear();
+    // append masspoints (AoS -> SoA)
+    void append(const MassVector& src);
+    // write the current state of masspoints [first, first + count) into AoS records (SoA -> AoS)
+    void exportTo(MassVector& dst, uint first, uint count) const;
+    // mark second neighbour springs of the masspoints of one masscube from first,
+    // remap = lattice index -> masspoint index (-1: not stored) of a width^3 lattice
+    void setSecondNeighbours(uint width, uint first, const std::vector<int>& remap);
+    // number of stored masspoints
+    uint size() const { return (uint)maskdata.size(); }
+    // bytes read and written by one step of the spring loop (positions t-1, t, t+1 and masks)
+    size_t stepBytes() const { return (size_t)size() * (9 * sizeof(float) + sizeof(MASK)); }
+
+    // view of the current step, index 0 of the view is masspoint first
+    MASSVIEW view(uint first = 0);
+    // positions at t-1, t and t+1
+    const POSARRAY& prev() const { return pos[(head + 2) % 3]; }
+    const POSARRAY& curr() const { return pos[head]; }
+    POSARRAY& next() { return pos[(head + 1) % 3]; }
+    // packed neighbour masks
+    const MASK* masks() const { return maskdata.data(); }
+    // t+1 becomes t
+    void advance() { head = (head + 1) % 3; }
+};
+
+#endif
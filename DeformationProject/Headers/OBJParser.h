@@ -0,0 +1,55 @@
+//--------------------------------------------------------------------------------------
+// File: OBJParser.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Memory-mapped, parallel .OBJ parser (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _OBJPARSER_H_
+#define _OBJPARSER_H_
+
+#include <string>
+#include <vector>
+#include "Constants.h"
+
+class ThreadPool;
+
+
+/// Geometry of an .OBJ file in flat arrays
+struct OBJMESH
+{
+    // x, y, z of every vertex and of every normal
+    std::vector<float> positions;
+    std::vector<float> normals;
+    // 3 vertex indices per triangle (from 0), the normal indices of the same corners
+    std::vector<uint> indices;
+    std::vector<uint> normalIndices;
+    // file size, wall time of the parse (ms)
+    size_t bytes;
+    double ms;
+};
+
+
+/// .OBJ reader for large scans
+/// The file is memory-mapped and split into newline-aligned chunks (OBJ_CHUNK_BYTES at least),
+/// the chunks are parsed in parallel with std::from_chars (a local parser on older compilers)
+/// straight into flat arrays and then concatenated. Reads v, vn and f with a, a/b, a//c and
+/// a/b/c corners; polygons are split into fans, a corner without a normal index uses its
+/// vertex index. Negative (relative) indices count back from the last vertex before the face,
+/// across chunks.
+/// Other records (vt, o, g, s, usemtl, comments) are skipped.
+class OBJParser
+{
+public:
+    // parse the file, pool: parallel chunks (nullptr: one thread per hardware core);
+    // throws if the file cannot be read or a face refers to a missing vertex
+    static OBJMESH parse(const std::string& file, ThreadPool* pool = nullptr);
+    // throughput of a parse (MB/s)
+    static double throughput(const OBJMESH& mesh) { return mesh.ms > 0.0 ? mesh.bytes / (1024.0 * 1024.0) / (mesh.ms / 1000.0) : 0.0; }
+};
+
+#endif
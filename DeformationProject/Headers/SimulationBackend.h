@@ -0,0 +1,43 @@
+//--------------------------------------------------------------------------------------
+// File: SimulationBackend.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Simulation backend interface (D3D11 compute shaders or CPU solver)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _SIMULATIONBACKEND_H_
+#define _SIMULATIONBACKEND_H_
+
+#include <vector>
+#include <memory>
+#include "Constants.h"
+
+class DeformableBase;
+
+
+/// Interface of a mass-spring simulation backend
+/// A backend owns its copy of the scene state: load() takes the built objects,
+/// step() advances every masscube by one timestep, exportSnapshot() returns the
+/// current state in the layout of the GPU buffers (object o at o * masscube size)
+class SimulationBackend
+{
+public:
+    // virtual destructor for the concrete backends
+    virtual ~SimulationBackend() {}
+    // take the initial state of the scene objects
+    virtual void load(std::vector<std::unique_ptr<DeformableBase>>& objects) = 0;
+    // advance the simulation by one step (physics fields of the CS constant buffer)
+    virtual void step(const CB_CS& cb) = 0;
+    // copy the current masscube and particle state of all objects
+    virtual void exportSnapshot(MassVector& masscube1, MassVector& masscube2, std::vector<PARTICLE>& particles) = 0;
+    // copy the current particle state only (previous substep for interpolated rendering)
+    virtual void exportParticles(std::vector<PARTICLE>& particles) = 0;
+    // backend name, for logging
+    virtual const char* name() const = 0;
+};
+
+#endif
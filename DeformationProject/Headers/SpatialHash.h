@@ -0,0 +1,106 @@
+//--------------------------------------------------------------------------------------
+// File: SpatialHash.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Uniform hash grid over the surface masspoints of the CPU solver (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _SPATIALHASH_H_
+#define _SPATIALHASH_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "Constants.h"
+#include "AlignedAllocator.h"
+#include "MasspointStore.h"
+#include "ThreadPool.h"
+
+
+/// Contact search without collision trees
+/// The surface masspoints (the leaves of the collision trees) are hashed into a uniform
+/// grid of collision range sized cells, rebuilt every step by a counting sort over the
+/// hash buckets. A masspoint within the collision range of a query point (on every axis)
+/// lies in one of the 27 cells around the query, so a query scans a fixed neighbourhood
+/// instead of traversing one tree per object.
+/// Positions are copied in bucket order, a bucket is one contiguous run; distinct cells
+/// sharing a bucket are told apart by the range test, buckets are visited once per query.
+/// The same grid serves the self-collision of the objects (visit() with the graph IDs).
+class SpatialHash
+{
+private:
+    // graph IDs and objects of the surface masspoints
+    std::vector<uint> pointID;
+    std::vector<uint> pointObject;
+    // bucket of every masspoint in the last update
+    std::vector<uint> pointBucket;
+    // bucket b holds sorted entries [bucketStart[b], bucketStart[b + 1])
+    std::vector<uint> bucketStart;
+    // positions, objects and graph IDs in bucket order
+    AlignedVector<float> sortedX;
+    AlignedVector<float> sortedY;
+    AlignedVector<float> sortedZ;
+    std::vector<uint> sortedObject;
+    std::vector<uint> sortedID;
+    // edge of a cell, 1 / edge
+    float cellSize;
+    float invCellSize;
+
+    // bucket of a cell
+    uint bucket(int x, int y, int z) const;
+
+public:
+    SpatialHash();
+    ~SpatialHash();
+
+    // hashed masspoints: graph IDs and their objects
+    void build(const std::vector<uint>& ids, const std::vector<uint>& objects);
+    // rehash at the positions of v (graph IDs), cells of the collision range
+    void update(const MASSVIEW& v, float range, ThreadPool& pool);
+    // repulsion of the hashed masspoints of other objects within range of cpos on every axis
+    XMFLOAT3 query(const XMFLOAT3& cpos, uint objnum, float range) const;
+    // f(id, object, d) for every hashed masspoint within range of cpos on every axis, d = cpos - its position
+    template <typename F> void visit(const XMFLOAT3& cpos, float range, F f) const;
+
+    // number of hashed masspoints
+    uint size() const { return (uint)pointID.size(); }
+    // graph ID and object of a hashed masspoint (build order)
+    uint id(uint i) const { return pointID[i]; }
+    uint object(uint i) const { return pointObject[i]; }
+};
+
+//--------------------------------------------------------------------------------------
+// Visit: 27 cells around cpos, every bucket once
+//--------------------------------------------------------------------------------------
+template <typename F> void SpatialHash::visit(const XMFLOAT3& cpos, float range, F f) const {
+
+    int cx = (int)floorf(cpos.x * invCellSize);
+    int cy = (int)floorf(cpos.y * invCellSize);
+    int cz = (int)floorf(cpos.z * invCellSize);
+
+    uint visited[27];
+    uint visits = 0;
+    for (int dz = -1; dz <= 1; dz++){
+        for (int dy = -1; dy <= 1; dy++){
+            for (int dx = -1; dx <= 1; dx++){
+                uint b = bucket(cx + dx, cy + dy, cz + dz);
+                if (std::find(visited, visited + visits, b) != visited + visits)
+                    continue;
+                visited[visits++] = b;
+
+                for (uint e = bucketStart[b]; e < bucketStart[b + 1]; e++){
+                    XMFLOAT3 d(cpos.x - sortedX[e], cpos.y - sortedY[e], cpos.z - sortedZ[e]);
+                    if (fabsf(d.x) > range || fabsf(d.y) > range || fabsf(d.z) > range)
+                        continue;
+                    f(sortedID[e], sortedObject[e], d);
+                }
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------------------
+// File: SpringGraph.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Compressed spring topology (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _SPRINGGRAPH_H_
+#define _SPRINGGRAPH_H_
+
+#include <vector>
+#include "Constants.h"
+
+/// rest-length classes of springs (the modes of acceleration() in the shaders)
+#define SPRING_SAME             0           // same cube, cubeCellSize
+#define SPRING_OTHER            1           // other cube, cubeCellSize * sqrt(3) / 2
+#define SPRING_SECOND           2           // second neighbour in the same cube, 2 * cubeCellSize
+
+
+/// Spring topology of a set of masspoints in CSR form
+/// Directed springs: the springs of masspoint v are targets[offsets[v] ... offsets[v + 1] - 1],
+/// in the order in which CSMain1/CSMain2 evaluate them.
+/// Undirected edges: every spring pair a -> b, b -> a shares one edge, a directed spring
+/// refers to its edge with a sign (+1: a -> b as stored, -1: reversed), so edge forces can be
+/// computed once in parallel and gathered per masspoint without atomics.
+class SpringGraph
+{
+public:
+    // first directed spring of every masspoint (size = masspoints + 1)
+    std::vector<uint> offsets;
+    // end point of every directed spring
+    std::vector<uint> targets;
+    // rest-length class of every directed spring
+    std::vector<unsigned char> lengthClass;
+    // undirected edge of every directed spring
+    std::vector<uint> springEdge;
+    // +1 or -1, direction of the spring relative to its edge
+    std::vector<float> springSign;
+
+    // end points and rest-length class of the undirected edges
+    std::vector<uint> edgeA;
+    std::vector<uint> edgeB;
+    std::vector<unsigned char> edgeClass;
+
+    SpringGraph();
+    ~SpringGraph();
+
+    // remove everything
+    void clear();
+    // start the spring list of the next masspoint
+    void addMasspoint();
+    // add a directed spring from the last masspoint
+    void addSpring(uint target, unsigned char cls);
+    // append masspoints [first, first + count) of src; targets t < split map to offset1 + t,
+    // the others to offset2 + (t - split) (masscube1 and masscube2 in the scene buffers)
+    void appendRows(const SpringGraph& src, uint first, uint count, uint split, uint offset1, uint offset2);
+    // pair up the directed springs into undirected edges
+    void buildEdges();
+
+    // number of masspoints, directed springs and undirected edges
+    uint masspointCount() const { return offsets.empty() ? 0 : (uint)offsets.size() - 1; }
+    uint springCount() const { return (uint)targets.size(); }
+    uint edgeCount() const { return (uint)edgeA.size(); }
+};
+
+#endif
@@ -0,0 +1,103 @@
+//--------------------------------------------------------------------------------------
+// File: SpringKernel.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Vectorized spring force kernel of the CPU solver (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _SPRINGKERNEL_H_
+#define _SPRINGKERNEL_H_
+
+#include "Constants.h"
+#include "MasspointStore.h"
+#include "SpringGraph.h"
+
+
+/// Physics constants of one step, shared by every row
+struct SPRINGPARAMS
+{
+    // spring stiffness
+    float stiffness;
+    // spring damping, negative
+    float damping;
+    // 1 / dt
+    float idt;
+    // inverse mass of masspoints
+    float im;
+    // gravity * im, initial value of the accelerations
+    float gravityAcc;
+    // rest lengths of the object: 0 == same cube, 1 == other cube, 2 == second neighbour
+    float len[3];
+};
+
+/// Index offsets of the neighbours of a masspoint
+struct SPRINGLAYOUT
+{
+    // same cube: LEFT, RIGHT, DOWN, UP, FRONT, BACK
+    int same[6];
+    // second neighbours in the same directions
+    int second[6];
+    // other cube, relative to the matching index there: NEAR_BOT_LEFT ... FAR_TOP_RIGHT
+    int other[8];
+};
+
+
+/// Spring accelerations (plus gravity) for rows of masspoints
+/// One row is a run of consecutive masspoints, so every neighbour is at a constant
+/// offset: 8 (AVX2) or 16 (AVX-512) masspoints are evaluated per instruction and
+/// the neighbour bits become lane masks. Lengths use rsqrt with one Newton-Raphson
+/// step; every ISA performs the same operations in the same order, without FMA,
+/// so the results are bit-identical on a given CPU.
+/// The static functions evaluate the same springs from a SpringGraph instead of the
+/// masks, per masspoint (vertex-parallel) or per edge (edge-parallel + gather).
+class SpringKernel
+{
+public:
+    enum Isa { ISA_SCALAR = 0, ISA_AVX2 = 1, ISA_AVX512 = 2 };
+
+    // row function: self = cube of the row, other = other cube,
+    // base = first masspoint of the row in self, obase = its matching index in other
+    typedef void(*RowFunc)(const MASSVIEW& self, const MASSVIEW& other, const SPRINGLAYOUT& layout, const SPRINGPARAMS& params,
+                            int base, int obase, uint count, float* ax, float* ay, float* az);
+
+private:
+    // selected instruction set
+    Isa selected;
+    // row function of the selected instruction set
+    RowFunc func;
+
+public:
+    // widest instruction set supported by the CPU and the OS
+    SpringKernel();
+    // requested instruction set, or the widest supported one below it
+    explicit SpringKernel(Isa isa);
+
+    // accelerations of count masspoints starting at base
+    void row(const MASSVIEW& self, const MASSVIEW& other, const SPRINGLAYOUT& layout, const SPRINGPARAMS& params,
+             int base, int obase, uint count, float* ax, float* ay, float* az) const {
+        func(self, other, layout, params, base, obase, count, ax, ay, az);
+    }
+
+    // vertex-parallel: springs of masspoints [first, first + count) from the CSR lists,
+    // v is a view of the whole store (graph IDs)
+    static void vertices(const MASSVIEW& v, const SpringGraph& graph, const SPRINGPARAMS& params,
+                         uint first, uint count, float* ax, float* ay, float* az);
+    // edge-parallel: acceleration of edgeA along edges [first, first + count), rest = rest length of every edge
+    static void edges(const MASSVIEW& v, const SpringGraph& graph, const SPRINGPARAMS& params, const float* rest,
+                      uint first, uint count, float* fx, float* fy, float* fz);
+    // sum the edge accelerations (plus gravity) of masspoints [first, first + count)
+    static void gather(const SpringGraph& graph, const SPRINGPARAMS& params, const float* fx, const float* fy, const float* fz,
+                       uint first, uint count, float* ax, float* ay, float* az);
+
+    Isa isa() const { return selected; }
+    const char* name() const;
+
+    // widest instruction set available at runtime
+    static Isa detect();
+};
+
+#endif
@@ -0,0 +1,101 @@
+//--------------------------------------------------------------------------------------
+// File: StaticColliders.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Static environment of the CPU solver, baked into a signed distance grid (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _STATICCOLLIDERS_H_
+#define _STATICCOLLIDERS_H_
+
+#include <string>
+#include <vector>
+#include "Constants.h"
+#include "AlignedAllocator.h"
+#include "ThreadPool.h"
+
+
+/// Static half-space: points p with dot(normal, p) < offset are inside
+struct COLLIDERPLANE
+{
+    XMFLOAT3 normal;
+    float offset;
+};
+
+/// Static axis-aligned box
+struct COLLIDERBOX
+{
+    XMFLOAT3 center;
+    XMFLOAT3 halfSize;
+};
+
+
+/// Static colliders of the scene: planes, boxes and closed triangle meshes
+/// bake() samples their union into a signed distance grid (negative inside), a masspoint is
+/// then tested with one trilinear lookup instead of a traversal of the meshes (six more for
+/// the gradient of a masspoint inside a collider). Meshes are exact in a band of SDF_BAND
+/// cells around their triangles and clamped beyond it; the sign comes from the parity of the
+/// triangles crossed by the grid column below a sample.
+/// The grid covers the boxes and meshes with a margin of the band; outside of it the planes
+/// and boxes are evaluated directly, no mesh reaches there.
+/// The bake runs one task per z-slice (distances) and per y-row (signs); the grid can be
+/// cached in a file, reused while the colliders and the cell size are the same.
+class StaticColliders
+{
+private:
+    std::vector<COLLIDERPLANE> planes;
+    std::vector<COLLIDERBOX> boxes;
+    // triangles of every mesh, 3 corners each
+    std::vector<XMFLOAT3> triangles;
+    // edge of a grid cell, grid corner, samples per axis
+    float cellSize;
+    XMFLOAT3 origin;
+    uint dimX;
+    uint dimY;
+    uint dimZ;
+    // signed distance of every sample, x fastest
+    AlignedVector<float> grid;
+    // grid matches the colliders
+    bool baked;
+
+    // distance of the planes and boxes
+    float analytic(const XMFLOAT3& p) const;
+    // key of the colliders and the cell size (cache files)
+    unsigned long long key() const;
+    // grid from a cache file with the same key
+    bool readCache(const std::string& file);
+    void writeCache(const std::string& file) const;
+
+public:
+    // cell = edge of a grid cell
+    explicit StaticColliders(float cell = 100.0f);
+    ~StaticColliders();
+
+    // add colliders (the grid has to be baked again)
+    void addPlane(const XMFLOAT3& normal, float offset);
+    void addBox(const XMFLOAT3& center, const XMFLOAT3& halfSize);
+    // closed mesh: corners and 3 indices per triangle, throws on an index out of range
+    void addMesh(const std::vector<XMFLOAT3>& vertices, const std::vector<uint>& indices);
+    // remove every collider
+    void clear();
+    // sample the colliders into the grid (cacheFile: reused if it matches, written otherwise)
+    void bake(ThreadPool& pool, const std::string& cacheFile = "");
+
+    // signed distance at p (trilinear in the grid)
+    float distance(const XMFLOAT3& p) const;
+    // repulsion of a masspoint inside a collider, along the distance gradient
+    // (the force of the table below it, exp_mul in the shaders)
+    XMFLOAT3 repulsion(const XMFLOAT3& p) const;
+
+    // no colliders
+    bool empty() const { return planes.empty() && boxes.empty() && triangles.empty(); }
+    bool isBaked() const { return baked; }
+    // samples of the grid
+    size_t samples() const { return grid.size(); }
+};
+
+#endif
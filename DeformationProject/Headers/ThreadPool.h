@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// File: ThreadPool.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Work-stealing thread pool of the CPU solver (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Constants.h"
+
+
+/// Fixed set of worker threads running parallel loops
+/// parallelFor() splits the task indices into contiguous blocks, one per queue;
+/// every thread pops from the back of its own queue and steals from the front
+/// of the others when it runs dry. The calling thread works as queue 0 and
+/// returns when every task has finished.
+class ThreadPool
+{
+private:
+    /// task indices of one thread
+    struct WORKQUEUE
+    {
+        std::mutex lock;
+        std::deque<uint> tasks;
+    };
+
+    // worker threads (the caller is the extra thread of queue 0)
+    std::vector<std::thread> workers;
+    // task queues, one per thread
+    std::vector<std::unique_ptr<WORKQUEUE>> queues;
+    // loop body of the running batch
+    const std::function<void(uint)>* body;
+    // unfinished tasks of the running batch
+    std::atomic<uint> pending;
+    // batch counter, wakes the workers
+    uint generation;
+    // shutting down
+    bool stopping;
+    std::mutex batchLock;
+    std::condition_variable batchStart;
+    std::condition_variable batchDone;
+    // tasks taken from another thread's queue
+    std::atomic<uint> stolen;
+
+    // worker thread main loop
+    void workerLoop(uint index);
+    // run tasks until every queue is empty
+    void work(uint index);
+    // take a task from the back of an own queue
+    bool pop(uint index, uint& task);
+    // take a task from the front of another queue
+    bool steal(uint index, uint& task);
+
+public:
+    // threads == 0: one thread per hardware core
+    explicit ThreadPool(uint threads = 0);
+    // joins the workers
+    ~ThreadPool();
+
+    // run body(0) ... body(count - 1), blocks until all of them finished
+    void parallelFor(uint count, const std::function<void(uint)>& body);
+    // number of threads working on a batch, the caller included
+    uint size() const { return (uint)queues.size(); }
+    // number of stolen tasks since construction
+    uint steals() const { return stolen; }
+};
+
+#endif
@@ -0,0 +1,42 @@
+//--------------------------------------------------------------------------------------
+// File: Voxelizer.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Surface rasterization and outside flood fill of the masscube lattices (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _VOXELIZER_H_
+#define _VOXELIZER_H_
+
+#include <vector>
+#include "Constants.h"
+
+class ThreadPool;
+
+
+/// Classification of the masspoints of a lattice against the model surface
+/// States as in nvc1/nvc2: 0 inside, 1 surface (corner of a cell touched by the surface),
+/// 2 outside. rasterize() marks the corners of every cell a triangle overlaps (separating
+/// axis test against the cell grown by a small margin, so the surface is closed in the
+/// lattice if the mesh is), floodFill() marks every masspoint reachable from the lattice
+/// boundary through 6-neighbours that are not surface. Both run in linear time, the flood
+/// fill over the masspoints and the rasterization over the cells the triangles touch.
+/// The rasterization bins the faces by cell slice (z); slice z writes masspoint planes z
+/// and z + 1, so the even slices run in parallel, then the odd ones. The flood fill is serial.
+/// The lattice has width masspoints per axis, masspoint (x, y, z) at origin + (x, y, z) * cell.
+class Voxelizer
+{
+public:
+    // mark the corners of the cells overlapped by the faces (vertex indices from 0) as surface
+    // (pool: slices in parallel, nullptr: serial; same result)
+    static void rasterize(const Float3Vector& vertices, const Uint3Vector& faces, const XMFLOAT3& origin, float cell,
+                          int width, std::vector<uint>& states, ThreadPool* pool = nullptr);
+    // mark the non-surface masspoints connected to the lattice boundary as outside
+    static void floodFill(int width, std::vector<uint>& states);
+};
+
+#endif
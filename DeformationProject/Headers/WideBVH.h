@@ -0,0 +1,201 @@
+//--------------------------------------------------------------------------------------
+// File: WideBVH.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Quantized 4-wide collision trees of the CPU solver (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _WIDEBVH_H_
+#define _WIDEBVH_H_
+
+#include <vector>
+#include "Constants.h"
+#include "Collision.h"
+#include "MasspointStore.h"
+#include "ThreadPool.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WIDEBVH_SSE             1
+#include <emmintrin.h>
+#else
+#define WIDEBVH_SSE             0
+#endif
+
+
+// child is a masspoint (graph ID in the lower bits)
+#define QBVH_MASSPOINT          0x80000000u
+// no child
+#define QBVH_EMPTY              0xFFFFFFFFu
+// largest quantized coordinate
+#define QBVH_QMAX               65535
+
+/// Node of a 4-wide collision tree (64 bytes)
+/// The bounds of the children are quantized to 16 bits in the bounds of the node:
+/// 0 is the node minimum, QBVH_QMAX the node maximum. Lanes are stored per axis, so one
+/// test covers the 4 children.
+struct QBVHNODE
+{
+    unsigned short minX[4];
+    unsigned short maxX[4];
+    unsigned short minY[4];
+    unsigned short maxY[4];
+    unsigned short minZ[4];
+    unsigned short maxZ[4];
+    // child node, masspoint graph ID | QBVH_MASSPOINT or QBVH_EMPTY
+    uint child[4];
+};
+
+
+/// Compact 4-wide collision trees of every object
+/// The nodes of an object are stored children before parents, the root is the last one;
+/// a node has up to 4 nodes or up to 4 masspoints as children, and there is no padding.
+/// The root bounds are kept as floats, every other box is only known relative to its
+/// parent: a query dequantizes the children of a node while it descends. Rounding is
+/// outwards, so a dequantized box always holds the exact one.
+/// Trees are either built from the collision masspoints (Morton order, 4 masspoints per
+/// leaf node, 4 nodes per parent) or converted from the binary trees (ctree): a wide node
+/// takes the grandchildren of a binary node, the masspoints at the deepest levels.
+/// The refit computes the float boxes bottom-up into a scratch buffer, then quantizes every
+/// node in its parent top-down.
+class WideBVH
+{
+private:
+    /// Float bounds of a node during the refit
+    struct BOUNDS
+    {
+        XMFLOAT3 lo;
+        XMFLOAT3 hi;
+    };
+
+    // nodes of every object, object o owns [nodeOffsets[o], nodeOffsets[o + 1])
+    std::vector<QBVHNODE> nodes;
+    std::vector<uint> nodeOffsets;
+    // bounds of the root of every object
+    std::vector<BOUNDS> roots;
+    // float bounds of every node (refit)
+    std::vector<BOUNDS> scratch;
+
+    // append a node with the given children, returns its index
+    uint addNode(const uint* children, uint count);
+    // wide node of the binary subtree at index (level in a tree of maxlevel levels)
+    uint convertNode(const BVBOX* tree, uint index, uint level, uint maxlevel, uint mass1Offset, uint mass2Offset);
+    // quantize the children of node n in its bounds (scratch), children get their dequantized bounds
+    void quantize(uint n, const MASSVIEW& v, float range, bool swept);
+    // exact bounds of a masspoint
+    static BOUNDS masspointBounds(const MASSVIEW& v, uint id, float range, bool swept);
+    // dequantization step of an axis, rounded up so QBVH_QMAX steps cover the whole axis
+    static float quantum(float lo, float hi) { return (hi - lo) / QBVH_QMAX * (1.0f + 1.0f / (1 << 20)); }
+#if WIDEBVH_SSE
+    // 4 quantized coordinates of an axis: lo + q * step per lane
+    static __m128 dequantize(const unsigned short* q, float lo, float step){
+        __m128i widened = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)q), _mm_setzero_si128());
+        return _mm_add_ps(_mm_set1_ps(lo), _mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_set1_ps(step)));
+    }
+#endif
+
+public:
+    WideBVH();
+    ~WideBVH();
+
+    // forget every tree
+    void clear();
+    // append the tree of the next object, built from its collision masspoints
+    // (graph IDs of masscube1 and masscube2 start at mass1Offset and mass2Offset)
+    void build(const BVHLeafVector& masspoints, uint mass1Offset, uint mass2Offset);
+    // append the tree of the next object, converted from its binary tree
+    void convert(const BVBoxVector& ctree, uint mass1Offset, uint mass2Offset);
+    // refit every tree to the positions of v (graph IDs), boxes grown by range
+    // (swept: also around the next position, 2 * new - old)
+    void refit(const MASSVIEW& v, float range, ThreadPool& pool, bool swept = false);
+
+    // f(id) for every masspoint of object o whose box overlaps lo-hi
+    template <typename F> uint query(uint o, const XMFLOAT3& lo, const XMFLOAT3& hi, F f) const;
+
+    // bounds of the tree of object o (false: empty tree)
+    bool bounds(uint o, XMFLOAT3& lo, XMFLOAT3& hi) const;
+    // number of trees
+    uint objects() const { return (uint)roots.size(); }
+    // memory of the trees: nodes and root bounds
+    size_t bytes() const { return nodes.size() * sizeof(QBVHNODE) + roots.size() * sizeof(BOUNDS); }
+};
+
+//--------------------------------------------------------------------------------------
+// Query: descend from the root, 4 children per SSE test; returns the visited nodes
+//--------------------------------------------------------------------------------------
+template <typename F> uint WideBVH::query(uint o, const XMFLOAT3& lo, const XMFLOAT3& hi, F f) const {
+
+    if (nodeOffsets[o + 1] == nodeOffsets[o])
+        return 0;
+    const BOUNDS& root = roots[o];
+    if (lo.x > root.hi.x || root.lo.x > hi.x || lo.y > root.hi.y || root.lo.y > hi.y || lo.z > root.hi.z || root.lo.z > hi.z)
+        return 0;
+
+    struct ENTRY { uint node; BOUNDS b; };
+    ENTRY stack[64];
+    stack[0] = ENTRY{ nodeOffsets[o + 1] - 1, root };
+    uint stacks = 1;
+    uint visited = 0;
+
+    while (stacks > 0){
+        ENTRY e = stack[--stacks];
+        const QBVHNODE& node = nodes[e.node];
+        visited++;
+
+        // the 4 lanes: dequantized child bounds against lo-hi
+        const float sx = quantum(e.b.lo.x, e.b.hi.x);
+        const float sy = quantum(e.b.lo.y, e.b.hi.y);
+        const float sz = quantum(e.b.lo.z, e.b.hi.z);
+        float cminX[4], cmaxX[4], cminY[4], cmaxY[4], cminZ[4], cmaxZ[4];
+#if WIDEBVH_SSE
+        __m128 minX4 = dequantize(node.minX, e.b.lo.x, sx), maxX4 = dequantize(node.maxX, e.b.lo.x, sx);
+        __m128 minY4 = dequantize(node.minY, e.b.lo.y, sy), maxY4 = dequantize(node.maxY, e.b.lo.y, sy);
+        __m128 minZ4 = dequantize(node.minZ, e.b.lo.z, sz), maxZ4 = dequantize(node.maxZ, e.b.lo.z, sz);
+        __m128 overlap = _mm_and_ps(_mm_cmple_ps(_mm_set1_ps(lo.x), maxX4), _mm_cmple_ps(minX4, _mm_set1_ps(hi.x)));
+        overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_set1_ps(lo.y), maxY4), _mm_cmple_ps(minY4, _mm_set1_ps(hi.y))));
+        overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_set1_ps(lo.z), maxZ4), _mm_cmple_ps(minZ4, _mm_set1_ps(hi.z))));
+        int hits = _mm_movemask_ps(overlap);
+        if (hits == 0)
+            continue;
+        _mm_storeu_ps(cminX, minX4);
+        _mm_storeu_ps(cmaxX, maxX4);
+        _mm_storeu_ps(cminY, minY4);
+        _mm_storeu_ps(cmaxY, maxY4);
+        _mm_storeu_ps(cminZ, minZ4);
+        _mm_storeu_ps(cmaxZ, maxZ4);
+#else
+        int hits = 0;
+        for (uint k = 0; k < 4; k++){
+            cminX[k] = e.b.lo.x + node.minX[k] * sx;
+            cmaxX[k] = e.b.lo.x + node.maxX[k] * sx;
+            cminY[k] = e.b.lo.y + node.minY[k] * sy;
+            cmaxY[k] = e.b.lo.y + node.maxY[k] * sy;
+            cminZ[k] = e.b.lo.z + node.minZ[k] * sz;
+            cmaxZ[k] = e.b.lo.z + node.maxZ[k] * sz;
+            if ((lo.x <= cmaxX[k]) & (cminX[k] <= hi.x) & (lo.y <= cmaxY[k]) & (cminY[k] <= hi.y) & (lo.z <= cmaxZ[k]) & (cminZ[k] <= hi.z))
+                hits |= 1 << k;
+        }
+#endif
+        bool hit[4] = { (hits & 1) != 0, (hits & 2) != 0, (hits & 4) != 0, (hits & 8) != 0 };
+
+        // masspoints in lane order, nodes pushed last lane first (lane 0 is visited first)
+        for (uint k = 0; k < 4; k++){
+            if (hit[k] && node.child[k] != QBVH_EMPTY && (node.child[k] & QBVH_MASSPOINT))
+                f(node.child[k] & ~QBVH_MASSPOINT);
+        }
+        for (int k = 3; k >= 0; k--){
+            if (hit[k] && node.child[k] != QBVH_EMPTY && !(node.child[k] & QBVH_MASSPOINT)){
+                BOUNDS b;
+                b.lo = XMFLOAT3(cminX[k], cminY[k], cminZ[k]);
+                b.hi = XMFLOAT3(cmaxX[k], cmaxY[k], cmaxZ[k]);
+                stack[stacks++] = ENTRY{ node.child[k], b };
+            }
+        }
+    }
+    return visited;
+}
+
+#endif
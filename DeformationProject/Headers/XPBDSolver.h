@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------------
+// File: XPBDSolver.h
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// XPBD distance constraint solver of the CPU solver (header)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#ifndef _XPBDSOLVER_H_
+#define _XPBDSOLVER_H_
+
+#include <vector>
+#include "Constants.h"
+#include "MasspointStore.h"
+#include "SpringGraph.h"
+#include "SpringKernel.h"
+#include "ThreadPool.h"
+
+
+/// Extended position based dynamics on the spring edges
+/// Every edge of the spring graph is a distance constraint |x_a - x_b| = rest with
+/// compliance 1 / stiffness (and the damping of the springs). A step predicts the
+/// positions from the velocities and the external accelerations, then projects the
+/// constraints with Gauss-Seidel sweeps into v.next; the velocities follow from the
+/// positions, as in the Verlet step.
+/// The edges are colored at build time so that no two edges of a color share a
+/// masspoint: a color is projected in parallel without atomics, and the result does
+/// not depend on the number of threads. Every edge is swept as many times as the
+/// solverIterations of its object.
+class XPBDSolver
+{
+private:
+    // edges in color order: edges of color c are [colorOffsets[c], colorOffsets[c + 1])
+    std::vector<uint> colorOffsets;
+    // end points, rest lengths and iteration counts of the edges, in color order
+    std::vector<uint> edgeA;
+    std::vector<uint> edgeB;
+    std::vector<float> rest;
+    std::vector<uint> edgeIterations;
+    // Lagrange multiplier of every edge in the current step
+    std::vector<float> lambda;
+    // most iterations of any object
+    uint maxIterations;
+
+public:
+    XPBDSolver();
+    ~XPBDSolver();
+
+    // color the edges of graph: rest = rest length, iterations = constraint iterations of every edge
+    void build(const SpringGraph& graph, const float* rest, const std::vector<uint>& iterations);
+    // one step of every masspoint of v (graph IDs) into v.next, accel = external accelerations
+    void step(const MASSVIEW& v, const SPRINGPARAMS& params, const std::vector<XMFLOAT3>& accel, float dt, ThreadPool& pool);
+
+    // number of independent constraint sets
+    uint colorCount() const { return colorOffsets.empty() ? 0 : (uint)colorOffsets.size() - 1; }
+};
+
+#endif
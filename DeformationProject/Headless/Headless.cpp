@@ -0,0 +1,110 @@
+//--------------------------------------------------------------------------------------
+// File: Headless.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Console driver of the CPU solver, no window or graphics device (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../Headers/Constants.h"
+#include "../Headers/DeformableOBJ.h"
+#include "../Headers/CPUSimulation.h"
+#include "../Headers/Benchmark.h"
+#include "../Headers/ThreadPool.h"
+
+
+//--------------------------------------------------------------------------------------
+// Usage: Headless model.obj [objects] [steps] [threads] [verlet|implicit|xpbd]
+// Builds the copies of the model (3000 apart on the x axis, same as the application scene),
+// steps them with timestepConstant and reports the build and step times and the final state
+//--------------------------------------------------------------------------------------
+int main(int argc, char** argv){
+
+    if (argc < 2){
+        printf("usage: %s model.obj [objects=3] [steps=600] [threads=0] [verlet|implicit|xpbd]\n", argv[0]);
+        return 1;
+    }
+    std::string file = argv[1];
+    uint count = argc > 2 ? std::max(1, atoi(argv[2])) : 3;
+    uint steps = argc > 3 ? std::max(1, atoi(argv[3])) : 600;
+    uint threads = argc > 4 ? std::max(0, atoi(argv[4])) : 0;
+    CPUSimulation::Integrator integrator = CPUSimulation::INTEGRATOR_VERLET;
+    if (argc > 5){
+        if (strcmp(argv[5], "implicit") == 0)
+            integrator = CPUSimulation::INTEGRATOR_IMPLICIT;
+        else if (strcmp(argv[5], "xpbd") == 0)
+            integrator = CPUSimulation::INTEGRATOR_XPBD;
+        else if (strcmp(argv[5], "verlet") != 0){
+            printf("unknown integrator: %s\n", argv[5]);
+            return 1;
+        }
+    }
+
+    // build the scene
+    std::vector<std::unique_ptr<DeformableBase>> objects;
+    auto start = std::chrono::high_resolution_clock::now();
+    try {
+        ThreadPool buildPool(threads);
+        for (uint i = 0; i < count; i++){
+            objects.push_back(std::unique_ptr<DeformableOBJ>(new DeformableOBJ(file, i)));
+            objects[i]->build(&buildPool);
+            objects[i]->translate(3000 * i, 0, 0);
+        }
+    }
+    catch (const char* error){
+        printf("%s: %s\n", file.c_str(), error);
+        return 1;
+    }
+    auto built = std::chrono::high_resolution_clock::now();
+
+    // step
+    CPUSimulation sim(threads);
+    sim.setIntegrator(integrator);
+    sim.load(objects);
+    CB_CS cb = benchmarkConstants(objects, timestepConstant);
+    uint iterations = 0, capped = 0;
+    auto loaded = std::chrono::high_resolution_clock::now();
+    for (uint s = 0; s < steps; s++){
+        sim.step(cb);
+        iterations += sim.solverIterations();
+        capped += sim.solverIterations() >= CPU_CG_ITERATIONS;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // final state: bounds of the particles, blown up if non-finite
+    MassVector m1, m2;
+    std::vector<PARTICLE> particles;
+    sim.exportSnapshot(m1, m2, particles);
+    XMFLOAT3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    bool stable = true;
+    for (const PARTICLE& p : particles){
+        stable &= std::isfinite(p.pos.x) && std::isfinite(p.pos.y) && std::isfinite(p.pos.z);
+        lo = XMFLOAT3(std::min(lo.x, p.pos.x), std::min(lo.y, p.pos.y), std::min(lo.z, p.pos.z));
+        hi = XMFLOAT3(std::max(hi.x, p.pos.x), std::max(hi.y, p.pos.y), std::max(hi.z, p.pos.z));
+    }
+
+    const char* names[3] = { "verlet", "implicit", "xpbd" };
+    double buildMs = std::chrono::duration<double, std::milli>(built - start).count();
+    double stepMs = std::chrono::duration<double, std::milli>(end - loaded).count() / steps;
+    printf("objects:%u particles:%u threads:%u\n", count, (uint)particles.size(), sim.threads());
+    printf("build:%.2fms %s %u steps of %.2fms:%.3fms/step\n", buildMs, names[integrator], steps, cb.dt * 1000, stepMs);
+    if (integrator == CPUSimulation::INTEGRATOR_IMPLICIT)
+        printf("cg:%.2fit/step %u capped\n", (double)iterations / steps, capped);
+    if (stable)
+        printf("bounds:(%.1f %.1f %.1f)-(%.1f %.1f %.1f)\n", lo.x, lo.y, lo.z, hi.x, hi.y, hi.z);
+    else
+        printf("unstable\n");
+    return stable ? 0 : 2;
+}
@@ -15,139 +15,97 @@ StructuredBuffer<MassPoint> volcube1    : register(t0);
 StructuredBuffer<MassPoint> volcube2    : register(t1);
 StructuredBuffer<BVHDesc> obvhdesc      : register(t2);
 StructuredBuffer<BVBox> obvhdata        : register(t3);
+StructuredBuffer<RefitNode> refitnodes  : register(t4);
 RWStructuredBuffer<BVHDesc> bvhdesc     : register(u0);
 RWStructuredBuffer<BVBox> bvhdata       : register(u1);
 
 
+// One refit pass: every node of one level of every tree (trees aligned at the deepest level),
+// one thread per node; the passes run bottom-up, one dispatch each
+[numthreads(refit_tgsize, 1, 1)]
+void CSBVHRefit(uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID, uint GI : SV_GroupIndex)
+{
+    if (DTid.x >= refit_count)
+        return;
+
+    /// Helper variables
+    RefitNode rn = refitnodes[refit_first + DTid.x];
+    BVHDesc olddesc = obvhdesc[rn.object];
+    BVBox tmp = bvhdata[rn.node];
+
+    // true if left and right children are valid
+    bool validleft = tmp.left_type != -1;
+    bool validright = tmp.right_type != -1;
+
+    BVBox equ;
+    equ.left_id = tmp.left_id;
+    equ.left_type = tmp.left_type;
+    equ.right_id = tmp.right_id;
+    equ.right_type = tmp.right_type;
+    equ.min_x = equ.min_y = equ.min_z = 3.402823466e+38f;
+    equ.max_x = equ.max_y = equ.max_z = -3.402823466e+38f;
+
+    // leaf level, update BVBoxes from the masspoints
+    if (refit_leaf != 0){
+        float3 ml = float3(0, 0, 0), mr = float3(0, 0, 0);
+
+        // index: object offset in masscube(1|2) + index_in_cube
+        if (tmp.left_id != (-1))
+            ml = tmp.left_type == 1 ? volcube1[olddesc.mass1_offset + tmp.left_id].newpos.xyz : volcube2[olddesc.mass2_offset + tmp.left_id].newpos.xyz;
+        if (tmp.right_id != (-1))
+            mr = tmp.right_type == 1 ? volcube1[olddesc.mass1_offset + tmp.right_id].newpos.xyz : volcube2[olddesc.mass2_offset + tmp.right_id].newpos.xyz;
+
+        // only one valid child (must be on the left side)
+        if (validleft && !validright)
+            mr = ml;
+
+        if (validleft){
+            equ.min_x = min(ml.x, mr.x) - collision_range;
+            equ.max_x = max(ml.x, mr.x) + collision_range;
+            equ.min_y = min(ml.y, mr.y) - collision_range;
+            equ.max_y = max(ml.y, mr.y) + collision_range;
+            equ.min_z = min(ml.z, mr.z) - collision_range;
+            equ.max_z = max(ml.z, mr.z) + collision_range;
+        }
+    }
+
+    // higher in the tree, update from two children (refitted by the previous pass)
+    else {
+        uint local = rn.node - olddesc.array_offset;
+        BVBox a = bvhdata[olddesc.array_offset + 2 * local + 1];
+        BVBox b = validright ? bvhdata[olddesc.array_offset + 2 * local + 2] : a;
+
+        if (validleft){
+            equ.min_x = min(a.min_x, b.min_x);
+            equ.max_x = max(a.max_x, b.max_x);
+            equ.min_y = min(a.min_y, b.min_y);
+            equ.max_y = max(a.max_y, b.max_y);
+            equ.min_z = min(a.min_z, b.min_z);
+            equ.max_z = max(a.max_z, b.max_z);
+        }
+    }
+
+    bvhdata[rn.node] = equ;
+}
+
+
+// Catalogue update after the refit passes, one thread per object
 [numthreads(1, 1, 1)]
 void CSBVHUpdate(uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID, uint3 GTid : SV_GroupThreadID, uint GI : SV_GroupIndex)
 {
     /// Helper variables
     // object line number
     uint objnum = Gid.x;
-    // offset in bvhdata array, index of tree root in global array
-    uint offset = obvhdesc[objnum].array_offset;
-    // num of tree levels
-    uint maxlevel = log2(obvhdesc[objnum].masspoint_count + 1);
-    uint level = maxlevel;
     // old descriptor entry
     BVHDesc olddesc = obvhdesc[objnum];
-    // old tree root entry
-    BVBox olddata = obvhdata[offset];
-
-    /// Update tree data
-    while (level > 0){
-
-        // leveloffset = 2^(level-1)-1, number of nodes higher in the tree
-        uint leveloffset = exp2(level - 1) - 1;
-
-        // leaf level, update BVBoxes
-        if (level == maxlevel){
-            // For every node on the current level, get min and max from masspoint data
-            for (uint i = 0; i < leveloffset + 1; i++){
-
-                BVBox tmp = bvhdata[offset + leveloffset + i];
-                MassPoint ml, mr;
-
-                // true if left and right children masspoints are valid
-                bool validleft = tmp.left_type != -1;
-                bool validright = tmp.right_type != -1;
-
-                // left child valid, read from masscube data
-                if (tmp.left_id != (-1) && tmp.left_type == 1){
-                    // index: objnum * masscube(1|2)_size + index_in_cube
-                    ml = volcube1[objnum*cube_width*cube_width*cube_width + tmp.left_id];
-                }
-                else if (tmp.left_id != (-1) && tmp.left_type == 2){
-                    // index: objnum * masscube(1|2)_size + index_in_cube
-                    ml = volcube2[objnum*(cube_width + 1)*(cube_width + 1)*(cube_width + 1) + tmp.left_id];
-                }
-
-                // right child valid, read from masscube data
-                if (tmp.right_id != (-1) && tmp.right_type == 1){
-                    // index: objnum * masscube(1|2)_size + index_in_cube
-                    mr = volcube1[objnum*cube_width*cube_width*cube_width + tmp.right_id];
-                }
-                else if (tmp.right_id != (-1) && tmp.right_type == 2){
-                    // index: objnum * masscube(1|2)_size + index_in_cube
-                    mr = volcube2[objnum*(cube_width + 1)*(cube_width + 1)*(cube_width + 1) + tmp.right_id];
-                }
-
-                BVBox equ;
-                equ.left_id = tmp.left_id;
-                equ.left_type = tmp.left_type;
-                equ.right_id = tmp.right_id;
-                equ.right_type = tmp.right_type;
-
-                // two valid children masspoint
-                if (validleft && validright){
-                    equ.min_x = min(ml.newpos.x, mr.newpos.x) - collision_range;
-                    equ.max_x = max(ml.newpos.x, mr.newpos.x) + collision_range;
-                    equ.min_y = min(ml.newpos.y, mr.newpos.y) - collision_range;
-                    equ.max_y = max(ml.newpos.y, mr.newpos.y) + collision_range;
-                    equ.min_z = min(ml.newpos.z, mr.newpos.z) - collision_range;
-                    equ.max_z = max(ml.newpos.z, mr.newpos.z) + collision_range;
-                }
-
-                // only one valid child (must be on the left side)
-                else if (validleft && !validright){
-                    equ.min_x = ml.newpos.x - collision_range;
-                    equ.max_x = ml.newpos.x + collision_range;
-                    equ.min_y = ml.newpos.y - collision_range;
-                    equ.max_y = ml.newpos.y + collision_range;
-                    equ.min_z = ml.newpos.z - collision_range;
-                    equ.max_z = ml.newpos.z + collision_range;
-                }
-
-                bvhdata[offset + leveloffset + i] = equ;
-            }
-        }
-
-        // higher in the tree, update from two children
-        else {
-            // For every node on the current level, get min and max from left and right children
-            for (uint i = 0; i < leveloffset + 1; i++){
-                BVBox tmp = bvhdata[offset + leveloffset + i];
-                BVBox a = bvhdata[offset + 2 * (leveloffset + i) + 1];
-                BVBox b = bvhdata[offset + 2 * (leveloffset + i) + 2];
-                bool validleft = tmp.left_type != -1;
-                bool validright = tmp.right_type != -1;
-
-                BVBox equ;
-                equ.left_id = tmp.left_id;
-                equ.left_type = tmp.left_type;
-                equ.right_id = tmp.right_id;
-                equ.right_type = tmp.right_type;
-
-                // two valid children masspoint
-                if (validleft && validright){
-                    equ.min_x = min(a.min_x, b.min_x);
-                    equ.max_x = max(a.max_x, b.max_x);
-                    equ.min_y = min(a.min_y, b.min_y);
-                    equ.max_y = max(a.max_y, b.max_y);
-                    equ.min_z = min(a.min_z, b.min_z);
-                    equ.max_z = max(a.max_z, b.max_z);
-                }
-                // only one valid child (must be on the left side)
-                else if (validleft && !validright){
-                    equ.min_x = a.min_x;
-                    equ.max_x = a.max_x;
-                    equ.min_y = a.min_y;
-                    equ.max_y = a.max_y;
-                    equ.min_z = a.min_z;
-                    equ.max_z = a.max_z;
-                }
-                bvhdata[offset + leveloffset + i] = equ;
-            }
-        }
-
-        level--;
-    }
 
     /// Update catalogue
-    BVBox newroot = bvhdata[offset];
+    BVBox newroot = bvhdata[olddesc.array_offset];
     BVHDesc eqv = { olddesc.array_offset, olddesc.masspoint_count, 
                     newroot.min_x, newroot.max_x, newroot.min_y,
-                    newroot.max_y, newroot.min_z, newroot.max_z };
+                    newroot.max_y, newroot.min_z, newroot.max_z,
+                    olddesc.cube_width, olddesc.cube_cell_size,
+                    olddesc.mass1_offset, olddesc.mass2_offset,
+                    olddesc.mass1_count, olddesc.mass2_count, olddesc.remap_offset };
     bvhdesc[objnum] = eqv;
 }
\ No newline at end of file
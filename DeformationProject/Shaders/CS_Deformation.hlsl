@@ -19,21 +19,23 @@ Texture2D<float4> vertexID1             : register(t2);
 Texture2D<float4> vertexID2             : register(t3);
 StructuredBuffer<BVHDesc> bvhdesc       : register(t4);
 StructuredBuffer<BVBox> bvhdata         : register(t5);
+StructuredBuffer<int> remap             : register(t6);
 RWStructuredBuffer<MassPoint> volcube1  : register(u0);
 RWStructuredBuffer<MassPoint> volcube2  : register(u1);
 
 
 // Return force/acceleration affecting the first input vertex (mass spring system, spring between the two vertices)
-float3 acceleration(MassPoint a, MassPoint b, uint mode)
+// cell_size = lattice cell size of the object
+float3 acceleration(MassPoint a, MassPoint b, uint mode, uint cell_size)
 {
     float invlen = 1.0f / length(a.newpos - b.newpos);
     float3 v = (a.newpos - a.oldpos - b.newpos + b.oldpos).xyz / dt;// + ab*dt - aa*dt;
     float len;
     // 0 == same cube, 1 == other cube, 2 == same cube+second neighbour
     switch (mode){
-        case 0: len = cube_cell_size; break;
-        case 1: len = cube_cell_size * 0.5f * sqrt(3); break;
-        case 2: len = cube_cell_size * 2; break;
+        case 0: len = cell_size; break;
+        case 1: len = cell_size * 0.5f * sqrt(3); break;
+        case 2: len = cell_size * 2; break;
         default: break;
     }
 
@@ -44,6 +46,15 @@ float3 acceleration(MassPoint a, MassPoint b, uint mode)
 }
 
 
+// masscube buffer index of an active lattice position of the object (first and second masscube)
+uint masspoint1(BVHDesc desc, uint cube){
+    return desc.mass1_offset + remap[desc.remap_offset + cube];
+}
+uint masspoint2(BVHDesc desc, uint cube){
+    return desc.mass2_offset + remap[desc.remap_offset + desc.cube_width*desc.cube_width*desc.cube_width + cube];
+}
+
+
 // collide to points in space (cpos = base point, xpos = colliding neighbour
 float3 collide(float3 cpos, float3 xpos){
 
@@ -109,17 +120,17 @@ float3 collision_detection(MassPoint old, uint objnum){
                         BVBox node = bvhdata[arr_off + index];
                         // collide left leaf
                         if (node.left_type == 1){
-                            accel += collide(cpos.xyz, ovolcube1[o * cube_width * cube_width * cube_width + node.left_id].newpos.xyz);
+                            accel += collide(cpos.xyz, ovolcube1[colldesc.mass1_offset + node.left_id].newpos.xyz);
                         }
                         else if (node.left_type == 2){
-                            accel += collide(cpos.xyz, ovolcube2[o * (cube_width + 1) * (cube_width + 1) * (cube_width + 1) + node.left_id].newpos.xyz);
+                            accel += collide(cpos.xyz, ovolcube2[colldesc.mass2_offset + node.left_id].newpos.xyz);
                         }
                         // collide right leaf
                         if (node.right_type == 1){
-                            accel += collide(cpos.xyz, ovolcube1[o * cube_width * cube_width * cube_width + node.right_id].newpos.xyz);
+                            accel += collide(cpos.xyz, ovolcube1[colldesc.mass1_offset + node.right_id].newpos.xyz);
                         }
                         else if (node.right_type == 2){
-                            accel += collide(cpos.xyz, ovolcube2[o * (cube_width + 1) * (cube_width + 1) * (cube_width + 1) + node.right_id].newpos.xyz);
+                            accel += collide(cpos.xyz, ovolcube2[colldesc.mass2_offset + node.right_id].newpos.xyz);
                         }
                     }
                     // node level, check children
@@ -151,29 +162,33 @@ void CSMain1(uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID, uint3 GTi
 {
 
     /// Helper variables
-    uint full = DTid.x;
-    // object masscube's index in masscube buffer
-    uint objnum = full / (cube_width*cube_width*cube_width);
-    // masspoint index in cube
-    uint cube = full % (cube_width*cube_width*cube_width);
-    uint z = cube / cube_width / cube_width;
-    uint y = (cube - z*cube_width*cube_width) / cube_width;
-    uint x = (cube - z*cube_width*cube_width - y*cube_width);
-
-    // full indices in first and second masscube buffer
-    uint ind = objnum*cube_width*cube_width*cube_width + z*cube_width*cube_width + y*cube_width + x;
-    uint ind2 = objnum*(cube_width + 1)*(cube_width + 1)*(cube_width + 1) + z*(cube_width + 1)*(cube_width + 1) + y*(cube_width + 1) + x;
+    // one row of thread groups per object, lattice of the object from the catalogue
+    uint objnum = DTid.y;
+    BVHDesc desc = bvhdesc[objnum];
+    uint cw = desc.cube_width;
+    // only active masspoints are stored (the dispatch covers the object with the most)
+    if (DTid.x >= desc.mass1_count)
+        return;
 
+    // full index in first masscube buffer
+    uint ind = desc.mass1_offset + DTid.x;
 
     // old masspoint data
     MassPoint old = ovolcube1[ind];
 
+    // lattice position in first and second masscube, neighbours through the remap table
+    uint cube = old.local_id;
+    uint z = cube / cw / cw;
+    uint y = (cube - z*cw*cw) / cw;
+    uint x = (cube - z*cw*cw - y*cw);
+    uint cube2 = z*(cw + 1)*(cw + 1) + y*(cw + 1) + x;
+
     /// Picking
     // ID of picked masscube's lower left masspoint
     float4 pickID = vertexID1[uint2(pick_origin_x, pick_origin_y)];
 
     // if picking mode is on AND the pick didn't happen over a black pixel AND the picked vertex is adjacent to the current masspoint
-    if (is_picking && pickID.w != 0 && (x == pickID.x && y == pickID.y && (z + objnum * cube_width) == pickID.z)){
+    if (is_picking && pickID.w != 0 && (x == pickID.x && y == pickID.y && (z + objnum * vcube_width_max) == pickID.z)){
         float len = length(old.newpos.xyz - eye_pos.xyz);
         float3 v_curr = pick_dir.xyz * len + eye_pos.xyz;
 
@@ -200,64 +215,64 @@ void CSMain1(uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID, uint3 GTi
         // Get neighbours (immediate and second), set acceleration, with index checking
         // left neighbour
         if (same & NB_SAME_LEFT){
-            accel += acceleration(old, ovolcube1[ind - 1], 0);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube - 1)], 0, desc.cube_cell_size);
             //second to left
-            if (x > 1 && (ovolcube1[ind - 1].neighbour_same & NB_SAME_LEFT))
-                accel += acceleration(old, ovolcube1[ind - 2], 2);
+            if (x > 1 && (ovolcube1[masspoint1(desc, cube - 1)].neighbour_same & NB_SAME_LEFT))
+                accel += acceleration(old, ovolcube1[masspoint1(desc, cube - 2)], 2, desc.cube_cell_size);
         }
         // right neighbour
         if (same & NB_SAME_RIGHT){
-            accel += acceleration(old, ovolcube1[ind + 1], 0);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube + 1)], 0, desc.cube_cell_size);
             //second to right
-            if (x < cube_width - 2 && (ovolcube1[ind + 1].neighbour_same & NB_SAME_RIGHT))
-                accel += acceleration(old, ovolcube1[ind + 2], 2);
+            if (x < cw - 2 && (ovolcube1[masspoint1(desc, cube + 1)].neighbour_same & NB_SAME_RIGHT))
+                accel += acceleration(old, ovolcube1[masspoint1(desc, cube + 2)], 2, desc.cube_cell_size);
         }
         // lower neighbour
         if (same & NB_SAME_DOWN){
-            accel += acceleration(old, ovolcube1[ind - cube_width], 0);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube - cw)], 0, desc.cube_cell_size);
             //second down
-            if (y > 1 && (ovolcube1[ind - cube_width].neighbour_same & NB_SAME_DOWN))
-                accel += acceleration(old, ovolcube1[ind - 2 * cube_width], 2);
+            if (y > 1 && (ovolcube1[masspoint1(desc, cube - cw)].neighbour_same & NB_SAME_DOWN))
+                accel += acceleration(old, ovolcube1[masspoint1(desc, cube - 2 * cw)], 2, desc.cube_cell_size);
         }
         // upper neighbour
         if (same & NB_SAME_UP){
-            accel += acceleration(old, ovolcube1[ind + cube_width], 0);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube + cw)], 0, desc.cube_cell_size);
             //second up
-            if (y < cube_width - 2 && (ovolcube1[ind + cube_width].neighbour_same & NB_SAME_UP))
-                accel += acceleration(old, ovolcube1[ind + 2 * cube_width], 2);
+            if (y < cw - 2 && (ovolcube1[masspoint1(desc, cube + cw)].neighbour_same & NB_SAME_UP))
+                accel += acceleration(old, ovolcube1[masspoint1(desc, cube + 2 * cw)], 2, desc.cube_cell_size);
         }
         // nearer neighbour
         if (same & NB_SAME_FRONT){
-            accel += acceleration(old, ovolcube1[ind - cube_width*cube_width], 0);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube - cw*cw)], 0, desc.cube_cell_size);
             //second front
-            if (z > 1 && (ovolcube1[ind - cube_width*cube_width].neighbour_same & NB_SAME_FRONT))
-                accel += acceleration(old, ovolcube1[ind - 2 * cube_width * cube_width], 2);
+            if (z > 1 && (ovolcube1[masspoint1(desc, cube - cw*cw)].neighbour_same & NB_SAME_FRONT))
+                accel += acceleration(old, ovolcube1[masspoint1(desc, cube - 2 * cw * cw)], 2, desc.cube_cell_size);
         }
         // farther neighbour
         if (same & NB_SAME_BACK){
-            accel += acceleration(old, ovolcube1[ind + cube_width*cube_width], 0);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube + cw*cw)], 0, desc.cube_cell_size);
             //second back
-            if (z < cube_width - 2 && (ovolcube1[ind + cube_width*cube_width].neighbour_same & NB_SAME_BACK))
-                accel += acceleration(old, ovolcube1[ind + 2 * cube_width * cube_width], 2);
+            if (z < cw - 2 && (ovolcube1[masspoint1(desc, cube + cw*cw)].neighbour_same & NB_SAME_BACK))
+                accel += acceleration(old, ovolcube1[masspoint1(desc, cube + 2 * cw * cw)], 2, desc.cube_cell_size);
         }
 
         // neighbours in second volcube
         if (other & NB_OTHER_NEAR_BOT_LEFT)
-            accel += acceleration(old, ovolcube2[ind2], 1);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube2)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_NEAR_BOT_RIGHT)
-            accel += acceleration(old, ovolcube2[ind2 + 1], 1);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube2 + 1)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_NEAR_TOP_LEFT)
-            accel += acceleration(old, ovolcube2[ind2 + cube_width + 1], 1);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube2 + cw + 1)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_NEAR_TOP_RIGHT)
-            accel += acceleration(old, ovolcube2[ind2 + cube_width + 2], 1);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube2 + cw + 2)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_FAR_BOT_LEFT)
-            accel += acceleration(old, ovolcube2[ind2 + (cube_width + 1)*(cube_width + 1)], 1);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube2 + (cw + 1)*(cw + 1))], 1, desc.cube_cell_size);
         if (other & NB_OTHER_FAR_BOT_RIGHT)
-            accel += acceleration(old, ovolcube2[ind2 + (cube_width + 1)*(cube_width + 1) + 1], 1);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube2 + (cw + 1)*(cw + 1) + 1)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_FAR_TOP_LEFT)
-            accel += acceleration(old, ovolcube2[ind2 + (cube_width + 1)*(cube_width + 1) + cube_width + 1], 1);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube2 + (cw + 1)*(cw + 1) + cw + 1)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_FAR_TOP_RIGHT)
-            accel += acceleration(old, ovolcube2[ind2 + (cube_width + 1)*(cube_width + 1) + cube_width + 2], 1);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube2 + (cw + 1)*(cw + 1) + cw + 2)], 1, desc.cube_cell_size);
 
         // collision detection
         accel += collision_detection(old, objnum);
@@ -280,21 +295,25 @@ void CSMain2(uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID, uint3 GTi
 {
 
     /// Helper variables
-    uint full = DTid.x;
-    uint objnum = full / ((cube_width + 1)*(cube_width + 1)*(cube_width + 1));
-    uint cube = full % ((cube_width + 1)*(cube_width + 1)*(cube_width + 1));
-    uint z = cube / (cube_width + 1) / (cube_width + 1);
-    uint y = (cube - z*(cube_width + 1)*(cube_width + 1)) / (cube_width + 1);
-    uint x = (cube - z*(cube_width + 1)*(cube_width + 1) - y*(cube_width + 1));
-    uint ind = objnum*(cube_width + 1)*(cube_width + 1)*(cube_width + 1) + z*(cube_width + 1)*(cube_width + 1) + y*(cube_width + 1) + x;
-    uint ind1 = objnum*cube_width*cube_width*cube_width + z*cube_width*cube_width + y*cube_width + x;
+    uint objnum = DTid.y;
+    BVHDesc desc = bvhdesc[objnum];
+    uint cw = desc.cube_width;
+    if (DTid.x >= desc.mass2_count)
+        return;
+    uint ind = desc.mass2_offset + DTid.x;
 
     MassPoint old = ovolcube2[ind];
 
+    uint cube = old.local_id;
+    uint z = cube / (cw + 1) / (cw + 1);
+    uint y = (cube - z*(cw + 1)*(cw + 1)) / (cw + 1);
+    uint x = (cube - z*(cw + 1)*(cw + 1) - y*(cw + 1));
+    uint cube1 = z*cw*cw + y*cw + x;
+
     /// Picking
     float4 pickID = vertexID2[uint2(pick_origin_x, pick_origin_y)];
 
-    if (is_picking && pickID.w != 0 && (x == pickID.x && y == pickID.y && (z + objnum*(cube_width + 1)) == pickID.z)){
+    if (is_picking && pickID.w != 0 && (x == pickID.x && y == pickID.y && (z + objnum*(vcube_width_max + 1)) == pickID.z)){
         float len = length(old.newpos.xyz - eye_pos.xyz);
         float3 v_curr = pick_dir.xyz * len + eye_pos.xyz;
 
@@ -318,53 +337,53 @@ void CSMain2(uint3 Gid : SV_GroupID, uint3 DTid : SV_DispatchThreadID, uint3 GTi
 
         // Get neighbours, set acceleration, with index checking
         if (same & NB_SAME_LEFT){
-            accel += acceleration(old, ovolcube2[ind - 1], 0);
-            if (x > 1 && (ovolcube2[ind - 1].neighbour_same & NB_SAME_LEFT))
-                accel += acceleration(old, ovolcube2[ind - 2], 2);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube - 1)], 0, desc.cube_cell_size);
+            if (x > 1 && (ovolcube2[masspoint2(desc, cube - 1)].neighbour_same & NB_SAME_LEFT))
+                accel += acceleration(old, ovolcube2[masspoint2(desc, cube - 2)], 2, desc.cube_cell_size);
         }
         if (same & NB_SAME_RIGHT){
-            accel += acceleration(old, ovolcube2[ind + 1], 0);
-            if (x < cube_width - 1 && (ovolcube2[ind + 1].neighbour_same & NB_SAME_RIGHT))
-                accel += acceleration(old, ovolcube2[ind + 2], 2);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube + 1)], 0, desc.cube_cell_size);
+            if (x < cw - 1 && (ovolcube2[masspoint2(desc, cube + 1)].neighbour_same & NB_SAME_RIGHT))
+                accel += acceleration(old, ovolcube2[masspoint2(desc, cube + 2)], 2, desc.cube_cell_size);
         }
         if (same & NB_SAME_DOWN){
-            accel += acceleration(old, ovolcube2[ind - cube_width - 1], 0);
-            if (y > 1 && (ovolcube2[ind - (cube_width + 1)].neighbour_same & NB_SAME_DOWN))
-                accel += acceleration(old, ovolcube2[ind - 2 * (cube_width + 1)], 2);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube - cw - 1)], 0, desc.cube_cell_size);
+            if (y > 1 && (ovolcube2[masspoint2(desc, cube - (cw + 1))].neighbour_same & NB_SAME_DOWN))
+                accel += acceleration(old, ovolcube2[masspoint2(desc, cube - 2 * (cw + 1))], 2, desc.cube_cell_size);
         }
         if (same & NB_SAME_UP){
-            accel += acceleration(old, ovolcube2[ind + cube_width + 1], 0);
-            if (y < cube_width - 1 && (ovolcube2[ind + cube_width + 1].neighbour_same & NB_SAME_UP))
-                accel += acceleration(old, ovolcube2[ind + 2 * (cube_width + 1)], 2);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube + cw + 1)], 0, desc.cube_cell_size);
+            if (y < cw - 1 && (ovolcube2[masspoint2(desc, cube + cw + 1)].neighbour_same & NB_SAME_UP))
+                accel += acceleration(old, ovolcube2[masspoint2(desc, cube + 2 * (cw + 1))], 2, desc.cube_cell_size);
         }
         if (same & NB_SAME_FRONT){
-            accel += acceleration(old, ovolcube2[ind - (cube_width + 1)*(cube_width + 1)], 0);
-            if (z > 1 && (ovolcube2[ind - (cube_width + 1)*(cube_width + 1)].neighbour_same & NB_SAME_FRONT))
-                accel += acceleration(old, ovolcube2[ind - 2 * (cube_width + 1) * (cube_width + 1)], 2);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube - (cw + 1)*(cw + 1))], 0, desc.cube_cell_size);
+            if (z > 1 && (ovolcube2[masspoint2(desc, cube - (cw + 1)*(cw + 1))].neighbour_same & NB_SAME_FRONT))
+                accel += acceleration(old, ovolcube2[masspoint2(desc, cube - 2 * (cw + 1) * (cw + 1))], 2, desc.cube_cell_size);
         }
         if (same & NB_SAME_BACK){
-            accel += acceleration(old, ovolcube2[ind + (cube_width + 1)*(cube_width + 1)], 0);
-            if (z < cube_width - 1 && (ovolcube2[ind + (cube_width + 1)*(cube_width + 1)].neighbour_same & NB_SAME_BACK))
-                accel += acceleration(old, ovolcube2[ind + 2 * (cube_width + 1) * (cube_width + 1)], 2);
+            accel += acceleration(old, ovolcube2[masspoint2(desc, cube + (cw + 1)*(cw + 1))], 0, desc.cube_cell_size);
+            if (z < cw - 1 && (ovolcube2[masspoint2(desc, cube + (cw + 1)*(cw + 1))].neighbour_same & NB_SAME_BACK))
+                accel += acceleration(old, ovolcube2[masspoint2(desc, cube + 2 * (cw + 1) * (cw + 1))], 2, desc.cube_cell_size);
         }
 
         // neighbours in second volcube
         if (other & NB_OTHER_NEAR_BOT_LEFT)
-            accel += acceleration(old, ovolcube1[ind1 - cube_width*cube_width - cube_width - 1], 1);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube1 - cw*cw - cw - 1)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_NEAR_BOT_RIGHT)
-            accel += acceleration(old, ovolcube1[ind1 - cube_width*cube_width - cube_width], 1);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube1 - cw*cw - cw)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_NEAR_TOP_LEFT)
-            accel += acceleration(old, ovolcube1[ind1 - cube_width*cube_width - 1], 1);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube1 - cw*cw - 1)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_NEAR_TOP_RIGHT)
-            accel += acceleration(old, ovolcube1[ind1 - cube_width*cube_width], 1);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube1 - cw*cw)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_FAR_BOT_LEFT)
-            accel += acceleration(old, ovolcube1[ind1 - cube_width - 1], 1);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube1 - cw - 1)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_FAR_BOT_RIGHT)
-            accel += acceleration(old, ovolcube1[ind1 - cube_width], 1);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube1 - cw)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_FAR_TOP_LEFT)
-            accel += acceleration(old, ovolcube1[ind1 - 1], 1);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube1 - 1)], 1, desc.cube_cell_size);
         if (other & NB_OTHER_FAR_TOP_RIGHT)
-            accel += acceleration(old, ovolcube1[ind1], 1);
+            accel += acceleration(old, ovolcube1[masspoint1(desc, cube1)], 1, desc.cube_cell_size);
 
         // collision detection
         accel += collision_detection(old, objnum);
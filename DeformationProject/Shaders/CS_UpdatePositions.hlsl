@@ -13,6 +13,8 @@
 
 RWStructuredBuffer<Particle> particles  : register(u0);
 StructuredBuffer<Indexer> indexer       : register(t0);
+StructuredBuffer<BVHDesc> bvhdesc       : register(t1);
+StructuredBuffer<int> remap             : register(t2);
 RWStructuredBuffer<MassPoint> volcube1  : register(u1);
 RWStructuredBuffer<MassPoint> volcube2  : register(u2);
 
@@ -21,43 +23,47 @@ void CSPosUpdate(uint3 DTid : SV_DispatchThreadID)
 {
     // Calculate new particle position
     Indexer old = indexer[DTid.x];
-    int ind1 = old.vc1index.z*cube_width*cube_width + old.vc1index.y*cube_width + old.vc1index.x;
-    int ind2 = old.vc2index.z*(cube_width + 1)*(cube_width + 1) + old.vc2index.y*(cube_width + 1) + old.vc2index.x;
-    float3 pos1 = old.w1[0] * volcube1[ind1].newpos.xyz +
-        old.w1[1] * volcube1[ind1 + 1].newpos.xyz +
-        old.w1[2] * volcube1[ind1 + cube_width].newpos.xyz +
-        old.w1[3] * volcube1[ind1 + cube_width + 1].newpos.xyz +
-        old.w1[4] * volcube1[ind1 + cube_width*cube_width].newpos.xyz +
-        old.w1[5] * volcube1[ind1 + cube_width*cube_width + 1].newpos.xyz +
-        old.w1[6] * volcube1[ind1 + cube_width*cube_width + cube_width].newpos.xyz +
-        old.w1[7] * volcube1[ind1 + cube_width*cube_width + cube_width + 1].newpos.xyz;
-    float3 pos2 = old.w2[0] * volcube2[ind2].newpos.xyz +
-        old.w2[1] * volcube2[ind2 + 1].newpos.xyz +
-        old.w2[2] * volcube2[ind2 + (cube_width + 1)].newpos.xyz +
-        old.w2[3] * volcube2[ind2 + (cube_width + 1) + 1].newpos.xyz +
-        old.w2[4] * volcube2[ind2 + (cube_width + 1)*(cube_width + 1)].newpos.xyz +
-        old.w2[5] * volcube2[ind2 + (cube_width + 1)*(cube_width + 1) + 1].newpos.xyz +
-        old.w2[6] * volcube2[ind2 + (cube_width + 1)*(cube_width + 1) + (cube_width + 1)].newpos.xyz +
-        old.w2[7] * volcube2[ind2 + (cube_width + 1)*(cube_width + 1) + (cube_width + 1) + 1].newpos.xyz;
+    // lattice of the particle's object
+    BVHDesc desc = bvhdesc[old.object];
+    uint cw = desc.cube_width;
+    // lattice indices of the lower corners, every corner is active (masscube index through the remap table)
+    int ind1 = desc.remap_offset + old.vc1index.z*cw*cw + old.vc1index.y*cw + old.vc1index.x;
+    int ind2 = desc.remap_offset + cw*cw*cw + old.vc2index.z*(cw + 1)*(cw + 1) + old.vc2index.y*(cw + 1) + old.vc2index.x;
+    float3 pos1 = old.w1[0] * volcube1[desc.mass1_offset + remap[ind1]].newpos.xyz +
+        old.w1[1] * volcube1[desc.mass1_offset + remap[ind1 + 1]].newpos.xyz +
+        old.w1[2] * volcube1[desc.mass1_offset + remap[ind1 + cw]].newpos.xyz +
+        old.w1[3] * volcube1[desc.mass1_offset + remap[ind1 + cw + 1]].newpos.xyz +
+        old.w1[4] * volcube1[desc.mass1_offset + remap[ind1 + cw*cw]].newpos.xyz +
+        old.w1[5] * volcube1[desc.mass1_offset + remap[ind1 + cw*cw + 1]].newpos.xyz +
+        old.w1[6] * volcube1[desc.mass1_offset + remap[ind1 + cw*cw + cw]].newpos.xyz +
+        old.w1[7] * volcube1[desc.mass1_offset + remap[ind1 + cw*cw + cw + 1]].newpos.xyz;
+    float3 pos2 = old.w2[0] * volcube2[desc.mass2_offset + remap[ind2]].newpos.xyz +
+        old.w2[1] * volcube2[desc.mass2_offset + remap[ind2 + 1]].newpos.xyz +
+        old.w2[2] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)]].newpos.xyz +
+        old.w2[3] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1) + 1]].newpos.xyz +
+        old.w2[4] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)*(cw + 1)]].newpos.xyz +
+        old.w2[5] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)*(cw + 1) + 1]].newpos.xyz +
+        old.w2[6] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)*(cw + 1) + (cw + 1)]].newpos.xyz +
+        old.w2[7] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)*(cw + 1) + (cw + 1) + 1]].newpos.xyz;
     // Set final position
     particles[DTid.x].pos.xyz = pos1 * 0.5f + pos2 * 0.5f;
 
     // Calculate new normals
-    float3 npos1 = old.nw1[0] * volcube1[ind1].newpos.xyz +
-        old.nw1[1] * volcube1[ind1 + 1].newpos.xyz +
-        old.nw1[2] * volcube1[ind1 + cube_width].newpos.xyz +
-        old.nw1[3] * volcube1[ind1 + cube_width + 1].newpos.xyz +
-        old.nw1[4] * volcube1[ind1 + cube_width*cube_width].newpos.xyz +
-        old.nw1[5] * volcube1[ind1 + cube_width*cube_width + 1].newpos.xyz +
-        old.nw1[6] * volcube1[ind1 + cube_width*cube_width + cube_width].newpos.xyz +
-        old.nw1[7] * volcube1[ind1 + cube_width*cube_width + cube_width + 1].newpos.xyz;
-    float3 npos2 = old.nw2[0] * volcube2[ind2].newpos.xyz +
-        old.nw2[1] * volcube2[ind2 + 1].newpos.xyz +
-        old.nw2[2] * volcube2[ind2 + (cube_width + 1)].newpos.xyz +
-        old.nw2[3] * volcube2[ind2 + (cube_width + 1) + 1].newpos.xyz +
-        old.nw2[4] * volcube2[ind2 + (cube_width + 1)*(cube_width + 1)].newpos.xyz +
-        old.nw2[5] * volcube2[ind2 + (cube_width + 1)*(cube_width + 1) + 1].newpos.xyz +
-        old.nw2[6] * volcube2[ind2 + (cube_width + 1)*(cube_width + 1) + (cube_width + 1)].newpos.xyz +
-        old.nw2[7] * volcube2[ind2 + (cube_width + 1)*(cube_width + 1) + (cube_width + 1) + 1].newpos.xyz;
+    float3 npos1 = old.nw1[0] * volcube1[desc.mass1_offset + remap[ind1]].newpos.xyz +
+        old.nw1[1] * volcube1[desc.mass1_offset + remap[ind1 + 1]].newpos.xyz +
+        old.nw1[2] * volcube1[desc.mass1_offset + remap[ind1 + cw]].newpos.xyz +
+        old.nw1[3] * volcube1[desc.mass1_offset + remap[ind1 + cw + 1]].newpos.xyz +
+        old.nw1[4] * volcube1[desc.mass1_offset + remap[ind1 + cw*cw]].newpos.xyz +
+        old.nw1[5] * volcube1[desc.mass1_offset + remap[ind1 + cw*cw + 1]].newpos.xyz +
+        old.nw1[6] * volcube1[desc.mass1_offset + remap[ind1 + cw*cw + cw]].newpos.xyz +
+        old.nw1[7] * volcube1[desc.mass1_offset + remap[ind1 + cw*cw + cw + 1]].newpos.xyz;
+    float3 npos2 = old.nw2[0] * volcube2[desc.mass2_offset + remap[ind2]].newpos.xyz +
+        old.nw2[1] * volcube2[desc.mass2_offset + remap[ind2 + 1]].newpos.xyz +
+        old.nw2[2] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)]].newpos.xyz +
+        old.nw2[3] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1) + 1]].newpos.xyz +
+        old.nw2[4] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)*(cw + 1)]].newpos.xyz +
+        old.nw2[5] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)*(cw + 1) + 1]].newpos.xyz +
+        old.nw2[6] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)*(cw + 1) + (cw + 1)]].newpos.xyz +
+        old.nw2[7] * volcube2[desc.mass2_offset + remap[ind2 + (cw + 1)*(cw + 1) + (cw + 1) + 1]].newpos.xyz;
     particles[DTid.x].npos.xyz = npos1 * 0.5f + npos2 * 0.5f;
 }
\ No newline at end of file
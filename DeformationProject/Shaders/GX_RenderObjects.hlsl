@@ -21,6 +21,7 @@ StructuredBuffer<BufferVertex> g_bufParticle : register(t0);
 StructuredBuffer<Face> g_bufFace : register(t1);
 Texture2D<float> g_txShadowMap : register(t2);
 StructuredBuffer<MassPoint> g_bufMasspoint : register(t3);
+StructuredBuffer<BufferVertex> g_bufParticlePrev : register(t5);
 Texture2D g_txDiffuse : register(t0);
 
 
@@ -48,6 +49,8 @@ cbuffer cb0
     float4 eyepos;
     float4 lightpos;
     float4 lightcol;
+    // x: blend factor from the previous to the last substep state
+    float4 interpolation;
 };
 
 cbuffer cb1
@@ -112,6 +115,18 @@ float4 BlinnPhong(float3 P, float3 N)
     return ka + kd * float4(diffuse, 1) + ks * float4(spec, 1);
 }
 
+//
+// Particle between the last two simulation substeps
+//
+BufferVertex interpolatedVertex(uint id)
+{
+    BufferVertex vertex = g_bufParticle[id];
+    BufferVertex prev = g_bufParticlePrev[id];
+    vertex.pos.xyz = lerp(prev.pos.xyz, vertex.pos.xyz, interpolation.x);
+    vertex.npos.xyz = lerp(prev.npos.xyz, vertex.npos.xyz, interpolation.x);
+    return vertex;
+}
+
 //
 // Vertex shader for drawing the point-sprite particles (object drawing)
 //
@@ -158,7 +173,7 @@ void GSObjectDraw(uint id : SV_PrimitiveID, point Face input[1], inout TriangleS
     // draw object face
     for (int i = 0; i<3; i++)
     {
-        BufferVertex vertex = g_bufParticle[points[2 - i]];
+        BufferVertex vertex = interpolatedVertex(points[2 - i]);
         output.pos = mul(vertex.pos, g_mWorldViewProj);
         output.lpos = mul(vertex.pos, g_mLightViewProj);
 
@@ -317,7 +332,7 @@ void GSShadowDraw(uint id : SV_PrimitiveID, point Face input[1], inout TriangleS
     // draw object face
     for (int i = 0; i<3; i++)
     {
-        BufferVertex vertex = g_bufParticle[points[2 - i]];
+        BufferVertex vertex = interpolatedVertex(points[2 - i]);
         output.pos = mul(vertex.pos, g_mLightViewProj);
         SpriteStream.Append(output);
     }
@@ -341,6 +356,8 @@ ObjectVertex VSMasspointDraw(uint id : SV_VertexID)
 {
     ObjectVertex output;
     output.pos = g_bufMasspoint[id].newpos;
+    // oldpos: position before the last substep
+    output.pos.xyz = lerp(g_bufMasspoint[id].oldpos.xyz, output.pos.xyz, interpolation.x);
     output.lpos = float4(0, 0, 0, 0);
     output.color = g_bufMasspoint[id].color;
     return output;
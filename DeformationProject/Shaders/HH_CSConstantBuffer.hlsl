@@ -31,4 +31,13 @@ cbuffer cbCS : register(b0)
 
     float4 pick_dir;
     float4 eye_pos;
-};
\ No newline at end of file
+};
+
+// constant buffer for one collision tree refit pass
+cbuffer cbRefit : register(b1)
+{
+    uint refit_first;       // first node of the pass in the refit list
+    uint refit_count;       // number of nodes in the pass
+    uint refit_leaf;        // 1: deepest level of the trees
+    uint refit_dummy;
+};
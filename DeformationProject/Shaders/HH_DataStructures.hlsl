@@ -32,6 +32,8 @@
 #define exp_max                 1000000         // default: 1000000
 #define masspoint_tgsize        256
 #define particle_tgsize         256
+#define refit_tgsize            256
+#define vcube_width_max         32              // picking ID slot of an object (VCUBEWIDTH_MAX)
 
 
 // masspoint structure (defined in RenderObjects as well)
@@ -58,12 +60,13 @@ struct Particle
 // indexer entry structure
 struct Indexer
 {
-    float3 vc1index;        // index in first volumetric cube
-    float3 vc2index;        // index in second volumetric cube
+    float3 vc1index;        // lattice index in first volumetric cube (masscube index: remap)
+    float3 vc2index;        // lattice index in second volumetric cube
     float w1[8];            // neighbour weights in first volumetric cube
     float w2[8];            // neighbour weights in second volumetric cube
     float nw1[8];           // neighbour weights for normal
     float nw2[8];           //          --||--
+    uint object;            // object of the particle (BVHDesc index)
 };
 
 // BVHData entry (bounding box)
@@ -90,6 +93,19 @@ struct BVHDesc {
     float max_y;            // bounding box coordinates
     float min_z;            // bounding box coordinates
     float max_z;            // bounding box coordinates
+    uint cube_width;        // lattice width of the object
+    uint cube_cell_size;    // lattice cell size of the object
+    uint mass1_offset;      // first masspoint of the object in the first masscube buffer
+    uint mass2_offset;      // first masspoint of the object in the second masscube buffer
+    uint mass1_count;       // active masspoints of the object in the first masscube buffer
+    uint mass2_count;       // active masspoints of the object in the second masscube buffer
+    uint remap_offset;      // lattice -> masscube index table of the object (second masscube after cw^3)
+};
+
+// Refit list entry (collision tree node of a refit pass)
+struct RefitNode {
+    uint node;              // index in bvhdata array
+    uint object;            // object of the tree (BVHDesc index)
 };
 
 // Bone structure
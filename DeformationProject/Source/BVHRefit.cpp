@@ -0,0 +1,150 @@
+//--------------------------------------------------------------------------------------
+// File: BVHRefit.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Level-parallel refit of the collision trees (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "../Headers/BVHRefit.h"
+
+
+// tree levels of a catalogue entry (masspointCount: number of tree nodes, 2^levels - 1)
+static inline uint treeLevels(const BVHDESC& desc){
+    uint levels = 0;
+    while ((1u << levels) - 1 < desc.masspointCount)
+        levels++;
+    return levels;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+BVHRefit::BVHRefit(){}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+BVHRefit::~BVHRefit(){}
+
+//--------------------------------------------------------------------------------------
+// Build: nodes of every tree, grouped by height above the deepest level
+//--------------------------------------------------------------------------------------
+void BVHRefit::build(const BVHDESC* catalogue, uint objectCount){
+
+    nodes.clear();
+    passOffsets.assign(1, 0);
+
+    uint passes = 0;
+    for (uint o = 0; o < objectCount; o++)
+        passes = std::max(passes, treeLevels(catalogue[o]));
+
+    for (uint p = 0; p < passes; p++){
+        for (uint o = 0; o < objectCount; o++){
+            uint levels = treeLevels(catalogue[o]);
+            if (p >= levels)
+                continue;
+            // level l = levels - p (root: 1) holds 2^(l-1) nodes after 2^(l-1) - 1 others
+            uint width = 1u << (levels - p - 1);
+            for (uint i = 0; i < width; i++)
+                nodes.push_back(REFITNODE{ catalogue[o].arrayOffset + width - 1 + i, o });
+        }
+        passOffsets.push_back(nodes.size());
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Refit: passes in order, the nodes of a pass in parallel (CSBVHRefit, CSBVHUpdate)
+//--------------------------------------------------------------------------------------
+void BVHRefit::refit(BVHDESC* catalogue, uint objectCount, BVBOX* bvhdata, const MASSVIEW& volcube1, const MASSVIEW& volcube2,
+                     float range, ThreadPool& pool, bool swept) const {
+
+    for (uint p = 0; p < passCount(); p++){
+        uint first = passOffsets[p];
+        uint count = passOffsets[p + 1] - first;
+        pool.parallelFor((count + CPU_REFIT_BATCH - 1) / CPU_REFIT_BATCH, [&](uint task){
+            uint end = first + std::min(count, (task + 1) * CPU_REFIT_BATCH);
+            for (uint n = first + task * CPU_REFIT_BATCH; n < end; n++){
+                const BVHDESC& desc = catalogue[nodes[n].object];
+                uint index = nodes[n].node;
+                BVBOX& node = bvhdata[index];
+                BVBOX equ;
+                equ.leftID = node.leftID;
+                equ.leftType = node.leftType;
+                equ.rightID = node.rightID;
+                equ.rightType = node.rightType;
+                bool validleft = node.leftType != -1;
+                bool validright = node.rightType != -1;
+
+                // deepest level, boxes around the masspoints
+                if (p == 0){
+                    // position and extrapolated next position of each masspoint
+                    XMFLOAT3 ml(0, 0, 0), mr(0, 0, 0), nl(0, 0, 0), nr(0, 0, 0);
+                    if (node.leftID != -1){
+                        const MASSVIEW& v = node.leftType == 1 ? volcube1 : volcube2;
+                        uint i = (node.leftType == 1 ? desc.mass1Offset : desc.mass2Offset) + node.leftID;
+                        ml = XMFLOAT3(v.newX[i], v.newY[i], v.newZ[i]);
+                        nl = XMFLOAT3(2 * v.newX[i] - v.oldX[i], 2 * v.newY[i] - v.oldY[i], 2 * v.newZ[i] - v.oldZ[i]);
+                    }
+                    if (node.rightID != -1){
+                        const MASSVIEW& v = node.rightType == 1 ? volcube1 : volcube2;
+                        uint i = (node.rightType == 1 ? desc.mass1Offset : desc.mass2Offset) + node.rightID;
+                        mr = XMFLOAT3(v.newX[i], v.newY[i], v.newZ[i]);
+                        nr = XMFLOAT3(2 * v.newX[i] - v.oldX[i], 2 * v.newY[i] - v.oldY[i], 2 * v.newZ[i] - v.oldZ[i]);
+                    }
+                    if (validleft && !validright){
+                        mr = ml;
+                        nr = nl;
+                    }
+                    if (validleft){
+                        equ.minX = std::min(ml.x, mr.x) - range;
+                        equ.maxX = std::max(ml.x, mr.x) + range;
+                        equ.minY = std::min(ml.y, mr.y) - range;
+                        equ.maxY = std::max(ml.y, mr.y) + range;
+                        equ.minZ = std::min(ml.z, mr.z) - range;
+                        equ.maxZ = std::max(ml.z, mr.z) + range;
+                    }
+                    if (validleft && swept){
+                        equ.minX = std::min(equ.minX, std::min(nl.x, nr.x) - range);
+                        equ.maxX = std::max(equ.maxX, std::max(nl.x, nr.x) + range);
+                        equ.minY = std::min(equ.minY, std::min(nl.y, nr.y) - range);
+                        equ.maxY = std::max(equ.maxY, std::max(nl.y, nr.y) + range);
+                        equ.minZ = std::min(equ.minZ, std::min(nl.z, nr.z) - range);
+                        equ.maxZ = std::max(equ.maxZ, std::max(nl.z, nr.z) + range);
+                    }
+                }
+                // higher in the tree, union of the two children
+                else {
+                    uint local = index - desc.arrayOffset;
+                    const BVBOX& a = bvhdata[desc.arrayOffset + 2 * local + 1];
+                    const BVBOX& b = validright ? bvhdata[desc.arrayOffset + 2 * local + 2] : a;
+                    if (validleft){
+                        equ.minX = std::min(a.minX, b.minX);
+                        equ.maxX = std::max(a.maxX, b.maxX);
+                        equ.minY = std::min(a.minY, b.minY);
+                        equ.maxY = std::max(a.maxY, b.maxY);
+                        equ.minZ = std::min(a.minZ, b.minZ);
+                        equ.maxZ = std::max(a.maxZ, b.maxZ);
+                    }
+                }
+                node = equ;
+            }
+        });
+    }
+
+    // update catalogue
+    for (uint o = 0; o < objectCount; o++){
+        const BVBOX& root = bvhdata[catalogue[o].arrayOffset];
+        catalogue[o].minX = root.minX;
+        catalogue[o].maxX = root.maxX;
+        catalogue[o].minY = root.minY;
+        catalogue[o].maxY = root.maxY;
+        catalogue[o].minZ = root.minZ;
+        catalogue[o].maxZ = root.maxZ;
+    }
+}
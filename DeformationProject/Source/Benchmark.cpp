@@ -0,0 +1,587 @@
+//--------------------------------------------------------------------------------------
+// File: Benchmark.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Headless benchmarks of the CPU solver (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include "../Headers/Benchmark.h"
+#include "../Headers/CPUSimulation.h"
+#include "../Headers/OBJParser.h"
+#include "../Headers/WideBVH.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constants: physics fields of the CS constant buffer, no picking
+//--------------------------------------------------------------------------------------
+CB_CS benchmarkConstants(std::vector<std::unique_ptr<DeformableBase>>& objects, float dt){
+
+    CB_CS cb;
+    memset(&cb, 0, sizeof(CB_CS));
+    // widest lattice of the scene
+    cb.cubeWidth = 0;
+    for (auto& obj : objects)
+        cb.cubeWidth = std::max(cb.cubeWidth, (uint)obj->cubeWidth);
+    cb.cubeCellSize = objects.empty() ? 0 : objects[0]->cubeCellSize;
+    cb.objectCount = objects.size();
+    cb.stiffness = stiffnessConstant;
+    cb.damping = dampingConstant;
+    cb.dt = dt;
+    cb.im = invMassConstant;
+    cb.gravity = gravityConstant;
+    cb.tablePos = tablePositionConstant;
+    cb.collisionRange = collisionRangeConstant;
+    return cb;
+}
+
+//--------------------------------------------------------------------------------------
+// Scaling: same scene and step count with a growing number of threads
+//--------------------------------------------------------------------------------------
+std::vector<BENCHRESULT> benchmarkScaling(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps, uint maxThreads){
+
+    std::vector<BENCHRESULT> results;
+    if (objects.empty() || steps == 0)
+        return results;
+
+    if (maxThreads == 0)
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    CB_CS cb = benchmarkConstants(objects, timestepConstant);
+    for (uint t = 1; t <= maxThreads; t++){
+        CPUSimulation sim(t);
+        sim.load(objects);
+        // warm up caches and worker threads
+        sim.step(cb);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint s = 0; s < steps; s++)
+            sim.step(cb);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        BENCHRESULT r;
+        r.threads = t;
+        r.msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+        r.speedup = results.empty() ? 1.0 : results[0].msPerStep / r.msPerStep;
+        results.push_back(r);
+    }
+    return results;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: one item per thread count
+//--------------------------------------------------------------------------------------
+std::wstring formatBenchmark(const std::vector<BENCHRESULT>& results){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (uint i = 0; i < results.size(); i++){
+        if (i > 0)
+            out << L" ";
+        out << results[i].threads << L":" << results[i].msPerStep << L"ms(" << results[i].speedup << L"x)";
+    }
+    return out.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Integrators: every integrator on a ladder of timesteps, same scene and stiffness
+//--------------------------------------------------------------------------------------
+std::vector<INTEGRATORRESULT> benchmarkIntegrators(std::vector<std::unique_ptr<DeformableBase>>& objects, float stiffness, float seconds){
+
+    std::vector<INTEGRATORRESULT> results;
+    if (objects.empty() || seconds <= 0.0f)
+        return results;
+
+    const float rates[5] = { 960.0f, 480.0f, 240.0f, 120.0f, 60.0f };
+    for (int mode = CPUSimulation::INTEGRATOR_VERLET; mode <= CPUSimulation::INTEGRATOR_XPBD; mode++){
+        for (float rate : rates){
+            CB_CS cb = benchmarkConstants(objects, 1.0f / rate);
+            cb.stiffness = stiffness;
+            uint steps = std::max(1u, (uint)ceil(seconds * rate));
+
+            CPUSimulation sim;
+            sim.setIntegrator((CPUSimulation::Integrator)mode);
+            sim.load(objects);
+
+            uint iterations = 0, capped = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint s = 0; s < steps; s++){
+                sim.step(cb);
+                iterations += sim.solverIterations();
+                capped += sim.solverIterations() >= CPU_CG_ITERATIONS;
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+
+            // blown up: non-finite or far outside the scene
+            MassVector m1, m2;
+            std::vector<PARTICLE> particles;
+            sim.exportSnapshot(m1, m2, particles);
+            bool stable = true;
+            for (const PARTICLE& p : particles)
+                stable &= std::isfinite(p.pos.x) && std::isfinite(p.pos.y) && std::isfinite(p.pos.z) &&
+                          fabsf(p.pos.x) < 1e6f && fabsf(p.pos.y) < 1e6f && fabsf(p.pos.z) < 1e6f;
+
+            INTEGRATORRESULT r;
+            r.integrator = mode;
+            r.dt = cb.dt;
+            r.msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+            r.msPerSecond = r.msPerStep * rate;
+            r.iterations = mode == CPUSimulation::INTEGRATOR_IMPLICIT ? (double)iterations / steps : 0.0;
+            r.capped = mode == CPUSimulation::INTEGRATOR_IMPLICIT ? capped : 0;
+            r.stable = stable;
+            results.push_back(r);
+        }
+    }
+    return results;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: one item per integrator and timestep
+//--------------------------------------------------------------------------------------
+std::wstring formatIntegrators(const std::vector<INTEGRATORRESULT>& results){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (uint i = 0; i < results.size(); i++){
+        const INTEGRATORRESULT& r = results[i];
+        if (i > 0)
+            out << L" ";
+        const wchar_t* names[3] = { L"verlet@", L"implicit@", L"xpbd@" };
+        out << names[r.integrator] << (int)(1.0f / r.dt + 0.5f) << L"Hz:";
+        if (!r.stable)
+            out << L"unstable";
+        else
+            out << r.msPerSecond << L"ms/s";
+        if (r.integrator == CPUSimulation::INTEGRATOR_IMPLICIT)
+            out << L"(" << r.iterations << L"it," << r.capped << L"capped)";
+    }
+    return out.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Broad phase: pairs pruned by sweep and prune while stepping the scene
+//--------------------------------------------------------------------------------------
+BROADPHASERESULT benchmarkBroadPhase(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps){
+
+    BROADPHASERESULT r;
+    memset(&r, 0, sizeof(BROADPHASERESULT));
+    if (objects.empty() || steps == 0)
+        return r;
+
+    CB_CS cb = benchmarkConstants(objects, timestepConstant);
+    CPUSimulation sim;
+    sim.load(objects);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint s = 0; s < steps; s++){
+        sim.step(cb);
+        const BROADPHASESTATS& stats = sim.broadPhaseStats();
+        r.pairs += stats.pairs;
+        r.candidates += stats.candidates;
+        r.pruned += stats.pruned;
+        r.swaps += stats.swaps;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    r.steps = steps;
+    r.msPerStep = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: counters per step
+//--------------------------------------------------------------------------------------
+std::wstring formatBroadPhase(const BROADPHASERESULT& result){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(2);
+    double steps = std::max(1u, result.steps);
+    out << L"pairs:" << result.pairs / steps << L" candidates:" << result.candidates / steps
+        << L" pruned:" << result.pruned / steps << L" swaps:" << result.swaps / steps << L" " << result.msPerStep << L"ms";
+    return out.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Contact cache: same scene stepped without and with the cache
+//--------------------------------------------------------------------------------------
+CONTACTCACHERESULT benchmarkContactCache(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps){
+
+    CONTACTCACHERESULT r;
+    memset(&r, 0, sizeof(CONTACTCACHERESULT));
+    if (objects.empty() || steps == 0)
+        return r;
+
+    CB_CS cb = benchmarkConstants(objects, timestepConstant);
+    for (int cached = 0; cached <= 1; cached++){
+        CPUSimulation sim;
+        sim.setContactCache(cached != 0);
+        sim.load(objects);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint s = 0; s < steps; s++){
+            sim.step(cb);
+            if (cached){
+                const CONTACTCACHESTATS& stats = sim.contactCacheStats();
+                r.queries += stats.queries;
+                r.hits += stats.hits;
+                r.traversals += stats.traversals;
+                r.nodes += stats.nodes;
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        (cached ? r.cachedMs : r.uncachedMs) = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+    }
+    r.steps = steps;
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: rates and counters per step
+//--------------------------------------------------------------------------------------
+std::wstring formatContactCache(const CONTACTCACHERESULT& result){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(2);
+    double steps = std::max(1u, result.steps);
+    double rate = result.queries > 0 ? result.hits / result.queries : 0.0;
+    double saved = result.traversals > 0 ? result.hits * result.nodes / result.traversals : 0.0;
+    out << L"hitrate:" << rate * 100 << L"% queries:" << result.queries / steps << L" nodes:" << result.nodes / steps
+        << L" saved:" << saved / steps << L" " << result.uncachedMs << L"/" << result.cachedMs << L"ms";
+    return out.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Contact queries: the same scene with per-masspoint and batched traversals
+//--------------------------------------------------------------------------------------
+CONTACTQUERYRESULT benchmarkContactQueries(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps){
+
+    CONTACTQUERYRESULT r;
+    memset(&r, 0, sizeof(CONTACTQUERYRESULT));
+    if (objects.empty() || steps == 0)
+        return r;
+
+    CB_CS cb = benchmarkConstants(objects, timestepConstant);
+    MassVector snapshot[2][2];
+    std::vector<PARTICLE> particles;
+    for (int batched = 0; batched <= 1; batched++){
+        CPUSimulation sim;
+        sim.setBatchedQueries(batched != 0);
+        sim.load(objects);
+
+        double nodes = 0.0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint s = 0; s < steps; s++){
+            sim.step(cb);
+            uint queries, fetched;
+            sim.contactQueryStats(queries, fetched);
+            r.queries += batched ? 0 : queries;
+            nodes += fetched;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        (batched ? r.packetMs : r.pointMs) = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+        (batched ? r.packetNodes : r.pointNodes) = nodes;
+        sim.exportSnapshot(snapshot[batched][0], snapshot[batched][1], particles);
+    }
+
+    r.identical = true;
+    for (uint cube = 0; cube < 2; cube++){
+        for (uint i = 0; i < snapshot[0][cube].size() && r.identical; i++)
+            r.identical = memcmp(&snapshot[0][cube][i].newpos, &snapshot[1][cube][i].newpos, sizeof(XMFLOAT4)) == 0;
+    }
+    r.steps = steps;
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: counters per step and per query
+//--------------------------------------------------------------------------------------
+std::wstring formatContactQueries(const CONTACTQUERYRESULT& result){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(2);
+    double steps = std::max(1u, result.steps);
+    double queries = std::max(1.0, result.queries);
+    out << L"queries:" << result.queries / steps << L" nodes/query:" << result.pointNodes / queries << L"/" << result.packetNodes / queries
+        << L" us/query:" << result.pointMs * 1000 * steps / queries << L"/" << result.packetMs * 1000 * steps / queries
+        << L" " << result.pointMs << L"/" << result.packetMs << L"ms" << (result.identical ? L"" : L" (forces differ)");
+    return out.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Import: best of the repeated parses, one thread and every thread
+//--------------------------------------------------------------------------------------
+IMPORTRESULT benchmarkImport(const std::string& file, uint repeats){
+
+    IMPORTRESULT r;
+    memset(&r, 0, sizeof(IMPORTRESULT));
+    if (repeats == 0)
+        return r;
+
+    ThreadPool serial(1), parallel;
+    r.threads = parallel.size();
+    r.serialMs = r.parallelMs = DBL_MAX;
+    for (uint i = 0; i < repeats; i++){
+        OBJMESH mesh = OBJParser::parse(file, &serial);
+        r.serialMs = std::min(r.serialMs, mesh.ms);
+        mesh = OBJParser::parse(file, &parallel);
+        r.parallelMs = std::min(r.parallelMs, mesh.ms);
+        r.bytes = mesh.bytes;
+        r.vertices = mesh.positions.size() / 3;
+        r.triangles = mesh.indices.size() / 3;
+    }
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: file, best times and MB/s
+//--------------------------------------------------------------------------------------
+std::wstring formatImport(const IMPORTRESULT& result){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(1);
+    double mb = result.bytes / (1024.0 * 1024.0);
+    out << L"file:" << mb << L"MB vertices:" << result.vertices << L" triangles:" << result.triangles
+        << L" 1:" << result.serialMs << L"ms(" << mb / std::max(1e-6, result.serialMs / 1000) << L"MB/s)"
+        << L" " << result.threads << L":" << result.parallelMs << L"ms(" << mb / std::max(1e-6, result.parallelMs / 1000) << L"MB/s)";
+    return out.str();
+}
+
+// same masscubes, springs and collision tree
+static bool sameBuild(const DeformableBase& a, const DeformableBase& b){
+    return a.masscube1.size() == b.masscube1.size() && a.masscube2.size() == b.masscube2.size() &&
+        a.ctree.size() == b.ctree.size() && a.indexcube.size() == b.indexcube.size() && a.springs.targets == b.springs.targets &&
+        memcmp(a.masscube1.data(), b.masscube1.data(), a.masscube1.size() * sizeof(MASSPOINT)) == 0 &&
+        memcmp(a.masscube2.data(), b.masscube2.data(), a.masscube2.size() * sizeof(MASSPOINT)) == 0 &&
+        memcmp(a.indexcube.data(), b.indexcube.data(), a.indexcube.size() * sizeof(INDEXER)) == 0 &&
+        memcmp(a.ctree.data(), b.ctree.data(), a.ctree.size() * sizeof(BVBOX)) == 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Spawn: best of the repeated builds, serial, parallel and from the cache
+//--------------------------------------------------------------------------------------
+SPAWNRESULT benchmarkSpawn(const std::string& file, uint repeats){
+
+    SPAWNRESULT r;
+    memset(&r, 0, sizeof(SPAWNRESULT));
+    if (repeats == 0)
+        return r;
+
+    // the cache file (DFM_CACHE_DIR) is written by the first build
+    ThreadPool serial(1), pool;
+    DeformableOBJ first(file, 0);
+    first.enableCache();
+    first.build(&serial);
+    r.threads = pool.size();
+    r.buildMs = r.parallelMs = r.cachedMs = DBL_MAX;
+    r.identical = true;
+    for (uint i = 0; i < repeats; i++){
+        DeformableOBJ full(file, 0), parallel(file, 0), cached(file, 0);
+        cached.enableCache();
+        auto start = std::chrono::high_resolution_clock::now();
+        full.build(&serial);
+        auto middle = std::chrono::high_resolution_clock::now();
+        parallel.build(&pool);
+        auto middle2 = std::chrono::high_resolution_clock::now();
+        cached.build(&serial);
+        auto end = std::chrono::high_resolution_clock::now();
+        r.buildMs = std::min(r.buildMs, std::chrono::duration<double, std::milli>(middle - start).count());
+        r.parallelMs = std::min(r.parallelMs, std::chrono::duration<double, std::milli>(middle2 - middle).count());
+        r.cachedMs = std::min(r.cachedMs, std::chrono::duration<double, std::milli>(end - middle2).count());
+
+        r.cached = cached.vertices.empty();
+        r.identical = r.identical && sameBuild(full, parallel) && sameBuild(full, cached);
+        r.masspoints = full.masscube1.size() + full.masscube2.size();
+        r.springs = full.springs.springCount();
+    }
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: sizes, best times
+//--------------------------------------------------------------------------------------
+std::wstring formatSpawn(const SPAWNRESULT& result){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << L"masspoints:" << result.masspoints << L" springs:" << result.springs << L" build 1:" << result.buildMs << L"ms "
+        << result.threads << L":" << result.parallelMs << L"ms(" << result.buildMs / std::max(1e-6, result.parallelMs) << L"x)";
+    if (result.cached)
+        out << L" cached:" << result.cachedMs << L"ms(" << result.buildMs / std::max(1e-6, result.cachedMs) << L"x)";
+    else
+        out << L" (cache file not written)";
+    out << (result.identical ? L"" : L" (data differs)");
+    return out.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Trees: memory of both layouts, the same scene stepped with each
+//--------------------------------------------------------------------------------------
+TREERESULT benchmarkTrees(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps){
+
+    TREERESULT r;
+    memset(&r, 0, sizeof(TREERESULT));
+    if (objects.empty() || steps == 0)
+        return r;
+
+    // converted trees: graph IDs do not matter for the size, every object starts at 0
+    WideBVH converted;
+    for (const std::unique_ptr<DeformableBase>& object : objects){
+        r.binaryBytes += object->ctree.size() * sizeof(BVBOX);
+        converted.convert(object->ctree, 0, 0);
+    }
+    r.convertedBytes = converted.bytes();
+
+    CB_CS cb = benchmarkConstants(objects, timestepConstant);
+    const CPUSimulation::CollisionMode modes[2] = { CPUSimulation::COLLISION_BVH, CPUSimulation::COLLISION_WIDE };
+    for (CPUSimulation::CollisionMode mode : modes){
+        CPUSimulation sim;
+        sim.setCollisionMode(mode);
+        sim.load(objects);
+        r.wideBytes = sim.wideTreeBytes();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint s = 0; s < steps; s++)
+            sim.step(cb);
+        auto end = std::chrono::high_resolution_clock::now();
+        (mode == CPUSimulation::COLLISION_WIDE ? r.wideMs : r.bvhMs) = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+    }
+    for (const std::unique_ptr<DeformableBase>& object : objects){
+        for (const BVBOX& node : object->ctree)
+            r.masspoints += (node.leftType == 1 || node.leftType == 2) + (node.rightType == 1 || node.rightType == 2);
+    }
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: memory of every layout, step times
+//--------------------------------------------------------------------------------------
+std::wstring formatTrees(const TREERESULT& result){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(1);
+    double binary = std::max<size_t>(1, result.binaryBytes);
+    out << L"masspoints:" << result.masspoints << L" binary:" << result.binaryBytes / 1024.0 << L"KB"
+        << L" wide:" << result.wideBytes / 1024.0 << L"KB(" << result.wideBytes * 100 / binary << L"%)"
+        << L" converted:" << result.convertedBytes / 1024.0 << L"KB(" << result.convertedBytes * 100 / binary << L"%)"
+        << std::setprecision(2) << L" " << result.bvhMs << L"/" << result.wideMs << L"ms";
+    return out.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Stages: stage times of the CPU solver, averaged over the steps
+//--------------------------------------------------------------------------------------
+STEPTIMES benchmarkStages(std::vector<std::unique_ptr<DeformableBase>>& objects, uint steps, bool selfCollision){
+
+    STEPTIMES r;
+    memset(&r, 0, sizeof(STEPTIMES));
+    if (objects.empty() || steps == 0)
+        return r;
+
+    CB_CS cb = benchmarkConstants(objects, timestepConstant);
+    CPUSimulation sim;
+    sim.setSelfCollision(selfCollision);
+    sim.load(objects);
+
+    for (uint s = 0; s < steps; s++){
+        sim.step(cb);
+        const STEPTIMES& t = sim.stepTimes();
+        r.hash += t.hash / steps;
+        r.selfCollision += t.selfCollision / steps;
+        r.masscubes += t.masscubes / steps;
+        r.solver += t.solver / steps;
+        r.particles += t.particles / steps;
+        r.trees += t.trees / steps;
+    }
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: one item per stage
+//--------------------------------------------------------------------------------------
+std::wstring formatStages(const STEPTIMES& times){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << L"hash:" << times.hash << L" self:" << times.selfCollision << L" queries:" << times.queries << L" masscubes:" << times.masscubes
+        << L" solver:" << times.solver << L" particles:" << times.particles << L" trees:" << times.trees << L"ms";
+    return out.str();
+}
+
+//--------------------------------------------------------------------------------------
+// Collision: same scene stepped with collision trees and with the hash grid
+//--------------------------------------------------------------------------------------
+std::vector<COLLISIONRESULT> benchmarkCollision(const DeformableOBJ& prototype, uint maxObjects, uint steps){
+
+    std::vector<COLLISIONRESULT> results;
+    if (prototype.ctree.empty() || steps == 0)
+        return results;
+
+    // object width from the root of its collision tree
+    const BVBOX& root = prototype.ctree[0];
+    float width = std::max(root.maxX - root.minX, std::max(root.maxY - root.minY, root.maxZ - root.minZ));
+    const float spacings[3] = { 0.75f, 1.0f, 1.5f };
+
+    for (uint count = 2; count <= std::max(2u, maxObjects); count *= 2){
+        for (float spacing : spacings){
+            // copies on a cubic grid, side^3 >= count
+            uint side = 1;
+            while (side * side * side < count)
+                side++;
+            int step = (int)(width * spacing);
+            std::vector<std::unique_ptr<DeformableBase>> objects;
+            for (uint i = 0; i < count; i++){
+                objects.push_back(std::unique_ptr<DeformableBase>(new DeformableOBJ(prototype)));
+                objects[i]->translate((i % side) * step, (i / side % side) * step, (i / (side * side)) * step);
+            }
+
+            CB_CS cb = benchmarkConstants(objects, timestepConstant);
+            double ms[2];
+            for (int mode = CPUSimulation::COLLISION_BVH; mode <= CPUSimulation::COLLISION_HASH; mode++){
+                CPUSimulation sim;
+                sim.setCollisionMode((CPUSimulation::CollisionMode)mode);
+                sim.load(objects);
+                auto start = std::chrono::high_resolution_clock::now();
+                for (uint s = 0; s < steps; s++)
+                    sim.step(cb);
+                auto end = std::chrono::high_resolution_clock::now();
+                ms[mode] = std::chrono::duration<double, std::milli>(end - start).count() / steps;
+            }
+
+            COLLISIONRESULT r;
+            r.objects = count;
+            r.spacing = spacing;
+            r.bvhMs = ms[CPUSimulation::COLLISION_BVH];
+            r.hashMs = ms[CPUSimulation::COLLISION_HASH];
+            results.push_back(r);
+        }
+    }
+    return results;
+}
+
+//--------------------------------------------------------------------------------------
+// Format: one item per object count and spacing
+//--------------------------------------------------------------------------------------
+std::wstring formatCollision(const std::vector<COLLISIONRESULT>& results){
+
+    std::wstringstream out;
+    out << std::fixed << std::setprecision(2);
+    for (uint i = 0; i < results.size(); i++){
+        const COLLISIONRESULT& r = results[i];
+        if (i > 0)
+            out << L" ";
+        out << r.objects << L"@" << r.spacing << L":" << r.bvhMs << L"/" << r.hashMs << L"ms"
+            << (r.hashMs < r.bvhMs ? L"(hash)" : L"(bvh)");
+    }
+    return out.str();
+}
@@ -0,0 +1,128 @@
+//--------------------------------------------------------------------------------------
+// File: BroadPhase.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Sweep-and-prune broad phase of the CPU solver (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "../Headers/BroadPhase.h"
+
+
+// endpoint order: value, then min before max (touching boxes overlap, as in between())
+static inline bool before(float av, uint ac, float bv, uint bc){
+    return av < bv || (av == bv && (ac & 1) < (bc & 1));
+}
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+BroadPhase::BroadPhase(){
+    reset(0);
+}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+BroadPhase::~BroadPhase(){}
+
+//--------------------------------------------------------------------------------------
+// Reset: endpoints of n objects, every pair is a candidate
+//--------------------------------------------------------------------------------------
+void BroadPhase::reset(uint objectCount){
+
+    endpoints.resize(objectCount * 2);
+    for (uint i = 0; i < objectCount * 2; i++)
+        endpoints[i] = ENDPOINT{ 0.0f, i };
+    boxMin.assign(objectCount, XMFLOAT3(0, 0, 0));
+    boxMax.assign(objectCount, XMFLOAT3(0, 0, 0));
+
+    pairOffsets.assign(objectCount + 1, 0);
+    pairObjects.clear();
+    for (uint o = 0; o < objectCount; o++){
+        for (uint k = 0; k < objectCount; k++){
+            if (k != o)
+                pairObjects.push_back(k);
+        }
+        pairOffsets[o + 1] = pairObjects.size();
+    }
+
+    counters.objects = objectCount;
+    counters.pairs = objectCount > 0 ? objectCount * (objectCount - 1) / 2 : 0;
+    counters.candidates = counters.pairs;
+    counters.pruned = 0;
+    counters.swaps = 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Update: insertion sort of the endpoints, sweep along x, pairs per object
+//--------------------------------------------------------------------------------------
+void BroadPhase::update(const XMFLOAT3* minCorner, const XMFLOAT3* maxCorner){
+
+    uint n = boxMin.size();
+    std::copy(minCorner, minCorner + n, boxMin.begin());
+    std::copy(maxCorner, maxCorner + n, boxMax.begin());
+
+    // new values, then sort (coherent in time: few swaps)
+    counters.swaps = 0;
+    for (ENDPOINT& e : endpoints)
+        e.value = (e.code & 1) ? boxMax[e.code >> 1].x : boxMin[e.code >> 1].x;
+    for (uint i = 1; i < endpoints.size(); i++){
+        ENDPOINT e = endpoints[i];
+        uint j = i;
+        while (j > 0 && before(e.value, e.code, endpoints[j - 1].value, endpoints[j - 1].code)){
+            endpoints[j] = endpoints[j - 1];
+            j--;
+            counters.swaps++;
+        }
+        endpoints[j] = e;
+    }
+
+    // sweep: an opening box is tested against the open ones in y and z
+    open.clear();
+    pairA.clear();
+    pairB.clear();
+    for (const ENDPOINT& e : endpoints){
+        uint o = e.code >> 1;
+        // (NaN bounds of a blown up object do not sort, its max may come first)
+        if (e.code & 1){
+            auto it = std::find(open.begin(), open.end(), o);
+            if (it != open.end())
+                open.erase(it);
+            continue;
+        }
+        for (uint k : open){
+            if (boxMin[o].y <= boxMax[k].y && boxMin[k].y <= boxMax[o].y &&
+                boxMin[o].z <= boxMax[k].z && boxMin[k].z <= boxMax[o].z){
+                pairA.push_back(std::min(o, k));
+                pairB.push_back(std::max(o, k));
+            }
+        }
+        open.push_back(o);
+    }
+
+    // both directions, increasing object order per object
+    pairOffsets.assign(n + 1, 0);
+    for (uint p = 0; p < pairA.size(); p++){
+        pairOffsets[pairA[p] + 1]++;
+        pairOffsets[pairB[p] + 1]++;
+    }
+    for (uint o = 0; o < n; o++)
+        pairOffsets[o + 1] += pairOffsets[o];
+    pairObjects.resize(pairOffsets[n]);
+    fill.assign(pairOffsets.begin(), pairOffsets.end() - 1);
+    for (uint p = 0; p < pairA.size(); p++){
+        pairObjects[fill[pairA[p]]++] = pairB[p];
+        pairObjects[fill[pairB[p]]++] = pairA[p];
+    }
+    for (uint o = 0; o < n; o++)
+        std::sort(pairObjects.begin() + pairOffsets[o], pairObjects.begin() + pairOffsets[o + 1]);
+
+    counters.candidates = pairA.size();
+    counters.pruned = counters.pairs - counters.candidates;
+}
@@ -0,0 +1,1021 @@
+//--------------------------------------------------------------------------------------
+// File: CPUSimulation.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Portable CPU simulation backend (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include "../Headers/CPUSimulation.h"
+#include "../Headers/Constants.h"
+#include "../Headers/Collision.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Vector helpers (float3 arithmetic of the shaders)
+//--------------------------------------------------------------------------------------
+static inline XMFLOAT3 sub3(const XMFLOAT3& a, const XMFLOAT3& b){
+    return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+// position of masspoint i at t
+static inline XMFLOAT3 newpos(const MASSVIEW& v, uint i){
+    return XMFLOAT3(v.newX[i], v.newY[i], v.newZ[i]);
+}
+
+static inline void addTo3(XMFLOAT3& a, const XMFLOAT3& b){
+    a.x += b.x; a.y += b.y; a.z += b.z;
+}
+
+static inline float length3(const XMFLOAT3& a){
+    return sqrtf(a.x * a.x + a.y * a.y + a.z * a.z);
+}
+
+// x is between a and b values
+static inline bool between(float x, float a, float b){
+    return (a <= x) && (x <= b);
+}
+
+// point is inside the bounding box
+static inline bool inside(const XMFLOAT3& p, const BVBOX& box){
+    return between(p.x, box.minX, box.maxX) && between(p.y, box.minY, box.maxY) && between(p.z, box.minZ, box.maxZ);
+}
+
+// box of the segment lo-hi (component-wise sorted) overlaps the bounding box
+static inline bool overlaps(const XMFLOAT3& lo, const XMFLOAT3& hi, const BVBOX& box){
+    return lo.x <= box.maxX && box.minX <= hi.x && lo.y <= box.maxY && box.minY <= hi.y && lo.z <= box.maxZ && box.minZ <= hi.z;
+}
+
+// milliseconds since start, start moved to now
+static inline double lap(std::chrono::high_resolution_clock::time_point& start){
+    auto now = std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - start).count();
+    start = now;
+    return ms;
+}
+
+// index of the lowest set bit of m (m != 0)
+static inline uint ctz(uint m){
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, m);
+    return (uint)i;
+#else
+    return (uint)__builtin_ctz(m);
+#endif
+}
+
+// speculative contact of two points moving from cpos to cnext and from xpos to xnext: an out of
+// range pair that would get within range during the step loses the part of its approach that
+// crosses the range, half each (pairs in range or staying out of it repel as in collide())
+static inline XMFLOAT3 collideSwept(const XMFLOAT3& cpos, const XMFLOAT3& cnext, const XMFLOAT3& xpos, const XMFLOAT3& xnext, float collisionRange, float dt,
+                                    bool& speculative){
+
+    speculative = false;
+    XMFLOAT3 d = sub3(cpos, xpos);
+    float dist = length3(d);
+    if (dist < collisionRange)
+        return collide(cpos, xpos, collisionRange);
+
+    // relative displacement, closest approach at t in [0, 1], approach along the current direction
+    XMFLOAT3 m = sub3(sub3(cnext, cpos), sub3(xnext, xpos));
+    float dm = d.x * m.x + d.y * m.y + d.z * m.z;
+    float mm = m.x * m.x + m.y * m.y + m.z * m.z;
+    float t = mm > 0.0f ? std::min(1.0f, std::max(0.0f, -dm / mm)) : 0.0f;
+    float closest = length3(XMFLOAT3(d.x + t * m.x, d.y + t * m.y, d.z + t * m.z));
+    float approach = -dm / dist;
+    if (closest >= collisionRange || approach <= dist - collisionRange)
+        return collide(cpos, xpos, collisionRange);
+
+    // bounded by the approach itself, not by EXP_MAX (fast pairs need more than EXP_MAX * dt^2)
+    speculative = true;
+    float w = 0.5f * (approach - (dist - collisionRange)) / (dt * dt) / dist;
+    return XMFLOAT3(d.x * w, d.y * w, d.z * w);
+}
+
+// contact of the query at cpos (moving to cnext) with masspoint i of v: the force of collide(),
+// or with swept boxes the one of collideSwept(), only the largest speculative push is kept in spec
+static inline XMFLOAT3 pairForce(const XMFLOAT3& cpos, const XMFLOAT3& cnext, const MASSVIEW& v, uint i, bool swept, const CB_CS& cb,
+                                 XMFLOAT3& spec, float& specSq){
+
+    if (!swept)
+        return collide(cpos, newpos(v, i), cb.collisionRange);
+    XMFLOAT3 xnext(2 * v.newX[i] - v.oldX[i], 2 * v.newY[i] - v.oldY[i], 2 * v.newZ[i] - v.oldZ[i]);
+    bool speculative;
+    XMFLOAT3 f = collideSwept(cpos, cnext, newpos(v, i), xnext, cb.collisionRange, cb.dt, speculative);
+    if (!speculative)
+        return f;
+    float sq = f.x * f.x + f.y * f.y + f.z * f.z;
+    if (sq > specSq){
+        spec = f;
+        specSq = sq;
+    }
+    return XMFLOAT3(0, 0, 0);
+}
+
+// constant offset from start + l to the neighbour of lane l (lattice index target + l) over the
+// lanes of a run that have the neighbour bit, false if it changes along the run
+static bool rowOffset(const MASK* masks, uint base, uint count, MASK bit, const int* remap, uint offset, int target, int start, int& result){
+
+    bool found = false;
+    result = 0;
+    for (uint l = 0; l < count; l++){
+        if (!(masks[base + l] & bit))
+            continue;
+        int d = (int)offset + remap[target + (int)l] - (start + (int)l);
+        if (found && d != result)
+            return false;
+        result = d;
+        found = true;
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+CPUSimulation::CPUSimulation(uint threads) : objectCount(0), mass1Count(0), integrator(INTEGRATOR_VERLET), pool(threads), collisionMode(COLLISION_BVH), continuous(false), caching(false), selfCollision(false), selfCells(2), batching(false) {
+
+    memset(&times, 0, sizeof(STEPTIMES));
+
+    // SIMD rows are the fastest where the wide paths exist, otherwise every spring
+    // is evaluated once along its edge (half of the scalar work)
+    springMode = kernel.isa() == SpringKernel::ISA_SCALAR ? SPRINGS_EDGE : SPRINGS_ROWS;
+}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+CPUSimulation::~CPUSimulation(){}
+
+//--------------------------------------------------------------------------------------
+// Load: gather the objects' data into scene-wide buffers (like initBuffers)
+//--------------------------------------------------------------------------------------
+void CPUSimulation::load(std::vector<std::unique_ptr<DeformableBase>>& objects){
+
+    objectCount = objects.size();
+    masspoints.clear();
+    springs.clear();
+    particles.clear();
+    indexer.clear();
+    bvhdesc.clear();
+    bvhdata.clear();
+    remap.clear();
+    rows.clear();
+    slabs.clear();
+
+    uint mass2Count = 0;
+    for (uint i = 0; i < objectCount; i++){
+        uint cw = objects[i]->cubeWidth;
+        uint first = masspoints.size();
+        masspoints.append(objects[i]->masscube1);
+        masspoints.setSecondNeighbours(cw, first, objects[i]->remap1);
+        particles.insert(particles.end(), objects[i]->particles.begin(), objects[i]->particles.end());
+        for (const INDEXER& idx : objects[i]->indexcube){
+            indexer.push_back(idx);
+            indexer.back().object = i;
+        }
+
+        // tree descriptor and lattice, same as the GPU catalogue
+        BVHDESC desc;
+        desc.arrayOffset = bvhdata.size();
+        desc.masspointCount = objects[i]->ctree.size();
+        desc.minX = objects[i]->ctree[0].minX;
+        desc.maxX = objects[i]->ctree[0].maxX;
+        desc.minY = objects[i]->ctree[0].minY;
+        desc.maxY = objects[i]->ctree[0].maxY;
+        desc.minZ = objects[i]->ctree[0].minZ;
+        desc.maxZ = objects[i]->ctree[0].maxZ;
+        desc.cubeWidth = cw;
+        desc.cubeCellSize = objects[i]->cubeCellSize;
+        desc.mass1Offset = first;
+        desc.mass2Offset = mass2Count;
+        desc.mass1Count = objects[i]->masscube1.size();
+        desc.mass2Count = objects[i]->masscube2.size();
+        desc.remapOffset = remap.size();
+        bvhdesc.push_back(desc);
+        bvhdata.insert(bvhdata.end(), objects[i]->ctree.begin(), objects[i]->ctree.end());
+        remap.insert(remap.end(), objects[i]->remap1.begin(), objects[i]->remap1.end());
+        remap.insert(remap.end(), objects[i]->remap2.begin(), objects[i]->remap2.end());
+        mass2Count += desc.mass2Count;
+    }
+    mass1Count = masspoints.size();
+    for (uint i = 0; i < objectCount; i++){
+        masspoints.append(objects[i]->masscube2);
+        masspoints.setSecondNeighbours(bvhdesc[i].cubeWidth + 1, mass1Count + bvhdesc[i].mass2Offset, objects[i]->remap2);
+    }
+    refit.build(bvhdesc.data(), objectCount);
+
+    // indexer corners through the remap tables, in the order of the indexer weights
+    corners.resize(indexer.size() * 16);
+    for (uint i = 0; i < indexer.size(); i++){
+        const INDEXER& idx = indexer[i];
+        const BVHDESC& desc = bvhdesc[idx.object];
+        uint cw = desc.cubeWidth;
+        uint w = cw + 1;
+        const int* remap1 = &remap[desc.remapOffset];
+        const int* remap2 = remap1 + cw*cw*cw;
+        uint ind1 = (uint)idx.vc1index.z*cw*cw + (uint)idx.vc1index.y*cw + (uint)idx.vc1index.x;
+        uint ind2 = (uint)idx.vc2index.z*w*w + (uint)idx.vc2index.y*w + (uint)idx.vc2index.x;
+        const uint off1[8] = { 0, 1, cw, cw + 1, cw*cw, cw*cw + 1, cw*cw + cw, cw*cw + cw + 1 };
+        const uint off2[8] = { 0, 1, w, w + 1, w*w, w*w + 1, w*w + w, w*w + w + 1 };
+        for (uint k = 0; k < 8; k++){
+            corners[i * 16 + k] = desc.mass1Offset + remap1[ind1 + off1[k]];
+            corners[i * 16 + 8 + k] = desc.mass2Offset + remap2[ind2 + off2[k]];
+        }
+    }
+    updateViews();
+
+    // tasks of an object: runs in slabs of CPU_SLAB_DEPTH z-slices of masscube1, then of masscube2
+    for (uint i = 0; i < objectCount; i++){
+        for (uint cube = 1; cube <= 2; cube++){
+            int w = bvhdesc[i].cubeWidth + (cube - 1);
+            for (int z0 = 0; z0 < w; z0 += CPU_SLAB_DEPTH){
+                SLABTASK task;
+                task.row0 = rows.size();
+                for (int z = z0; z < std::min(w, z0 + CPU_SLAB_DEPTH); z++)
+                    buildRows(i, cube, z);
+                task.row1 = rows.size();
+                if (task.row1 > task.row0)
+                    slabs.push_back(task);
+            }
+        }
+    }
+
+    // spring lists of the objects in store order, local IDs mapped to global ones
+    for (uint i = 0; i < objectCount; i++)
+        springs.appendRows(objects[i]->springs, 0, objects[i]->masscube1.size(), objects[i]->masscube1.size(),
+                           bvhdesc[i].mass1Offset, mass1Count + bvhdesc[i].mass2Offset);
+    for (uint i = 0; i < objectCount; i++)
+        springs.appendRows(objects[i]->springs, objects[i]->masscube1.size(), objects[i]->masscube2.size(), objects[i]->masscube1.size(),
+                           bvhdesc[i].mass1Offset, mass1Count + bvhdesc[i].mass2Offset);
+    springs.buildEdges();
+
+    // rest length of every edge from the cell size of its object
+    std::vector<uint> owner(masspoints.size());
+    for (uint i = 0; i < objectCount; i++){
+        std::fill(owner.begin() + bvhdesc[i].mass1Offset, owner.begin() + bvhdesc[i].mass1Offset + objects[i]->masscube1.size(), i);
+        std::fill(owner.begin() + mass1Count + bvhdesc[i].mass2Offset,
+                  owner.begin() + mass1Count + bvhdesc[i].mass2Offset + objects[i]->masscube2.size(), i);
+    }
+    edgeRest.resize(springs.edgeCount());
+    for (uint e = 0; e < springs.edgeCount(); e++){
+        float cell = (float)bvhdesc[owner[springs.edgeA[e]]].cubeCellSize;
+        const float len[3] = { cell, cell * 0.5f * sqrtf(3.0f), cell * 2 };
+        edgeRest[e] = len[springs.edgeClass[e]];
+    }
+    edgeX.assign(springs.edgeCount(), 0.0f);
+    edgeY.assign(springs.edgeCount(), 0.0f);
+    edgeZ.assign(springs.edgeCount(), 0.0f);
+
+    implicit.resize(springs);
+    std::vector<uint> iterations(springs.edgeCount());
+    for (uint e = 0; e < springs.edgeCount(); e++)
+        iterations[e] = objects[owner[springs.edgeA[e]]]->solverIterations;
+    xpbd.build(springs, edgeRest.data(), iterations);
+    accel.assign(masspoints.size(), XMFLOAT3(0, 0, 0));
+
+    // surface masspoints: the leaves of the collision trees, the 4-wide trees are built over them
+    std::vector<uint> surface, surfaceObject;
+    wide.clear();
+    for (uint i = 0; i < objectCount; i++){
+        const BVHDESC& desc = bvhdesc[i];
+        BVHLeafVector leafMasspoints;
+        uint leaves = (desc.masspointCount + 1) / 2;
+        for (uint n = leaves - 1; n < 2 * leaves - 1; n++){
+            const BVBOX& node = bvhdata[desc.arrayOffset + n];
+            const int ids[2] = { node.leftID, node.rightID };
+            const int types[2] = { node.leftType, node.rightType };
+            for (uint k = 0; k < 2; k++){
+                if (types[k] == 1 || types[k] == 2){
+                    surface.push_back(types[k] == 1 ? desc.mass1Offset + ids[k] : mass1Count + desc.mass2Offset + ids[k]);
+                    surfaceObject.push_back(i);
+                    const XMFLOAT4& p = types[k] == 1 ? objects[i]->masscube1[ids[k]].newpos : objects[i]->masscube2[ids[k]].newpos;
+                    leafMasspoints.push_back(BVHLEAF{ ids[k], types[k], XMFLOAT3(p.x, p.y, p.z) });
+                }
+            }
+        }
+        wide.build(leafMasspoints, desc.mass1Offset, mass1Count + desc.mass2Offset);
+    }
+    hash.build(surface, surfaceObject);
+
+    // lattice positions in half cells from the remap tables (lattice index -> masscube index)
+    lattice.assign(masspoints.size(), 0);
+    for (uint i = 0; i < objectCount; i++){
+        for (uint cube = 1; cube <= 2; cube++){
+            uint w = bvhdesc[i].cubeWidth + (cube - 1);
+            const std::vector<int>& table = cube == 1 ? objects[i]->remap1 : objects[i]->remap2;
+            uint first = cube == 1 ? bvhdesc[i].mass1Offset : mass1Count + bvhdesc[i].mass2Offset;
+            for (uint l = 0; l < table.size(); l++){
+                if (table[l] < 0)
+                    continue;
+                uint x = l % w, y = l / w % w, z = l / (w * w);
+                uint odd = cube == 1 ? 1 : 0;
+                lattice[first + table[l]] = (2 * x + odd) | (2 * y + odd) << 10 | (2 * z + odd) << 20;
+            }
+        }
+    }
+    selfAccel.assign(masspoints.size(), XMFLOAT3(0, 0, 0));
+
+    // query packets: masspoints of every object along the Morton curve of their lattice positions
+    // (the lattice does not move, neighbours on the curve stay close while the object deforms)
+    queryOrder.clear();
+    packetStart.clear();
+    packetObject.clear();
+    for (uint i = 0; i < objectCount; i++){
+        std::vector<uint> codes, order;
+        auto add = [&](uint first, uint count){
+            for (uint g = first; g < first + count; g++){
+                uint l = lattice[g];
+                codes.push_back(BVHierarchy::morton((l & 0x3FF) / 1024.0f, (l >> 10 & 0x3FF) / 1024.0f, (l >> 20 & 0x3FF) / 1024.0f));
+                order.push_back(g);
+            }
+        };
+        add(bvhdesc[i].mass1Offset, bvhdesc[i].mass1Count);
+        add(mass1Count + bvhdesc[i].mass2Offset, bvhdesc[i].mass2Count);
+        BVHierarchy::radixSort(codes, order);
+        for (uint k = 0; k < order.size(); k += CPU_QUERY_PACKET){
+            packetStart.push_back(queryOrder.size() + k);
+            packetObject.push_back(i);
+        }
+        queryOrder.insert(queryOrder.end(), order.begin(), order.end());
+    }
+    packetStart.push_back(queryOrder.size());
+    packetAccel.assign(masspoints.size(), XMFLOAT3(0, 0, 0));
+    queryNodes.assign(masspoints.size(), 0);
+    // 4-wide trees at the margin of the initial trees
+    wide.refit(view1, collisionRangeConstant, pool);
+    // distance grid of the static colliders
+    if (!colliders.empty() && !colliders.isBaked())
+        colliders.bake(pool, colliderCache);
+
+    broadPhase.reset(objectCount);
+    contacts.resize(masspoints.size(), objectCount);
+    updateBroadPhase();
+}
+
+//--------------------------------------------------------------------------------------
+// Step: masscube update, buffer swap, particle update, collision tree update
+//--------------------------------------------------------------------------------------
+void CPUSimulation::step(const CB_CS& cb){
+
+    // constants of the spring kernel, rest lengths from the cell size of each object
+    objectParams.resize(objectCount);
+    for (uint i = 0; i < objectCount; i++){
+        SPRINGPARAMS& params = objectParams[i];
+        params.stiffness = cb.stiffness;
+        params.damping = cb.damping;
+        params.idt = 1.0f / cb.dt;
+        params.im = cb.im;
+        params.gravityAcc = cb.gravity * cb.im;
+        params.len[0] = (float)bvhdesc[i].cubeCellSize;
+        params.len[1] = (float)bvhdesc[i].cubeCellSize * 0.5f * sqrtf(3.0f);
+        params.len[2] = (float)bvhdesc[i].cubeCellSize * 2;
+    }
+    updateViews();
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // hash grid of the current positions, cells of the collision range
+    if (collisionMode == COLLISION_HASH || selfCollision)
+        hash.update(view1, cb.collisionRange, pool);
+    times.hash = lap(start);
+    if (selfCollision)
+        updateSelfCollision(cb);
+    times.selfCollision = lap(start);
+    if (batched()){
+        uint packets = packetObject.size();
+        pool.parallelFor((packets + CPU_PACKET_BATCH - 1) / CPU_PACKET_BATCH, [&](uint task){
+            uint end = std::min(packets, (task + 1) * CPU_PACKET_BATCH);
+            for (uint p = task * CPU_PACKET_BATCH; p < end; p++)
+                contactPacket(cb, p);
+        });
+    }
+    times.queries = lap(start);
+
+    // edge-parallel springs: every edge once, the masscube tasks gather them
+    // (only the rest lengths differ between objects, they come from edgeRest)
+    if (springMode == SPRINGS_EDGE && integrator != INTEGRATOR_XPBD && objectCount > 0){
+        uint edges = springs.edgeCount();
+        pool.parallelFor((edges + CPU_EDGE_BATCH - 1) / CPU_EDGE_BATCH, [&](uint task){
+            uint first = task * CPU_EDGE_BATCH;
+            SpringKernel::edges(view1, springs, objectParams[0], edgeRest.data(), first, std::min((uint)CPU_EDGE_BATCH, edges - first),
+                                edgeX.data(), edgeY.data(), edgeZ.data());
+        });
+    }
+
+    // first volcube (CSMain1) and second volcube (CSMain2), both read the current state
+    // (implicit: accelerations only, then one linear solve for the whole store)
+    pool.parallelFor(slabs.size(), [&](uint task){
+        stepSlab(cb, slabs[task]);
+    });
+    if (caching)
+        contacts.gather();
+    times.masscubes = lap(start);
+    if (integrator == INTEGRATOR_IMPLICIT && objectCount > 0)
+        implicit.step(view1, springs, objectParams[0], edgeRest.data(), accel, cb.dt, pool);
+    else if (integrator == INTEGRATOR_XPBD && objectCount > 0)
+        xpbd.step(view1, objectParams[0], accel, cb.dt, pool);
+    times.solver = lap(start);
+
+    // t+1 becomes the current state
+    masspoints.advance();
+    updateViews();
+
+    updateParticles();
+    times.particles = lap(start);
+    updateBVH(cb);
+    times.trees = lap(start);
+}
+
+//--------------------------------------------------------------------------------------
+// Views: pointers of the current step, masscube2 starts after every masscube1
+//--------------------------------------------------------------------------------------
+void CPUSimulation::updateViews(){
+
+    view1 = masspoints.view();
+    view2 = masspoints.view(mass1Count);
+}
+
+//--------------------------------------------------------------------------------------
+// Rows: runs of stored masspoints along x, neighbour offsets from the remap tables
+//--------------------------------------------------------------------------------------
+void CPUSimulation::buildRows(uint objnum, uint cube, int z){
+
+    const BVHDESC& desc = bvhdesc[objnum];
+    int cw = desc.cubeWidth;
+    // width of this (n) and of the other (m) masscube
+    int n = cube == 1 ? cw : cw + 1;
+    int m = cube == 1 ? cw + 1 : cw;
+    const int* self = &remap[desc.remapOffset + (cube == 1 ? 0 : cw*cw*cw)];
+    const int* other = &remap[desc.remapOffset + (cube == 1 ? cw*cw*cw : 0)];
+    uint offset = cube == 1 ? desc.mass1Offset : desc.mass2Offset;
+    uint ooffset = cube == 1 ? desc.mass2Offset : desc.mass1Offset;
+    const MASK* masks = cube == 1 ? view1.masks : view2.masks;
+
+    // lattice offsets, in the order of the NB_SAME_* and NB_OTHER_* bits
+    const int same[6] = { -1, 1, -n, n, -n*n, n*n };
+    const int other1[8] = { 0, 1, m, m + 1, m*m, m*m + 1, m*m + m, m*m + m + 1 };
+    const int other2[8] = { -m*m - m - 1, -m*m - m, -m*m - 1, -m*m, -m - 1, -m, -1, 0 };
+    const int* others = cube == 1 ? other1 : other2;
+
+    for (int y = 0; y < n; y++){
+        int x = 0;
+        while (x < n){
+            int l = (z*n + y)*n + x;
+            if (self[l] < 0){
+                x++;
+                continue;
+            }
+            int x1 = x;
+            while (x1 < n && self[l + (x1 - x)] >= 0)
+                x1++;
+
+            SPRINGROW row;
+            row.object = objnum;
+            row.cube = cube;
+            row.base = offset + self[l];
+            row.count = x1 - x;
+            row.uniform = true;
+            // matching lattice index of the first masspoint in the other cube
+            int ol = (z*m + y)*m + x;
+            for (uint k = 0; k < 6; k++){
+                MASK bit = packMasks(NB_SAME_LEFT >> k, 0);
+                row.uniform &= rowOffset(masks, row.base, row.count, bit, self, offset, l + same[k], row.base, row.layout.same[k]);
+                row.uniform &= rowOffset(masks, row.base, row.count, bit << 8, self, offset, l + 2 * same[k], row.base, row.layout.second[k]);
+            }
+            for (uint k = 0; k < 8; k++){
+                MASK bit = packMasks(0, NB_OTHER_NEAR_BOT_LEFT >> k);
+                row.uniform &= rowOffset(masks, row.base, row.count, bit, other, ooffset, ol + others[k], 0, row.layout.other[k]);
+            }
+            rows.push_back(row);
+            x = x1;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Spring forces: accelerations (springs + gravity) of the masspoints of a run
+//--------------------------------------------------------------------------------------
+void CPUSimulation::springForces(const SPRINGPARAMS& params, const SPRINGROW& row, float* ax, float* ay, float* az) const {
+
+    // ID in the spring graph
+    uint first = row.cube == 1 ? row.base : mass1Count + row.base;
+
+    switch (springMode){
+    case SPRINGS_VERTEX:
+        SpringKernel::vertices(view1, springs, params, first, row.count, ax, ay, az);
+        break;
+    case SPRINGS_EDGE:
+        SpringKernel::gather(springs, params, edgeX.data(), edgeY.data(), edgeZ.data(), first, row.count, ax, ay, az);
+        break;
+    default:
+        // other cube offsets are relative to the lane, obase = 0
+        if (!row.uniform)
+            SpringKernel::vertices(view1, springs, params, first, row.count, ax, ay, az);
+        else if (row.cube == 1)
+            kernel.row(view1, view2, row.layout, params, row.base, 0, row.count, ax, ay, az);
+        else
+            kernel.row(view2, view1, row.layout, params, row.base, 0, row.count, ax, ay, az);
+        break;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Collision detection: colliding forces affecting the current masspoint
+//--------------------------------------------------------------------------------------
+XMFLOAT3 CPUSimulation::collisionDetection(const XMFLOAT3& cpos, const XMFLOAT3& cnext, uint id, uint objnum, const CB_CS& cb) const {
+
+    XMFLOAT3 accel(0, 0, 0);
+    const MASSVIEW& ovolcube1 = view1;
+    const MASSVIEW& ovolcube2 = view2;
+
+    // continuous collision: the swept boxes are tested against the whole move of the masspoint
+    bool swept = continuous && collisionMode != COLLISION_HASH;
+    XMFLOAT3 lo(std::min(cpos.x, cnext.x), std::min(cpos.y, cnext.y), std::min(cpos.z, cnext.z));
+    XMFLOAT3 hi(std::max(cpos.x, cnext.x), std::max(cpos.y, cnext.y), std::max(cpos.z, cnext.z));
+    auto touches = [&](const BVBOX& box){
+        return swept ? overlaps(lo, hi, box) : inside(cpos, box);
+    };
+    // speculative contacts would stop the same approach once per neighbour: only the largest is kept
+    XMFLOAT3 spec(0, 0, 0);
+    float specSq = 0.0f;
+    auto hit = [&](const MASSVIEW& v, uint i){
+        return pairForce(cpos, cnext, v, i, swept, cb, spec, specSq);
+    };
+
+    // box of another object contains the masspoint
+    auto reaches = [&](const BVHDESC& colldesc){
+        BVBOX bounds;
+        bounds.minX = colldesc.minX; bounds.maxX = colldesc.maxX;
+        bounds.minY = colldesc.minY; bounds.maxY = colldesc.maxY;
+        bounds.minZ = colldesc.minZ; bounds.maxZ = colldesc.maxZ;
+        return touches(bounds);
+    };
+    // both masspoints of a leaf
+    auto leaf = [&](const BVHDESC& colldesc, const BVBOX& node){
+        if (node.leftType == 1)
+            addTo3(accel, hit(ovolcube1, colldesc.mass1Offset + node.leftID));
+        else if (node.leftType == 2)
+            addTo3(accel, hit(ovolcube2, colldesc.mass2Offset + node.leftID));
+        if (node.rightType == 1)
+            addTo3(accel, hit(ovolcube1, colldesc.mass1Offset + node.rightID));
+        else if (node.rightType == 2)
+            addTo3(accel, hit(ovolcube2, colldesc.mass2Offset + node.rightID));
+    };
+
+    // objects overlapping this one (no self-collision) whose box contains the masspoint
+    const uint* candidates = broadPhase.candidates(objnum);
+    uint boxes = 0;
+    for (uint c = 0; c < broadPhase.candidateCount(objnum); c++){
+        if (!reaches(bvhdesc[candidates[c]]))
+            continue;
+        // hash grid: masspoints of every other object in the 27 cells around cpos, once
+        if (collisionMode == COLLISION_HASH)
+            return hash.query(cpos, objnum, cb.collisionRange);
+        boxes++;
+    }
+    bool cached = caching && collisionMode == COLLISION_BVH;
+    queryNodes[id] = boxes > 0 ? 1 : 0;
+    if (boxes == 0){
+        if (cached)
+            contacts.clear(id);
+        return accel;
+    }
+
+    // 4-wide trees: every masspoint whose box holds the masspoint (swept: overlaps its move)
+    if (collisionMode == COLLISION_WIDE){
+        const XMFLOAT3& qlo = swept ? lo : cpos;
+        const XMFLOAT3& qhi = swept ? hi : cpos;
+        for (uint c = 0; c < broadPhase.candidateCount(objnum); c++){
+            if (reaches(bvhdesc[candidates[c]]))
+                wide.query(candidates[c], qlo, qhi, [&](uint g){ addTo3(accel, hit(ovolcube1, g)); });
+        }
+        addTo3(accel, spec);
+        return accel;
+    }
+
+    // contact cache: the leaves of the last traversal, if they all still contain the masspoint
+    if (cached){
+        uint leafCount;
+        const CONTACTLEAF* last = contacts.lookup(id, objnum, boxes, leafCount);
+        bool valid = last != nullptr;
+        for (uint k = 0; valid && k < leafCount; k++)
+            valid = touches(bvhdata[bvhdesc[last[k].object].arrayOffset + last[k].node]);
+        if (valid){
+            for (uint k = 0; k < leafCount; k++)
+                leaf(bvhdesc[last[k].object], bvhdata[bvhdesc[last[k].object].arrayOffset + last[k].node]);
+            contacts.hit(id);
+            addTo3(accel, spec);
+            return accel;
+        }
+    }
+
+    // leaves reached and nodes visited by the traversal (contact cache)
+    CONTACTLEAF found[CONTACT_CACHE_SLOTS];
+    uint foundCount = 0;
+    uint nodes = 0;
+    for (uint c = 0; c < broadPhase.candidateCount(objnum); c++){
+        uint o = candidates[c];
+        const BVHDESC& colldesc = bvhdesc[o];
+        if (!reaches(colldesc))
+            continue;
+
+        // collision with the other object, compute forces (DFS in collision tree)
+        const BVBOX* tree = &bvhdata[colldesc.arrayOffset];
+        uint stack[32];
+        stack[0] = 0;
+        uint stacks = 1;
+        uint maxlevel = (uint)log2((float)(colldesc.masspointCount + 1));
+
+        while (stacks > 0){
+            stacks--;
+            uint index = stack[stacks];
+            uint level = (uint)log2((float)(index + 1));
+            nodes++;
+
+            // leaf level, bvboxes with two leaf-children
+            if (level == maxlevel - 1){
+                leaf(colldesc, tree[index]);
+                if (foundCount < CONTACT_CACHE_SLOTS)
+                    found[foundCount] = CONTACTLEAF{ o, index };
+                foundCount++;
+            }
+            // node level, check children (right pushed first, left is visited first)
+            else {
+                if (touches(tree[index * 2 + 2])){
+                    stack[stacks] = index * 2 + 2;
+                    stacks++;
+                }
+                if (touches(tree[index * 2 + 1])){
+                    stack[stacks] = index * 2 + 1;
+                    stacks++;
+                }
+            }
+        }
+    }
+    if (cached)
+        contacts.store(id, boxes, found, foundCount, nodes);
+    queryNodes[id] += nodes;
+    addTo3(accel, spec);
+    return accel;
+}
+
+//--------------------------------------------------------------------------------------
+// Contact packet: the queries of a packet traverse each collision tree together, a node
+//                 carries the queries that reached it (same order of leaves per query as
+//                 collisionDetection, so the same sums)
+//--------------------------------------------------------------------------------------
+void CPUSimulation::contactPacket(const CB_CS& cb, uint p){
+
+    const MASSVIEW& ovolcube1 = view1;
+    const MASSVIEW& ovolcube2 = view2;
+    uint first = packetStart[p];
+    uint count = packetStart[p + 1] - first;
+    uint objnum = packetObject[p];
+    bool swept = continuous;
+
+    // queries of the moving masspoints (graph IDs index view1)
+    XMFLOAT3 cpos[CPU_QUERY_PACKET], cnext[CPU_QUERY_PACKET], lo[CPU_QUERY_PACKET], hi[CPU_QUERY_PACKET];
+    XMFLOAT3 accel[CPU_QUERY_PACKET], spec[CPU_QUERY_PACKET];
+    float specSq[CPU_QUERY_PACKET];
+    uint active = 0;
+    for (uint q = 0; q < count; q++){
+        uint g = queryOrder[first + q];
+        queryNodes[g] = 0;
+        if ((view1.masks[g] & 0xFFFF) == 0)
+            continue;
+        cpos[q] = newpos(view1, g);
+        cnext[q] = XMFLOAT3(2 * view1.newX[g] - view1.oldX[g], 2 * view1.newY[g] - view1.oldY[g], 2 * view1.newZ[g] - view1.oldZ[g]);
+        lo[q] = XMFLOAT3(std::min(cpos[q].x, cnext[q].x), std::min(cpos[q].y, cnext[q].y), std::min(cpos[q].z, cnext[q].z));
+        hi[q] = XMFLOAT3(std::max(cpos[q].x, cnext[q].x), std::max(cpos[q].y, cnext[q].y), std::max(cpos[q].z, cnext[q].z));
+        accel[q] = XMFLOAT3(0, 0, 0);
+        spec[q] = XMFLOAT3(0, 0, 0);
+        specSq[q] = 0.0f;
+        active |= 1u << q;
+    }
+
+    // queries of mask whose point (swept: segment) is in the box
+    auto touching = [&](uint mask, const BVBOX& box){
+        uint result = 0;
+        for (uint m = mask; m != 0; m &= m - 1){
+            uint q = ctz(m);
+            if (swept ? overlaps(lo[q], hi[q], box) : inside(cpos[q], box))
+                result |= 1u << q;
+        }
+        return result;
+    };
+    auto hit = [&](uint q, const MASSVIEW& v, uint i){
+        addTo3(accel[q], pairForce(cpos[q], cnext[q], v, i, swept, cb, spec[q], specSq[q]));
+    };
+
+    // objects overlapping this one, every tree once for the whole packet
+    const uint* candidates = broadPhase.candidates(objnum);
+    uint reached = 0;
+    uint nodes = 0;
+    for (uint c = 0; c < broadPhase.candidateCount(objnum); c++){
+        const BVHDESC& colldesc = bvhdesc[candidates[c]];
+        BVBOX bounds;
+        bounds.minX = colldesc.minX; bounds.maxX = colldesc.maxX;
+        bounds.minY = colldesc.minY; bounds.maxY = colldesc.maxY;
+        bounds.minZ = colldesc.minZ; bounds.maxZ = colldesc.maxZ;
+        uint mask = touching(active, bounds);
+        if (mask == 0)
+            continue;
+        reached |= mask;
+
+        // DFS with the queries of every node (right pushed first, left is visited first)
+        const BVBOX* tree = &bvhdata[colldesc.arrayOffset];
+        uint stack[32], stackMask[32];
+        stack[0] = 0;
+        stackMask[0] = mask;
+        uint stacks = 1;
+        uint maxlevel = (uint)log2((float)(colldesc.masspointCount + 1));
+
+        while (stacks > 0){
+            stacks--;
+            uint index = stack[stacks];
+            uint queries = stackMask[stacks];
+            uint level = (uint)log2((float)(index + 1));
+            nodes++;
+
+            // leaf level, both masspoints for every query
+            if (level == maxlevel - 1){
+                const BVBOX& node = tree[index];
+                for (uint m = queries; m != 0; m &= m - 1){
+                    uint q = ctz(m);
+                    if (node.leftType == 1)
+                        hit(q, ovolcube1, colldesc.mass1Offset + node.leftID);
+                    else if (node.leftType == 2)
+                        hit(q, ovolcube2, colldesc.mass2Offset + node.leftID);
+                    if (node.rightType == 1)
+                        hit(q, ovolcube1, colldesc.mass1Offset + node.rightID);
+                    else if (node.rightType == 2)
+                        hit(q, ovolcube2, colldesc.mass2Offset + node.rightID);
+                }
+            }
+            else {
+                uint right = touching(queries, tree[index * 2 + 2]);
+                if (right != 0){
+                    stack[stacks] = index * 2 + 2;
+                    stackMask[stacks] = right;
+                    stacks++;
+                }
+                uint left = touching(queries, tree[index * 2 + 1]);
+                if (left != 0){
+                    stack[stacks] = index * 2 + 1;
+                    stackMask[stacks] = left;
+                    stacks++;
+                }
+            }
+        }
+    }
+
+    for (uint q = 0; q < count; q++){
+        if (!(active & 1u << q))
+            continue;
+        uint g = queryOrder[first + q];
+        addTo3(accel[q], spec[q]);
+        packetAccel[g] = accel[q];
+        if (reached & 1u << q){
+            queryNodes[g] = 1 + nodes;
+            nodes = 0;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Contact query counters: queries that reached a collision tree, nodes fetched
+//--------------------------------------------------------------------------------------
+void CPUSimulation::contactQueryStats(uint& queries, uint& nodes) const {
+
+    queries = 0;
+    nodes = 0;
+    for (uint n : queryNodes){
+        if (n == 0)
+            continue;
+        queries++;
+        nodes += n - 1;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Masscube update: springs of a whole run, then per masspoint
+//                  collision, table and Verlet (CSMain1 / CSMain2),
+//                  or the accelerations of the implicit and XPBD solvers
+//--------------------------------------------------------------------------------------
+void CPUSimulation::stepSlab(const CB_CS& cb, const SLABTASK& task){
+
+    float ax[VCUBEWIDTH_MAX + 1], ay[VCUBEWIDTH_MAX + 1], az[VCUBEWIDTH_MAX + 1];
+    for (uint r = task.row0; r < task.row1; r++){
+        const SPRINGROW& row = rows[r];
+        const SPRINGPARAMS& params = objectParams[row.object];
+        // XPBD: the springs are constraints, gravity is the only force
+        if (integrator == INTEGRATOR_XPBD){
+            std::fill(ax, ax + row.count, 0.0f);
+            std::fill(ay, ay + row.count, params.gravityAcc);
+            std::fill(az, az + row.count, 0.0f);
+        }
+        else
+            springForces(params, row, ax, ay, az);
+
+        // graph IDs, masscube2 after masscube1
+        uint first = row.cube == 1 ? row.base : mass1Count + row.base;
+        if (selfCollision){
+            for (uint x = 0; x < row.count; x++){
+                ax[x] += selfAccel[first + x].x;
+                ay[x] += selfAccel[first + x].y;
+                az[x] += selfAccel[first + x].z;
+            }
+        }
+
+        const MASSVIEW& v = row.cube == 1 ? view1 : view2;
+        if (integrator != INTEGRATOR_VERLET){
+            for (uint x = 0; x < row.count; x++){
+                XMFLOAT3 a(ax[x], ay[x], az[x]);
+                if ((v.masks[row.base + x] & 0xFFFF) != 0)
+                    contactForces(cb, v, row.base + x, first + x, row.object, a);
+                accel[first + x] = a;
+            }
+            continue;
+        }
+        for (uint x = 0; x < row.count; x++)
+            integrate(cb, row.base + x, first + x, row.object, XMFLOAT3(ax[x], ay[x], az[x]), v);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Integrate: collision, table and Verlet step of one masspoint
+//--------------------------------------------------------------------------------------
+void CPUSimulation::integrate(const CB_CS& cb, uint ind, uint id, uint objnum, XMFLOAT3 accel, const MASSVIEW& v) const {
+
+    // old masspoint data
+    XMFLOAT3 cpos = newpos(v, ind);
+
+    // static masspoint, no neighbours
+    if ((v.masks[ind] & 0xFFFF) == 0){
+        v.nextX[ind] = cpos.x;
+        v.nextY[ind] = cpos.y;
+        v.nextZ[ind] = cpos.z;
+        return;
+    }
+
+    contactForces(cb, v, ind, id, objnum, accel);
+
+    // Verlet + Acceleration
+    v.nextX[ind] = cpos.x * 2 - v.oldX[ind] + accel.x * cb.dt * cb.dt;
+    v.nextY[ind] = cpos.y * 2 - v.oldY[ind] + accel.y * cb.dt * cb.dt;
+    v.nextZ[ind] = cpos.z * 2 - v.oldZ[ind] + accel.z * cb.dt * cb.dt;
+}
+
+//--------------------------------------------------------------------------------------
+// Contact forces: collision with the other objects, table, static colliders
+//--------------------------------------------------------------------------------------
+void CPUSimulation::contactForces(const CB_CS& cb, const MASSVIEW& v, uint ind, uint id, uint objnum, XMFLOAT3& accel) const {
+
+    // collision detection, next position extrapolated from the last step
+    XMFLOAT3 cpos = newpos(v, ind);
+    XMFLOAT3 cnext(2 * v.newX[ind] - v.oldX[ind], 2 * v.newY[ind] - v.oldY[ind], 2 * v.newZ[ind] - v.oldZ[ind]);
+    addTo3(accel, batched() ? packetAccel[id] : collisionDetection(cpos, cnext, id, objnum, cb));
+
+    // table
+    if (cpos.y < cb.tablePos)
+        accel.y += std::min(EXP_MAX, 1000.0f * exp2f(fabsf(cpos.y - cb.tablePos)) * EXP_MUL);
+
+    // static colliders
+    if (!colliders.empty())
+        addTo3(accel, colliders.repulsion(cpos));
+}
+
+//--------------------------------------------------------------------------------------
+// Particle update: trilinear interpolation in both masscubes (CSPosUpdate)
+//--------------------------------------------------------------------------------------
+void CPUSimulation::updateParticles(){
+
+    const MASSVIEW& volcube1 = view1;
+    const MASSVIEW& volcube2 = view2;
+
+    // batches of CPU_PARTICLE_BATCH particles
+    uint count = particles.size();
+    pool.parallelFor((count + CPU_PARTICLE_BATCH - 1) / CPU_PARTICLE_BATCH, [&](uint task){
+        uint end = std::min(count, (task + 1) * CPU_PARTICLE_BATCH);
+        for (uint i = task * CPU_PARTICLE_BATCH; i < end; i++){
+            const INDEXER& old = indexer[i];
+            const uint* c = &corners[i * 16];
+
+            XMFLOAT3 pos(0, 0, 0), npos(0, 0, 0);
+            for (uint k = 0; k < 8; k++){
+                XMFLOAT3 p1 = newpos(volcube1, c[k]);
+                XMFLOAT3 p2 = newpos(volcube2, c[k + 8]);
+                pos.x += 0.5f * (old.w1[k] * p1.x + old.w2[k] * p2.x);
+                pos.y += 0.5f * (old.w1[k] * p1.y + old.w2[k] * p2.y);
+                pos.z += 0.5f * (old.w1[k] * p1.z + old.w2[k] * p2.z);
+                npos.x += 0.5f * (old.nw1[k] * p1.x + old.nw2[k] * p2.x);
+                npos.y += 0.5f * (old.nw1[k] * p1.y + old.nw2[k] * p2.y);
+                npos.z += 0.5f * (old.nw1[k] * p1.z + old.nw2[k] * p2.z);
+            }
+            particles[i].pos = XMFLOAT4(pos.x, pos.y, pos.z, particles[i].pos.w);
+            particles[i].npos = XMFLOAT4(npos.x, npos.y, npos.z, particles[i].npos.w);
+        }
+    });
+}
+
+//--------------------------------------------------------------------------------------
+// Collision tree update: level-parallel refit of every tree, then the catalogue (CSBVHRefit, CSBVHUpdate)
+//--------------------------------------------------------------------------------------
+void CPUSimulation::updateBVH(const CB_CS& cb){
+
+    // 4-wide trees: only their roots enter the catalogue, the binary trees are left as they are
+    if (collisionMode == COLLISION_WIDE){
+        wide.refit(view1, cb.collisionRange, pool, continuous);
+        for (uint o = 0; o < objectCount; o++){
+            XMFLOAT3 lo, hi;
+            if (!wide.bounds(o, lo, hi))
+                continue;
+            bvhdesc[o].minX = lo.x; bvhdesc[o].maxX = hi.x;
+            bvhdesc[o].minY = lo.y; bvhdesc[o].maxY = hi.y;
+            bvhdesc[o].minZ = lo.z; bvhdesc[o].maxZ = hi.z;
+        }
+    }
+    else
+        refit.refit(bvhdesc.data(), objectCount, bvhdata.data(), view1, view2, cb.collisionRange, pool,
+                    continuous && collisionMode == COLLISION_BVH);
+    updateBroadPhase();
+}
+
+//--------------------------------------------------------------------------------------
+// Broad phase: box of every object (masspoints and collision tree), sweep and prune
+//--------------------------------------------------------------------------------------
+void CPUSimulation::updateBroadPhase(){
+
+    objectMin.resize(objectCount);
+    objectMax.resize(objectCount);
+    pool.parallelFor(objectCount, [&](uint o){
+        const BVHDESC& desc = bvhdesc[o];
+        XMFLOAT3 lo(desc.minX, desc.minY, desc.minZ), hi(desc.maxX, desc.maxY, desc.maxZ);
+        auto grow = [&](const MASSVIEW& v, uint first, uint count){
+            for (uint i = first; i < first + count; i++){
+                lo = XMFLOAT3(std::min(lo.x, v.newX[i]), std::min(lo.y, v.newY[i]), std::min(lo.z, v.newZ[i]));
+                hi = XMFLOAT3(std::max(hi.x, v.newX[i]), std::max(hi.y, v.newY[i]), std::max(hi.z, v.newZ[i]));
+            }
+        };
+        grow(view1, desc.mass1Offset, desc.mass1Count);
+        grow(view2, desc.mass2Offset, desc.mass2Count);
+        objectMin[o] = lo;
+        objectMax[o] = hi;
+    });
+    broadPhase.update(objectMin.data(), objectMax.data());
+    contacts.update(broadPhase);
+}
+
+//--------------------------------------------------------------------------------------
+// Self-collision: surface masspoints of the same object in the 27 cells around each one,
+//                 lattice neighbours (springs included) skipped
+//--------------------------------------------------------------------------------------
+void CPUSimulation::updateSelfCollision(const CB_CS& cb){
+
+    uint n = hash.size();
+    int reach = 2 * (int)selfCells;
+    pool.parallelFor((n + CPU_HASH_BATCH - 1) / CPU_HASH_BATCH, [&](uint task){
+        uint end = std::min(n, (task + 1) * CPU_HASH_BATCH);
+        for (uint i = task * CPU_HASH_BATCH; i < end; i++){
+            uint g = hash.id(i);
+            uint objnum = hash.object(i);
+            uint cell = lattice[g];
+            XMFLOAT3 a(0, 0, 0);
+            hash.visit(newpos(view1, g), cb.collisionRange, [&](uint id, uint object, const XMFLOAT3& d){
+                if (object != objnum)
+                    return;
+                // lattice distance in half cells, largest axis
+                uint other = lattice[id];
+                int dx = std::abs((int)(cell & 1023) - (int)(other & 1023));
+                int dy = std::abs((int)(cell >> 10 & 1023) - (int)(other >> 10 & 1023));
+                int dz = std::abs((int)(cell >> 20 & 1023) - (int)(other >> 20 & 1023));
+                if (std::max(dx, std::max(dy, dz)) <= reach)
+                    return;
+                addTo3(a, repel(d, cb.collisionRange));
+            });
+            selfAccel[g] = a;
+        }
+    });
+}
+
+//--------------------------------------------------------------------------------------
+// Export snapshot: convert the current state back to AoS
+//--------------------------------------------------------------------------------------
+void CPUSimulation::exportSnapshot(MassVector& masscube1, MassVector& masscube2, std::vector<PARTICLE>& particles){
+
+    masspoints.exportTo(masscube1, 0, mass1Count);
+    masspoints.exportTo(masscube2, mass1Count, masspoints.size() - mass1Count);
+    particles = this->particles;
+}
@@ -11,200 +11,196 @@
 
 #include <algorithm>
 #include <cmath>
-#include <tuple>
 #include "../Headers/Collision.h"
 #include "../Headers/Constants.h"
+#include "../Headers/ThreadPool.h"
 
 
 
 //--------------------------------------------------------------------------------------
-// Constructor: malloc tree memory, build tree, sort tree (<- USE THIS)
+// Morton helpers
 //--------------------------------------------------------------------------------------
-BVHierarchy::BVHierarchy(MassIDTypeVector masspoints){
-
-    // Mass[] -> Mass+ID[]
-    MassIDTypeVector x;
-    uint size = masspoints.size();
-    // extend array to contain power-of-2 number elements
-    uint ext = (uint)std::exp2(std::ceil(std::log2(size))) - size;
-    x.reserve(size + ext);
-    for (uint i = 0; i < size; i++){
-        x.push_back(masspoints[i]);
-    }
-    for (uint i = 0; i < ext; i++){
-        x.push_back(MassIDType(-1, -1, MASSPOINT{}));
-    }
-
-    // sort and structurise input
-    bvh = sort(x, 0);
 
+// spread the lower 10 bits of v to every third bit
+static inline uint expandBits(uint v){
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
 }
 
-
-//--------------------------------------------------------------------------------------
-// Destructor: delete hierarchy tree data
-//--------------------------------------------------------------------------------------
-BVHierarchy::~BVHierarchy(){}
-
-
-//--------------------------------------------------------------------------------------
-// Sort helpers
-//--------------------------------------------------------------------------------------
-bool sortX(MassIDType a, MassIDType b){
-    return (std::get<2>(a)).newpos.x < (std::get<2>(b)).newpos.x;
-}
-
-bool sortY(MassIDType a, MassIDType b){
-    return (std::get<2>(a)).newpos.y < (std::get<2>(b)).newpos.y;
+// box of one or two masspoints, grown by the collision range
+static void leafBox(BVBOX& box, const XMFLOAT3& a, const XMFLOAT3& b){
+    box.minX = std::min(a.x, b.x) - collisionRangeConstant;
+    box.maxX = std::max(a.x, b.x) + collisionRangeConstant;
+    box.minY = std::min(a.y, b.y) - collisionRangeConstant;
+    box.maxY = std::max(a.y, b.y) + collisionRangeConstant;
+    box.minZ = std::min(a.z, b.z) - collisionRangeConstant;
+    box.maxZ = std::max(a.z, b.z) + collisionRangeConstant;
 }
 
-bool sortZ(MassIDType a, MassIDType b){
-    return (std::get<2>(a)).newpos.z < (std::get<2>(b)).newpos.z;
+// dead node: both children are padding
+static inline bool deadNode(const BVBOX& box){
+    return box.leftType == -1 && box.rightType == -1;
 }
 
 
 //--------------------------------------------------------------------------------------
-// Sort: sort masspoint+ID pairs: repeatedly by X-Y-Z coordinates
-//       mode: 0=X, 1=Y, 2=Z (sort)
+// Constructor: Morton order, leaves, internal nodes bottom-up (<- USE THIS)
 //--------------------------------------------------------------------------------------
-BVBoxVector BVHierarchy::sort(MassIDTypeVector masspoints, uint mode){
-
-    // sort 'em!
-
-    // two masspoints -> leaf
-    if (masspoints.size() == 2){
-
-        BVBOX tmp;
-        BVBoxVector ret;
-
-        // two invalid leaves, signal with two '-1's
-        if (std::get<0>(masspoints[0]) == -1 && std::get<0>(masspoints[1]) == -1){
-            tmp.leftType = -1;
-            tmp.rightType = -1;
-        }
-
-        // one valid and one invalid masspoint -> yippie, edge of the 'valid tree'
-        else if (std::get<0>(masspoints[0]) != -1 && std::get<0>(masspoints[1]) == -1){
-            tmp.leftID = std::get<0>(masspoints[0]);
-            tmp.leftType = std::get<1>(masspoints[0]);
-            tmp.rightID = -1;
-            tmp.rightType = -1;         // -1 is for empty leaves
-            tmp.minX = (std::get<2>(masspoints[0])).newpos.x - collisionRangeConstant;
-            tmp.maxX = (std::get<2>(masspoints[0])).newpos.x + collisionRangeConstant;
-            tmp.minY = (std::get<2>(masspoints[0])).newpos.y - collisionRangeConstant;
-            tmp.maxY = (std::get<2>(masspoints[0])).newpos.y + collisionRangeConstant;
-            tmp.minZ = (std::get<2>(masspoints[0])).newpos.z - collisionRangeConstant;
-            tmp.maxZ = (std::get<2>(masspoints[0])).newpos.z + collisionRangeConstant;
-        }
+BVHierarchy::BVHierarchy(const BVHLeafVector& masspoints, ThreadPool* pool){
 
-        // two valid masspoints
-        else if (std::get<0>(masspoints[0]) != -1 && std::get<0>(masspoints[1]) != -1){
-            tmp.leftID = std::get<0>(masspoints[0]);
-            tmp.leftType = std::get<1>(masspoints[0]);
-            tmp.rightID = std::get<0>(masspoints[1]);
-            tmp.rightType = std::get<1>(masspoints[1]);
-            tmp.minX = std::min((std::get<2>(masspoints[0])).newpos.x, (std::get<2>(masspoints[1])).newpos.x) - collisionRangeConstant;
-            tmp.maxX = std::max((std::get<2>(masspoints[0])).newpos.x, (std::get<2>(masspoints[1])).newpos.x) + collisionRangeConstant;
-            tmp.minY = std::min((std::get<2>(masspoints[0])).newpos.y, (std::get<2>(masspoints[1])).newpos.y) - collisionRangeConstant;
-            tmp.maxY = std::max((std::get<2>(masspoints[0])).newpos.y, (std::get<2>(masspoints[1])).newpos.y) + collisionRangeConstant;
-            tmp.minZ = std::min((std::get<2>(masspoints[0])).newpos.z, (std::get<2>(masspoints[1])).newpos.z) - collisionRangeConstant;
-            tmp.maxZ = std::max((std::get<2>(masspoints[0])).newpos.z, (std::get<2>(masspoints[1])).newpos.z) + collisionRangeConstant;
-            
-        }
+    uint count = masspoints.size();
+    if (count == 0)
+        return;
 
-        ret.push_back(tmp);
-        return ret;
+    // bounds of the masspoints, codes in the unit cube (flat boxes get a unit extent)
+    XMFLOAT3 lo = masspoints[0].pos, hi = masspoints[0].pos;
+    for (const BVHLEAF& m : masspoints){
+        lo = XMFLOAT3(std::min(lo.x, m.pos.x), std::min(lo.y, m.pos.y), std::min(lo.z, m.pos.z));
+        hi = XMFLOAT3(std::max(hi.x, m.pos.x), std::max(hi.y, m.pos.y), std::max(hi.z, m.pos.z));
     }
+    XMFLOAT3 scale(hi.x > lo.x ? 1.0f / (hi.x - lo.x) : 1.0f, hi.y > lo.y ? 1.0f / (hi.y - lo.y) : 1.0f, hi.z > lo.z ? 1.0f / (hi.z - lo.z) : 1.0f);
 
-    // three or more masspoints -> sort, divide, recursion
-    else {
-
-        // only sort valid masspoints (no -1 ID)
-        MassIDTypeVector tmp;
-        uint valid = 0;
-        while (valid < masspoints.size() && std::get<0>(masspoints[valid]) != (-1)){
-            valid++;
+    std::vector<uint> codes(count), order(count);
+    for (uint i = 0; i < count; i++){
+        const XMFLOAT3& p = masspoints[i].pos;
+        codes[i] = morton((p.x - lo.x) * scale.x, (p.y - lo.y) * scale.y, (p.z - lo.z) * scale.z);
+        order[i] = i;
+    }
+    radixSort(codes, order, pool);
+
+    // power-of-2 number of masspoints (at least one leaf node), padding at the end
+    uint size = 2;
+    while (size < count)
+        size *= 2;
+    bvh.assign(size - 1, BVBOX());
+
+    // deepest level: masspoints 2i and 2i+1 of the curve
+    uint first = size / 2 - 1;
+    for (uint i = 0; i < size / 2; i++){
+        BVBOX& node = bvh[first + i];
+        uint a = 2 * i, b = 2 * i + 1;
+        if (a >= count){
+            node.leftType = -1;
+            node.rightType = -1;
+            continue;
         }
-
-        // sort vector elements by the appropriate coordinate
-        switch (mode)
-        {
-            case 0: std::sort(masspoints.begin(), masspoints.begin() + valid, sortX); break;
-            case 1: std::sort(masspoints.begin(), masspoints.begin() + valid, sortY); break;
-            case 2: std::sort(masspoints.begin(), masspoints.begin() + valid, sortZ); break;
-            default: break;
+        const BVHLEAF& l = masspoints[order[a]];
+        node.leftID = l.id;
+        node.leftType = l.type;
+        if (b < count){
+            const BVHLEAF& r = masspoints[order[b]];
+            node.rightID = r.id;
+            node.rightType = r.type;
+            leafBox(node, l.pos, r.pos);
         }
-
-        // valid masspoints must stay at the beginning
-        // divide vector and recurse
-        BVBoxVector x, y, xy;
-        int div = (int)std::ceil((float)masspoints.size() / 2);
-        x = sort(MassIDTypeVector(masspoints.begin(), masspoints.begin() + div), (mode + 1) % 3);
-        y = sort(MassIDTypeVector(masspoints.begin() + div, masspoints.end()), (mode + 1) % 3);
-
-        // tmp <- bounding box for each masspoint in masspoints
-        BVBOX tmp2;
-
-        // (check for empty subtrees)
-        if (x.size() != 0){
-            // 0: valid tree node, -1: invalid (dead) tree node
-            tmp2.leftType = (x[0].leftType == -1 && x[0].rightType == -1)? -1 : 0;   
-            tmp2.rightType = (y.size() != 0 && y[0].leftType == -1 && y[0].rightType == -1) ? -1 : 0;
-            tmp2.minX = (y.size() != 0 ? std::min(x[0].minX, y[0].minX) : x[0].minX);
-            tmp2.maxX = (y.size() != 0 ? std::max(x[0].maxX, y[0].maxX) : x[0].maxX);
-            tmp2.minY = (y.size() != 0 ? std::min(x[0].minY, y[0].minY) : x[0].minY);
-            tmp2.maxY = (y.size() != 0 ? std::max(x[0].maxY, y[0].maxY) : x[0].maxY);
-            tmp2.minZ = (y.size() != 0 ? std::min(x[0].minZ, y[0].minZ) : x[0].minZ);
-            tmp2.maxZ = (y.size() != 0 ? std::max(x[0].maxZ, y[0].maxZ) : x[0].maxZ);
+        else {
+            node.rightID = -1;
+            node.rightType = -1;
+            leafBox(node, l.pos, l.pos);
         }
+    }
 
-
-        //if (!(x.size() == 0 && y.size() == 0)){           // only push if node has any children
-            xy.reserve(x.size() + y.size() + 1);
-            // merge two children
-            xy = merge(x, y);                               
-            // vector[] <- {container, leftchildren, rightchildren}
-            xy.insert(xy.begin(), tmp2);                    
-        //}
-
-        return xy;
-
+    // higher levels: union of the children (0: valid child, -1: dead child)
+    for (int i = (int)first - 1; i >= 0; i--){
+        BVBOX& node = bvh[i];
+        const BVBOX& a = bvh[2 * i + 1];
+        const BVBOX& b = bvh[2 * i + 2];
+        node.leftType = deadNode(a) ? -1 : 0;
+        node.rightType = deadNode(b) ? -1 : 0;
+        node.minX = std::min(a.minX, b.minX);
+        node.maxX = std::max(a.maxX, b.maxX);
+        node.minY = std::min(a.minY, b.minY);
+        node.maxY = std::max(a.maxY, b.maxY);
+        node.minZ = std::min(a.minZ, b.minZ);
+        node.maxZ = std::max(a.maxZ, b.maxZ);
     }
 }
 
 
 //--------------------------------------------------------------------------------------
-// Merge: get two binary trees in an array -> merge them -> convert back to array
+// Destructor: delete hierarchy tree data
 //--------------------------------------------------------------------------------------
-BVBoxVector BVHierarchy::merge(BVBoxVector a, BVBoxVector b){
+BVHierarchy::~BVHierarchy(){}
 
-    // two nonempty tree
-    if (a.size() != 0 && b.size() != 0){
 
-        uint level = (uint)std::log2(a.size() + 1);       // num of levels in each tree
+//--------------------------------------------------------------------------------------
+// Morton code: 10 bits per axis, interleaved x-y-z
+//--------------------------------------------------------------------------------------
+uint BVHierarchy::morton(float x, float y, float z){
 
-        BVBoxVector ret;
+    uint ix = (uint)std::min(std::max(x * 1024.0f, 0.0f), 1023.0f);
+    uint iy = (uint)std::min(std::max(y * 1024.0f, 0.0f), 1023.0f);
+    uint iz = (uint)std::min(std::max(z * 1024.0f, 0.0f), 1023.0f);
+    return expandBits(ix) * 4 + expandBits(iy) * 2 + expandBits(iz);
+}
 
-        BVBoxVector::iterator ai = a.begin();
-        BVBoxVector::iterator bi = b.begin();
 
-        for (uint i = 1; i <= level; i++){          // get 2^level elements from the array ('treeize')
-            int inc = (int)std::pow(2, i - 1);
-            ret.insert(ret.end(), ai, ai + inc);
-            ai = ai + inc;
-            ret.insert(ret.end(), bi, bi + inc);
-            bi = bi + inc;
+//--------------------------------------------------------------------------------------
+// Radix sort: LSD, 8 bits per pass; with a pool every thread histograms and scatters
+//             a contiguous chunk (chunks in order, so the sort stays stable)
+//--------------------------------------------------------------------------------------
+void BVHierarchy::radixSort(std::vector<uint>& codes, std::vector<uint>& order, ThreadPool* pool){
+
+    uint count = codes.size();
+    uint chunks = pool ? std::max(1u, std::min(pool->size(), count / 1024)) : 1;
+    uint chunkSize = (count + chunks - 1) / chunks;
+    std::vector<uint> tmpCodes(count), tmpOrder(count);
+    std::vector<uint> histogram(chunks * 256);
+
+    for (uint shift = 0; shift < 32; shift += 8){
+
+        // digits of every chunk
+        std::fill(histogram.begin(), histogram.end(), 0);
+        auto countChunk = [&](uint c){
+            uint* h = &histogram[c * 256];
+            uint end = std::min(count, (c + 1) * chunkSize);
+            for (uint i = c * chunkSize; i < end; i++)
+                h[(codes[i] >> shift) & 0xFF]++;
+        };
+        if (chunks > 1)
+            pool->parallelFor(chunks, countChunk);
+        else
+            countChunk(0);
+
+        // every code has the same digit: nothing to do in this pass
+        bool single = false;
+        for (uint d = 0; d < 256 && !single; d++){
+            uint sum = 0;
+            for (uint c = 0; c < chunks; c++)
+                sum += histogram[c * 256 + d];
+            single = sum == count;
+        }
+        if (single)
+            continue;
+
+        // start of every (digit, chunk) in the output
+        uint offset = 0;
+        for (uint d = 0; d < 256; d++){
+            for (uint c = 0; c < chunks; c++){
+                uint n = histogram[c * 256 + d];
+                histogram[c * 256 + d] = offset;
+                offset += n;
+            }
         }
-        return ret;
-    }
-
-    // one empty tree, must be the right side
-    else if (a.size() != 0 && b.size() == 0){
-        return a;
-    }
 
-    // both trees are empty, return empty array
-    else{
-        return BVBoxVector();
+        auto scatterChunk = [&](uint c){
+            uint* h = &histogram[c * 256];
+            uint end = std::min(count, (c + 1) * chunkSize);
+            for (uint i = c * chunkSize; i < end; i++){
+                uint dst = h[(codes[i] >> shift) & 0xFF]++;
+                tmpCodes[dst] = codes[i];
+                tmpOrder[dst] = order[i];
+            }
+        };
+        if (chunks > 1)
+            pool->parallelFor(chunks, scatterChunk);
+        else
+            scatterChunk(0);
+
+        codes.swap(tmpCodes);
+        order.swap(tmpOrder);
     }
-}
\ No newline at end of file
+}
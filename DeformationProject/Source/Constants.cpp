@@ -18,5 +18,6 @@ std::atomic<float> invMassConstant = 1.0f;
 std::atomic<float> collisionRangeConstant = 500.0f;
 std::atomic<float> gravityConstant = -1000.0f;
 std::atomic<float> tablePositionConstant = -1000.0f;
+std::atomic<float> timestepConstant = 1.0f / 240.0f;
 std::atomic<VECTOR4> lightPos(VECTOR4{ 15000, 15000, -10000, 0 });
 std::atomic<VECTOR4> lightCol(VECTOR4{ 0, 1, 1, 1 });
\ No newline at end of file
@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------------------
+// File: ContactCache.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Contacts of the last collision tree traversals, reused between steps (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cstring>
+#include "../Headers/ContactCache.h"
+
+
+// entry has to be traversed (ContactCache::clear)
+#define CONTACT_CACHE_INVALID   0xFF
+// no query in this step
+#define CONTACT_CACHE_IDLE      0xFFFFFFFF
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+ContactCache::ContactCache(){
+    memset(&counters, 0, sizeof(CONTACTCACHESTATS));
+}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+ContactCache::~ContactCache(){}
+
+//--------------------------------------------------------------------------------------
+// Resize: empty entries, ages staggered so the expiries spread over the steps
+//--------------------------------------------------------------------------------------
+void ContactCache::resize(uint masspointCount, uint objectCount){
+
+    leaves.assign(masspointCount * CONTACT_CACHE_SLOTS, CONTACTLEAF{ 0, 0 });
+    count.assign(masspointCount, CONTACT_CACHE_INVALID);
+    boxes.assign(masspointCount, 0);
+    age.resize(masspointCount);
+    for (uint i = 0; i < masspointCount; i++)
+        age[i] = i % CONTACT_CACHE_FRAMES;
+    visited.assign(masspointCount, CONTACT_CACHE_IDLE);
+    partners.assign(objectCount, std::vector<uint>());
+    changed.assign(objectCount, true);
+    memset(&counters, 0, sizeof(CONTACTCACHESTATS));
+}
+
+//--------------------------------------------------------------------------------------
+// Update: objects whose broad phase pairs differ from the last update
+//--------------------------------------------------------------------------------------
+void ContactCache::update(const BroadPhase& broadPhase){
+
+    for (uint o = 0; o < partners.size(); o++){
+        const uint* c = broadPhase.candidates(o);
+        uint n = broadPhase.candidateCount(o);
+        changed[o] = partners[o].size() != n || !std::equal(c, c + n, partners[o].begin());
+        if (changed[o])
+            partners[o].assign(c, c + n);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Lookup: valid, unexpired entry of an object with the same pairs
+//--------------------------------------------------------------------------------------
+const CONTACTLEAF* ContactCache::lookup(uint id, uint objnum, uint objectBoxes, uint& leafCount) const {
+
+    if (count[id] == CONTACT_CACHE_INVALID || age[id] >= CONTACT_CACHE_FRAMES || changed[objnum] || boxes[id] != objectBoxes)
+        return nullptr;
+    leafCount = count[id];
+    return &leaves[id * CONTACT_CACHE_SLOTS];
+}
+
+//--------------------------------------------------------------------------------------
+// Hit: entry used once more
+//--------------------------------------------------------------------------------------
+void ContactCache::hit(uint id){
+
+    age[id]++;
+    visited[id] = 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Store: leaves of a full traversal
+//--------------------------------------------------------------------------------------
+void ContactCache::store(uint id, uint objectBoxes, const CONTACTLEAF* leafNodes, uint leafCount, uint nodes){
+
+    age[id] = 0;
+    visited[id] = nodes;
+    boxes[id] = objectBoxes;
+    if (leafCount > CONTACT_CACHE_SLOTS){
+        count[id] = CONTACT_CACHE_INVALID;
+        return;
+    }
+    count[id] = leafCount;
+    std::copy(leafNodes, leafNodes + leafCount, leaves.begin() + id * CONTACT_CACHE_SLOTS);
+}
+
+//--------------------------------------------------------------------------------------
+// Clear: masspoint outside every object box (written only if it had an entry)
+//--------------------------------------------------------------------------------------
+void ContactCache::clear(uint id){
+
+    if (count[id] != CONTACT_CACHE_INVALID)
+        count[id] = CONTACT_CACHE_INVALID;
+}
+
+//--------------------------------------------------------------------------------------
+// Gather: counters of the queries of the step
+//--------------------------------------------------------------------------------------
+void ContactCache::gather(){
+
+    memset(&counters, 0, sizeof(CONTACTCACHESTATS));
+    for (uint i = 0; i < visited.size(); i++){
+        if (visited[i] == CONTACT_CACHE_IDLE)
+            continue;
+        counters.queries++;
+        if (visited[i] == 0)
+            counters.hits++;
+        else {
+            counters.traversals++;
+            counters.nodes += visited[i];
+        }
+        visited[i] = CONTACT_CACHE_IDLE;
+    }
+}
@@ -13,9 +13,16 @@
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <cstring>
+#include <memory>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 #include <boost/algorithm/string.hpp>
-#include "DXUT.h"
 #include "../Headers/DeformableBase.h"
+#include "../Headers/MappedFile.h"
+#include "../Headers/ThreadPool.h"
+#include "../Headers/Voxelizer.h"
 #include "../Headers/Constants.h"
 #include "../Headers/Collision.h"
 
@@ -29,23 +36,61 @@ DeformableBase::DeformableBase(std::string x, int id){
     this->file = x;
     // object ID in the applications object-container (determines offset in buffers)
     this->id = id;
+    this->buildPool = nullptr;
+    // lattice width chosen in build()
+    this->cubeWidth = 0;
+    // XPBD iterations, change before loading the scene into the solver
+    this->solverIterations = XPBD_ITERATIONS;
+    // no prebuilt cache unless enabled
+    this->cacheFile = "";
 }
 
 //--------------------------------------------------------------------------------------
 // Init (A) Initialize all components
 //--------------------------------------------------------------------------------------
-void DeformableBase::build(){
-
-    this->importFile();
-    this->checkImport();
-    this->initVars();
-    this->initParticles();
-    this->initMasscubes();
-    this->initIndexer();
-    this->initNeighbouring();
+void DeformableBase::build(ThreadPool* pool){
+
+    this->buildPool = pool;
+    // the cache holds everything up to the object ID
+    unsigned long long key = this->cacheFile.empty() ? 0 : this->cacheKey();
+    if (key == 0 || !this->loadCache(key)){
+        this->importFile();
+        this->checkImport();
+        this->initVars();
+        this->initParticlesAndMasscubes();
+        this->initIndexer();
+        this->initNeighbouring();
+        this->initSprings();
+        this->compactMasscubes();
+        this->initCollisionDetection();
+        if (key != 0)
+            this->saveCache(key);
+    }
     this->addOffset();
-    this->initCollisionDetection();
+    this->buildPool = nullptr;
+
+}
+
+//--------------------------------------------------------------------------------------
+// Enable cache: file of the model in the cache directory
+//--------------------------------------------------------------------------------------
+void DeformableBase::enableCache(const std::string& directory){
 
+    size_t slash = this->file.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? this->file : this->file.substr(slash + 1);
+    this->cacheFile = directory + "/" + name + ".dfm";
+}
+
+//--------------------------------------------------------------------------------------
+// For each: tasks of a build stage on the pool, or in order
+//--------------------------------------------------------------------------------------
+void DeformableBase::forEach(uint count, const std::function<void(uint)>& body){
+
+    if (this->buildPool && count > 1)
+        this->buildPool->parallelFor(count, body);
+    else
+        for (uint i = 0; i < count; i++)
+            body(i);
 }
 
 //--------------------------------------------------------------------------------------
@@ -60,37 +105,58 @@ void DeformableBase::checkImport(){
 }
 
 //--------------------------------------------------------------------------------------
-// Init (2) Deformable model data: initialize cube cell size, cube pos and model pos
+// Cell size: a lattice of the given width around a model of the given extent
+//--------------------------------------------------------------------------------------
+int DeformableBase::cellSize(float extent, int width){
+
+    // ceil((float)extent/(width-1)) = "tight" value of VOLCUBECELL
+    // ceil((float)(tight+50)/100)*100 = upper 100 neighbour of tight
+    float tmp = ceil(extent / (width - 1));
+    tmp = ceil((float)(tmp + 50) / 100) * 100;
+    return (int)tmp;
+}
+
+//--------------------------------------------------------------------------------------
+// Init (2) Deformable model data: initialize lattice width, cube cell size, cube pos and model pos
 //--------------------------------------------------------------------------------------
 void DeformableBase::initVars(){
 
     // get/set space division parameters
     float minx, miny, minz, maxx, maxy, maxz;
-    maxx = minx = this->vertices[0][1];
-    maxy = miny = this->vertices[0][2];
-    maxz = minz = this->vertices[0][3];
+    maxx = minx = this->vertices[0].x;
+    maxy = miny = this->vertices[0].y;
+    maxz = minz = this->vertices[0].z;
     for (unsigned int i = 0; i < this->vertices.size(); i++){
-        if (this->vertices[i][1] < minx)
-            minx = this->vertices[i][1];
-        if (this->vertices[i][1] > maxx)
-            maxx = this->vertices[i][1];
-        if (this->vertices[i][2] < miny)
-            miny = this->vertices[i][2];
-        if (this->vertices[i][2] > maxy)
-            maxy = this->vertices[i][2];
-        if (this->vertices[i][3] < minz)
-            minz = this->vertices[i][3];
-        if (this->vertices[i][3] > maxz)
-            maxz = this->vertices[i][3];
+        if (this->vertices[i].x < minx)
+            minx = this->vertices[i].x;
+        if (this->vertices[i].x > maxx)
+            maxx = this->vertices[i].x;
+        if (this->vertices[i].y < miny)
+            miny = this->vertices[i].y;
+        if (this->vertices[i].y > maxy)
+            maxy = this->vertices[i].y;
+        if (this->vertices[i].z < minz)
+            minz = this->vertices[i].z;
+        if (this->vertices[i].z > maxz)
+            maxz = this->vertices[i].z;
     }
 
     // tmp = greatest length in any direction (x|y|z)
     float tmp = std::max(abs(ceil(maxx) - floor(minx)), std::max(abs(ceil(maxy) - floor(miny)), abs(ceil(maxz) - floor(minz)))) + 1;
-    // ceil((float)tmp/VCUBEWIDTH) = "tight" value of VOLCUBECELL
-    // ceil((float)(tight+50)/100)*100 = upper 100 neighbour of tight
-    tmp = ceil((float)tmp / (VCUBEWIDTH - 1));
-    tmp = ceil((float)(tmp + 50) / 100) * 100;
-    this->cubeCellSize = (int)tmp;
+
+    // lattice width: enough cells for the vertex count, then the smallest width with the
+    // same cell size (wider lattices would only add empty rows around the model)
+    if (this->cubeWidth == 0){
+        int width = (int)ceil(sqrtf((float)this->vertices.size() / VCUBE_VERTEX_DENSITY));
+        width = std::min(VCUBEWIDTH_MAX, std::max(VCUBEWIDTH_MIN, width));
+        while (width > VCUBEWIDTH_MIN && cellSize(tmp, width - 1) == cellSize(tmp, width))
+            width--;
+        this->cubeWidth = width;
+    }
+    if (this->cubeWidth < VCUBEWIDTH_MIN || this->cubeWidth > VCUBEWIDTH_MAX){
+        throw "[ERROR]: lattice width out of range!";
+    }
+    this->cubeCellSize = cellSize(tmp, this->cubeWidth);
 
     // Set global volumetric cube offsets to align the model
     this->cubePos = XMFLOAT3(floor(minx), floor(miny), floor(minz));
@@ -107,75 +173,97 @@ void DeformableBase::initVars(){
 }
 
 //--------------------------------------------------------------------------------------
-// Init (3) Deformable model data: initialize particle container (position+normal)
+// Init (3) Deformable model data: particles and masscubes, both only need initVars(),
+//          vertex blocks and z-slices of both cubes run as one batch
+//--------------------------------------------------------------------------------------
+void DeformableBase::initParticlesAndMasscubes(){
+
+    this->particles.resize(this->vertexCount);
+    this->masscube1.resize(cubeWidth * cubeWidth * cubeWidth);
+    this->masscube2.resize((cubeWidth + 1) * (cubeWidth + 1) * (cubeWidth + 1));
+
+    uint blocks = (this->vertexCount + CPU_BUILD_BATCH - 1) / CPU_BUILD_BATCH;
+    forEach(blocks + 2 * cubeWidth + 1, [&](uint t){
+        if (t < blocks)
+            initParticles(t * CPU_BUILD_BATCH, std::min((uint)CPU_BUILD_BATCH, this->vertexCount - t * CPU_BUILD_BATCH));
+        else if (t < blocks + cubeWidth)
+            initMasscubes(1, t - blocks);
+        else
+            initMasscubes(2, t - blocks - cubeWidth);
+    });
+}
+
+//--------------------------------------------------------------------------------------
+// Init (3,25) Deformable model data: initialize particle container (position+normal)
 //--------------------------------------------------------------------------------------
-void DeformableBase::initParticles(){
+void DeformableBase::initParticles(uint first, uint count){
 
     // Load model vertices + normals
-    for (uint i = 0; i < this->vertexCount; i++)
+    for (uint i = first; i < first + count; i++)
     {
         PARTICLE push{ XMFLOAT4(0, 0, 0, 1), XMFLOAT4(0, 0, 0, 1), XMFLOAT4(0, 0, 0, 0), XMFLOAT4(0, 0, 0, 0) };
 
         // position
-        XMVECTOR tmp = XMVectorSet(this->vertices[i][1], this->vertices[i][2], this->vertices[i][3], 1);
+        XMVECTOR tmp = XMVectorSet(this->vertices[i].x, this->vertices[i].y, this->vertices[i].z, 1);
         XMStoreFloat4(&push.pos, tmp);
 
         // normalized normals -> store the endpoint of the normals (=npos)
-        float len = this->normals[i][1] * this->normals[i][1] + this->normals[i][2] * this->normals[i][2] + this->normals[i][3] * this->normals[i][3];
+        float len = this->normals[i].x * this->normals[i].x + this->normals[i].y * this->normals[i].y + this->normals[i].z * this->normals[i].z;
         len = (len == 0 ? -1 : sqrtf(len));
-        XMVECTOR tmp2 = XMVectorSet((float)this->normals[i][1] / len, (float)this->normals[i][2] / len, (float)this->normals[i][3] / len, 0);
+        XMVECTOR tmp2 = XMVectorSet((float)this->normals[i].x / len, (float)this->normals[i].y / len, (float)this->normals[i].z / len, 0);
         XMStoreFloat4(&push.npos, XMVectorAdd(tmp, XMVector3Normalize(tmp2)));
 
         // store temporary vector in container
-        particles.push_back(push);
+        particles[i] = push;
     }
 }
 
 //--------------------------------------------------------------------------------------
-// Init (4) Deformable model data: initialize masscube containers (pos, acc)
+// Init (3,5) Deformable model data: initialize masscube containers (pos, acc), one z-slice
 //--------------------------------------------------------------------------------------
 #pragma warning(push)
 #pragma warning(disable : 4244)
-void DeformableBase::initMasscubes(){
+void DeformableBase::initMasscubes(int cube, int i){
 
     int ind;
     MASSPOINT push;
     push.color = XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f);
+    push.neighbour_same = push.neighbour_other = 0;
 
     // Load first volumetric cube
-    for (int i = 0; i < VCUBEWIDTH; i++)
+    if (cube == 1)
     {
-        for (int j = 0; j < VCUBEWIDTH; j++)
+        for (int j = 0; j < cubeWidth; j++)
         {
-            for (int k = 0; k < VCUBEWIDTH; k++)
+            for (int k = 0; k < cubeWidth; k++)
             {
-                ind = i*VCUBEWIDTH*VCUBEWIDTH + j*VCUBEWIDTH + k;
+                ind = i*cubeWidth*cubeWidth + j*cubeWidth + k;
                 XMVECTOR tmp = XMVectorAdd(XMVectorSet(k * this->cubeCellSize, j * this->cubeCellSize, i * this->cubeCellSize, 1),
                     XMVectorSet(this->cubePos.x, this->cubePos.y, this->cubePos.z, 0));
                 XMStoreFloat4(&push.newpos, tmp);
                 XMStoreFloat4(&push.oldpos, tmp);
                 push.localID = ind;
                 push.acc = XMFLOAT4(0, 0, 0, 0);
-                this->masscube1.push_back(push);
+                this->masscube1[ind] = push;
             }
         }
     }
 
     // Load second volumetric cube
-    for (int i = 0; i < VCUBEWIDTH + 1; i++)
+    else
     {
-        for (int j = 0; j < VCUBEWIDTH + 1; j++)
+        for (int j = 0; j < cubeWidth + 1; j++)
         {
-            for (int k = 0; k < VCUBEWIDTH + 1; k++)
+            for (int k = 0; k < cubeWidth + 1; k++)
             {
-                ind = i*(VCUBEWIDTH + 1)*(VCUBEWIDTH + 1) + j*(VCUBEWIDTH + 1) + k;
+                ind = i*(cubeWidth + 1)*(cubeWidth + 1) + j*(cubeWidth + 1) + k;
                 XMVECTOR tmp = XMVectorAdd(XMVectorSet(k * this->cubeCellSize - 0.5f * this->cubeCellSize, j * this->cubeCellSize - 0.5f * this->cubeCellSize, i * this->cubeCellSize - 0.5f * this->cubeCellSize, 1),
                     XMVectorSet(this->cubePos.x, this->cubePos.y, this->cubePos.z, 0));
                 XMStoreFloat4(&push.oldpos, tmp);
                 XMStoreFloat4(&push.newpos, tmp);
                 push.localID = ind;
                 push.acc = XMFLOAT4(0, 0, 0, 0);
-                this->masscube2.push_back(push);
+                this->masscube2[ind] = push;
             }
         }
     }
@@ -189,83 +277,93 @@ void DeformableBase::initMasscubes(){
 #pragma warning(disable: 4244)
 void DeformableBase::initIndexer(){
 
-    // Load indexer cube
+    // Load indexer cube, blocks of vertices
     XMFLOAT3 vc_pos1(this->masscube1[0].oldpos.x, this->masscube1[0].oldpos.y, this->masscube1[0].oldpos.z);
     XMFLOAT3 vc_pos2(this->masscube2[0].oldpos.x, this->masscube2[0].oldpos.y, this->masscube2[0].oldpos.z);
-    XMFLOAT3 vertex;
-    int vind;
+    this->indexcube.resize(this->vertexCount);
+    std::atomic<bool> outside(false);
 
-    for (uint i = 0; i < this->vertexCount; i++)
-    {
-        INDEXER push;
+    uint blocks = (this->vertexCount + CPU_BUILD_BATCH - 1) / CPU_BUILD_BATCH;
+    forEach(blocks, [&](uint b){
+        for (uint i = b * CPU_BUILD_BATCH; i < std::min(this->vertexCount, (b + 1) * CPU_BUILD_BATCH); i++)
+        {
+            INDEXER push;
+            XMFLOAT3 vertex;
+            int vind;
 
-        // Get indices and weights in first volumetric cube
-        vertex = XMFLOAT3(this->particles[i].pos.x, this->particles[i].pos.y, this->particles[i].pos.z);
-        int x = (std::max(vertex.x, vc_pos1.x) - std::min(vertex.x, vc_pos1.x)) / this->cubeCellSize;
-        int y = (std::max(vertex.y, vc_pos1.y) - std::min(vertex.y, vc_pos1.y)) / this->cubeCellSize;
-        int z = (std::max(vertex.z, vc_pos1.z) - std::min(vertex.z, vc_pos1.z)) / this->cubeCellSize;
+            // Get indices and weights in first volumetric cube
+            vertex = XMFLOAT3(this->particles[i].pos.x, this->particles[i].pos.y, this->particles[i].pos.z);
+            int x = (std::max(vertex.x, vc_pos1.x) - std::min(vertex.x, vc_pos1.x)) / this->cubeCellSize;
+            int y = (std::max(vertex.y, vc_pos1.y) - std::min(vertex.y, vc_pos1.y)) / this->cubeCellSize;
+            int z = (std::max(vertex.z, vc_pos1.z) - std::min(vertex.z, vc_pos1.z)) / this->cubeCellSize;
 
-        if (x == VCUBEWIDTH - 1 || y == VCUBEWIDTH - 1 || z == VCUBEWIDTH - 1)
-        {
-            throw "Incorrect indexing in IndexerStructure!";
+            if (x == cubeWidth - 1 || y == cubeWidth - 1 || z == cubeWidth - 1)
+            {
+                // (thrown after the batch, not from a pool task)
+                outside = true;
+                continue;
+            }
+
+            XMStoreFloat3(&push.vc1index, XMVectorSet(x, y, z, 0));
+            XMStoreFloat4(&this->particles[i].mpid1, XMVectorSet(x, y, z, 1));
+
+            // trilinear interpolation
+            vind = z*cubeWidth*cubeWidth + y*cubeWidth + x;
+            float wx = (vertex.x - this->masscube1[vind].newpos.x) / this->cubeCellSize;
+            float dwx = 1.0f - wx;
+            float wy = (vertex.y - this->masscube1[vind].newpos.y) / this->cubeCellSize;
+            float dwy = 1.0f - wy;
+            float wz = (vertex.z - this->masscube1[vind].newpos.z) / this->cubeCellSize;
+            float dwz = 1.0f - wz;
+            push.w1[0] = dwx*dwy*dwz; push.w1[1] = wx*dwy*dwz; push.w1[2] = dwx*wy*dwz; push.w1[3] = wx*wy*dwz;
+            push.w1[4] = dwx*dwy*wz; push.w1[5] = wx*dwy*wz; push.w1[6] = dwx*wy*wz; push.w1[7] = wx*wy*wz;
+
+            // trilinear for npos
+            vertex = XMFLOAT3(this->particles[i].npos.x, this->particles[i].npos.y, this->particles[i].npos.z);
+            wx = (vertex.x - this->masscube1[vind].newpos.x) / this->cubeCellSize;
+            dwx = 1.0f - wx;
+            wy = (vertex.y - this->masscube1[vind].newpos.y) / this->cubeCellSize;
+            dwy = 1.0f - wy;
+            wz = (vertex.z - this->masscube1[vind].newpos.z) / this->cubeCellSize;
+            dwz = 1.0f - wz;
+            push.nw1[0] = dwx*dwy*dwz; push.nw1[1] = wx*dwy*dwz; push.nw1[2] = dwx*wy*dwz; push.nw1[3] = wx*wy*dwz;
+            push.nw1[4] = dwx*dwy*wz; push.nw1[5] = wx*dwy*wz; push.nw1[6] = dwx*wy*wz; push.nw1[7] = wx*wy*wz;
+
+
+            // Fill second indexer
+            vertex = XMFLOAT3(this->particles[i].pos.x, this->particles[i].pos.y, this->particles[i].pos.z);
+            x = (std::max(vertex.x, vc_pos2.x) - std::min(vertex.x, vc_pos2.x)) / this->cubeCellSize;
+            y = (std::max(vertex.y, vc_pos2.y) - std::min(vertex.y, vc_pos2.y)) / this->cubeCellSize;
+            z = (std::max(vertex.z, vc_pos2.z) - std::min(vertex.z, vc_pos2.z)) / this->cubeCellSize;
+            XMStoreFloat3(&push.vc2index, XMVectorSet(x, y, z, 0));
+            XMStoreFloat4(&this->particles[i].mpid2, XMVectorSet(x, y, z, 1));
+
+            vind = z*(cubeWidth + 1)*(cubeWidth + 1) + y*(cubeWidth + 1) + x;
+            wx = (vertex.x - this->masscube2[vind].newpos.x) / this->cubeCellSize;
+            dwx = 1.0f - wx;
+            wy = (vertex.y - this->masscube2[vind].newpos.y) / this->cubeCellSize;
+            dwy = 1.0f - wy;
+            wz = (vertex.z - this->masscube2[vind].newpos.z) / this->cubeCellSize;
+            dwz = 1.0f - wz;
+            push.w2[0] = dwx*dwy*dwz; push.w2[1] = wx*dwy*dwz; push.w2[2] = dwx*wy*dwz; push.w2[3] = wx*wy*dwz;
+            push.w2[4] = dwx*dwy*wz; push.w2[5] = wx*dwy*wz; push.w2[6] = dwx*wy*wz; push.w2[7] = wx*wy*wz;
+
+            vertex = XMFLOAT3(this->particles[i].npos.x, this->particles[i].npos.y, this->particles[i].npos.z);
+            wx = (vertex.x - this->masscube2[vind].newpos.x) / this->cubeCellSize;
+            dwx = 1.0f - wx;
+            wy = (vertex.y - this->masscube2[vind].newpos.y) / this->cubeCellSize;
+            dwy = 1.0f - wy;
+            wz = (vertex.z - this->masscube2[vind].newpos.z) / this->cubeCellSize;
+            dwz = 1.0f - wz;
+            push.nw2[0] = dwx*dwy*dwz; push.nw2[1] = wx*dwy*dwz; push.nw2[2] = dwx*wy*dwz; push.nw2[3] = wx*wy*dwz;
+            push.nw2[4] = dwx*dwy*wz; push.nw2[5] = wx*dwy*wz; push.nw2[6] = dwx*wy*wz; push.nw2[7] = wx*wy*wz;
+
+            indexcube[i] = push;
         }
+    });
 
-        XMStoreFloat3(&push.vc1index, XMVectorSet(x, y, z, 0));
-        XMStoreFloat4(&this->particles[i].mpid1, XMVectorSet(x, y, z, 1));
-
-        // trilinear interpolation
-        vind = z*VCUBEWIDTH*VCUBEWIDTH + y*VCUBEWIDTH + x;
-        float wx = (vertex.x - this->masscube1[vind].newpos.x) / this->cubeCellSize;
-        float dwx = 1.0f - wx;
-        float wy = (vertex.y - this->masscube1[vind].newpos.y) / this->cubeCellSize;
-        float dwy = 1.0f - wy;
-        float wz = (vertex.z - this->masscube1[vind].newpos.z) / this->cubeCellSize;
-        float dwz = 1.0f - wz;
-        push.w1[0] = dwx*dwy*dwz; push.w1[1] = wx*dwy*dwz; push.w1[2] = dwx*wy*dwz; push.w1[3] = wx*wy*dwz;
-        push.w1[4] = dwx*dwy*wz; push.w1[5] = wx*dwy*wz; push.w1[6] = dwx*wy*wz; push.w1[7] = wx*wy*wz;
-
-        // trilinear for npos
-        vertex = XMFLOAT3(this->particles[i].npos.x, this->particles[i].npos.y, this->particles[i].npos.z);
-        wx = (vertex.x - this->masscube1[vind].newpos.x) / this->cubeCellSize;
-        dwx = 1.0f - wx;
-        wy = (vertex.y - this->masscube1[vind].newpos.y) / this->cubeCellSize;
-        dwy = 1.0f - wy;
-        wz = (vertex.z - this->masscube1[vind].newpos.z) / this->cubeCellSize;
-        dwz = 1.0f - wz;
-        push.nw1[0] = dwx*dwy*dwz; push.nw1[1] = wx*dwy*dwz; push.nw1[2] = dwx*wy*dwz; push.nw1[3] = wx*wy*dwz;
-        push.nw1[4] = dwx*dwy*wz; push.nw1[5] = wx*dwy*wz; push.nw1[6] = dwx*wy*wz; push.nw1[7] = wx*wy*wz;
-
-
-        // Fill second indexer
-        vertex = XMFLOAT3(this->particles[i].pos.x, this->particles[i].pos.y, this->particles[i].pos.z);
-        x = (std::max(vertex.x, vc_pos2.x) - std::min(vertex.x, vc_pos2.x)) / this->cubeCellSize;
-        y = (std::max(vertex.y, vc_pos2.y) - std::min(vertex.y, vc_pos2.y)) / this->cubeCellSize;
-        z = (std::max(vertex.z, vc_pos2.z) - std::min(vertex.z, vc_pos2.z)) / this->cubeCellSize;
-        XMStoreFloat3(&push.vc2index, XMVectorSet(x, y, z, 0));
-        XMStoreFloat4(&this->particles[i].mpid2, XMVectorSet(x, y, z, 1));
-
-        vind = z*(VCUBEWIDTH + 1)*(VCUBEWIDTH + 1) + y*(VCUBEWIDTH + 1) + x;
-        wx = (vertex.x - this->masscube2[vind].newpos.x) / this->cubeCellSize;
-        dwx = 1.0f - wx;
-        wy = (vertex.y - this->masscube2[vind].newpos.y) / this->cubeCellSize;
-        dwy = 1.0f - wy;
-        wz = (vertex.z - this->masscube2[vind].newpos.z) / this->cubeCellSize;
-        dwz = 1.0f - wz;
-        push.w2[0] = dwx*dwy*dwz; push.w2[1] = wx*dwy*dwz; push.w2[2] = dwx*wy*dwz; push.w2[3] = wx*wy*dwz;
-        push.w2[4] = dwx*dwy*wz; push.w2[5] = wx*dwy*wz; push.w2[6] = dwx*wy*wz; push.w2[7] = wx*wy*wz;
-
-        vertex = XMFLOAT3(this->particles[i].npos.x, this->particles[i].npos.y, this->particles[i].npos.z);
-        wx = (vertex.x - this->masscube2[vind].newpos.x) / this->cubeCellSize;
-        dwx = 1.0f - wx;
-        wy = (vertex.y - this->masscube2[vind].newpos.y) / this->cubeCellSize;
-        dwy = 1.0f - wy;
-        wz = (vertex.z - this->masscube2[vind].newpos.z) / this->cubeCellSize;
-        dwz = 1.0f - wz;
-        push.nw2[0] = dwx*dwy*dwz; push.nw2[1] = wx*dwy*dwz; push.nw2[2] = dwx*wy*dwz; push.nw2[3] = wx*wy*dwz;
-        push.nw2[4] = dwx*dwy*wz; push.nw2[5] = wx*dwy*wz; push.nw2[6] = dwx*wy*wz; push.nw2[7] = wx*wy*wz;
-
-        indexcube.push_back(push);
-    }
+    if (outside)
+        throw "Incorrect indexing in IndexerStructure!";
 }
 #pragma warning(pop)
 
@@ -275,186 +373,77 @@ void DeformableBase::initIndexer(){
 void DeformableBase::initNeighbouring(){
 
     /// Set proper neighbouring data (disable masspoints with no model points)
-    for (int z = 0; z < VCUBEWIDTH; z++){
-        for (int y = 0; y < VCUBEWIDTH; y++){
-            for (int x = 0; x < VCUBEWIDTH; x++){
-                nvc1[z][y][x] = 0;
-            }
-        }
-    }
-    for (int z = 0; z < VCUBEWIDTH + 1; z++){
-        for (int y = 0; y < VCUBEWIDTH + 1; y++){
-            for (int x = 0; x < VCUBEWIDTH + 1; x++){
-                nvc2[z][y][x] = 0;
-            }
-        }
-    }
+    nvc1.assign(cubeWidth * cubeWidth * cubeWidth, 0);
+    nvc2.assign((cubeWidth + 1) * (cubeWidth + 1) * (cubeWidth + 1), 0);
     XMFLOAT3 vx;
-    // Set edge masspoints to 1
+    // Set edge masspoints to 1 (one pass, vertices share the cells)
     for (uint i = 0; i < this->vertexCount; i++)
     {
         vx = this->indexcube[i].vc1index;
-        nvc1[(int)vx.z][(int)vx.y][(int)vx.x] = 1;
-        nvc1[(int)vx.z][(int)vx.y][(int)vx.x + 1] = 1;
-        nvc1[(int)vx.z][(int)vx.y + 1][(int)vx.x] = 1;
-        nvc1[(int)vx.z][(int)vx.y + 1][(int)vx.x + 1] = 1;
-        nvc1[(int)vx.z + 1][(int)vx.y][(int)vx.x] = 1;
-        nvc1[(int)vx.z + 1][(int)vx.y][(int)vx.x + 1] = 1;
-        nvc1[(int)vx.z + 1][(int)vx.y + 1][(int)vx.x] = 1;
-        nvc1[(int)vx.z + 1][(int)vx.y + 1][(int)vx.x + 1] = 1;
+        nvc1[index1((int)vx.x, (int)vx.y, (int)vx.z)] = 1;
+        nvc1[index1((int)vx.x + 1, (int)vx.y, (int)vx.z)] = 1;
+        nvc1[index1((int)vx.x, (int)vx.y + 1, (int)vx.z)] = 1;
+        nvc1[index1((int)vx.x + 1, (int)vx.y + 1, (int)vx.z)] = 1;
+        nvc1[index1((int)vx.x, (int)vx.y, (int)vx.z + 1)] = 1;
+        nvc1[index1((int)vx.x + 1, (int)vx.y, (int)vx.z + 1)] = 1;
+        nvc1[index1((int)vx.x, (int)vx.y + 1, (int)vx.z + 1)] = 1;
+        nvc1[index1((int)vx.x + 1, (int)vx.y + 1, (int)vx.z + 1)] = 1;
         vx = this->indexcube[i].vc2index;
-        nvc2[(int)vx.z][(int)vx.y][(int)vx.x] = 1;
-        nvc2[(int)vx.z][(int)vx.y][(int)vx.x + 1] = 1;
-        nvc2[(int)vx.z][(int)vx.y + 1][(int)vx.x] = 1;
-        nvc2[(int)vx.z][(int)vx.y + 1][(int)vx.x + 1] = 1;
-        nvc2[(int)vx.z + 1][(int)vx.y][(int)vx.x] = 1;
-        nvc2[(int)vx.z + 1][(int)vx.y][(int)vx.x + 1] = 1;
-        nvc2[(int)vx.z + 1][(int)vx.y + 1][(int)vx.x] = 1;
-        nvc2[(int)vx.z + 1][(int)vx.y + 1][(int)vx.x + 1] = 1;
+        nvc2[index2((int)vx.x, (int)vx.y, (int)vx.z)] = 1;
+        nvc2[index2((int)vx.x + 1, (int)vx.y, (int)vx.z)] = 1;
+        nvc2[index2((int)vx.x, (int)vx.y + 1, (int)vx.z)] = 1;
+        nvc2[index2((int)vx.x + 1, (int)vx.y + 1, (int)vx.z)] = 1;
+        nvc2[index2((int)vx.x, (int)vx.y, (int)vx.z + 1)] = 1;
+        nvc2[index2((int)vx.x + 1, (int)vx.y, (int)vx.z + 1)] = 1;
+        nvc2[index2((int)vx.x, (int)vx.y + 1, (int)vx.z + 1)] = 1;
+        nvc2[index2((int)vx.x + 1, (int)vx.y + 1, (int)vx.z + 1)] = 1;
     }
 
-    // Set outer masspoints to 2 - 1st volcube
-    //left+
-    for (int z = 0; z < VCUBEWIDTH; z++){
-        for (int y = 0; y < VCUBEWIDTH; y++){
-            for (int x = 0; x < VCUBEWIDTH; x++){
-                if (nvc1[z][y][x] == 1) break;
-                else nvc1[z][y][x] = 2;
-            }
-        }
-    }
-    //right+
-    for (int z = 0; z < VCUBEWIDTH; z++){
-        for (int y = 0; y < VCUBEWIDTH; y++){
-            for (int x = VCUBEWIDTH - 1; x >= 0; x--){
-                if (nvc1[z][y][x] == 1) break;
-                else nvc1[z][y][x] = 2;
-            }
-        }
-    }
-    //bottom+
-    for (int z = 0; z < VCUBEWIDTH; z++){
-        for (int x = 0; x < VCUBEWIDTH; x++){
-            for (int y = 0; y < VCUBEWIDTH; y++){
-                if (nvc1[z][y][x] == 1) break;
-                else nvc1[z][y][x] = 2;
-            }
-        }
-    }
-    //up+
-    for (int z = 0; z < VCUBEWIDTH; z++){
-        for (int x = 0; x < VCUBEWIDTH; x++){
-            for (int y = VCUBEWIDTH - 1; y >= 0; y--){
-                if (nvc1[z][y][x] == 1) break;
-                else nvc1[z][y][x] = 2;
-            }
-        }
-    }
-    //front+
-    for (int y = 0; y < VCUBEWIDTH; y++){
-        for (int x = 0; x < VCUBEWIDTH; x++){
-            for (int z = 0; z < VCUBEWIDTH; z++){
-                if (nvc1[z][y][x] == 1) break;
-                else nvc1[z][y][x] = 2;
-            }
-        }
-    }
-    //back+
-    for (int y = 0; y < VCUBEWIDTH; y++){
-        for (int x = 0; x < VCUBEWIDTH; x++){
-            for (int z = VCUBEWIDTH - 1; z >= 0; z--){
-                if (nvc1[z][y][x] == 1) break;
-                else nvc1[z][y][x] = 2;
-            }
-        }
-    }
-    //Set outer masspoints to 2 - 2nd volcube
-    //left+
-    for (int z = 0; z < VCUBEWIDTH + 1; z++){
-        for (int y = 0; y < VCUBEWIDTH + 1; y++){
-            for (int x = 0; x < VCUBEWIDTH + 1; x++){
-                if (nvc2[z][y][x] == 1) break;
-                else nvc2[z][y][x] = 2;
-            }
-        }
-    }
-    //right+
-    for (int z = 0; z < VCUBEWIDTH + 1; z++){
-        for (int y = 0; y < VCUBEWIDTH + 1; y++){
-            for (int x = VCUBEWIDTH; x >= 0; x--){
-                if (nvc2[z][y][x] == 1) break;
-                else nvc2[z][y][x] = 2;
-            }
-        }
-    }
-    //bottom+
-    for (int z = 0; z < VCUBEWIDTH + 1; z++){
-        for (int x = 0; x < VCUBEWIDTH + 1; x++){
-            for (int y = 0; y < VCUBEWIDTH + 1; y++){
-                if (nvc2[z][y][x] == 1) break;
-                else nvc2[z][y][x] = 2;
-            }
-        }
-    }
-    //up+
-    for (int z = 0; z < VCUBEWIDTH + 1; z++){
-        for (int x = 0; x < VCUBEWIDTH + 1; x++){
-            for (int y = VCUBEWIDTH; y >= 0; y--){
-                if (nvc2[z][y][x] == 1) break;
-                else nvc2[z][y][x] = 2;
-            }
-        }
-    }
-    //front+
-    for (int y = 0; y < VCUBEWIDTH + 1; y++){
-        for (int x = 0; x < VCUBEWIDTH + 1; x++){
-            for (int z = 0; z < VCUBEWIDTH + 1; z++){
-                if (nvc2[z][y][x] == 1) break;
-                else nvc2[z][y][x] = 2;
-            }
-        }
-    }
-    //back+
-    for (int y = 0; y < VCUBEWIDTH + 1; y++){
-        for (int x = 0; x < VCUBEWIDTH + 1; x++){
-            for (int z = VCUBEWIDTH; z >= 0; z--){
-                if (nvc2[z][y][x] == 1) break;
-                else nvc2[z][y][x] = 2;
-            }
-        }
-    }
-
-    // Correct neighbouring in 1st volcube
-    unsigned int ind, mask, mtmp;
-    for (int i = 0; i < VCUBEWIDTH; i++)
-    {
-        for (int j = 0; j < VCUBEWIDTH; j++)
+    // Edge masspoints of the cells crossed by the faces (closes the surface between vertices),
+    // then outer masspoints to 2: flood fill from the lattice boundary
+    XMFLOAT3 origin1(this->masscube1[0].oldpos.x, this->masscube1[0].oldpos.y, this->masscube1[0].oldpos.z);
+    XMFLOAT3 origin2(this->masscube2[0].oldpos.x, this->masscube2[0].oldpos.y, this->masscube2[0].oldpos.z);
+    Voxelizer::rasterize(this->vertices, this->faces, origin1, (float)this->cubeCellSize, cubeWidth, nvc1, this->buildPool);
+    Voxelizer::rasterize(this->vertices, this->faces, origin2, (float)this->cubeCellSize, cubeWidth + 1, nvc2, this->buildPool);
+    // (the flood fills are linear in the lattice, one task each)
+    forEach(2, [&](uint c){
+        if (c == 0)
+            Voxelizer::floodFill(cubeWidth, nvc1);
+        else
+            Voxelizer::floodFill(cubeWidth + 1, nvc2);
+    });
+
+    // Correct neighbouring in 1st volcube, z-slices in parallel
+    forEach(cubeWidth, [&](uint slice){
+        int i = (int)slice;
+        unsigned int ind, mask, mtmp;
+        for (int j = 0; j < cubeWidth; j++)
         {
-            for (int k = 0; k < VCUBEWIDTH; k++)
+            for (int k = 0; k < cubeWidth; k++)
             {
-                ind = i*VCUBEWIDTH*VCUBEWIDTH + j*VCUBEWIDTH + k;
+                ind = i*cubeWidth*cubeWidth + j*cubeWidth + k;
 
                 // same volcube bitmasks
                 mask = 0x00;
-                mask = k != 0 && nvc1[i][j][k - 1] != 2 ? mask | NB_SAME_LEFT : mask;
-                mask = k != (VCUBEWIDTH - 1) && nvc1[i][j][k + 1] != 2 ? mask | NB_SAME_RIGHT : mask;
-                mask = j != 0 && nvc1[i][j - 1][k] != 2 ? mask | NB_SAME_DOWN : mask;
-                mask = j != (VCUBEWIDTH - 1) && nvc1[i][j + 1][k] != 2 ? mask | NB_SAME_UP : mask;
-                mask = i != 0 && nvc1[i - 1][j][k] != 2 ? mask | NB_SAME_FRONT : mask;
-                mask = i != (VCUBEWIDTH - 1) && nvc1[i + 1][j][k] != 2 ? mask | NB_SAME_BACK : mask;
+                mask = k != 0 && nvc1[index1(k - 1, j, i)] != 2 ? mask | NB_SAME_LEFT : mask;
+                mask = k != (cubeWidth - 1) && nvc1[index1(k + 1, j, i)] != 2 ? mask | NB_SAME_RIGHT : mask;
+                mask = j != 0 && nvc1[index1(k, j - 1, i)] != 2 ? mask | NB_SAME_DOWN : mask;
+                mask = j != (cubeWidth - 1) && nvc1[index1(k, j + 1, i)] != 2 ? mask | NB_SAME_UP : mask;
+                mask = i != 0 && nvc1[index1(k, j, i - 1)] != 2 ? mask | NB_SAME_FRONT : mask;
+                mask = i != (cubeWidth - 1) && nvc1[index1(k, j, i + 1)] != 2 ? mask | NB_SAME_BACK : mask;
                 this->masscube1[ind].neighbour_same = mask;
                 mtmp = mask;
 
                 // other volcube bitmasks
                 mask = 0x00;
-                mask = nvc2[i][j][k] != 2 ? mask | NB_OTHER_NEAR_BOT_LEFT : mask;
-                mask = nvc2[i][j][k + 1] != 2 ? mask | NB_OTHER_NEAR_BOT_RIGHT : mask;
-                mask = nvc2[i][j + 1][k] != 2 ? mask | NB_OTHER_NEAR_TOP_LEFT : mask;
-                mask = nvc2[i][j + 1][k + 1] != 2 ? mask | NB_OTHER_NEAR_TOP_RIGHT : mask;
-                mask = nvc2[i + 1][j][k] != 2 ? mask | NB_OTHER_FAR_BOT_LEFT : mask;
-                mask = nvc2[i + 1][j][k + 1] != 2 ? mask | NB_OTHER_FAR_BOT_RIGHT : mask;
-                mask = nvc2[i + 1][j + 1][k] != 2 ? mask | NB_OTHER_FAR_TOP_LEFT : mask;
-                mask = nvc2[i + 1][j + 1][k + 1] != 2 ? mask | NB_OTHER_FAR_TOP_RIGHT : mask;
+                mask = nvc2[index2(k, j, i)] != 2 ? mask | NB_OTHER_NEAR_BOT_LEFT : mask;
+                mask = nvc2[index2(k + 1, j, i)] != 2 ? mask | NB_OTHER_NEAR_BOT_RIGHT : mask;
+                mask = nvc2[index2(k, j + 1, i)] != 2 ? mask | NB_OTHER_NEAR_TOP_LEFT : mask;
+                mask = nvc2[index2(k + 1, j + 1, i)] != 2 ? mask | NB_OTHER_NEAR_TOP_RIGHT : mask;
+                mask = nvc2[index2(k, j, i + 1)] != 2 ? mask | NB_OTHER_FAR_BOT_LEFT : mask;
+                mask = nvc2[index2(k + 1, j, i + 1)] != 2 ? mask | NB_OTHER_FAR_BOT_RIGHT : mask;
+                mask = nvc2[index2(k, j + 1, i + 1)] != 2 ? mask | NB_OTHER_FAR_TOP_LEFT : mask;
+                mask = nvc2[index2(k + 1, j + 1, i + 1)] != 2 ? mask | NB_OTHER_FAR_TOP_RIGHT : mask;
                 this->masscube1[ind].neighbour_other = mask;
 
                 // static masspoint, set to white
@@ -464,38 +453,39 @@ void DeformableBase::initNeighbouring(){
                 }
             }
         }
-    }
+    });
 
-    // Correct neighbouring in 2nd volcube
-    for (int i = 0; i < VCUBEWIDTH + 1; i++)
-    {
-        for (int j = 0; j < VCUBEWIDTH + 1; j++)
+    // Correct neighbouring in 2nd volcube, z-slices in parallel
+    forEach(cubeWidth + 1, [&](uint slice){
+        int i = (int)slice;
+        unsigned int ind, mask, mtmp;
+        for (int j = 0; j < cubeWidth + 1; j++)
         {
-            for (int k = 0; k < VCUBEWIDTH + 1; k++)
+            for (int k = 0; k < cubeWidth + 1; k++)
             {
-                ind = i*(VCUBEWIDTH + 1)*(VCUBEWIDTH + 1) + j*(VCUBEWIDTH + 1) + k;
+                ind = i*(cubeWidth + 1)*(cubeWidth + 1) + j*(cubeWidth + 1) + k;
 
                 // same volcube bitmasks
                 mask = 0x00;
-                mask = k != 0 && nvc2[i][j][k - 1] != 2 ? mask | NB_SAME_LEFT : mask;
-                mask = k != (VCUBEWIDTH) && nvc2[i][j][k + 1] != 2 ? mask | NB_SAME_RIGHT : mask;
-                mask = j != 0 && nvc2[i][j - 1][k] != 2 ? mask | NB_SAME_DOWN : mask;
-                mask = j != (VCUBEWIDTH) && nvc2[i][j + 1][k] != 2 ? mask | NB_SAME_UP : mask;
-                mask = i != 0 && nvc2[i - 1][j][k] != 2 ? mask | NB_SAME_FRONT : mask;
-                mask = i != (VCUBEWIDTH) && nvc2[i + 1][j][k] != 2 ? mask | NB_SAME_BACK : mask;
+                mask = k != 0 && nvc2[index2(k - 1, j, i)] != 2 ? mask | NB_SAME_LEFT : mask;
+                mask = k != (cubeWidth) && nvc2[index2(k + 1, j, i)] != 2 ? mask | NB_SAME_RIGHT : mask;
+                mask = j != 0 && nvc2[index2(k, j - 1, i)] != 2 ? mask | NB_SAME_DOWN : mask;
+                mask = j != (cubeWidth) && nvc2[index2(k, j + 1, i)] != 2 ? mask | NB_SAME_UP : mask;
+                mask = i != 0 && nvc2[index2(k, j, i - 1)] != 2 ? mask | NB_SAME_FRONT : mask;
+                mask = i != (cubeWidth) && nvc2[index2(k, j, i + 1)] != 2 ? mask | NB_SAME_BACK : mask;
                 this->masscube2[ind].neighbour_same = mask;
                 mtmp = mask;
 
                 //// other volcube bitmasks
                 mask = 0x00;
-                mask = (i != 0 && j != 0 && k != 0) && nvc1[i - 1][j - 1][k - 1] != 2 ? mask | NB_OTHER_NEAR_BOT_LEFT : mask;
-                mask = (i != 0 && j != 0 && k != VCUBEWIDTH) && nvc1[i - 1][j - 1][k] != 2 ? mask | NB_OTHER_NEAR_BOT_RIGHT : mask;
-                mask = (i != 0 && j != VCUBEWIDTH && k != 0) && nvc1[i - 1][j][k - 1] != 2 ? mask | NB_OTHER_NEAR_TOP_LEFT : mask;
-                mask = (i != 0 && j != VCUBEWIDTH && k != VCUBEWIDTH) && nvc1[i - 1][j][k] != 2 ? mask | NB_OTHER_NEAR_TOP_RIGHT : mask;
-                mask = (i != VCUBEWIDTH && j != 0 && k != 0) && nvc1[i][j - 1][k - 1] != 2 ? mask | NB_OTHER_FAR_BOT_LEFT : mask;
-                mask = (i != VCUBEWIDTH && j != 0 && k != VCUBEWIDTH) && nvc1[i][j - 1][k] != 2 ? mask | NB_OTHER_FAR_BOT_RIGHT : mask;
-                mask = (i != VCUBEWIDTH && j != VCUBEWIDTH && k != 0) && nvc1[i][j][k - 1] != 2 ? mask | NB_OTHER_FAR_TOP_LEFT : mask;
-                mask = (i != VCUBEWIDTH && j != VCUBEWIDTH && k != VCUBEWIDTH) && nvc1[i][j][k] != 2 ? mask | NB_OTHER_FAR_TOP_RIGHT : mask;
+                mask = (i != 0 && j != 0 && k != 0) && nvc1[index1(k - 1, j - 1, i - 1)] != 2 ? mask | NB_OTHER_NEAR_BOT_LEFT : mask;
+                mask = (i != 0 && j != 0 && k != cubeWidth) && nvc1[index1(k, j - 1, i - 1)] != 2 ? mask | NB_OTHER_NEAR_BOT_RIGHT : mask;
+                mask = (i != 0 && j != cubeWidth && k != 0) && nvc1[index1(k - 1, j, i - 1)] != 2 ? mask | NB_OTHER_NEAR_TOP_LEFT : mask;
+                mask = (i != 0 && j != cubeWidth && k != cubeWidth) && nvc1[index1(k, j, i - 1)] != 2 ? mask | NB_OTHER_NEAR_TOP_RIGHT : mask;
+                mask = (i != cubeWidth && j != 0 && k != 0) && nvc1[index1(k - 1, j - 1, i)] != 2 ? mask | NB_OTHER_FAR_BOT_LEFT : mask;
+                mask = (i != cubeWidth && j != 0 && k != cubeWidth) && nvc1[index1(k, j - 1, i)] != 2 ? mask | NB_OTHER_FAR_BOT_RIGHT : mask;
+                mask = (i != cubeWidth && j != cubeWidth && k != 0) && nvc1[index1(k - 1, j, i)] != 2 ? mask | NB_OTHER_FAR_TOP_LEFT : mask;
+                mask = (i != cubeWidth && j != cubeWidth && k != cubeWidth) && nvc1[index1(k, j, i)] != 2 ? mask | NB_OTHER_FAR_TOP_RIGHT : mask;
                 this->masscube2[ind].neighbour_other = mask;
 
                 // static masspoint, set to white
@@ -505,18 +495,122 @@ void DeformableBase::initNeighbouring(){
                 }
             }
         }
+    });
+}
+
+//--------------------------------------------------------------------------------------
+// Init (6,5) Deformable model data: compile neighbouring masks into springs, in the order
+//            of CSMain1/CSMain2 (same cube + second neighbour per direction, other cube)
+//--------------------------------------------------------------------------------------
+void DeformableBase::initSprings(){
+
+    const uint dirs[6] = { NB_SAME_LEFT, NB_SAME_RIGHT, NB_SAME_DOWN, NB_SAME_UP, NB_SAME_FRONT, NB_SAME_BACK };
+    const uint others[8] = { NB_OTHER_NEAR_BOT_LEFT, NB_OTHER_NEAR_BOT_RIGHT, NB_OTHER_NEAR_TOP_LEFT, NB_OTHER_NEAR_TOP_RIGHT,
+                             NB_OTHER_FAR_BOT_LEFT, NB_OTHER_FAR_BOT_RIGHT, NB_OTHER_FAR_TOP_LEFT, NB_OTHER_FAR_TOP_RIGHT };
+    int w1 = cubeWidth;
+    int w2 = cubeWidth + 1;
+    int size1 = w1*w1*w1;
+    // neighbour offsets in masscube1 and masscube2, other cube relative to the matching ID
+    const int same1[6] = { -1, 1, -w1, w1, -w1*w1, w1*w1 };
+    const int same2[6] = { -1, 1, -w2, w2, -w2*w2, w2*w2 };
+    const int other1[8] = { 0, 1, w2, w2 + 1, w2*w2, w2*w2 + 1, w2*w2 + w2, w2*w2 + w2 + 1 };
+    const int other2[8] = { -w1*w1 - w1 - 1, -w1*w1 - w1, -w1*w1 - 1, -w1*w1, -w1 - 1, -w1, -1, 0 };
+
+    springs.clear();
+    for (int c = 0; c < 2; c++){
+        const MassVector& cube = c == 0 ? masscube1 : masscube2;
+        int w = c == 0 ? w1 : w2;
+        const int* same = c == 0 ? same1 : same2;
+        const int* other = c == 0 ? other1 : other2;
+        // ID of the first masspoint of this and the other cube
+        int base = c == 0 ? 0 : size1;
+        int obase = c == 0 ? size1 : 0;
+
+        for (int z = 0; z < w; z++){
+            for (int y = 0; y < w; y++){
+                for (int x = 0; x < w; x++){
+                    int ind = z*w*w + y*w + x;
+                    // index of the matching masspoint in the other cube
+                    int oind = c == 0 ? z*w2*w2 + y*w2 + x : z*w1*w1 + y*w1 + x;
+                    const int coords[6] = { x, x, y, y, z, z };
+                    uint nsame = cube[ind].neighbour_same;
+                    uint nother = cube[ind].neighbour_other;
+
+                    springs.addMasspoint();
+                    for (int k = 0; k < 6; k++){
+                        if (!(nsame & dirs[k]))
+                            continue;
+                        springs.addSpring(base + ind + same[k], SPRING_SAME);
+                        // second neighbour: lower directions need coord > 1, upper ones coord < w - 2
+                        bool inbounds = (k % 2 == 0) ? coords[k] > 1 : coords[k] < w - 2;
+                        if (inbounds && (cube[ind + same[k]].neighbour_same & dirs[k]))
+                            springs.addSpring(base + ind + 2 * same[k], SPRING_SECOND);
+                    }
+                    for (int k = 0; k < 8; k++){
+                        if (nother & others[k])
+                            springs.addSpring(obase + oind + other[k], SPRING_OTHER);
+                    }
+                }
+            }
+        }
     }
 }
 
+//--------------------------------------------------------------------------------------
+// Init (6,75) Deformable model data: keep only the masspoints that move or are referenced
+//             (neighbours, springs, indexer corners and tree leaves are never outside = 2),
+//             so memory and iteration scale with the volume of the model
+//--------------------------------------------------------------------------------------
+void DeformableBase::compactMasscubes(){
+
+    int size1 = cubeWidth * cubeWidth * cubeWidth;
+    int size2 = (cubeWidth + 1) * (cubeWidth + 1) * (cubeWidth + 1);
+    MassVector cube1, cube2;
+
+    // lattice order is kept, so rows of active masspoints stay contiguous
+    remap1.assign(size1, -1);
+    for (int i = 0; i < size1; i++){
+        if (nvc1[i] != 2 || (masscube1[i].neighbour_same | masscube1[i].neighbour_other) != 0){
+            remap1[i] = (int)cube1.size();
+            cube1.push_back(masscube1[i]);
+        }
+    }
+    remap2.assign(size2, -1);
+    for (int i = 0; i < size2; i++){
+        if (nvc2[i] != 2 || (masscube2[i].neighbour_same | masscube2[i].neighbour_other) != 0){
+            remap2[i] = (int)cube2.size();
+            cube2.push_back(masscube2[i]);
+        }
+    }
+
+    // spring IDs: masscube2 IDs follow the active masscube1 IDs
+    SpringGraph compact;
+    for (int i = 0; i < size1 + size2; i++){
+        int id = i < size1 ? remap1[i] : remap2[i - size1];
+        if (id < 0)
+            continue;
+        compact.addMasspoint();
+        for (uint s = springs.offsets[i]; s < springs.offsets[i + 1]; s++){
+            uint t = springs.targets[s];
+            compact.addSpring(t < (uint)size1 ? remap1[t] : (int)cube1.size() + remap2[t - size1], springs.lengthClass[s]);
+        }
+    }
+
+    springs = compact;
+    masscube1.swap(cube1);
+    masscube2.swap(cube2);
+}
+
 //--------------------------------------------------------------------------------------
 // Init (7) Deformable model data: add offset to picking helper IDs
 //--------------------------------------------------------------------------------------
 void DeformableBase::addOffset(){
 
-    // object masspoint1 offset in central containers, added to Z mpid
-    int offset1 = id * VCUBEWIDTH;
-    // object masspoint2 offset in central containers, added to Z mpid
-    int offset2 = id * (VCUBEWIDTH + 1);
+    // object masspoint1 offset in the picking textures, added to Z mpid
+    // (lattice widths differ between objects, every object gets the widest slot)
+    int offset1 = id * VCUBEWIDTH_MAX;
+    // object masspoint2 offset in the picking textures, added to Z mpid
+    int offset2 = id * (VCUBEWIDTH_MAX + 1);
 
     // add offset to particle data
     for (uint i = 0; i < particles.size(); i++){
@@ -524,10 +618,9 @@ void DeformableBase::addOffset(){
         particles[i].mpid2.z += offset2;
     }
 
-    // add offset to indexer data
+    // indexer data stays in the object's lattice, the catalogue entry of the object gives the offsets
     for (uint i = 0; i < indexcube.size(); i++){
-        indexcube[i].vc1index.z += offset1;
-        indexcube[i].vc2index.z += offset2;
+        indexcube[i].object = id;
     }
 }
 
@@ -537,34 +630,238 @@ void DeformableBase::addOffset(){
 //--------------------------------------------------------------------------------------
 void DeformableBase::initCollisionDetection(){
 
-    MassIDTypeVector tmp;
+    BVHLeafVector tmp;
 
-    // create MassIDs from surface masspoints in 1st vc
-    for (uint z = 0; z < VCUBEWIDTH; z++){
-        for (uint y = 0; y < VCUBEWIDTH; y++){
-            for (uint x = 0; x < VCUBEWIDTH; x++){
+    // create leaves from surface masspoints in 1st vc (tree leaves hold masscube indices)
+    for (int z = 0; z < cubeWidth; z++){
+        for (int y = 0; y < cubeWidth; y++){
+            for (int x = 0; x < cubeWidth; x++){
                 // type 1 masspoint -> model surface masspoints
-                if (nvc1[z][y][x] == 1){               
-                    tmp.push_back(MassIDType(z*VCUBEWIDTH*VCUBEWIDTH + y*VCUBEWIDTH + x, 1, masscube1[z*VCUBEWIDTH*VCUBEWIDTH + y*VCUBEWIDTH + x]));
-                    masscube1[z*VCUBEWIDTH*VCUBEWIDTH + y*VCUBEWIDTH + x].color = XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+                if (nvc1[index1(x, y, z)] == 1){
+                    int ind = remap1[index1(x, y, z)];
+                    tmp.push_back(BVHLEAF{ ind, 1, XMFLOAT3(masscube1[ind].newpos.x, masscube1[ind].newpos.y, masscube1[ind].newpos.z) });
+                    masscube1[ind].color = XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
                 }
             }
         }
     }
 
-    // create MassIDs from surface masspoints in 2nd vc
-    for (uint z = 0; z < VCUBEWIDTH + 1; z++){
-        for (uint y = 0; y < VCUBEWIDTH + 1; y++){
-            for (uint x = 0; x < VCUBEWIDTH + 1; x++){
+    // create leaves from surface masspoints in 2nd vc
+    for (int z = 0; z < cubeWidth + 1; z++){
+        for (int y = 0; y < cubeWidth + 1; y++){
+            for (int x = 0; x < cubeWidth + 1; x++){
                 // type 1 masspoint -> model surface masspoints
-                if (nvc2[z][y][x] == 1){               
-                    tmp.push_back(MassIDType(z*(VCUBEWIDTH + 1)*(VCUBEWIDTH + 1) + y*(VCUBEWIDTH + 1) + x, 2, masscube2[z*(VCUBEWIDTH + 1)*(VCUBEWIDTH + 1) + y*(VCUBEWIDTH + 1) + x]));
-                    masscube2[z*(VCUBEWIDTH + 1)*(VCUBEWIDTH + 1) + y*(VCUBEWIDTH + 1) + x].color = XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
+                if (nvc2[index2(x, y, z)] == 1){
+                    int ind = remap2[index2(x, y, z)];
+                    tmp.push_back(BVHLEAF{ ind, 2, XMFLOAT3(masscube2[ind].newpos.x, masscube2[ind].newpos.y, masscube2[ind].newpos.z) });
+                    masscube2[ind].color = XMFLOAT4(0.0f, 0.0f, 1.0f, 1.0f);
                 }
             }
         }
     }
-    ctree = BVHierarchy(tmp).bvh;         // store BVHierarchy
+    ctree = BVHierarchy(tmp, this->buildPool).bvh;         // store BVHierarchy
+}
+
+
+//--------------------------------------------------------------------------------------
+// Cache (.dfm): header, then the arrays of build() in section order, 16-byte aligned
+//--------------------------------------------------------------------------------------
+
+#define DFM_MAGIC               0x314D4644u
+#define DFM_VERSION             4u
+#define DFM_ALIGN               16
+
+// arrays of the cache file
+enum DFMSECTION { DFM_PARTICLES, DFM_MASSCUBE1, DFM_MASSCUBE2, DFM_REMAP1, DFM_REMAP2, DFM_INDEXCUBE, DFM_NVC1, DFM_NVC2,
+                  DFM_CTREE, DFM_FACES, DFM_SPRING_OFFSETS, DFM_SPRING_TARGETS, DFM_SPRING_CLASSES, DFM_SECTIONS };
+
+// element size of every section
+static const uint DFM_ELEMENT_SIZE[DFM_SECTIONS] = { sizeof(PARTICLE), sizeof(MASSPOINT), sizeof(MASSPOINT), sizeof(int), sizeof(int), sizeof(INDEXER),
+                                                     sizeof(uint), sizeof(uint), sizeof(BVBOX), sizeof(XMUINT3), sizeof(uint), sizeof(uint), sizeof(unsigned char) };
+
+/// First bytes of a cache file
+struct DFMHEADER
+{
+    uint magic;
+    uint version;
+    // build settings (cacheKey)
+    unsigned long long key;
+    // source file: size, modification time, hash of the contents
+    unsigned long long sourceSize;
+    long long sourceTime;
+    unsigned long long sourceHash;
+    // lattice and model data of initVars()
+    int cubeWidth;
+    int cubeCellSize;
+    XMFLOAT3 cubePos;
+    uint vertexCount;
+    uint normalCount;
+    uint faceCount;
+    // element size and count of every section (a changed struct invalidates the file)
+    uint elementSize[DFM_SECTIONS];
+    uint count[DFM_SECTIONS];
+};
+
+static size_t alignUp(size_t n){
+    return (n + DFM_ALIGN - 1) & ~(size_t)(DFM_ALIGN - 1);
+}
+
+// copy a section of the mapped file into a vector
+template <typename T, typename A>
+static void readSection(const char* section, uint count, std::vector<T, A>& out){
+    const T* first = (const T*)section;
+    out.assign(first, first + count);
+}
+
+//--------------------------------------------------------------------------------------
+// Cache key: requested lattice width, lattice constants
+//--------------------------------------------------------------------------------------
+unsigned long long DeformableBase::cacheKey() const {
+
+    unsigned long long h = 14695981039346656037ull;
+    const long long settings[4] = { this->cubeWidth, VCUBEWIDTH_MIN, VCUBEWIDTH_MAX, VCUBE_VERTEX_DENSITY };
+    for (long long v : settings)
+        h = (h ^ (unsigned long long)v) * 1099511628211ull;
+    return h == 0 ? 1 : h;
+}
+
+//--------------------------------------------------------------------------------------
+// Load cache: map the file, check the header and sizes, copy the sections
+//--------------------------------------------------------------------------------------
+bool DeformableBase::loadCache(unsigned long long key){
+
+    std::unique_ptr<MappedFile> mapped;
+    try {
+        mapped.reset(new MappedFile(this->cacheFile));
+    }
+    catch (const char*){
+        return false;
+    }
+    if (mapped->size() < sizeof(DFMHEADER))
+        return false;
+    DFMHEADER h;
+    memcpy(&h, mapped->data(), sizeof(DFMHEADER));
+    if (h.magic != DFM_MAGIC || h.version != DFM_VERSION || h.key != key)
+        return false;
+
+    // source file: another size is another file, the contents are only hashed when the
+    // size matches but the modification time does not (copied or touched files)
+    unsigned long long sourceSize;
+    long long sourceTime;
+    if (!MappedFile::stamp(this->file, sourceSize, sourceTime) || sourceSize != h.sourceSize)
+        return false;
+    if (sourceTime != h.sourceTime){
+        try {
+            if (MappedFile(this->file).hash() != h.sourceHash)
+                return false;
+        }
+        catch (const char*){
+            return false;
+        }
+    }
+
+    // section offsets, the file has to hold all of them
+    size_t offset[DFM_SECTIONS];
+    size_t end = alignUp(sizeof(DFMHEADER));
+    for (uint k = 0; k < DFM_SECTIONS; k++){
+        if (h.elementSize[k] != DFM_ELEMENT_SIZE[k])
+            return false;
+        offset[k] = end;
+        end = alignUp(end + (size_t)h.count[k] * DFM_ELEMENT_SIZE[k]);
+    }
+    if (end > mapped->size() || h.count[DFM_FACES] != h.faceCount)
+        return false;
+
+    const char* data = mapped->data();
+    readSection(data + offset[DFM_PARTICLES], h.count[DFM_PARTICLES], this->particles);
+    readSection(data + offset[DFM_MASSCUBE1], h.count[DFM_MASSCUBE1], this->masscube1);
+    readSection(data + offset[DFM_MASSCUBE2], h.count[DFM_MASSCUBE2], this->masscube2);
+    readSection(data + offset[DFM_REMAP1], h.count[DFM_REMAP1], this->remap1);
+    readSection(data + offset[DFM_REMAP2], h.count[DFM_REMAP2], this->remap2);
+    readSection(data + offset[DFM_INDEXCUBE], h.count[DFM_INDEXCUBE], this->indexcube);
+    readSection(data + offset[DFM_NVC1], h.count[DFM_NVC1], this->nvc1);
+    readSection(data + offset[DFM_NVC2], h.count[DFM_NVC2], this->nvc2);
+    readSection(data + offset[DFM_CTREE], h.count[DFM_CTREE], this->ctree);
+    this->springs.clear();
+    readSection(data + offset[DFM_SPRING_OFFSETS], h.count[DFM_SPRING_OFFSETS], this->springs.offsets);
+    readSection(data + offset[DFM_SPRING_TARGETS], h.count[DFM_SPRING_TARGETS], this->springs.targets);
+    readSection(data + offset[DFM_SPRING_CLASSES], h.count[DFM_SPRING_CLASSES], this->springs.lengthClass);
+
+    readSection(data + offset[DFM_FACES], h.count[DFM_FACES], this->faces);
+    this->vertices.clear();
+    this->normals.clear();
+    this->cubeWidth = h.cubeWidth;
+    this->cubeCellSize = h.cubeCellSize;
+    this->cubePos = h.cubePos;
+    this->vertexCount = h.vertexCount;
+    this->normalCount = h.normalCount;
+    this->faceCount = h.faceCount;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Save cache: header and sections; a file that cannot be written is skipped
+//--------------------------------------------------------------------------------------
+void DeformableBase::saveCache(unsigned long long key) const {
+
+    DFMHEADER h;
+    memset(&h, 0, sizeof(DFMHEADER));
+    h.magic = DFM_MAGIC;
+    h.version = DFM_VERSION;
+    h.key = key;
+    if (!MappedFile::stamp(this->file, h.sourceSize, h.sourceTime))
+        return;
+    try {
+        h.sourceHash = MappedFile(this->file).hash();
+    }
+    catch (const char*){
+        return;
+    }
+    h.cubeWidth = this->cubeWidth;
+    h.cubeCellSize = this->cubeCellSize;
+    h.cubePos = this->cubePos;
+    h.vertexCount = this->vertexCount;
+    h.normalCount = this->normalCount;
+    h.faceCount = this->faceCount;
+
+    const char* sections[DFM_SECTIONS] = { (const char*)this->particles.data(), (const char*)this->masscube1.data(), (const char*)this->masscube2.data(),
+                                           (const char*)this->remap1.data(), (const char*)this->remap2.data(), (const char*)this->indexcube.data(),
+                                           (const char*)this->nvc1.data(), (const char*)this->nvc2.data(), (const char*)this->ctree.data(),
+                                           (const char*)this->faces.data(), (const char*)this->springs.offsets.data(),
+                                           (const char*)this->springs.targets.data(), (const char*)this->springs.lengthClass.data() };
+    const size_t counts[DFM_SECTIONS] = { this->particles.size(), this->masscube1.size(), this->masscube2.size(), this->remap1.size(), this->remap2.size(),
+                                          this->indexcube.size(), this->nvc1.size(), this->nvc2.size(), this->ctree.size(), this->faces.size(),
+                                          this->springs.offsets.size(), this->springs.targets.size(), this->springs.lengthClass.size() };
+    for (uint k = 0; k < DFM_SECTIONS; k++){
+        h.elementSize[k] = DFM_ELEMENT_SIZE[k];
+        h.count[k] = (uint)counts[k];
+    }
+
+    // the directory of the file, if it does not exist yet (one level)
+    size_t slash = this->cacheFile.find_last_of("/\\");
+    if (slash != std::string::npos && slash > 0){
+        std::string directory = this->cacheFile.substr(0, slash);
+#ifdef _WIN32
+        CreateDirectoryA(directory.c_str(), nullptr);
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    std::ofstream output(this->cacheFile, std::ios::binary | std::ios::trunc);
+    if (!output)
+        return;
+    const char zeros[DFM_ALIGN] = { 0 };
+    size_t written = sizeof(DFMHEADER);
+    output.write((const char*)&h, sizeof(DFMHEADER));
+    for (uint k = 0; k < DFM_SECTIONS; k++){
+        output.write(zeros, alignUp(written) - written);
+        written = alignUp(written);
+        size_t bytes = (size_t)h.count[k] * h.elementSize[k];
+        output.write(sections[k], bytes);
+        written += bytes;
+    }
+    output.write(zeros, alignUp(written) - written);
 }
 
 
@@ -607,6 +904,23 @@ void DeformableBase::translate(int x, int y, int z){
     initCollisionDetection();
 }
 
+//--------------------------------------------------------------------------------------
+// Memory: capacity of the import arrays and of the built arrays
+//--------------------------------------------------------------------------------------
+size_t DeformableBase::geometryBytes() const {
+
+    return vertices.capacity() * sizeof(XMFLOAT3) + normals.capacity() * sizeof(XMFLOAT3) + faces.capacity() * sizeof(XMUINT3);
+}
+
+size_t DeformableBase::builtBytes() const {
+
+    return particles.capacity() * sizeof(PARTICLE) + (masscube1.capacity() + masscube2.capacity()) * sizeof(MASSPOINT) +
+        (remap1.capacity() + remap2.capacity()) * sizeof(int) + indexcube.capacity() * sizeof(INDEXER) +
+        (nvc1.capacity() + nvc2.capacity()) * sizeof(uint) + ctree.capacity() * sizeof(BVBOX) +
+        (springs.offsets.capacity() + springs.targets.capacity() + springs.springEdge.capacity() + springs.edgeA.capacity() + springs.edgeB.capacity()) * sizeof(uint) +
+        springs.springSign.capacity() * sizeof(float) + (springs.lengthClass.capacity() + springs.edgeClass.capacity()) * sizeof(unsigned char);
+}
+
 //--------------------------------------------------------------------------------------
 // Destructor
 //--------------------------------------------------------------------------------------
@@ -45,35 +45,20 @@ void DeformableFBX::importFile(){
     // successful import, process data
     else
     {
-        // fill vertex array
-        for (uint i = 0; i < scene->mMeshes[0]->mNumVertices; i++)
+        // fill vertex and normal arrays
+        const aiMesh* mesh = scene->mMeshes[0];
+        this->vertices.resize(mesh->mNumVertices);
+        this->normals.resize(mesh->mNumVertices);
+        for (uint i = 0; i < mesh->mNumVertices; i++)
         {
-            vec1float v;
-            v.push_back(-1.0f);
-            v.push_back(scene->mMeshes[0]->mVertices[i].x);
-            v.push_back(scene->mMeshes[0]->mVertices[i].y);
-            v.push_back(scene->mMeshes[0]->mVertices[i].z);
-            this->vertices.push_back(v);
-        }
-        // fill normals array
-        for (uint i = 0; i < scene->mMeshes[0]->mNumVertices; i++)
-        {
-            vec1float n;
-            n.push_back(-1.0f);
-            n.push_back(scene->mMeshes[0]->mNormals[i].x);
-            n.push_back(scene->mMeshes[0]->mNormals[i].y);
-            n.push_back(scene->mMeshes[0]->mNormals[i].z);
-            this->normals.push_back(n);
+            this->vertices[i] = XMFLOAT3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+            this->normals[i] = XMFLOAT3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
         }
         // fill faces array
-        for (uint i = 0; i < scene->mMeshes[0]->mNumFaces; i++)
+        this->faces.resize(mesh->mNumFaces);
+        for (uint i = 0; i < mesh->mNumFaces; i++)
         {
-            vec1int f;
-            f.push_back(-1);
-            f.push_back(scene->mMeshes[0]->mFaces[i].mIndices[0]);
-            f.push_back(scene->mMeshes[0]->mFaces[i].mIndices[1]);
-            f.push_back(scene->mMeshes[0]->mFaces[i].mIndices[2]);
-            this->faces.push_back(f);
+            this->faces[i] = XMUINT3(mesh->mFaces[i].mIndices[0], mesh->mFaces[i].mIndices[1], mesh->mFaces[i].mIndices[2]);
         }
 
     }
@@ -9,13 +9,9 @@
 // @Copyright (c) pgq
 //--------------------------------------------------------------------------------------
 
-#include <iostream>
-#include <fstream>
-#include <sstream>
-#include <algorithm>
-#include <boost/algorithm/string.hpp>
-#include "DXUT.h"
+#include <cstring>
 #include "../Headers/DeformableOBJ.h"
+#include "../Headers/OBJParser.h"
 #include "../Headers/Constants.h"
 #include "../Headers/Collision.h"
 
@@ -26,54 +22,29 @@
 //--------------------------------------------------------------------------------------
 void DeformableOBJ::importFile(){
 
-    // Open file
-    std::ifstream input;
-    input.open(this->file);
+    // Parse file (flat arrays), chunks on the build pool
+    OBJMESH mesh = OBJParser::parse(this->file, this->buildPool);
+    size_t vertexCount = mesh.positions.size() / 3;
 
-    // Process file
-    while (!input.eof()){
-        // get line
-        std::string line;
-        getline(input, line);
+    // store vertices
+    this->vertices.resize(vertexCount);
+    memcpy(this->vertices.data(), mesh.positions.data(), vertexCount * sizeof(XMFLOAT3));
 
-        // split at spaces
-        vec1float v;
-        vec1float n;
-        vec1int f;
-        std::istringstream buf(line);
-        std::istream_iterator<std::string> start(buf), end;
-        std::vector<std::string> parts(start, end);
-
-        // store vertex
-        if (line[0] == 'v' && line[1] != 'n'){
-            // parse
-            for (auto& s : parts){
-                v.push_back((float)atof(s.c_str()));
-            }
-            //store
-            this->vertices.push_back(v);
-        }
-        // store normal
-        else if (line[0] == 'v' && line[1] == 'n'){
-            // parse
-            for (auto& s : parts){
-                n.push_back((float)atof(s.c_str()));
-            }
-            //store
-            this->normals.push_back(n);
-        }
-        // store face
-        else if (line[0] == 'f'){
-            // parse
-            for (auto& s : parts){
-                auto z = strtok(const_cast<char*>(s.c_str()), "//");
-                f.push_back(atoi(z));
-            }
-            //store
-            this->faces.push_back(f);
+    // store normals, one per vertex: as listed, or from the face corners if the counts differ
+    if (mesh.normals.size() == mesh.positions.size() || mesh.normals.empty()){
+        this->normals.resize(mesh.normals.size() / 3);
+        memcpy(this->normals.data(), mesh.normals.data(), mesh.normals.size() * sizeof(float));
+    }
+    else {
+        this->normals.assign(vertexCount, XMFLOAT3(0, 0, 0));
+        for (size_t i = 0; i < mesh.indices.size(); i++){
+            uint n = mesh.normalIndices[i];
+            if (3 * (size_t)n < mesh.normals.size())
+                this->normals[mesh.indices[i]] = XMFLOAT3(mesh.normals[3 * n], mesh.normals[3 * n + 1], mesh.normals[3 * n + 2]);
         }
     }
 
-    // Close file
-    input.close();
-}
\ No newline at end of file
+    // store faces
+    this->faces.resize(mesh.indices.size() / 3);
+    memcpy(this->faces.data(), mesh.indices.data(), this->faces.size() * sizeof(XMUINT3));
+}
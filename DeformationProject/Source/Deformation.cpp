@@ -27,6 +27,7 @@
 #include <future>
 #include <atomic>
 #include <array>
+#include <chrono>
 #include <time.h>
 #include "../Headers/resource.h"
 #include "../Headers/WaitDlg.h"
@@ -34,6 +35,10 @@
 #include "../Headers/DeformableFBX.h"
 #include "../Headers/Constants.h"
 #include "../Headers/Collision.h"
+#include "../Headers/BVHRefit.h"
+#include "../Headers/SimulationBackend.h"
+#include "../Headers/CPUSimulation.h"
+#include "../Headers/FixedStepper.h"
 #include "../Headers/IPCClient.h"
 #include "../Headers/Quaternion.hpp"
 
@@ -62,6 +67,9 @@ ID3D11Buffer*                       bvhDataBuffer2 = nullptr;
 ID3D11Buffer*                       csConstantBuffer = nullptr;
 ID3D11Buffer*                       gsConstantBuffer = nullptr;
 ID3D11Buffer*                       indexerBuffer = nullptr;
+ID3D11Buffer*                       remapBuffer = nullptr;
+ID3D11Buffer*                       refitBuffer = nullptr;
+ID3D11Buffer*                       refitConstantBuffer = nullptr;
 ID3D11Buffer*                       masscube1Buffer1 = nullptr;
 ID3D11Buffer*                       masscube1Buffer2 = nullptr;
 ID3D11Buffer*                       masscube2Buffer1 = nullptr;
@@ -76,6 +84,8 @@ ID3D11ShaderResourceView*           bvhCatalogueSRV2 = nullptr;
 ID3D11ShaderResourceView*           bvhDataSRV1 = nullptr;
 ID3D11ShaderResourceView*           bvhDataSRV2 = nullptr;
 ID3D11ShaderResourceView*           indexerSRV = nullptr;
+ID3D11ShaderResourceView*           remapSRV = nullptr;
+ID3D11ShaderResourceView*           refitSRV = nullptr;
 ID3D11ShaderResourceView*           masscube1SRV1 = nullptr;
 ID3D11ShaderResourceView*           masscube1SRV2 = nullptr;
 ID3D11ShaderResourceView*           masscube2SRV1 = nullptr;
@@ -103,6 +113,7 @@ ID3D11UnorderedAccessView*          particleUAV2 = nullptr;
 // shaders
 
 ID3D11ComputeShader*                bvhCS = nullptr;
+ID3D11ComputeShader*                refitCS = nullptr;
 ID3D11ComputeShader*                physicsCS1 = nullptr;
 ID3D11ComputeShader*                physicsCS2 = nullptr;
 ID3D11ComputeShader*                updateCS = nullptr;
@@ -131,11 +142,56 @@ uint                                particleCount;
 uint                                faceCount;
 // # of total collision masspoints
 uint                                bvhPointCount;
+// level-by-level refit passes of the collision trees
+BVHRefit                            bvhRefit;
 // #s of total masspoints
 uint                                mass1Count;
 uint                                mass2Count;
 // cell size in masscubes
 uint                                cubeCellSize;
+// lattice width of the widest object
+uint                                maxCubeWidth;
+// active masspoints of the largest object in the masscubes (masscube dispatch width)
+uint                                maxMass1Count;
+uint                                maxMass2Count;
+// simulation backend (compute shaders or CPU solver)
+std::unique_ptr<SimulationBackend>  simulation;
+// time integration of the scene (CPU backend; the compute shaders always step with Verlet)
+CPUSimulation::Integrator           sceneIntegrator = CPUSimulation::INTEGRATOR_VERLET;
+// contact search of the scene (CPU backend only)
+CPUSimulation::CollisionMode        sceneCollisionMode = CPUSimulation::COLLISION_BVH;
+// self-collision of the objects (CPU backend only)
+bool                                sceneSelfCollision = false;
+// continuous collision of the objects (CPU backend only)
+bool                                sceneContinuousCollision = false;
+// leaf contacts kept between steps (CPU backend only)
+bool                                sceneContactCache = false;
+// contact queries in packets of neighbouring masspoints (CPU backend only)
+bool                                sceneBatchedQueries = false;
+// static environment besides the table (CPU backend only), distance grid cached in the file
+StaticColliders                     sceneColliders(50.0f);
+std::string                         sceneColliderCache = "../scene.sdf";
+// fixed timestep substeps of the frames
+FixedStepper                        stepper;
+#if CPUSIMULATION == 0
+/// GPU time of the substeps of one frame: timestamps around them inside a disjoint query
+struct SUBSTEPTIMER
+{
+    ID3D11Query* disjoint;
+    ID3D11Query* begin;
+    ID3D11Query* end;
+    // substeps between the timestamps, 0: not in flight
+    uint steps;
+};
+// query sets of the last frames (ring), the next one to issue
+SUBSTEPTIMER                        substepTimers[SIM_TIMER_FRAMES] = {};
+uint                                substepTimer = 0;
+#endif
+// system memory copy of the simulated state, CPU backend only
+MassVector                          snapshotMasscube1;
+MassVector                          snapshotMasscube2;
+std::vector<PARTICLE>               snapshotParticles;
+std::vector<PARTICLE>               snapshotPrevious;
 
 // Window & picking variables
 
@@ -252,11 +308,15 @@ bool CALLBACK ModifyDeviceSettings(DXUTDeviceSettings* pDeviceSettings, void* pU
 }
 
 //--------------------------------------------------------------------------------------
-// Update data at the beginning of every frame (no rendering call, only data updates)  
+// Simulation backend running the compute shaders on the buffers created in initBuffers
 //--------------------------------------------------------------------------------------
-void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
+class D3D11Simulation final : public SimulationBackend
 {
-    if (isFocused)
+public:
+    // the GPU buffers are shared with rendering and filled by initBuffers
+    void load(std::vector<std::unique_ptr<DeformableBase>>& objects) override {}
+
+    void step(const CB_CS& cb) override
     {
         HRESULT hr;
 
@@ -266,8 +326,8 @@ void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
         // EXECUTE FIRST COMPUTE SHADER: UPDATE VOLUMETRIC MODELS
         pd3dImmediateContext->CSSetShader(physicsCS1, nullptr, 0);
 
-        ID3D11ShaderResourceView* srvs[6] = { masscube1SRV2, masscube2SRV2, pickingSRV1, pickingSRV2, bvhCatalogueSRV1, bvhDataSRV1 };
-        pd3dImmediateContext->CSSetShaderResources(0, 6, srvs);
+        ID3D11ShaderResourceView* srvs[7] = { masscube1SRV2, masscube2SRV2, pickingSRV1, pickingSRV2, bvhCatalogueSRV1, bvhDataSRV1, remapSRV };
+        pd3dImmediateContext->CSSetShaderResources(0, 7, srvs);
 
         ID3D11UnorderedAccessView* aUAViews[2] = { masscube1UAV1, masscube2UAV1 };
         pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, aUAViews, (UINT*)(&aUAViews));
@@ -275,66 +335,21 @@ void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
         // For CS constant buffer
         D3D11_MAPPED_SUBRESOURCE MappedResource;
         V(pd3dImmediateContext->Map(csConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
-        auto pcbCS = reinterpret_cast<CB_CS*>(MappedResource.pData);
-
-        // Update CS constant buffer
-        pcbCS->cubeWidth = VCUBEWIDTH;
-        pcbCS->cubeCellSize = cubeCellSize;
-        pcbCS->objectCount = objectCount;
-        pcbCS->stiffness = stiffnessConstant;
-        pcbCS->damping = dampingConstant;
-        pcbCS->dt = fElapsedTime;
-        pcbCS->im = invMassConstant;
-        pcbCS->gravity = gravityConstant;
-        pcbCS->tablePos = tablePositionConstant;
-        pcbCS->collisionRange = collisionRangeConstant;
-
-        // Send picking data to GPU
-        if (isPicking)
-            pcbCS->isPicking = 1;
-        else
-            pcbCS->isPicking = 0;
-
-        // V matrix
-        XMMATRIX view = camera.GetViewMatrix();
-        // P matrix
-        XMMATRIX proj = camera.GetProjMatrix();
-        // eye pos
-        XMVECTOR eye = camera.GetEyePt();
-
-        // VP matrix
-        XMMATRIX viewproj = XMMatrixMultiply(view, proj);
-        // E matrix
-        XMMATRIX trans = XMMatrixTranslation(XMVectorGetX(eye), XMVectorGetY(eye), XMVectorGetZ(eye));
-
-        // current mouse ndc
-        XMVECTOR pickdir = XMVectorSet((float)((2.0f*mouseClickX) / windowWidth) - 1.0f,
-            (-1)*((float)((2.0f*mouseClickY) / windowHeight) - 1.0f), 0, 1);
-        // (E*VP)^-1
-        trans = XMMatrixInverse(nullptr, XMMatrixMultiply(trans, viewproj));
-        // pick direction = cmouse_ndc * (E*VP)^-1  --> normalized
-        pickdir = XMVector3Normalize(XMVector4Transform(pickdir, trans));
-        XMVectorSetW(pickdir, 1.0f);
-
-        pcbCS->pickOriginX = pickOriginX;
-        pcbCS->pickOriginY = pickOriginY;
-        XMStoreFloat4(&pcbCS->pickDir, pickdir);
-        XMStoreFloat4(&pcbCS->eyePos, eye);
-
+        memcpy(MappedResource.pData, &cb, sizeof(CB_CS));
         pd3dImmediateContext->Unmap(csConstantBuffer, 0);
         ID3D11Buffer* ppCB[1] = { csConstantBuffer };
         pd3dImmediateContext->CSSetConstantBuffers(0, 1, ppCB);
 
-        // Run first CS (first volcube)
-        pd3dImmediateContext->Dispatch((UINT)ceil((float)VCUBEWIDTH*VCUBEWIDTH*VCUBEWIDTH*objectCount / MASSPOINT_TGSIZE), 1, 1);
+        // Run first CS (first volcube), one row of groups per object, one thread per active masspoint
+        pd3dImmediateContext->Dispatch((UINT)ceil((float)maxMass1Count / MASSPOINT_TGSIZE), objectCount, 1);
 
         // Run second CS (second volcube)
         pd3dImmediateContext->CSSetShader(physicsCS2, nullptr, 0);
-        pd3dImmediateContext->Dispatch((UINT)ceil((float)(VCUBEWIDTH + 1)*(VCUBEWIDTH + 1)*(VCUBEWIDTH + 1)*objectCount / MASSPOINT_TGSIZE), 1, 1);
+        pd3dImmediateContext->Dispatch((UINT)ceil((float)maxMass2Count / MASSPOINT_TGSIZE), objectCount, 1);
 
         // Unbind resources for CS
-        ID3D11ShaderResourceView* srvnull[6] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
-        pd3dImmediateContext->CSSetShaderResources(0, 6, srvnull);
+        ID3D11ShaderResourceView* srvnull[7] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+        pd3dImmediateContext->CSSetShaderResources(0, 7, srvnull);
 
         ID3D11UnorderedAccessView* ppUAViewNULL[2] = { nullptr, nullptr };
         pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, ppUAViewNULL, (UINT*)(&aUAViews));
@@ -352,8 +367,8 @@ void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
         // EXECUTE SECOND COMPUTE SHADER: UPDATE POSITIONS
         pd3dImmediateContext->CSSetShader(updateCS, nullptr, 0);
 
-        ID3D11ShaderResourceView* uaRViews[1] = { indexerSRV };
-        pd3dImmediateContext->CSSetShaderResources(0, 1, uaRViews);
+        ID3D11ShaderResourceView* uaRViews[3] = { indexerSRV, bvhCatalogueSRV1, remapSRV };
+        pd3dImmediateContext->CSSetShaderResources(0, 3, uaRViews);
         ID3D11UnorderedAccessView* uaUAViews[3] = { particleUAV2, masscube1UAV2, masscube2UAV2 };
         pd3dImmediateContext->CSSetUnorderedAccessViews(0, 3, uaUAViews, (UINT*)(&uaUAViews));
 
@@ -361,8 +376,8 @@ void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
 
         ID3D11UnorderedAccessView* uppUAViewNULL[3] = { nullptr, nullptr, nullptr };
         pd3dImmediateContext->CSSetUnorderedAccessViews(0, 3, uppUAViewNULL, (UINT*)(&uaUAViews));
-        ID3D11ShaderResourceView* uppSRVNULL[1] = { nullptr };
-        pd3dImmediateContext->CSSetShaderResources(0, 1, uppSRVNULL);
+        ID3D11ShaderResourceView* uppSRVNULL[3] = { nullptr, nullptr, nullptr };
+        pd3dImmediateContext->CSSetShaderResources(0, 3, uppSRVNULL);
 
         std::swap(particleBuffer1, particleBuffer2);
         std::swap(particleSRV1, particleSRV2);
@@ -372,17 +387,29 @@ void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
         //--------------------------------------------------------------------------------------
         // EXECUTE THIRD COMPUTE SHADER: UPDATE COLLISION DETECTION DATA
 
-        pd3dImmediateContext->CSSetShader(bvhCS, nullptr, 0);
-
-        ID3D11ShaderResourceView* bvhRViews[4] = { masscube1SRV2, masscube2SRV2, bvhCatalogueSRV1, bvhDataSRV1 };
-        pd3dImmediateContext->CSSetShaderResources(0, 4, bvhRViews);
+        ID3D11ShaderResourceView* bvhRViews[5] = { masscube1SRV2, masscube2SRV2, bvhCatalogueSRV1, bvhDataSRV1, refitSRV };
+        pd3dImmediateContext->CSSetShaderResources(0, 5, bvhRViews);
         ID3D11UnorderedAccessView* bvhUAViews[2] = { bvhCatalogueUAV2, bvhDataUAV2 };
         pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, bvhUAViews, (UINT*)(&bvhUAViews));
 
+        // Refit passes bottom-up, every tree at once: one dispatch per level, one thread per node
+        pd3dImmediateContext->CSSetShader(refitCS, nullptr, 0);
+        for (uint p = 0; p < bvhRefit.passCount(); p++){
+            CB_REFIT rcb = { bvhRefit.passFirst(p), bvhRefit.passSize(p), p == 0 ? 1u : 0u, 0 };
+            V(pd3dImmediateContext->Map(refitConstantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedResource));
+            memcpy(MappedResource.pData, &rcb, sizeof(CB_REFIT));
+            pd3dImmediateContext->Unmap(refitConstantBuffer, 0);
+            ID3D11Buffer* ppRCB[2] = { csConstantBuffer, refitConstantBuffer };
+            pd3dImmediateContext->CSSetConstantBuffers(0, 2, ppRCB);
+            pd3dImmediateContext->Dispatch((UINT)ceil((float)rcb.count / REFIT_TGSIZE), 1, 1);
+        }
+
+        // Catalogue from the tree roots
+        pd3dImmediateContext->CSSetShader(bvhCS, nullptr, 0);
         pd3dImmediateContext->Dispatch(objectCount, 1, 1);
 
-        ID3D11ShaderResourceView* bvhSRViewNULL[4] = { nullptr, nullptr, nullptr, nullptr };
-        pd3dImmediateContext->CSSetShaderResources(0, 4, bvhSRViewNULL);
+        ID3D11ShaderResourceView* bvhSRViewNULL[5] = { nullptr, nullptr, nullptr, nullptr, nullptr };
+        pd3dImmediateContext->CSSetShaderResources(0, 5, bvhSRViewNULL);
         ID3D11UnorderedAccessView* bvhUAViewNULL[2] = { nullptr, nullptr };
         pd3dImmediateContext->CSSetUnorderedAccessViews(0, 2, bvhUAViewNULL, (UINT*)(bvhUAViews));
 
@@ -393,6 +420,202 @@ void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
         std::swap(bvhDataSRV1, bvhDataSRV2);
         std::swap(bvhDataUAV1, bvhDataUAV2);
         //--------------------------------------------------------------------------------------
+    }
+
+    // read back the current state through staging buffers (slow, for tools and tests)
+    void exportSnapshot(MassVector& masscube1, MassVector& masscube2, std::vector<PARTICLE>& particles) override
+    {
+        masscube1.resize(mass1Count);
+        masscube2.resize(mass2Count);
+        particles.resize(particleCount);
+        readBuffer(masscube1Buffer2, masscube1.data(), sizeof(MASSPOINT) * mass1Count);
+        readBuffer(masscube2Buffer2, masscube2.data(), sizeof(MASSPOINT) * mass2Count);
+        readBuffer(particleBuffer1, particles.data(), sizeof(PARTICLE) * particleCount);
+    }
+
+    void exportParticles(std::vector<PARTICLE>& particles) override
+    {
+        particles.resize(particleCount);
+        readBuffer(particleBuffer1, particles.data(), sizeof(PARTICLE) * particleCount);
+    }
+
+    const char* name() const override { return "D3D11"; }
+
+private:
+    // copy the contents of a GPU buffer to system memory
+    void readBuffer(ID3D11Buffer* buffer, void* dst, size_t size)
+    {
+        auto pd3dDevice = DXUTGetD3D11Device();
+        auto pd3dImmediateContext = DXUTGetD3D11DeviceContext();
+
+        D3D11_BUFFER_DESC desc;
+        buffer->GetDesc(&desc);
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+
+        ID3D11Buffer* staging = nullptr;
+        if (FAILED(pd3dDevice->CreateBuffer(&desc, nullptr, &staging)))
+            throw "Failed to create staging buffer";
+        pd3dImmediateContext->CopyResource(staging, buffer);
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (SUCCEEDED(pd3dImmediateContext->Map(staging, 0, D3D11_MAP_READ, 0, &mapped))){
+            memcpy(dst, mapped.pData, size);
+            pd3dImmediateContext->Unmap(staging, 0);
+        }
+        SAFE_RELEASE(staging);
+    }
+};
+
+//--------------------------------------------------------------------------------------
+// Upload the state of the CPU simulation to the buffers used for rendering
+//--------------------------------------------------------------------------------------
+void uploadSnapshot()
+{
+    auto pd3dImmediateContext = DXUTGetD3D11DeviceContext();
+
+    simulation->exportSnapshot(snapshotMasscube1, snapshotMasscube2, snapshotParticles);
+    pd3dImmediateContext->UpdateSubresource(masscube1Buffer2, 0, nullptr, snapshotMasscube1.data(), 0, 0);
+    pd3dImmediateContext->UpdateSubresource(masscube2Buffer2, 0, nullptr, snapshotMasscube2.data(), 0, 0);
+    pd3dImmediateContext->UpdateSubresource(particleBuffer1, 0, nullptr, snapshotParticles.data(), 0, 0);
+}
+
+//--------------------------------------------------------------------------------------
+// Upload the particles of the CPU simulation as the previous substep state (interpolation)
+//--------------------------------------------------------------------------------------
+void uploadPrevious()
+{
+    auto pd3dImmediateContext = DXUTGetD3D11DeviceContext();
+
+    simulation->exportParticles(snapshotPrevious);
+    pd3dImmediateContext->UpdateSubresource(particleBuffer2, 0, nullptr, snapshotPrevious.data(), 0, 0);
+}
+
+#if CPUSIMULATION == 0
+//--------------------------------------------------------------------------------------
+// Pass the GPU time of the finished substep query sets to the stepper, oldest first
+// (no flush, the queries of the last frames are usually not done yet)
+//--------------------------------------------------------------------------------------
+void readSubstepTimers()
+{
+    auto pd3dImmediateContext = DXUTGetD3D11DeviceContext();
+
+    for (uint i = 0; i < SIM_TIMER_FRAMES; i++){
+        SUBSTEPTIMER& timer = substepTimers[(substepTimer + i) % SIM_TIMER_FRAMES];
+        if (timer.steps == 0)
+            continue;
+
+        D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+        UINT64 begin, end;
+        if (pd3dImmediateContext->GetData(timer.disjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+            pd3dImmediateContext->GetData(timer.begin, &begin, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+            pd3dImmediateContext->GetData(timer.end, &end, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+            break;
+
+        // the GPU clock changed in between (power state): the timestamps are not comparable
+        if (!disjoint.Disjoint && end > begin)
+            stepper.end((double)(end - begin) * 1000.0 / disjoint.Frequency, timer.steps);
+        timer.steps = 0;
+    }
+}
+#endif
+
+//--------------------------------------------------------------------------------------
+// Update data at the beginning of every frame (no rendering call, only data updates)  
+//--------------------------------------------------------------------------------------
+void CALLBACK OnFrameMove(double fTime, float fElapsedTime, void* pUserContext)
+{
+    if (isFocused)
+    {
+        // Update CS constant buffer
+        CB_CS cb;
+        ZeroMemory(&cb, sizeof(CB_CS));
+        cb.cubeWidth = maxCubeWidth;
+        cb.cubeCellSize = cubeCellSize;
+        cb.objectCount = objectCount;
+        cb.stiffness = stiffnessConstant;
+        cb.damping = dampingConstant;
+        cb.dt = timestepConstant;
+        cb.im = invMassConstant;
+        cb.gravity = gravityConstant;
+        cb.tablePos = tablePositionConstant;
+        cb.collisionRange = collisionRangeConstant;
+
+        // Send picking data to GPU
+        if (isPicking)
+            cb.isPicking = 1;
+        else
+            cb.isPicking = 0;
+
+        // V matrix
+        XMMATRIX view = camera.GetViewMatrix();
+        // P matrix
+        XMMATRIX proj = camera.GetProjMatrix();
+        // eye pos
+        XMVECTOR eye = camera.GetEyePt();
+
+        // VP matrix
+        XMMATRIX viewproj = XMMatrixMultiply(view, proj);
+        // E matrix
+        XMMATRIX trans = XMMatrixTranslation(XMVectorGetX(eye), XMVectorGetY(eye), XMVectorGetZ(eye));
+
+        // current mouse ndc
+        XMVECTOR pickdir = XMVectorSet((float)((2.0f*mouseClickX) / windowWidth) - 1.0f,
+            (-1)*((float)((2.0f*mouseClickY) / windowHeight) - 1.0f), 0, 1);
+        // (E*VP)^-1
+        trans = XMMatrixInverse(nullptr, XMMatrixMultiply(trans, viewproj));
+        // pick direction = cmouse_ndc * (E*VP)^-1  --> normalized
+        pickdir = XMVector3Normalize(XMVector4Transform(pickdir, trans));
+        XMVectorSetW(pickdir, 1.0f);
+
+        cb.pickOriginX = pickOriginX;
+        cb.pickOriginY = pickOriginY;
+        XMStoreFloat4(&cb.pickDir, pickdir);
+        XMStoreFloat4(&cb.eyePos, eye);
+
+        // Advance the simulation in fixed substeps, as many as the frame time and the budget allow
+        uint substeps = stepper.begin(fElapsedTime, cb.dt);
+#if CPUSIMULATION == 1
+        auto start = std::chrono::high_resolution_clock::now();
+#else
+        // step() only queues the compute shaders: the substeps are timed on the GPU, the stepper
+        // gets their time a few frames later (no timing while every query set is in flight)
+        readSubstepTimers();
+        auto pd3dImmediateContext = DXUTGetD3D11DeviceContext();
+        SUBSTEPTIMER* timer = substeps > 0 && substepTimers[substepTimer].steps == 0 ? &substepTimers[substepTimer] : nullptr;
+        if (timer)
+        {
+            pd3dImmediateContext->Begin(timer->disjoint);
+            pd3dImmediateContext->End(timer->begin);
+        }
+#endif
+        for (uint s = 0; s < substeps; s++)
+        {
+#if CPUSIMULATION == 1
+            // rendering blends from the state before the last substep
+            if (s + 1 == substeps)
+                uploadPrevious();
+#endif
+            simulation->step(cb);
+        }
+#if CPUSIMULATION == 1
+        auto end = std::chrono::high_resolution_clock::now();
+        stepper.end(std::chrono::duration<double, std::milli>(end - start).count(), substeps);
+
+        // Results of the CPU solver are rendered from the GPU buffers
+        if (substeps > 0)
+            uploadSnapshot();
+#else
+        if (timer)
+        {
+            pd3dImmediateContext->End(timer->end);
+            pd3dImmediateContext->End(timer->disjoint);
+            timer->steps = substeps;
+            substepTimer = (substepTimer + 1) % SIM_TIMER_FRAMES;
+        }
+#endif
 
         // Update the camera's position based on user input 
         camera.FrameMove(fElapsedTime);
@@ -537,6 +760,8 @@ void CALLBACK OnKeyboard(UINT nChar, bool bKeyDown, bool bAltDown, void* pUserCo
         SAFE_RELEASE(bvhDataBuffer1);
         SAFE_RELEASE(bvhDataBuffer2);
         SAFE_RELEASE(indexerBuffer);
+        SAFE_RELEASE(remapBuffer);
+        SAFE_RELEASE(refitBuffer);
         SAFE_RELEASE(masscube1Buffer1);
         SAFE_RELEASE(masscube1Buffer2);
         SAFE_RELEASE(masscube2Buffer1);
@@ -550,6 +775,8 @@ void CALLBACK OnKeyboard(UINT nChar, bool bKeyDown, bool bAltDown, void* pUserCo
         SAFE_RELEASE(bvhDataSRV1);
         SAFE_RELEASE(bvhDataSRV2);
         SAFE_RELEASE(indexerSRV);
+        SAFE_RELEASE(remapSRV);
+        SAFE_RELEASE(refitSRV);
         SAFE_RELEASE(masscube1SRV1);
         SAFE_RELEASE(masscube1SRV2);
         SAFE_RELEASE(masscube2SRV1);
@@ -567,6 +794,7 @@ void CALLBACK OnKeyboard(UINT nChar, bool bKeyDown, bool bAltDown, void* pUserCo
         SAFE_RELEASE(particleUAV1);
         SAFE_RELEASE(particleUAV2);
         initBuffers(DXUTGetD3D11Device());
+        simulation->load(sceneObjects);
         break;
     }
     default: break;
@@ -593,22 +821,45 @@ bool CALLBACK IsD3D11DeviceAcceptable(const CD3D11EnumAdapterInfo *AdapterInfo,
 //--------------------------------------------------------------------------------------
 HRESULT importFiles(){
 
+    // builds run their per-vertex and per-masspoint stages on every core,
+    // the bunny is built once and then read from its cache in DFM_CACHE_DIR
+    ThreadPool buildPool;
+
     // set up first bunny: create Deformable, build representation, add to central container
     sceneObjects.push_back(std::unique_ptr<DeformableOBJ>(new DeformableOBJ("../bunny_model.obj", 0)));
-    sceneObjects[0]->build();
+    sceneObjects[0]->enableCache();
+    sceneObjects[0]->build(&buildPool);
     sceneObjects[0]->translate(-4000, 0, 0);
 
     //set up second bunny
     sceneObjects.push_back(std::unique_ptr<DeformableOBJ>(new DeformableOBJ("../bunny_model.obj", 1)));
-    sceneObjects[1]->build();
+    sceneObjects[1]->enableCache();
+    sceneObjects[1]->build(&buildPool);
     sceneObjects[1]->translate(3000, 0, 0);
 
     //set up third bunny
     sceneObjects.push_back(std::unique_ptr<DeformableOBJ>(new DeformableOBJ("../bunny_model.obj", 2)));
-    sceneObjects[2]->build();
+    sceneObjects[2]->enableCache();
+    sceneObjects[2]->build(&buildPool);
     sceneObjects[2]->translate(3000, 4000, 0);
     
 
+    // stiff scenes: set INTEGRATOR_IMPLICIT and a longer timestepConstant
+    sceneIntegrator = CPUSimulation::INTEGRATOR_VERLET;
+    // many or large objects, collision trees too big for the cache: set COLLISION_WIDE
+    sceneCollisionMode = CPUSimulation::COLLISION_BVH;
+    // large objects folding through themselves: set sceneSelfCollision
+    sceneSelfCollision = false;
+    // fast objects or long timesteps tunneling through each other: set sceneContinuousCollision
+    sceneContinuousCollision = false;
+    // objects resting on each other: set sceneContactCache
+    sceneContactCache = false;
+    // many objects in contact, moving ones: set sceneBatchedQueries (not with the contact cache)
+    sceneBatchedQueries = false;
+    // static environment: planes, boxes and closed meshes in sceneColliders
+    sceneColliders.clear();
+    //sceneColliders.addBox(XMFLOAT3(3000, -500, 0), XMFLOAT3(1000, 500, 1000));
+
     // miport FBX file
     //DeformableFBX anim("../soldier.fbx", 2);
     //anim.build();
@@ -649,6 +900,7 @@ HRESULT initShaders(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pd3dImmediate
     ID3DBlob* pBlobCalc2CS = nullptr;
     ID3DBlob* pBlobUpdateCS = nullptr;
     ID3DBlob* pBlobBVHCS = nullptr;
+    ID3DBlob* pBlobRefitCS = nullptr;
     ID3DBlob* pBlobPVS = nullptr;
     ID3DBlob* pBlobPGS = nullptr;
 
@@ -666,6 +918,7 @@ HRESULT initShaders(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pd3dImmediate
     V_RETURN(DXUTCompileFromFile(L"..\\Shaders\\GX_RenderObjects.hlsl", nullptr, "GSShadowDraw", "gs_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pBlobShadowGS));
     V_RETURN(DXUTCompileFromFile(L"..\\Shaders\\GX_RenderObjects.hlsl", nullptr, "PSShadowDraw", "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pBlobShadowPS));
     V_RETURN(DXUTCompileFromFile(L"..\\Shaders\\CS_CollisionDetection.hlsl", nullptr, "CSBVHUpdate", "cs_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pBlobBVHCS));
+    V_RETURN(DXUTCompileFromFile(L"..\\Shaders\\CS_CollisionDetection.hlsl", nullptr, "CSBVHRefit", "cs_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pBlobRefitCS));
     V_RETURN(DXUTCompileFromFile(L"..\\Shaders\\CS_Deformation.hlsl", nullptr, "CSMain1", "cs_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pBlobCalc1CS));
     V_RETURN(DXUTCompileFromFile(L"..\\Shaders\\CS_Deformation.hlsl", nullptr, "CSMain2", "cs_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pBlobCalc2CS));
     V_RETURN(DXUTCompileFromFile(L"..\\Shaders\\CS_UpdatePositions.hlsl", nullptr, "CSPosUpdate", "cs_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pBlobUpdateCS));
@@ -710,6 +963,9 @@ HRESULT initShaders(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pd3dImmediate
     V_RETURN(pd3dDevice->CreateComputeShader(pBlobBVHCS->GetBufferPointer(), pBlobBVHCS->GetBufferSize(), nullptr, &bvhCS));
     SetDXUTDebugName(bvhCS, "CSBVHUpdate");
 
+    V_RETURN(pd3dDevice->CreateComputeShader(pBlobRefitCS->GetBufferPointer(), pBlobRefitCS->GetBufferSize(), nullptr, &refitCS));
+    SetDXUTDebugName(refitCS, "CSBVHRefit");
+
     V_RETURN(pd3dDevice->CreateComputeShader(pBlobCalc1CS->GetBufferPointer(), pBlobCalc1CS->GetBufferSize(), nullptr, &physicsCS1));
     SetDXUTDebugName(physicsCS1, "CSMain1");
 
@@ -742,6 +998,7 @@ HRESULT initShaders(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pd3dImmediate
     SAFE_RELEASE(pBlobShadowGS);
     SAFE_RELEASE(pBlobShadowPS);
     SAFE_RELEASE(pBlobBVHCS);
+    SAFE_RELEASE(pBlobRefitCS);
     SAFE_RELEASE(pBlobCalc1CS);
     SAFE_RELEASE(pBlobCalc2CS);
     SAFE_RELEASE(pBlobUpdateCS);
@@ -782,6 +1039,7 @@ HRESULT initBuffers(ID3D11Device* pd3dDevice)
             memcpy(iData1[x].nw1, sceneObjects[i]->indexcube[k].nw1, size);
             memcpy(iData1[x].w2, sceneObjects[i]->indexcube[k].w2, size);
             memcpy(iData1[x].nw2, sceneObjects[i]->indexcube[k].nw2, size);
+            iData1[x].object = i;
             x++;
         }
     }
@@ -809,7 +1067,9 @@ HRESULT initBuffers(ID3D11Device* pd3dDevice)
     BVHDESC* bdData = new BVHDESC[objectCount];
     if (!bdData) return E_OUTOFMEMORY;
 
-    // create tree descriptors
+    // create tree descriptors (and the lattice of every object)
+    uint mass1Offset = 0, mass2Offset = 0, remapCount = 0;
+    maxCubeWidth = maxMass1Count = maxMass2Count = 0;
     for (uint i = 0; i < objectCount; i++){
 
         // create entry for the first ctree
@@ -822,9 +1082,35 @@ HRESULT initBuffers(ID3D11Device* pd3dDevice)
         tmp.maxY = sceneObjects[i]->ctree[0].maxY;
         tmp.minZ = sceneObjects[i]->ctree[0].minZ;
         tmp.maxZ = sceneObjects[i]->ctree[0].maxZ;
+        tmp.cubeWidth = sceneObjects[i]->cubeWidth;
+        tmp.cubeCellSize = sceneObjects[i]->cubeCellSize;
+        tmp.mass1Offset = mass1Offset;
+        tmp.mass2Offset = mass2Offset;
+        tmp.mass1Count = sceneObjects[i]->masscube1.size();
+        tmp.mass2Count = sceneObjects[i]->masscube2.size();
+        tmp.remapOffset = remapCount;
         bdData[i] = tmp;
         bvhPointCount += tmp.masspointCount;
+        mass1Offset += tmp.mass1Count;
+        mass2Offset += tmp.mass2Count;
+        remapCount += sceneObjects[i]->remap1.size() + sceneObjects[i]->remap2.size();
+        maxCubeWidth = std::max(maxCubeWidth, tmp.cubeWidth);
+        maxMass1Count = std::max(maxMass1Count, tmp.mass1Count);
+        maxMass2Count = std::max(maxMass2Count, tmp.mass2Count);
+
+    }
+    // refit passes of the trees
+    bvhRefit.build(bdData, objectCount);
 
+    // Lattice -> masscube index tables of the objects (masscube2 table after the masscube1 table)
+    int* rData = new int[remapCount];
+    if (!rData) return E_OUTOFMEMORY;
+    x = 0;
+    for (uint i = 0; i < objectCount; i++){
+        for (uint k = 0; k < sceneObjects[i]->remap1.size(); k++)
+            rData[x++] = sceneObjects[i]->remap1[k];
+        for (uint k = 0; k < sceneObjects[i]->remap2.size(); k++)
+            rData[x++] = sceneObjects[i]->remap2[k];
     }
 
     // Array for BVHierarchies' data
@@ -918,6 +1204,33 @@ HRESULT initBuffers(ID3D11Device* pd3dDevice)
     SetDXUTDebugName(indexerBuffer, "IndexCube");
     SAFE_DELETE_ARRAY(iData1);
 
+    // Buffer for the remap tables
+    D3D11_BUFFER_DESC rdesc;
+    ZeroMemory(&rdesc, sizeof(rdesc));
+    rdesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    rdesc.ByteWidth = remapCount * sizeof(int);
+    rdesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    rdesc.StructureByteStride = sizeof(int);
+    rdesc.Usage = D3D11_USAGE_IMMUTABLE;
+    D3D11_SUBRESOURCE_DATA remap_init;
+    remap_init.pSysMem = rData;
+    V_RETURN(pd3dDevice->CreateBuffer(&rdesc, &remap_init, &remapBuffer));
+    SetDXUTDebugName(remapBuffer, "Remap");
+    SAFE_DELETE_ARRAY(rData);
+
+    // Buffer for the refit list (every pass, see BVHRefit)
+    D3D11_BUFFER_DESC fldesc;
+    ZeroMemory(&fldesc, sizeof(fldesc));
+    fldesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    fldesc.ByteWidth = bvhRefit.list().size() * sizeof(REFITNODE);
+    fldesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    fldesc.StructureByteStride = sizeof(REFITNODE);
+    fldesc.Usage = D3D11_USAGE_IMMUTABLE;
+    D3D11_SUBRESOURCE_DATA refit_init;
+    refit_init.pSysMem = bvhRefit.list().data();
+    V_RETURN(pd3dDevice->CreateBuffer(&fldesc, &refit_init, &refitBuffer));
+    SetDXUTDebugName(refitBuffer, "RefitList");
+
     // Buffer for collision detection catalogue and data
     D3D11_SUBRESOURCE_DATA bc_init;
     bc_init.pSysMem = bdData;
@@ -956,6 +1269,12 @@ HRESULT initBuffers(ID3D11Device* pd3dDevice)
     DescRV2.Buffer.NumElements = particleCount;
     V_RETURN(pd3dDevice->CreateShaderResourceView(indexerBuffer, &DescRV2, &indexerSRV));
     SetDXUTDebugName(indexerSRV, "IndexCube SRV");
+    DescRV2.Buffer.NumElements = remapCount;
+    V_RETURN(pd3dDevice->CreateShaderResourceView(remapBuffer, &DescRV2, &remapSRV));
+    SetDXUTDebugName(remapSRV, "Remap SRV");
+    DescRV2.Buffer.NumElements = bvhRefit.list().size();
+    V_RETURN(pd3dDevice->CreateShaderResourceView(refitBuffer, &DescRV2, &refitSRV));
+    SetDXUTDebugName(refitSRV, "RefitList SRV");
 
     // SRV for VolCubes
     D3D11_SHADER_RESOURCE_VIEW_DESC DescRVV;
@@ -1058,7 +1377,7 @@ HRESULT initBuffers(ID3D11Device* pd3dDevice)
     {
         for (uint j = 0; j < sceneObjects[i]->faceCount; j++)
         {
-            faces[ii++].vertices = XMUINT4(sceneObjects[i]->faces[j][1] + offs - 1, sceneObjects[i]->faces[j][2] + offs - 1, sceneObjects[i]->faces[j][3] + offs - 1, 0);
+            faces[ii++].vertices = XMUINT4(sceneObjects[i]->faces[j].x + offs, sceneObjects[i]->faces[j].y + offs, sceneObjects[i]->faces[j].z + offs, 0);
         }
         offs += sceneObjects[i]->vertexCount;
     }
@@ -1114,6 +1433,10 @@ HRESULT initRender(ID3D11Device* pd3dDevice){
     V_RETURN(pd3dDevice->CreateBuffer(&Desc, nullptr, &csConstantBuffer));
     SetDXUTDebugName(csConstantBuffer, "CB_CS");
 
+    Desc.ByteWidth = sizeof(CB_REFIT);
+    V_RETURN(pd3dDevice->CreateBuffer(&Desc, nullptr, &refitConstantBuffer));
+    SetDXUTDebugName(refitConstantBuffer, "CB_REFIT");
+
     // Load Particle Texture
     V_RETURN(DXUTCreateShaderResourceViewFromFile(pd3dDevice, L"..\\DXUT\\Media\\misc\\particle.dds", &particleTextureSRV));
     SetDXUTDebugName(particleTextureSRV, "Particle Texture");
@@ -1325,6 +1648,38 @@ HRESULT CALLBACK OnD3D11CreateDevice(ID3D11Device* pd3dDevice, const DXGI_SURFAC
     // Initialize buffers with data
     V_RETURN(initBuffers(pd3dDevice));
 
+    // Create the simulation backend
+#if CPUSIMULATION == 1
+    {
+        CPUSimulation* cpu = new CPUSimulation();
+        cpu->setIntegrator(sceneIntegrator);
+        cpu->setCollisionMode(sceneCollisionMode);
+        cpu->setSelfCollision(sceneSelfCollision);
+        cpu->setContinuousCollision(sceneContinuousCollision);
+        cpu->setContactCache(sceneContactCache);
+        cpu->setBatchedQueries(sceneBatchedQueries);
+        cpu->setStaticColliders(sceneColliders, sceneColliderCache);
+        simulation.reset(cpu);
+    }
+#else
+    simulation.reset(new D3D11Simulation());
+
+    // Timestamp queries of the substeps
+    D3D11_QUERY_DESC queryDesc;
+    queryDesc.MiscFlags = 0;
+    for (SUBSTEPTIMER& timer : substepTimers)
+    {
+        queryDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+        V_RETURN(pd3dDevice->CreateQuery(&queryDesc, &timer.disjoint));
+        queryDesc.Query = D3D11_QUERY_TIMESTAMP;
+        V_RETURN(pd3dDevice->CreateQuery(&queryDesc, &timer.begin));
+        V_RETURN(pd3dDevice->CreateQuery(&queryDesc, &timer.end));
+        timer.steps = 0;
+    }
+    substepTimer = 0;
+#endif
+    simulation->load(sceneObjects);
+
     // Create textures&buffers for picking
     V_RETURN(initPicking(pd3dDevice, 800, 600));
 
@@ -1402,6 +1757,7 @@ bool drawPicking(ID3D11DeviceContext* pd3dImmediateContext, CXMMATRIX mView, CXM
     XMStoreFloat4(&pCBGS->eyePos, camera.GetEyePt());
     pCBGS->lightPos = lightPos;
     pCBGS->lightCol = lightCol;
+    pCBGS->interpolation = XMFLOAT4(stepper.interpolation(), 0, 0, 0);
     pd3dImmediateContext->Unmap(gsConstantBuffer, 0);
     pd3dImmediateContext->GSSetConstantBuffers(0, 1, &gsConstantBuffer);
 
@@ -1457,6 +1813,8 @@ bool drawObjects(ID3D11DeviceContext* pd3dImmediateContext, CXMMATRIX mView, CXM
     pd3dImmediateContext->VSSetShaderResources(0, 3, aRViews);
     pd3dImmediateContext->GSSetShaderResources(0, 3, aRViews);
     pd3dImmediateContext->PSSetShaderResources(0, 3, aRViews);
+    // particles of the previous substep, blended with the current ones
+    pd3dImmediateContext->GSSetShaderResources(5, 1, &particleSRV2);
 
     // Get light data
     VECTOR4 lp = lightPos.load();
@@ -1475,6 +1833,7 @@ bool drawObjects(ID3D11DeviceContext* pd3dImmediateContext, CXMMATRIX mView, CXM
     XMStoreFloat4(&pCBGS->eyePos, camera.GetEyePt());
     pCBGS->lightPos = lightPos;
     pCBGS->lightCol = lightCol;
+    pCBGS->interpolation = XMFLOAT4(stepper.interpolation(), 0, 0, 0);
     pd3dImmediateContext->Unmap(gsConstantBuffer, 0);
     pd3dImmediateContext->GSSetConstantBuffers(0, 1, &gsConstantBuffer);
     pd3dImmediateContext->PSSetSamplers(0, 1, &samplerState);
@@ -1501,6 +1860,7 @@ bool drawObjects(ID3D11DeviceContext* pd3dImmediateContext, CXMMATRIX mView, CXM
     XMStoreFloat4(&pCBGS2->eyePos, camera.GetEyePt());
     pCBGS2->lightPos = lightPos;
     pCBGS2->lightCol = lightCol;
+    pCBGS2->interpolation = XMFLOAT4(stepper.interpolation(), 0, 0, 0);
     pd3dImmediateContext->Unmap(gsConstantBuffer, 0);
     pd3dImmediateContext->GSSetConstantBuffers(0, 1, &gsConstantBuffer);
     pd3dImmediateContext->OMSetRenderTargets(1, &pRTV, pDSV);
@@ -1513,6 +1873,7 @@ bool drawObjects(ID3D11DeviceContext* pd3dImmediateContext, CXMMATRIX mView, CXM
     pd3dImmediateContext->VSSetShaderResources(0, 3, pxSRVNULL);
     pd3dImmediateContext->GSSetShaderResources(0, 3, pxSRVNULL);
     pd3dImmediateContext->PSSetShaderResources(0, 3, pxSRVNULL);
+    pd3dImmediateContext->GSSetShaderResources(5, 1, pxSRVNULL);
 
     pd3dImmediateContext->GSSetShader(nullptr, nullptr, 0);
     pd3dImmediateContext->OMSetBlendState(pBlendState0, &BlendFactor0.x, SampleMask0); SAFE_RELEASE(pBlendState0);
@@ -1545,6 +1906,7 @@ bool drawMasspoints(ID3D11DeviceContext* pd3dImmediateContext, CXMMATRIX mView,
     XMStoreFloat4x4(&pCBGS->inverseView, XMMatrixInverse(nullptr, mView));
     XMStoreFloat4(&pCBGS->eyePos, camera.GetEyePt());
     pCBGS->lightPos = lightPos;
+    pCBGS->interpolation = XMFLOAT4(stepper.interpolation(), 0, 0, 0);
     pd3dImmediateContext->Unmap(gsConstantBuffer, 0);
     pd3dImmediateContext->GSSetConstantBuffers(0, 1, &gsConstantBuffer);
     pd3dImmediateContext->PSSetSamplers(0, 1, &samplerState);
@@ -1633,6 +1995,9 @@ void CALLBACK OnD3D11DestroyDevice(void* pUserContext)
     SAFE_RELEASE(csConstantBuffer);
     SAFE_RELEASE(gsConstantBuffer);
     SAFE_RELEASE(indexerBuffer);
+    SAFE_RELEASE(remapBuffer);
+    SAFE_RELEASE(refitBuffer);
+    SAFE_RELEASE(refitConstantBuffer);
     SAFE_RELEASE(masscube1Buffer1);
     SAFE_RELEASE(masscube1Buffer2);
     SAFE_RELEASE(masscube2Buffer1);
@@ -1648,6 +2013,8 @@ void CALLBACK OnD3D11DestroyDevice(void* pUserContext)
     SAFE_RELEASE(bvhDataSRV1);
     SAFE_RELEASE(bvhDataSRV2);
     SAFE_RELEASE(indexerSRV);
+    SAFE_RELEASE(remapSRV);
+    SAFE_RELEASE(refitSRV);
     SAFE_RELEASE(masscube1SRV1);
     SAFE_RELEASE(masscube1SRV2);
     SAFE_RELEASE(masscube2SRV1);
@@ -1669,6 +2036,7 @@ void CALLBACK OnD3D11DestroyDevice(void* pUserContext)
     SAFE_RELEASE(particleUAV1);
     SAFE_RELEASE(particleUAV2);
     SAFE_RELEASE(bvhCS);
+    SAFE_RELEASE(refitCS);
     SAFE_RELEASE(physicsCS1);
     SAFE_RELEASE(physicsCS2);
     SAFE_RELEASE(updateCS);
@@ -1684,5 +2052,14 @@ void CALLBACK OnD3D11DestroyDevice(void* pUserContext)
     SAFE_RELEASE(masspointGS);
     SAFE_RELEASE(masspointPS);
     SAFE_RELEASE(masspointVS);
+#if CPUSIMULATION == 0
+    for (SUBSTEPTIMER& timer : substepTimers)
+    {
+        SAFE_RELEASE(timer.disjoint);
+        SAFE_RELEASE(timer.begin);
+        SAFE_RELEASE(timer.end);
+        timer.steps = 0;
+    }
+#endif
 
 }
\ No newline at end of file
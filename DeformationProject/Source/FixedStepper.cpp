@@ -0,0 +1,60 @@
+//--------------------------------------------------------------------------------------
+// File: FixedStepper.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Fixed timestep accumulator of the simulation loop (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "../Headers/FixedStepper.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+FixedStepper::FixedStepper() : accumulator(0.0f), dt(0.0f), limit(SIM_MAX_SUBSTEPS), msPerStep(0.0){}
+
+//--------------------------------------------------------------------------------------
+// Accumulate frame time, count the substeps of the frame
+//--------------------------------------------------------------------------------------
+uint FixedStepper::begin(float elapsed, float timestep){
+
+    if (timestep <= 0.0f)
+        throw "Invalid simulation timestep";
+
+    // timestep changed: keep the leftover as a fraction of a step
+    if (dt > 0.0f && dt != timestep)
+        accumulator *= timestep / dt;
+    dt = timestep;
+
+    // a hitch (window drag, breakpoint, loading) is not simulated
+    accumulator += std::min(std::max(elapsed, 0.0f), SIM_MAX_FRAME_TIME);
+
+    uint steps = (uint)(accumulator / dt);
+    // over budget: drop the excess, the leftover stays below one step
+    if (steps > limit){
+        accumulator -= (steps - limit) * dt;
+        steps = limit;
+    }
+    accumulator = std::max(accumulator - steps * dt, 0.0f);
+    return steps;
+}
+
+//--------------------------------------------------------------------------------------
+// Measure the substeps, update the substep limit
+//--------------------------------------------------------------------------------------
+void FixedStepper::end(double ms, uint steps){
+
+    if (steps == 0)
+        return;
+
+    double cost = ms / steps;
+    msPerStep = msPerStep == 0.0 ? cost : msPerStep * 0.9 + cost * 0.1;
+    if (msPerStep > 0.0)
+        limit = (uint)std::min(std::max(std::floor(SIM_FRAME_BUDGET_MS / msPerStep), 1.0), (double)SIM_MAX_SUBSTEPS);
+}
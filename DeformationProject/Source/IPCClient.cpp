@@ -9,6 +9,7 @@
 // @Copyright (c) pgq
 //--------------------------------------------------------------------------------------
 
+#include <cstring>
 #include "../Headers/IPCClient.h"
 
 HANDLE hPipe_comm = INVALID_HANDLE_VALUE;
@@ -169,6 +170,16 @@ wstuple ProcessCommand(byte* buf, int validBytes){
             gravityConstant = valueX;
             reply = L"ok";
         }
+        else if (param == "timestep")
+        {
+            x >> valueX;
+            if (valueX > 0.0f){
+                timestepConstant = valueX;
+                reply = L"ok";
+            }
+            else
+                reply = L"timestep must be positive";
+        }
         else if (param == "lightpos")
         {
             x >> valueX >> valueY >> valueZ;
@@ -192,10 +203,12 @@ wstuple ProcessCommand(byte* buf, int validBytes){
         x >> param >> num;
         if (param == "bunny"){
             uint bc = sceneObjects.size();
+            ThreadPool buildPool;
             for (uint i = 0; i < num; i++)
             {
                 DeformableOBJ tmp("bunny_res3_scaled.obj", bc + i);
-                tmp.build();
+                tmp.enableCache();
+                tmp.build(&buildPool);
                 sceneObjects.push_back(std::make_unique<DeformableOBJ>(tmp));
             }
             reply = L"added " + std::to_wstring(num) + L" bunnies";
@@ -216,6 +229,10 @@ wstuple ProcessCommand(byte* buf, int validBytes){
         {
             reply = std::to_wstring(gravityConstant);
         }
+        else if (param == "timestep")
+        {
+            reply = std::to_wstring(timestepConstant);
+        }
         else if (param == "lightpos")
         {
             VECTOR4 tmp = lightPos.load();
@@ -230,12 +247,99 @@ wstuple ProcessCommand(byte* buf, int validBytes){
         {
             reply = std::to_wstring(sceneObjects.size());
         }
+        else if (param == "memory")
+        {
+            // heap bytes of the scene objects: import data (flat vertex, normal, face arrays) and built data
+            size_t geometry = 0, built = 0;
+            for (const std::unique_ptr<DeformableBase>& object : sceneObjects){
+                geometry += object->geometryBytes();
+                built += object->builtBytes();
+            }
+            reply = L"geometry:" + std::to_wstring(geometry / 1024) + L"KB built:" + std::to_wstring(built / 1024) + L"KB";
+        }
         else
         {
             reply = L"unrecognized get command";
         }
     }
 
+    // BENCH commands
+    else if (type == "bench"){
+        x >> param >> num;
+        if (param == "threads")
+        {
+            // CPU solver on the scene objects with 1..#cores threads, num steps each
+            reply = formatBenchmark(benchmarkScaling(sceneObjects, num > 0 ? num : 100));
+        }
+        else if (param == "integrators")
+        {
+            // Verlet, implicit and XPBD steps per simulated second, num = stiffness (0: current)
+            reply = formatIntegrators(benchmarkIntegrators(sceneObjects, num > 0 ? (float)num : stiffnessConstant));
+        }
+        else if (param == "broadphase")
+        {
+            // candidate and pruned object pairs per step over num steps
+            reply = formatBroadPhase(benchmarkBroadPhase(sceneObjects, num > 0 ? num : 100));
+        }
+        else if (param == "contacts")
+        {
+            // contact cache hit rate and saved tree nodes over num steps
+            reply = formatContactCache(benchmarkContactCache(sceneObjects, num > 0 ? num : 100));
+        }
+        else if (param == "queries")
+        {
+            // per-masspoint against batched contact queries over num steps
+            reply = formatContactQueries(benchmarkContactQueries(sceneObjects, num > 0 ? num : 100));
+        }
+        else if (param == "trees")
+        {
+            // memory of the binary and 4-wide collision trees, step times with each over num steps
+            reply = formatTrees(benchmarkTrees(sceneObjects, num > 0 ? num : 100));
+        }
+        else if (param == "import")
+        {
+            // .OBJ parser throughput on the file of the first object, best of num parses
+            const DeformableOBJ* object = sceneObjects.empty() ? nullptr : dynamic_cast<DeformableOBJ*>(sceneObjects[0].get());
+            if (object == nullptr)
+                reply = L"bench import needs an OBJ object in the scene";
+            else {
+                try {
+                    reply = formatImport(benchmarkImport(object->file, num > 0 ? num : 5));
+                }
+                catch (const char* e){
+                    reply = std::wstring(e, e + strlen(e));
+                }
+            }
+        }
+        else if (param == "spawn")
+        {
+            // build of the first object's model without and with its .dfm cache, best of num builds
+            const DeformableOBJ* object = sceneObjects.empty() ? nullptr : dynamic_cast<DeformableOBJ*>(sceneObjects[0].get());
+            if (object == nullptr)
+                reply = L"bench spawn needs an OBJ object in the scene";
+            else
+                reply = formatSpawn(benchmarkSpawn(object->file, num > 0 ? num : 5));
+        }
+        else if (param == "stages")
+        {
+            // stage times per step over num steps, self-collision included
+            reply = formatStages(benchmarkStages(sceneObjects, num > 0 ? num : 100, true));
+        }
+        else if (param == "collision")
+        {
+            // collision trees against the hash grid, copies of the first object, up to num objects
+            const DeformableOBJ* prototype = sceneObjects.empty() ? nullptr : dynamic_cast<DeformableOBJ*>(sceneObjects[0].get());
+            if (prototype == nullptr)
+                reply = L"bench collision needs an OBJ object in the scene";
+            else
+                reply = formatCollision(benchmarkCollision(*prototype, num > 0 ? num : 16, 50));
+        }
+        else
+        {
+            reply = L"unrecognized bench command";
+        }
+    }
+
     // invalid command
     else
     {
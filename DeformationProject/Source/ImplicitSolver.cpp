@@ -0,0 +1,361 @@
+//--------------------------------------------------------------------------------------
+// File: ImplicitSolver.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Backward Euler step of the CPU solver, matrix-free PCG (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "../Headers/ImplicitSolver.h"
+
+
+//--------------------------------------------------------------------------------------
+// Helpers: symmetric 3x3 blocks (xx, xy, xz, yy, yz, zz)
+//--------------------------------------------------------------------------------------
+static inline XMFLOAT3 symmetricMul(const float* m, const XMFLOAT3& a){
+    return XMFLOAT3(m[0] * a.x + m[1] * a.y + m[2] * a.z,
+                    m[1] * a.x + m[3] * a.y + m[4] * a.z,
+                    m[2] * a.x + m[4] * a.y + m[5] * a.z);
+}
+
+// inverse of a symmetric block, identity if it is singular
+static void symmetricInverse(const double* m, float* inv){
+
+    double c0 = m[3] * m[5] - m[4] * m[4];
+    double c1 = m[2] * m[4] - m[1] * m[5];
+    double c2 = m[1] * m[4] - m[2] * m[3];
+    double det = m[0] * c0 + m[1] * c1 + m[2] * c2;
+    if (fabs(det) < 1e-30){
+        inv[0] = inv[3] = inv[5] = 1.0f;
+        inv[1] = inv[2] = inv[4] = 0.0f;
+        return;
+    }
+    double id = 1.0 / det;
+    inv[0] = (float)(c0 * id);
+    inv[1] = (float)(c1 * id);
+    inv[2] = (float)(c2 * id);
+    inv[3] = (float)((m[0] * m[5] - m[2] * m[2]) * id);
+    inv[4] = (float)((m[1] * m[2] - m[0] * m[4]) * id);
+    inv[5] = (float)((m[0] * m[3] - m[1] * m[1]) * id);
+}
+
+static inline double dot3(const XMFLOAT3& a, const XMFLOAT3& b){
+    return (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+}
+
+// masspoint without neighbours, not simulated
+static inline bool fixedMasspoint(const MASK* masks, uint i){
+    return (masks[i] & 0xFFFF) == 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+ImplicitSolver::ImplicitSolver() : lastIterations(0), lastResidual(0.0f){}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+ImplicitSolver::~ImplicitSolver(){}
+
+//--------------------------------------------------------------------------------------
+// Resize: vectors for every masspoint and edge of the graph
+//--------------------------------------------------------------------------------------
+void ImplicitSolver::resize(const SpringGraph& graph){
+
+    uint n = graph.masspointCount();
+    jacobian.assign(graph.edgeCount() * 6, 0.0f);
+
+    // edges of one directed spring, masspoints with such springs
+    std::vector<uint> springs(graph.edgeCount(), 0);
+    for (uint s = 0; s < graph.springCount(); s++)
+        springs[graph.springEdge[s]]++;
+    oneWay.resize(graph.edgeCount());
+    for (uint e = 0; e < graph.edgeCount(); e++)
+        oneWay[e] = springs[e] == 1;
+    oneWayRows.clear();
+    for (uint a = 0; a < n; a++){
+        for (uint s = graph.offsets[a]; s < graph.offsets[a + 1]; s++){
+            if (oneWay[graph.springEdge[s]]){
+                oneWayRows.push_back(a);
+                break;
+            }
+        }
+    }
+    blockInv.assign(n * 6, 0.0f);
+    dv.assign(n, XMFLOAT3(0, 0, 0));
+    vel.resize(n);
+    rhs.resize(n);
+    r.resize(n);
+    z.resize(n);
+    p.resize(n);
+    ap.resize(n);
+    partial.assign((n + CPU_SOLVER_BATCH - 1) / CPU_SOLVER_BATCH, 0.0);
+    lastIterations = 0;
+    lastResidual = 0.0f;
+}
+
+//--------------------------------------------------------------------------------------
+// Multiply: out = A * in (identity rows for fixed masspoints, one-way targets fixed)
+//--------------------------------------------------------------------------------------
+void ImplicitSolver::multiply(const SpringGraph& graph, const MASK* masks, const std::vector<XMFLOAT3>& in, std::vector<XMFLOAT3>& out,
+                              uint first, uint count) const {
+
+    for (uint a = first; a < first + count; a++){
+        XMFLOAT3 res = in[a];
+        if (!fixedMasspoint(masks, a)){
+            for (uint s = graph.offsets[a]; s < graph.offsets[a + 1]; s++){
+                uint e = graph.springEdge[s];
+                XMFLOAT3 b = oneWay[e] ? XMFLOAT3(0, 0, 0) : in[graph.targets[s]];
+                XMFLOAT3 d = symmetricMul(&jacobian[e * 6], XMFLOAT3(in[a].x - b.x, in[a].y - b.y, in[a].z - b.z));
+                res.x += d.x;
+                res.y += d.y;
+                res.z += d.z;
+            }
+        }
+        out[a] = res;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Solve one-way: dv_a = D_a^-1 * (b_a + sum of J * dv_t) for the listed rows [first, first + count)
+//--------------------------------------------------------------------------------------
+void ImplicitSolver::solveOneWay(const SpringGraph& graph, const MASK* masks, uint first, uint count){
+
+    for (uint i = first; i < first + count; i++){
+        uint a = oneWayRows[i];
+        if (fixedMasspoint(masks, a))
+            continue;
+        XMFLOAT3 b = rhs[a];
+        for (uint s = graph.offsets[a]; s < graph.offsets[a + 1]; s++){
+            XMFLOAT3 d = symmetricMul(&jacobian[graph.springEdge[s] * 6], dv[graph.targets[s]]);
+            b.x += d.x;
+            b.y += d.y;
+            b.z += d.z;
+        }
+        // (written to z: the targets may be rows of this pass too)
+        z[a] = symmetricMul(&blockInv[a * 6], b);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Precondition: block Jacobi
+//--------------------------------------------------------------------------------------
+void ImplicitSolver::precondition(const std::vector<XMFLOAT3>& in, std::vector<XMFLOAT3>& out, uint first, uint count) const {
+
+    for (uint a = first; a < first + count; a++)
+        out[a] = symmetricMul(&blockInv[a * 6], in[a]);
+}
+
+//--------------------------------------------------------------------------------------
+// Total: block partial sums in block order
+//--------------------------------------------------------------------------------------
+double ImplicitSolver::total() const {
+
+    double sum = 0.0;
+    for (double s : partial)
+        sum += s;
+    return sum;
+}
+
+//--------------------------------------------------------------------------------------
+// Step: Jacobians, right-hand side, PCG, new positions
+//--------------------------------------------------------------------------------------
+uint ImplicitSolver::step(const MASSVIEW& v, const SpringGraph& graph, const SPRINGPARAMS& params, const float* rest,
+                          const std::vector<XMFLOAT3>& accel, float dt, ThreadPool& pool){
+
+    uint n = graph.masspointCount();
+    uint edges = graph.edgeCount();
+    uint blocks = (n + CPU_SOLVER_BATCH - 1) / CPU_SOLVER_BATCH;
+    if (n == 0)
+        return 0;
+
+    // damping and stiffness terms of the Jacobians (damping is negative)
+    float cd = -params.damping * params.im * dt;
+    float ck = params.stiffness * params.im * dt * dt;
+
+    // edge Jacobians at the current positions
+    pool.parallelFor((edges + CPU_EDGE_BATCH - 1) / CPU_EDGE_BATCH, [&](uint task){
+        uint end = std::min(edges, (task + 1) * CPU_EDGE_BATCH);
+        for (uint e = task * CPU_EDGE_BATCH; e < end; e++){
+            uint a = graph.edgeA[e], b = graph.edgeB[e];
+            float dx = v.newX[b] - v.newX[a], dy = v.newY[b] - v.newY[a], dz = v.newZ[b] - v.newZ[a];
+            float len = sqrtf(dx * dx + dy * dy + dz * dz);
+            float* j = &jacobian[e * 6];
+            // coinciding end points: no direction, damping only
+            if (len == 0.0f){
+                j[0] = j[3] = j[5] = cd;
+                j[1] = j[2] = j[4] = 0.0f;
+                continue;
+            }
+            float il = 1.0f / len;
+            dx *= il; dy *= il; dz *= il;
+            float s = std::max(0.0f, 1.0f - rest[e] * il);
+            float t = ck * (1.0f - s);
+            j[0] = cd + ck * s + t * dx * dx;
+            j[1] = t * dx * dy;
+            j[2] = t * dx * dz;
+            j[3] = cd + ck * s + t * dy * dy;
+            j[4] = t * dy * dz;
+            j[5] = cd + ck * s + t * dz * dz;
+        }
+    });
+
+    // velocities, right-hand side b = h*a - h^2*im*K-part of sum J*(v_a - v_b), preconditioner,
+    // initial residual r = b - A*dv
+    float idt = 1.0f / dt;
+    pool.parallelFor(blocks, [&](uint task){
+        uint first = task * CPU_SOLVER_BATCH;
+        uint end = std::min(n, first + CPU_SOLVER_BATCH);
+        for (uint a = first; a < end; a++)
+            vel[a] = XMFLOAT3((v.newX[a] - v.oldX[a]) * idt, (v.newY[a] - v.oldY[a]) * idt, (v.newZ[a] - v.oldZ[a]) * idt);
+    });
+    pool.parallelFor(blocks, [&](uint task){
+        uint first = task * CPU_SOLVER_BATCH;
+        uint end = std::min(n, first + CPU_SOLVER_BATCH);
+        double bb = 0.0;
+        for (uint a = first; a < end; a++){
+            if (fixedMasspoint(v.masks, a)){
+                rhs[a] = dv[a] = XMFLOAT3(0, 0, 0);
+                blockInv[a * 6 + 0] = blockInv[a * 6 + 3] = blockInv[a * 6 + 5] = 1.0f;
+                blockInv[a * 6 + 1] = blockInv[a * 6 + 2] = blockInv[a * 6 + 4] = 0.0f;
+                continue;
+            }
+            XMFLOAT3 b(accel[a].x * dt, accel[a].y * dt, accel[a].z * dt);
+            double diag[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 1.0 };
+            for (uint s = graph.offsets[a]; s < graph.offsets[a + 1]; s++){
+                const float* j = &jacobian[graph.springEdge[s] * 6];
+                uint t = graph.targets[s];
+                // stiffness part only: the damping force at v is already in accel
+                float k[6] = { j[0] - cd, j[1], j[2], j[3] - cd, j[4], j[5] - cd };
+                XMFLOAT3 d = symmetricMul(k, XMFLOAT3(vel[a].x - vel[t].x, vel[a].y - vel[t].y, vel[a].z - vel[t].z));
+                b.x -= d.x;
+                b.y -= d.y;
+                b.z -= d.z;
+                for (uint c = 0; c < 6; c++)
+                    diag[c] += j[c];
+            }
+            rhs[a] = b;
+            symmetricInverse(diag, &blockInv[a * 6]);
+            bb += dot3(b, b);
+        }
+        partial[task] = bb;
+    });
+    double bnorm = sqrt(total());
+
+    pool.parallelFor(blocks, [&](uint task){
+        uint first = task * CPU_SOLVER_BATCH;
+        uint count = std::min(n, first + CPU_SOLVER_BATCH) - first;
+        multiply(graph, v.masks, dv, ap, first, count);
+        double rz = 0.0;
+        for (uint a = first; a < first + count; a++)
+            r[a] = XMFLOAT3(rhs[a].x - ap[a].x, rhs[a].y - ap[a].y, rhs[a].z - ap[a].z);
+        precondition(r, z, first, count);
+        for (uint a = first; a < first + count; a++){
+            p[a] = z[a];
+            rz += dot3(r[a], z[a]);
+        }
+        partial[task] = rz;
+    });
+    double rz = total();
+
+    // preconditioned conjugate gradient
+    uint it = 0;
+    double rnorm = bnorm;
+    while (it < CPU_CG_ITERATIONS && bnorm > 0.0){
+        pool.parallelFor(blocks, [&](uint task){
+            uint first = task * CPU_SOLVER_BATCH;
+            uint count = std::min(n, first + CPU_SOLVER_BATCH) - first;
+            multiply(graph, v.masks, p, ap, first, count);
+            double pap = 0.0;
+            for (uint a = first; a < first + count; a++)
+                pap += dot3(p[a], ap[a]);
+            partial[task] = pap;
+        });
+        double pap = total();
+        if (pap <= 0.0)
+            break;
+        float alpha = (float)(rz / pap);
+
+        pool.parallelFor(blocks, [&](uint task){
+            uint first = task * CPU_SOLVER_BATCH;
+            uint count = std::min(n, first + CPU_SOLVER_BATCH) - first;
+            double rr = 0.0;
+            for (uint a = first; a < first + count; a++){
+                dv[a].x += alpha * p[a].x;
+                dv[a].y += alpha * p[a].y;
+                dv[a].z += alpha * p[a].z;
+                r[a].x -= alpha * ap[a].x;
+                r[a].y -= alpha * ap[a].y;
+                r[a].z -= alpha * ap[a].z;
+                rr += dot3(r[a], r[a]);
+            }
+            partial[task] = rr;
+        });
+        rnorm = sqrt(total());
+        it++;
+        if (rnorm <= CPU_CG_TOLERANCE * bnorm)
+            break;
+
+        pool.parallelFor(blocks, [&](uint task){
+            uint first = task * CPU_SOLVER_BATCH;
+            uint count = std::min(n, first + CPU_SOLVER_BATCH) - first;
+            precondition(r, z, first, count);
+            double rz1 = 0.0;
+            for (uint a = first; a < first + count; a++)
+                rz1 += dot3(r[a], z[a]);
+            partial[task] = rz1;
+        });
+        double rz1 = total();
+        float beta = (float)(rz1 / rz);
+        rz = rz1;
+
+        pool.parallelFor(blocks, [&](uint task){
+            uint first = task * CPU_SOLVER_BATCH;
+            uint end = std::min(n, first + CPU_SOLVER_BATCH);
+            for (uint a = first; a < end; a++){
+                p[a].x = z[a].x + beta * p[a].x;
+                p[a].y = z[a].y + beta * p[a].y;
+                p[a].z = z[a].z + beta * p[a].z;
+            }
+        });
+    }
+    lastIterations = it;
+    lastResidual = bnorm > 0.0 ? (float)(rnorm / bnorm) : 0.0f;
+
+    // sources of one-way springs, from the dv of their targets
+    uint rows = (uint)oneWayRows.size();
+    uint rowBlocks = (rows + CPU_SOLVER_BATCH - 1) / CPU_SOLVER_BATCH;
+    pool.parallelFor(rowBlocks, [&](uint task){
+        uint first = task * CPU_SOLVER_BATCH;
+        solveOneWay(graph, v.masks, first, std::min(rows, first + CPU_SOLVER_BATCH) - first);
+    });
+    for (uint a : oneWayRows){
+        if (!fixedMasspoint(v.masks, a))
+            dv[a] = z[a];
+    }
+
+    // x(t+1) = x(t) + h * (v + dv)
+    pool.parallelFor(blocks, [&](uint task){
+        uint first = task * CPU_SOLVER_BATCH;
+        uint end = std::min(n, first + CPU_SOLVER_BATCH);
+        for (uint a = first; a < end; a++){
+            if (fixedMasspoint(v.masks, a)){
+                v.nextX[a] = v.newX[a];
+                v.nextY[a] = v.newY[a];
+                v.nextZ[a] = v.newZ[a];
+                continue;
+            }
+            v.nextX[a] = v.newX[a] + (vel[a].x + dv[a].x) * dt;
+            v.nextY[a] = v.newY[a] + (vel[a].y + dv[a].y) * dt;
+            v.nextZ[a] = v.newZ[a] + (vel[a].z + dv[a].z) * dt;
+        }
+    });
+    return it;
+}
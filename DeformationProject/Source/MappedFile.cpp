@@ -0,0 +1,118 @@
+//--------------------------------------------------------------------------------------
+// File: MappedFile.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Read-only memory-mapped file (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "../Headers/MappedFile.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constructor: open and map the whole file
+//--------------------------------------------------------------------------------------
+MappedFile::MappedFile(const std::string& name) : view(nullptr), length(0) {
+
+#ifdef _WIN32
+    mapping = nullptr;
+    file = CreateFileA(name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw "MappedFile: cannot open the file";
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    length = (size_t)size.QuadPart;
+    if (length > 0){
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        view = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view){
+            if (mapping)
+                CloseHandle(mapping);
+            CloseHandle(file);
+            throw "MappedFile: cannot map the file";
+        }
+    }
+#else
+    file = open(name.c_str(), O_RDONLY);
+    if (file < 0)
+        throw "MappedFile: cannot open the file";
+    struct stat info;
+    fstat(file, &info);
+    length = (size_t)info.st_size;
+    if (length > 0){
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+        if (p == MAP_FAILED){
+            close(file);
+            throw "MappedFile: cannot map the file";
+        }
+        view = (const char*)p;
+        madvise(p, length, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// Destructor: unmap and close
+//--------------------------------------------------------------------------------------
+MappedFile::~MappedFile(){
+
+#ifdef _WIN32
+    if (view)
+        UnmapViewOfFile(view);
+    if (mapping)
+        CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    if (view)
+        munmap((void*)view, length);
+    close(file);
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// Hash: FNV-1a over 8-byte words, then the tail bytes and the length
+//--------------------------------------------------------------------------------------
+unsigned long long MappedFile::hash() const {
+
+    const unsigned long long prime = 1099511628211ull;
+    unsigned long long h = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8){
+        unsigned long long word;
+        memcpy(&word, view + i, 8);
+        h = (h ^ word) * prime;
+    }
+    for (; i < length; i++)
+        h = (h ^ (unsigned char)view[i]) * prime;
+    return (h ^ length) * prime;
+}
+
+//--------------------------------------------------------------------------------------
+// Stamp: size and modification time of the file (seconds)
+//--------------------------------------------------------------------------------------
+bool MappedFile::stamp(const std::string& name, unsigned long long& size, long long& modified){
+
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(name.c_str(), &info) != 0)
+        return false;
+#else
+    struct stat info;
+    if (stat(name.c_str(), &info) != 0)
+        return false;
+#endif
+    size = (unsigned long long)info.st_size;
+    modified = (long long)info.st_mtime;
+    return true;
+}
@@ -0,0 +1,139 @@
+//--------------------------------------------------------------------------------------
+// File: MasspointStore.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Structure-of-arrays masspoint storage (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include "../Headers/MasspointStore.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+MasspointStore::MasspointStore() : head(1) {}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+MasspointStore::~MasspointStore(){}
+
+//--------------------------------------------------------------------------------------
+// Clear: remove every masspoint
+//--------------------------------------------------------------------------------------
+void MasspointStore::clear(){
+
+    for (uint s = 0; s < 3; s++){
+        pos[s].x.clear();
+        pos[s].y.clear();
+        pos[s].z.clear();
+    }
+    maskdata.clear();
+    records.clear();
+    head = 1;
+}
+
+//--------------------------------------------------------------------------------------
+// Append: AoS -> SoA, oldpos goes to t-1, newpos to t
+//--------------------------------------------------------------------------------------
+void MasspointStore::append(const MassVector& src){
+
+    POSARRAY& p = pos[(head + 2) % 3];
+    POSARRAY& c = pos[head];
+    POSARRAY& n = pos[(head + 1) % 3];
+
+    for (uint i = 0; i < src.size(); i++){
+        const MASSPOINT& m = src[i];
+        p.x.push_back(m.oldpos.x);
+        p.y.push_back(m.oldpos.y);
+        p.z.push_back(m.oldpos.z);
+        c.x.push_back(m.newpos.x);
+        c.y.push_back(m.newpos.y);
+        c.z.push_back(m.newpos.z);
+        n.x.push_back(m.newpos.x);
+        n.y.push_back(m.newpos.y);
+        n.z.push_back(m.newpos.z);
+        maskdata.push_back(packMasks(m.neighbour_same, m.neighbour_other));
+    }
+    records.insert(records.end(), src.begin(), src.end());
+}
+
+//--------------------------------------------------------------------------------------
+// Export: SoA -> AoS, positions of t-1 and t into the stored records
+//--------------------------------------------------------------------------------------
+void MasspointStore::exportTo(MassVector& dst, uint first, uint count) const {
+
+    const POSARRAY& p = prev();
+    const POSARRAY& c = curr();
+
+    dst.assign(records.begin() + first, records.begin() + first + count);
+    for (uint i = 0; i < count; i++){
+        dst[i].oldpos.x = p.x[first + i];
+        dst[i].oldpos.y = p.y[first + i];
+        dst[i].oldpos.z = p.z[first + i];
+        dst[i].newpos.x = c.x[first + i];
+        dst[i].newpos.y = c.y[first + i];
+        dst[i].newpos.z = c.z[first + i];
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Second neighbours: spring to the masspoint two cells away exists if the first neighbour
+//                    has a neighbour in the same direction (bounds of CSMain1/CSMain2)
+//--------------------------------------------------------------------------------------
+void MasspointStore::setSecondNeighbours(uint width, uint first, const std::vector<int>& remap){
+
+    const uint dirs[6] = { NB_SAME_LEFT, NB_SAME_RIGHT, NB_SAME_DOWN, NB_SAME_UP, NB_SAME_FRONT, NB_SAME_BACK };
+    const int offsets[6] = { -1, 1, -(int)width, (int)width, -(int)(width * width), (int)(width * width) };
+
+    for (uint local = 0; local < remap.size(); local++){
+        if (remap[local] < 0)
+            continue;
+        uint i = first + remap[local];
+        uint z = local / (width * width);
+        uint y = (local / width) % width;
+        uint x = local % width;
+        // coordinate along the axis of each direction
+        const uint coords[6] = { x, x, y, y, z, z };
+
+        // a neighbour bit is only set for stored masspoints
+        uint same = sameMask(maskdata[i]);
+        uint second = 0;
+        for (uint k = 0; k < 6; k++){
+            if (!(same & dirs[k]))
+                continue;
+            // lower directions need coord > 1, upper ones coord < width - 2
+            bool inbounds = (k % 2 == 0) ? coords[k] > 1 : coords[k] + 2 < width;
+            if (inbounds && (sameMask(maskdata[first + remap[local + offsets[k]]]) & dirs[k]))
+                second |= dirs[k];
+        }
+        maskdata[i] = (maskdata[i] & 0xFFFF) | (second << 16);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// View: pointers to the arrays of the current state
+//--------------------------------------------------------------------------------------
+MASSVIEW MasspointStore::view(uint first){
+
+    const POSARRAY& p = prev();
+    const POSARRAY& c = curr();
+    POSARRAY& n = next();
+
+    MASSVIEW v;
+    v.oldX = p.x.data() + first;
+    v.oldY = p.y.data() + first;
+    v.oldZ = p.z.data() + first;
+    v.newX = c.x.data() + first;
+    v.newY = c.y.data() + first;
+    v.newZ = c.z.data() + first;
+    v.masks = maskdata.data() + first;
+    v.nextX = n.x.data() + first;
+    v.nextY = n.y.data() + first;
+    v.nextZ = n.z.data() + first;
+    return v;
+}
@@ -0,0 +1,287 @@
+//--------------------------------------------------------------------------------------
+// File: OBJParser.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Memory-mapped, parallel .OBJ parser (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <memory>
+// floating-point std::from_chars: VS 2019 16.4 (/std:c++17), libstdc++ 11; a local parser before that
+#if defined(_MSC_VER) ? _MSC_VER >= 1924 && _MSVC_LANG >= 201703L : __cplusplus >= 201703L
+#include <charconv>
+#if defined(_MSC_VER) || defined(__cpp_lib_to_chars)
+#define OBJ_FROM_CHARS
+#endif
+#endif
+#include "../Headers/OBJParser.h"
+#include "../Headers/MappedFile.h"
+#include "../Headers/ThreadPool.h"
+
+
+// normal index of a corner without one: its vertex index
+static const int OBJ_SAME_INDEX = INT_MIN;
+
+
+/// Records of one chunk, indices resolved in the chunk
+struct OBJCHUNK
+{
+    const char* begin;
+    const char* end;
+    std::vector<float> positions;
+    std::vector<float> normals;
+    // from 0; negative in the file: from 0 in the chunk, listed in relative(Normals);
+    // OBJ_SAME_INDEX: corner without a normal index
+    std::vector<int> indices;
+    std::vector<int> normalIndices;
+    std::vector<uint> relative;
+    std::vector<uint> relativeNormals;
+    // an index out of range
+    bool invalid;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Tokenizer helpers
+//--------------------------------------------------------------------------------------
+
+static inline const char* skipSpace(const char* p, const char* end){
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+static inline const char* nextLine(const char* p, const char* end){
+    const char* n = (const char*)memchr(p, '\n', end - p);
+    return n ? n + 1 : end;
+}
+
+// one float, unchanged if there is none
+static inline const char* readFloat(const char* p, const char* end, float& f){
+#ifdef OBJ_FROM_CHARS
+    return std::from_chars(p, end, f).ptr;
+#else
+    // decimal mantissa and exponent (not correctly rounded in the last bit)
+    const char* start = p;
+    bool negative = p < end && *p == '-';
+    if (negative)
+        p++;
+    double mantissa = 0.0;
+    int exponent = 0, digits = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++)
+        mantissa = mantissa * 10 + (*p - '0');
+    if (p < end && *p == '.'){
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++, exponent--)
+            mantissa = mantissa * 10 + (*p - '0');
+    }
+    if (digits == 0)
+        return start;
+    if (p + 1 < end && (*p == 'e' || *p == 'E')){
+        const char* q = p + 1;
+        bool negativeExponent = *q == '-';
+        if (*q == '-' || *q == '+')
+            q++;
+        int e = 0;
+        if (q < end && *q >= '0' && *q <= '9'){
+            for (; q < end && *q >= '0' && *q <= '9'; q++)
+                e = std::min(e * 10 + (*q - '0'), 1000);
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+    f = (float)((negative ? -mantissa : mantissa) * pow(10.0, exponent));
+    return p;
+#endif
+}
+
+// 3 floats of a v or vn record (missing ones are 0)
+static inline void readFloats(const char* p, const char* end, std::vector<float>& out){
+    for (uint k = 0; k < 3; k++){
+        p = skipSpace(p, end);
+        float f = 0.0f;
+        if (p < end && *p == '+')
+            p++;
+        p = readFloat(p, end, f);
+        out.push_back(f);
+    }
+}
+
+// one index of a face corner, 0 if absent; nullptr if it does not fit in an int
+static inline const char* readIndex(const char* p, const char* end, int& index){
+    index = 0;
+    bool negative = p < end && *p == '-';
+    if (negative)
+        p++;
+    for (; p < end && *p >= '0' && *p <= '9'; p++){
+        int digit = *p - '0';
+        if (index > (INT_MAX - digit) / 10)
+            return nullptr;
+        index = index * 10 + digit;
+    }
+    if (negative)
+        index = -index;
+    return p;
+}
+
+//--------------------------------------------------------------------------------------
+// Parse chunk: v, vn and f records of [begin, end)
+//--------------------------------------------------------------------------------------
+static void parseChunk(OBJCHUNK& c){
+
+    std::vector<int> corners, cornerNormals;
+    const char* end = c.end;
+    for (const char* p = c.begin; p < end;){
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol)
+            eol = end;
+        const char* q = skipSpace(p, eol);
+        p = eol + (eol < end ? 1 : 0);
+        if (eol - q < 2)
+            continue;
+
+        // v, vn
+        if (q[0] == 'v' && (q[1] == ' ' || q[1] == '\t'))
+            readFloats(q + 2, eol, c.positions);
+        else if (q[0] == 'v' && q[1] == 'n' && eol - q > 2 && (q[2] == ' ' || q[2] == '\t'))
+            readFloats(q + 3, eol, c.normals);
+
+        // f: corners, then a fan of triangles
+        else if (q[0] == 'f' && (q[1] == ' ' || q[1] == '\t')){
+            corners.clear();
+            cornerNormals.clear();
+            q = skipSpace(q + 2, eol);
+            while (q < eol && *q != '\r' && *q != '#'){
+                int v, t, n = 0;
+                q = readIndex(q, eol, v);
+                if (q && q < eol && *q == '/'){
+                    q = readIndex(q + 1, eol, t);
+                    if (q && q < eol && *q == '/')
+                        q = readIndex(q + 1, eol, n);
+                }
+                // missing or overflowing index (no exceptions in the pool tasks, the merge reports it)
+                if (!q || v == 0){
+                    c.invalid = true;
+                    break;
+                }
+                corners.push_back(v);
+                cornerNormals.push_back(n);
+                // skip the rest of the token
+                while (q < eol && *q != ' ' && *q != '\t')
+                    q++;
+                q = skipSpace(q, eol);
+            }
+
+            int vertexCount = (int)c.positions.size() / 3, normalCount = (int)c.normals.size() / 3;
+            for (uint k = 2; k < corners.size(); k++){
+                uint fan[3] = { 0, k - 1, k };
+                for (uint j : fan){
+                    int v = corners[j], n = cornerNormals[j];
+                    if (v < 0){
+                        c.relative.push_back(c.indices.size());
+                        c.indices.push_back(vertexCount + v);
+                    }
+                    else
+                        c.indices.push_back(v - 1);
+                    if (n == 0)
+                        c.normalIndices.push_back(OBJ_SAME_INDEX);
+                    else if (n < 0){
+                        c.relativeNormals.push_back(c.normalIndices.size());
+                        c.normalIndices.push_back(normalCount + n);
+                    }
+                    else
+                        c.normalIndices.push_back(n - 1);
+                }
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Parse: chunks in parallel, then concatenated with the indices made global
+//--------------------------------------------------------------------------------------
+OBJMESH OBJParser::parse(const std::string& file, ThreadPool* pool){
+
+    auto start = std::chrono::high_resolution_clock::now();
+    MappedFile mapped(file);
+    const char* data = mapped.data();
+    size_t size = mapped.size();
+
+    // newline-aligned chunks
+    std::unique_ptr<ThreadPool> local;
+    if (!pool && size > OBJ_CHUNK_BYTES){
+        local.reset(new ThreadPool());
+        pool = local.get();
+    }
+    uint count = (uint)std::max<size_t>(1, size / OBJ_CHUNK_BYTES);
+    std::vector<OBJCHUNK> chunks(count);
+    const char* end = data + size;
+    const char* p = data;
+    for (uint k = 0; k < count; k++){
+        chunks[k].begin = p;
+        chunks[k].invalid = false;
+        p = k + 1 == count ? end : std::max(p, nextLine(data + size / count * (k + 1), end));
+        chunks[k].end = p;
+    }
+
+    auto run = [&](uint k){ parseChunk(chunks[k]); };
+    if (pool && count > 1)
+        pool->parallelFor(count, run);
+    else
+        for (uint k = 0; k < count; k++)
+            run(k);
+
+    // offsets of the chunks
+    std::vector<size_t> vertexOffset(count + 1, 0), normalOffset(count + 1, 0), indexOffset(count + 1, 0);
+    for (uint k = 0; k < count; k++){
+        vertexOffset[k + 1] = vertexOffset[k] + chunks[k].positions.size();
+        normalOffset[k + 1] = normalOffset[k] + chunks[k].normals.size();
+        indexOffset[k + 1] = indexOffset[k] + chunks[k].indices.size();
+    }
+    OBJMESH mesh;
+    mesh.positions.resize(vertexOffset[count]);
+    mesh.normals.resize(normalOffset[count]);
+    mesh.indices.resize(indexOffset[count]);
+    mesh.normalIndices.resize(indexOffset[count]);
+
+    // copy, relative indices shifted by the vertices of the chunks before, range checks
+    int vertexCount = (int)(vertexOffset[count] / 3), normalCount = (int)(normalOffset[count] / 3);
+    auto merge = [&](uint k){
+        OBJCHUNK& c = chunks[k];
+        int vertexBase = (int)(vertexOffset[k] / 3), normalBase = (int)(normalOffset[k] / 3);
+        for (uint i : c.relative)
+            c.indices[i] += vertexBase;
+        for (uint i : c.relativeNormals)
+            c.normalIndices[i] += normalBase;
+        std::copy(c.positions.begin(), c.positions.end(), mesh.positions.begin() + vertexOffset[k]);
+        std::copy(c.normals.begin(), c.normals.end(), mesh.normals.begin() + normalOffset[k]);
+        for (size_t i = 0; i < c.indices.size(); i++){
+            bool same = c.normalIndices[i] == OBJ_SAME_INDEX;
+            int v = c.indices[i], n = same ? v : c.normalIndices[i];
+            if (v < 0 || v >= vertexCount || (!same && (n < 0 || n >= normalCount)))
+                c.invalid = true;
+            mesh.indices[indexOffset[k] + i] = (uint)v;
+            mesh.normalIndices[indexOffset[k] + i] = (uint)n;
+        }
+    };
+    if (pool && count > 1)
+        pool->parallelFor(count, merge);
+    else
+        for (uint k = 0; k < count; k++)
+            merge(k);
+    for (const OBJCHUNK& c : chunks)
+        if (c.invalid)
+            throw "OBJParser: face index out of range";
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    mesh.bytes = size;
+    mesh.ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    return mesh;
+}
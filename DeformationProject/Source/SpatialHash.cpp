@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// File: SpatialHash.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Uniform hash grid over the surface masspoints of the CPU solver (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include "../Headers/SpatialHash.h"
+#include "../Headers/Collision.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+SpatialHash::SpatialHash() : cellSize(1.0f), invCellSize(1.0f){}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+SpatialHash::~SpatialHash(){}
+
+//--------------------------------------------------------------------------------------
+// Bucket: hash of the cell coordinates, table size is a power of 2
+//--------------------------------------------------------------------------------------
+uint SpatialHash::bucket(int x, int y, int z) const {
+
+    uint h = ((uint)x * 73856093u) ^ ((uint)y * 19349663u) ^ ((uint)z * 83492791u);
+    return h & ((uint)bucketStart.size() - 2);
+}
+
+//--------------------------------------------------------------------------------------
+// Build: masspoints of the grid, table of at least 2 buckets per masspoint
+//--------------------------------------------------------------------------------------
+void SpatialHash::build(const std::vector<uint>& ids, const std::vector<uint>& objects){
+
+    pointID = ids;
+    pointObject = objects;
+    uint n = ids.size();
+    uint buckets = 2;
+    while (buckets < 2 * n)
+        buckets *= 2;
+    bucketStart.assign(buckets + 1, 0);
+    pointBucket.assign(n, 0);
+    sortedX.assign(n, 0.0f);
+    sortedY.assign(n, 0.0f);
+    sortedZ.assign(n, 0.0f);
+    sortedObject.assign(n, 0);
+    sortedID.assign(n, 0);
+}
+
+//--------------------------------------------------------------------------------------
+// Update: bucket of every masspoint, counting sort by bucket
+//--------------------------------------------------------------------------------------
+void SpatialHash::update(const MASSVIEW& v, float range, ThreadPool& pool){
+
+    uint n = pointID.size();
+    cellSize = range > 0.0f ? range : 1.0f;
+    invCellSize = 1.0f / cellSize;
+
+    pool.parallelFor((n + CPU_HASH_BATCH - 1) / CPU_HASH_BATCH, [&](uint task){
+        uint end = std::min(n, (task + 1) * CPU_HASH_BATCH);
+        for (uint i = task * CPU_HASH_BATCH; i < end; i++){
+            uint g = pointID[i];
+            pointBucket[i] = bucket((int)floorf(v.newX[g] * invCellSize), (int)floorf(v.newY[g] * invCellSize), (int)floorf(v.newZ[g] * invCellSize));
+        }
+    });
+
+    // counting sort, masspoint order inside a bucket
+    std::fill(bucketStart.begin(), bucketStart.end(), 0);
+    for (uint i = 0; i < n; i++)
+        bucketStart[pointBucket[i] + 1]++;
+    for (uint b = 0; b + 1 < bucketStart.size(); b++)
+        bucketStart[b + 1] += bucketStart[b];
+    for (uint i = 0; i < n; i++){
+        uint dst = bucketStart[pointBucket[i]]++;
+        uint g = pointID[i];
+        sortedX[dst] = v.newX[g];
+        sortedY[dst] = v.newY[g];
+        sortedZ[dst] = v.newZ[g];
+        sortedObject[dst] = pointObject[i];
+        sortedID[dst] = g;
+    }
+    // the scatter moved every start to the next bucket
+    for (uint b = bucketStart.size() - 1; b > 0; b--)
+        bucketStart[b] = bucketStart[b - 1];
+    bucketStart[0] = 0;
+}
+
+//--------------------------------------------------------------------------------------
+// Query: masspoints of other objects in the 27 cells around cpos
+//--------------------------------------------------------------------------------------
+XMFLOAT3 SpatialHash::query(const XMFLOAT3& cpos, uint objnum, float range) const {
+
+    XMFLOAT3 accel(0, 0, 0);
+    visit(cpos, range, [&](uint, uint object, const XMFLOAT3& d){
+        if (object == objnum)
+            return;
+        // the force of collide() in the tree queries
+        XMFLOAT3 f = repel(d, range);
+        accel.x += f.x;
+        accel.y += f.y;
+        accel.z += f.z;
+    });
+    return accel;
+}
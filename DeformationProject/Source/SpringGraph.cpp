@@ -0,0 +1,109 @@
+//--------------------------------------------------------------------------------------
+// File: SpringGraph.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Compressed spring topology (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include "../Headers/SpringGraph.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+SpringGraph::SpringGraph(){
+    offsets.push_back(0);
+}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+SpringGraph::~SpringGraph(){}
+
+//--------------------------------------------------------------------------------------
+// Clear: no masspoints, no springs
+//--------------------------------------------------------------------------------------
+void SpringGraph::clear(){
+
+    offsets.assign(1, 0);
+    targets.clear();
+    lengthClass.clear();
+    springEdge.clear();
+    springSign.clear();
+    edgeA.clear();
+    edgeB.clear();
+    edgeClass.clear();
+}
+
+//--------------------------------------------------------------------------------------
+// Add masspoint: its springs are the ones added until the next addMasspoint()
+//--------------------------------------------------------------------------------------
+void SpringGraph::addMasspoint(){
+    offsets.push_back(offsets.back());
+}
+
+//--------------------------------------------------------------------------------------
+// Add spring: directed spring from the last masspoint
+//--------------------------------------------------------------------------------------
+void SpringGraph::addSpring(uint target, unsigned char cls){
+
+    targets.push_back(target);
+    lengthClass.push_back(cls);
+    offsets.back()++;
+}
+
+//--------------------------------------------------------------------------------------
+// Append rows: copy the springs of some masspoints of another graph, remapping targets
+//--------------------------------------------------------------------------------------
+void SpringGraph::appendRows(const SpringGraph& src, uint first, uint count, uint split, uint offset1, uint offset2){
+
+    for (uint v = first; v < first + count; v++){
+        addMasspoint();
+        for (uint s = src.offsets[v]; s < src.offsets[v + 1]; s++){
+            uint t = src.targets[s];
+            addSpring(t < split ? offset1 + t : offset2 + (t - split), src.lengthClass[s]);
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Build edges: a -> b and b -> a (same class) share an edge, one-way springs get their own
+//--------------------------------------------------------------------------------------
+void SpringGraph::buildEdges(){
+
+    uint n = masspointCount();
+    springEdge.assign(targets.size(), 0);
+    springSign.assign(targets.size(), 1.0f);
+    edgeA.clear();
+    edgeB.clear();
+    edgeClass.clear();
+
+    for (uint a = 0; a < n; a++){
+        for (uint s = offsets[a]; s < offsets[a + 1]; s++){
+            uint b = targets[s];
+
+            // the reverse spring of an earlier masspoint already created the edge
+            bool paired = false;
+            if (b < a){
+                for (uint r = offsets[b]; r < offsets[b + 1]; r++){
+                    if (targets[r] == a && lengthClass[r] == lengthClass[s]){
+                        springEdge[s] = springEdge[r];
+                        springSign[s] = -1.0f;
+                        paired = true;
+                        break;
+                    }
+                }
+            }
+            if (!paired){
+                springEdge[s] = edgeA.size();
+                edgeA.push_back(a);
+                edgeB.push_back(b);
+                edgeClass.push_back(lengthClass[s]);
+            }
+        }
+    }
+}
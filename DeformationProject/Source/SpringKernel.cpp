@@ -0,0 +1,449 @@
+//--------------------------------------------------------------------------------------
+// File: SpringKernel.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Vectorized spring force kernel of the CPU solver (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <cmath>
+#include "../Headers/SpringKernel.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPRINGKERNEL_X86        1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define SPRINGKERNEL_X86        0
+#endif
+
+// AVX-512 intrinsics need VS2017 or gcc/clang
+#if SPRINGKERNEL_X86 && (defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1911))
+#define SPRINGKERNEL_AVX512     1
+#else
+#define SPRINGKERNEL_AVX512     0
+#endif
+
+// gcc/clang compile the wide paths per function, MSVC emits any intrinsic
+#if defined(__GNUC__)
+#define TARGET_AVX2             __attribute__((target("avx2")))
+#define TARGET_AVX512           __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// neighbour bits inside a packed MASK
+#define SAME_BIT(k)             ((MASK)(NB_SAME_LEFT >> (k)) << 8)
+#define SECOND_BIT(k)           ((MASK)(NB_SAME_LEFT >> (k)) << 16)
+#define OTHER_BIT(k)            ((MASK)(NB_OTHER_NEAR_BOT_LEFT >> (k)))
+
+
+//--------------------------------------------------------------------------------------
+// Scalar path, the reference for the wide paths
+//--------------------------------------------------------------------------------------
+
+// approximate 1/sqrt(x), same table as the packed rsqrt instructions
+static inline float rsqrtApprox(float x){
+#if SPRINGKERNEL_X86
+    return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#else
+    return 1.0f / sqrtf(x);
+#endif
+}
+
+// acceleration of a from the spring a -> b (position an, displacement da = an - ao)
+static inline void springAcc(const MASSVIEW& vb, int b, float anx, float any, float anz, float dax, float day, float daz,
+                             const SPRINGPARAMS& p, float len, float& rx, float& ry, float& rz){
+
+    float bnx = vb.newX[b], bny = vb.newY[b], bnz = vb.newZ[b];
+
+    // v = (va - vb)
+    float vx = (dax - bnx + vb.oldX[b]) * p.idt;
+    float vy = (day - bny + vb.oldY[b]) * p.idt;
+    float vz = (daz - bnz + vb.oldZ[b]) * p.idt;
+
+    // |d| = d2 * rsqrt(d2), rsqrt refined by one Newton-Raphson step
+    float dx = bnx - anx, dy = bny - any, dz = bnz - anz;
+    float d2 = dx * dx + dy * dy + dz * dz;
+    float r0 = rsqrtApprox(d2);
+    float t = 0.5f * d2 * r0;
+    t = t * r0;
+    float r = d2 > 0.0f ? r0 * (1.5f - t) : 0.0f;
+    float s = p.stiffness * (d2 * r - len) * r;
+
+    rx = (s * dx + p.damping * vx) * p.im;
+    ry = (s * dy + p.damping * vy) * p.im;
+    rz = (s * dz + p.damping * vz) * p.im;
+}
+
+// spring a -> b, added to acc (adds zero if the spring does not exist)
+static inline void springScalar(bool exists, const MASSVIEW& vb, int b,
+                                float anx, float any, float anz, float dax, float day, float daz,
+                                const SPRINGPARAMS& p, float len, float& accx, float& accy, float& accz){
+
+    float rx = 0.0f, ry = 0.0f, rz = 0.0f;
+    if (exists)
+        springAcc(vb, b, anx, any, anz, dax, day, daz, p, len, rx, ry, rz);
+    accx += rx;
+    accy += ry;
+    accz += rz;
+}
+
+static void rowScalar(const MASSVIEW& self, const MASSVIEW& other, const SPRINGLAYOUT& layout, const SPRINGPARAMS& p,
+                      int base, int obase, uint count, float* ax, float* ay, float* az){
+
+    for (uint l = 0; l < count; l++){
+        int a = base + l;
+        int oa = obase + l;
+        MASK m = self.masks[a];
+
+        float anx = self.newX[a], any = self.newY[a], anz = self.newZ[a];
+        float dax = anx - self.oldX[a], day = any - self.oldY[a], daz = anz - self.oldZ[a];
+        float accx = 0.0f, accy = p.gravityAcc, accz = 0.0f;
+
+        for (uint k = 0; k < 6; k++){
+            springScalar((m & SAME_BIT(k)) != 0, self, a + layout.same[k], anx, any, anz, dax, day, daz, p, p.len[0], accx, accy, accz);
+            springScalar((m & SECOND_BIT(k)) != 0, self, a + layout.second[k], anx, any, anz, dax, day, daz, p, p.len[2], accx, accy, accz);
+        }
+        for (uint k = 0; k < 8; k++){
+            springScalar((m & OTHER_BIT(k)) != 0, other, oa + layout.other[k], anx, any, anz, dax, day, daz, p, p.len[1], accx, accy, accz);
+        }
+
+        ax[l] = accx;
+        ay[l] = accy;
+        az[l] = accz;
+    }
+}
+
+
+#if SPRINGKERNEL_X86
+//--------------------------------------------------------------------------------------
+// AVX2 path, 8 masspoints per instruction
+//--------------------------------------------------------------------------------------
+
+TARGET_AVX2 static inline void springAVX2(__m256i exists, const MASSVIEW& vb, int b,
+                                          __m256 anx, __m256 any, __m256 anz, __m256 dax, __m256 day, __m256 daz,
+                                          const SPRINGPARAMS& p, float len, __m256& accx, __m256& accy, __m256& accz){
+
+    // no lane has this spring
+    if (_mm256_testz_si256(exists, exists))
+        return;
+
+    __m256 lanes = _mm256_castsi256_ps(exists);
+    __m256 bnx = _mm256_maskload_ps(vb.newX + b, exists);
+    __m256 bny = _mm256_maskload_ps(vb.newY + b, exists);
+    __m256 bnz = _mm256_maskload_ps(vb.newZ + b, exists);
+    __m256 idt = _mm256_set1_ps(p.idt);
+
+    __m256 vx = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(dax, bnx), _mm256_maskload_ps(vb.oldX + b, exists)), idt);
+    __m256 vy = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(day, bny), _mm256_maskload_ps(vb.oldY + b, exists)), idt);
+    __m256 vz = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(daz, bnz), _mm256_maskload_ps(vb.oldZ + b, exists)), idt);
+
+    __m256 dx = _mm256_sub_ps(bnx, anx);
+    __m256 dy = _mm256_sub_ps(bny, any);
+    __m256 dz = _mm256_sub_ps(bnz, anz);
+    __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    __m256 r0 = _mm256_rsqrt_ps(d2);
+    __m256 t = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), d2), r0);
+    t = _mm256_mul_ps(t, r0);
+    __m256 r = _mm256_mul_ps(r0, _mm256_sub_ps(_mm256_set1_ps(1.5f), t));
+    r = _mm256_and_ps(r, _mm256_cmp_ps(d2, _mm256_setzero_ps(), _CMP_GT_OQ));
+    __m256 s = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(p.stiffness), _mm256_sub_ps(_mm256_mul_ps(d2, r), _mm256_set1_ps(len))), r);
+
+    __m256 damping = _mm256_set1_ps(p.damping);
+    __m256 im = _mm256_set1_ps(p.im);
+    __m256 rx = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(s, dx), _mm256_mul_ps(damping, vx)), im);
+    __m256 ry = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(s, dy), _mm256_mul_ps(damping, vy)), im);
+    __m256 rz = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(s, dz), _mm256_mul_ps(damping, vz)), im);
+
+    accx = _mm256_add_ps(accx, _mm256_and_ps(rx, lanes));
+    accy = _mm256_add_ps(accy, _mm256_and_ps(ry, lanes));
+    accz = _mm256_add_ps(accz, _mm256_and_ps(rz, lanes));
+}
+
+// lanes whose mask has the given bit
+TARGET_AVX2 static inline __m256i laneMaskAVX2(__m256i m, MASK bit){
+    __m256i b = _mm256_set1_epi32((int)bit);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(m, b), b);
+}
+
+TARGET_AVX2 static void rowAVX2(const MASSVIEW& self, const MASSVIEW& other, const SPRINGLAYOUT& layout, const SPRINGPARAMS& p,
+                                int base, int obase, uint count, float* ax, float* ay, float* az){
+
+    const __m256i laneid = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (uint l = 0; l < count; l += 8){
+        int a = base + l;
+        int oa = obase + l;
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(count - l)), laneid);
+        __m256i m = _mm256_maskload_epi32((const int*)(self.masks + a), valid);
+
+        __m256 anx = _mm256_maskload_ps(self.newX + a, valid);
+        __m256 any = _mm256_maskload_ps(self.newY + a, valid);
+        __m256 anz = _mm256_maskload_ps(self.newZ + a, valid);
+        __m256 dax = _mm256_sub_ps(anx, _mm256_maskload_ps(self.oldX + a, valid));
+        __m256 day = _mm256_sub_ps(any, _mm256_maskload_ps(self.oldY + a, valid));
+        __m256 daz = _mm256_sub_ps(anz, _mm256_maskload_ps(self.oldZ + a, valid));
+        __m256 accx = _mm256_setzero_ps(), accy = _mm256_set1_ps(p.gravityAcc), accz = _mm256_setzero_ps();
+
+        for (uint k = 0; k < 6; k++){
+            springAVX2(laneMaskAVX2(m, SAME_BIT(k)), self, a + layout.same[k], anx, any, anz, dax, day, daz, p, p.len[0], accx, accy, accz);
+            springAVX2(laneMaskAVX2(m, SECOND_BIT(k)), self, a + layout.second[k], anx, any, anz, dax, day, daz, p, p.len[2], accx, accy, accz);
+        }
+        for (uint k = 0; k < 8; k++){
+            springAVX2(laneMaskAVX2(m, OTHER_BIT(k)), other, oa + layout.other[k], anx, any, anz, dax, day, daz, p, p.len[1], accx, accy, accz);
+        }
+
+        _mm256_maskstore_ps(ax + l, valid, accx);
+        _mm256_maskstore_ps(ay + l, valid, accy);
+        _mm256_maskstore_ps(az + l, valid, accz);
+    }
+}
+#endif
+
+
+#if SPRINGKERNEL_AVX512
+//--------------------------------------------------------------------------------------
+// AVX-512 path, 16 masspoints per instruction
+//--------------------------------------------------------------------------------------
+
+// rsqrt of both halves with the AVX rsqrt, rsqrt14 would differ from the other paths
+TARGET_AVX512 static inline __m512 rsqrtAVX512(__m512 x){
+    __m256 lo = _mm256_rsqrt_ps(_mm512_castps512_ps256(x));
+    __m256 hi = _mm256_rsqrt_ps(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x), 1)));
+    return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lo)), _mm256_castps_pd(hi), 1));
+}
+
+TARGET_AVX512 static inline void springAVX512(__mmask16 exists, const MASSVIEW& vb, int b,
+                                              __m512 anx, __m512 any, __m512 anz, __m512 dax, __m512 day, __m512 daz,
+                                              const SPRINGPARAMS& p, float len, __m512& accx, __m512& accy, __m512& accz){
+
+    if (exists == 0)
+        return;
+
+    __m512 bnx = _mm512_maskz_loadu_ps(exists, vb.newX + b);
+    __m512 bny = _mm512_maskz_loadu_ps(exists, vb.newY + b);
+    __m512 bnz = _mm512_maskz_loadu_ps(exists, vb.newZ + b);
+    __m512 idt = _mm512_set1_ps(p.idt);
+
+    __m512 vx = _mm512_mul_ps(_mm512_add_ps(_mm512_sub_ps(dax, bnx), _mm512_maskz_loadu_ps(exists, vb.oldX + b)), idt);
+    __m512 vy = _mm512_mul_ps(_mm512_add_ps(_mm512_sub_ps(day, bny), _mm512_maskz_loadu_ps(exists, vb.oldY + b)), idt);
+    __m512 vz = _mm512_mul_ps(_mm512_add_ps(_mm512_sub_ps(daz, bnz), _mm512_maskz_loadu_ps(exists, vb.oldZ + b)), idt);
+
+    __m512 dx = _mm512_sub_ps(bnx, anx);
+    __m512 dy = _mm512_sub_ps(bny, any);
+    __m512 dz = _mm512_sub_ps(bnz, anz);
+    __m512 d2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+    __m512 r0 = rsqrtAVX512(d2);
+    __m512 t = _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), d2), r0);
+    t = _mm512_mul_ps(t, r0);
+    __m512 r = _mm512_mul_ps(r0, _mm512_sub_ps(_mm512_set1_ps(1.5f), t));
+    r = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(d2, _mm512_setzero_ps(), _CMP_GT_OQ), r);
+    __m512 s = _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(p.stiffness), _mm512_sub_ps(_mm512_mul_ps(d2, r), _mm512_set1_ps(len))), r);
+
+    __m512 damping = _mm512_set1_ps(p.damping);
+    __m512 im = _mm512_set1_ps(p.im);
+    __m512 rx = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(s, dx), _mm512_mul_ps(damping, vx)), im);
+    __m512 ry = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(s, dy), _mm512_mul_ps(damping, vy)), im);
+    __m512 rz = _mm512_mul_ps(_mm512_add_ps(_mm512_mul_ps(s, dz), _mm512_mul_ps(damping, vz)), im);
+
+    // add zero on the other lanes, like the scalar and AVX2 paths
+    accx = _mm512_add_ps(accx, _mm512_maskz_mov_ps(exists, rx));
+    accy = _mm512_add_ps(accy, _mm512_maskz_mov_ps(exists, ry));
+    accz = _mm512_add_ps(accz, _mm512_maskz_mov_ps(exists, rz));
+}
+
+TARGET_AVX512 static void rowAVX512(const MASSVIEW& self, const MASSVIEW& other, const SPRINGLAYOUT& layout, const SPRINGPARAMS& p,
+                                    int base, int obase, uint count, float* ax, float* ay, float* az){
+
+    for (uint l = 0; l < count; l += 16){
+        int a = base + l;
+        int oa = obase + l;
+        uint n = count - l;
+        __mmask16 valid = n >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << n) - 1);
+        __m512i m = _mm512_maskz_loadu_epi32(valid, self.masks + a);
+
+        __m512 anx = _mm512_maskz_loadu_ps(valid, self.newX + a);
+        __m512 any = _mm512_maskz_loadu_ps(valid, self.newY + a);
+        __m512 anz = _mm512_maskz_loadu_ps(valid, self.newZ + a);
+        __m512 dax = _mm512_sub_ps(anx, _mm512_maskz_loadu_ps(valid, self.oldX + a));
+        __m512 day = _mm512_sub_ps(any, _mm512_maskz_loadu_ps(valid, self.oldY + a));
+        __m512 daz = _mm512_sub_ps(anz, _mm512_maskz_loadu_ps(valid, self.oldZ + a));
+        __m512 accx = _mm512_setzero_ps(), accy = _mm512_set1_ps(p.gravityAcc), accz = _mm512_setzero_ps();
+
+        for (uint k = 0; k < 6; k++){
+            springAVX512(_mm512_test_epi32_mask(m, _mm512_set1_epi32((int)SAME_BIT(k))), self, a + layout.same[k],
+                         anx, any, anz, dax, day, daz, p, p.len[0], accx, accy, accz);
+            springAVX512(_mm512_test_epi32_mask(m, _mm512_set1_epi32((int)SECOND_BIT(k))), self, a + layout.second[k],
+                         anx, any, anz, dax, day, daz, p, p.len[2], accx, accy, accz);
+        }
+        for (uint k = 0; k < 8; k++){
+            springAVX512(_mm512_test_epi32_mask(m, _mm512_set1_epi32((int)OTHER_BIT(k))), other, oa + layout.other[k],
+                         anx, any, anz, dax, day, daz, p, p.len[1], accx, accy, accz);
+        }
+
+        _mm512_mask_storeu_ps(ax + l, valid, accx);
+        _mm512_mask_storeu_ps(ay + l, valid, accy);
+        _mm512_mask_storeu_ps(az + l, valid, accz);
+    }
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Spring graph paths: no mask decoding, only the springs that exist
+//--------------------------------------------------------------------------------------
+void SpringKernel::vertices(const MASSVIEW& v, const SpringGraph& graph, const SPRINGPARAMS& p,
+                            uint first, uint count, float* ax, float* ay, float* az){
+
+    for (uint l = 0; l < count; l++){
+        uint a = first + l;
+        float anx = v.newX[a], any = v.newY[a], anz = v.newZ[a];
+        float dax = anx - v.oldX[a], day = any - v.oldY[a], daz = anz - v.oldZ[a];
+        float accx = 0.0f, accy = p.gravityAcc, accz = 0.0f;
+
+        for (uint s = graph.offsets[a]; s < graph.offsets[a + 1]; s++){
+            float rx, ry, rz;
+            springAcc(v, graph.targets[s], anx, any, anz, dax, day, daz, p, p.len[graph.lengthClass[s]], rx, ry, rz);
+            accx += rx;
+            accy += ry;
+            accz += rz;
+        }
+
+        ax[l] = accx;
+        ay[l] = accy;
+        az[l] = accz;
+    }
+}
+
+void SpringKernel::edges(const MASSVIEW& v, const SpringGraph& graph, const SPRINGPARAMS& p, const float* rest,
+                         uint first, uint count, float* fx, float* fy, float* fz){
+
+    for (uint e = first; e < first + count; e++){
+        uint a = graph.edgeA[e];
+        float anx = v.newX[a], any = v.newY[a], anz = v.newZ[a];
+        springAcc(v, graph.edgeB[e], anx, any, anz, anx - v.oldX[a], any - v.oldY[a], anz - v.oldZ[a],
+                  p, rest[e], fx[e], fy[e], fz[e]);
+    }
+}
+
+void SpringKernel::gather(const SpringGraph& graph, const SPRINGPARAMS& p, const float* fx, const float* fy, const float* fz,
+                          uint first, uint count, float* ax, float* ay, float* az){
+
+    for (uint l = 0; l < count; l++){
+        uint a = first + l;
+        float accx = 0.0f, accy = p.gravityAcc, accz = 0.0f;
+
+        // the force on the b end of an edge is the negated force on a
+        for (uint s = graph.offsets[a]; s < graph.offsets[a + 1]; s++){
+            uint e = graph.springEdge[s];
+            float sign = graph.springSign[s];
+            accx += sign * fx[e];
+            accy += sign * fy[e];
+            accz += sign * fz[e];
+        }
+
+        ax[l] = accx;
+        ay[l] = accy;
+        az[l] = accz;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Runtime ISA detection: CPUID feature bits and OS support of the register state
+//--------------------------------------------------------------------------------------
+#if SPRINGKERNEL_X86
+static void cpuid(int leaf, int sub, int regs[4]){
+#if defined(_MSC_VER)
+    __cpuidex(regs, leaf, sub);
+#else
+    unsigned int a, b, c, d;
+    __cpuid_count(leaf, sub, a, b, c, d);
+    regs[0] = (int)a; regs[1] = (int)b; regs[2] = (int)c; regs[3] = (int)d;
+#endif
+}
+
+static unsigned long long xgetbv0(){
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+SpringKernel::Isa SpringKernel::detect(){
+
+#if SPRINGKERNEL_X86
+    int regs[4];
+    cpuid(0, 0, regs);
+    if (regs[0] < 7)
+        return ISA_SCALAR;
+
+    // OSXSAVE + AVX, and the OS saves the YMM state
+    cpuid(1, 0, regs);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx)
+        return ISA_SCALAR;
+    unsigned long long xcr0 = xgetbv0();
+    if ((xcr0 & 0x6) != 0x6)
+        return ISA_SCALAR;
+
+    cpuid(7, 0, regs);
+    bool avx2 = (regs[1] & (1 << 5)) != 0;
+    bool avx512f = (regs[1] & (1 << 16)) != 0;
+
+    // opmask, ZMM0-15 upper halves and ZMM16-31 saved by the OS
+    if (SPRINGKERNEL_AVX512 && avx2 && avx512f && (xcr0 & 0xE6) == 0xE6)
+        return ISA_AVX512;
+    if (avx2)
+        return ISA_AVX2;
+#endif
+    return ISA_SCALAR;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Constructors
+//--------------------------------------------------------------------------------------
+SpringKernel::SpringKernel() : SpringKernel(ISA_AVX512) {}
+
+SpringKernel::SpringKernel(Isa isa){
+
+    Isa available = detect();
+    selected = isa < available ? isa : available;
+
+    switch (selected){
+#if SPRINGKERNEL_AVX512
+    case ISA_AVX512: func = rowAVX512; break;
+#endif
+#if SPRINGKERNEL_X86
+    case ISA_AVX2: func = rowAVX2; break;
+#endif
+    default: selected = ISA_SCALAR; func = rowScalar; break;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Name of the selected instruction set
+//--------------------------------------------------------------------------------------
+const char* SpringKernel::name() const {
+
+    switch (selected){
+    case ISA_AVX512: return "AVX-512";
+    case ISA_AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
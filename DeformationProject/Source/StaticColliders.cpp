@@ -0,0 +1,396 @@
+//--------------------------------------------------------------------------------------
+// File: StaticColliders.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Static environment of the CPU solver, baked into a signed distance grid (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include "../Headers/StaticColliders.h"
+
+// cache file: magic, version of the layout
+#define SDF_MAGIC               0x31464453u
+#define SDF_VERSION             1u
+
+
+//--------------------------------------------------------------------------------------
+// Vector helpers
+//--------------------------------------------------------------------------------------
+static inline XMFLOAT3 sub3(const XMFLOAT3& a, const XMFLOAT3& b){
+    return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline float dot3(const XMFLOAT3& a, const XMFLOAT3& b){
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// squared distance of p and the closest point of triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+static float triangleDistanceSq(const XMFLOAT3& p, const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c){
+
+    XMFLOAT3 ab = sub3(b, a), ac = sub3(c, a), ap = sub3(p, a);
+    XMFLOAT3 q;
+    float d1 = dot3(ab, ap), d2 = dot3(ac, ap);
+    XMFLOAT3 bp = sub3(p, b);
+    float d3 = dot3(ab, bp), d4 = dot3(ac, bp);
+    XMFLOAT3 cp = sub3(p, c);
+    float d5 = dot3(ab, cp), d6 = dot3(ac, cp);
+    float va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+
+    // vertex regions, edge regions, face
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        q = a;
+    else if (d3 >= 0.0f && d4 <= d3)
+        q = b;
+    else if (d6 >= 0.0f && d5 <= d6)
+        q = c;
+    else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f){
+        float t = d1 / (d1 - d3);
+        q = XMFLOAT3(a.x + t * ab.x, a.y + t * ab.y, a.z + t * ab.z);
+    }
+    else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f){
+        float t = d2 / (d2 - d6);
+        q = XMFLOAT3(a.x + t * ac.x, a.y + t * ac.y, a.z + t * ac.z);
+    }
+    else if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f){
+        float t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        q = XMFLOAT3(b.x + t * (c.x - b.x), b.y + t * (c.y - b.y), b.z + t * (c.z - b.z));
+    }
+    else {
+        float denom = 1.0f / (va + vb + vc);
+        float v = vb * denom, w = vc * denom;
+        q = XMFLOAT3(a.x + ab.x * v + ac.x * w, a.y + ab.y * v + ac.y * w, a.z + ab.z * v + ac.z * w);
+    }
+    XMFLOAT3 d = sub3(p, q);
+    return dot3(d, d);
+}
+
+// height where the vertical line through (x, y) crosses triangle abc, false if it misses;
+// points on an edge belong to one side only (left or top edges of the counter-clockwise
+// triangle), so a ray through a shared edge crosses exactly one of its triangles
+static bool crossZ(double x, double y, const XMFLOAT3& a, const XMFLOAT3& b, const XMFLOAT3& c, float& z){
+
+    double area = ((double)b.x - a.x) * ((double)c.y - a.y) - ((double)b.y - a.y) * ((double)c.x - a.x);
+    if (area == 0.0)
+        return false;
+    const XMFLOAT3* v[3] = { &a, area > 0.0 ? &b : &c, area > 0.0 ? &c : &b };
+    double w[3];
+    for (uint k = 0; k < 3; k++){
+        const XMFLOAT3& p = *v[k];
+        const XMFLOAT3& q = *v[(k + 1) % 3];
+        double e = ((double)q.x - p.x) * (y - p.y) - ((double)q.y - p.y) * (x - p.x);
+        bool topLeft = (q.y < p.y) || (q.y == p.y && q.x < p.x);
+        if (e < 0.0 || (e == 0.0 && !topLeft))
+            return false;
+        // weight of the opposite corner
+        w[(k + 2) % 3] = e;
+    }
+    double sum = w[0] + w[1] + w[2];
+    z = (float)((w[0] * v[0]->z + w[1] * v[1]->z + w[2] * v[2]->z) / sum);
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+StaticColliders::StaticColliders(float cell) : cellSize(cell), origin(0, 0, 0), dimX(0), dimY(0), dimZ(0), baked(false){}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+StaticColliders::~StaticColliders(){}
+
+//--------------------------------------------------------------------------------------
+// Colliders
+//--------------------------------------------------------------------------------------
+void StaticColliders::addPlane(const XMFLOAT3& normal, float offset){
+
+    float len = sqrtf(dot3(normal, normal));
+    if (len == 0.0f)
+        throw "StaticColliders: plane without a normal";
+    planes.push_back(COLLIDERPLANE{ XMFLOAT3(normal.x / len, normal.y / len, normal.z / len), offset / len });
+    baked = false;
+}
+
+void StaticColliders::addBox(const XMFLOAT3& center, const XMFLOAT3& halfSize){
+
+    boxes.push_back(COLLIDERBOX{ center, XMFLOAT3(fabsf(halfSize.x), fabsf(halfSize.y), fabsf(halfSize.z)) });
+    baked = false;
+}
+
+void StaticColliders::addMesh(const std::vector<XMFLOAT3>& vertices, const std::vector<uint>& indices){
+
+    for (uint i = 0; i + 2 < indices.size(); i += 3){
+        if (indices[i] >= vertices.size() || indices[i + 1] >= vertices.size() || indices[i + 2] >= vertices.size())
+            throw "StaticColliders: mesh index out of range";
+        triangles.push_back(vertices[indices[i]]);
+        triangles.push_back(vertices[indices[i + 1]]);
+        triangles.push_back(vertices[indices[i + 2]]);
+    }
+    baked = false;
+}
+
+void StaticColliders::clear(){
+
+    planes.clear();
+    boxes.clear();
+    triangles.clear();
+    grid.clear();
+    dimX = dimY = dimZ = 0;
+    baked = false;
+}
+
+//--------------------------------------------------------------------------------------
+// Analytic distance: union of the planes and boxes
+//--------------------------------------------------------------------------------------
+float StaticColliders::analytic(const XMFLOAT3& p) const {
+
+    float d = FLT_MAX;
+    for (const COLLIDERPLANE& plane : planes)
+        d = std::min(d, dot3(plane.normal, p) - plane.offset);
+    for (const COLLIDERBOX& box : boxes){
+        XMFLOAT3 q(fabsf(p.x - box.center.x) - box.halfSize.x, fabsf(p.y - box.center.y) - box.halfSize.y, fabsf(p.z - box.center.z) - box.halfSize.z);
+        XMFLOAT3 out(std::max(q.x, 0.0f), std::max(q.y, 0.0f), std::max(q.z, 0.0f));
+        d = std::min(d, sqrtf(dot3(out, out)) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f));
+    }
+    return d;
+}
+
+//--------------------------------------------------------------------------------------
+// Key: FNV-1a of the colliders and the grid parameters
+//--------------------------------------------------------------------------------------
+unsigned long long StaticColliders::key() const {
+
+    unsigned long long h = 14695981039346656037ull;
+    auto hash = [&](const void* data, size_t bytes){
+        const unsigned char* b = (const unsigned char*)data;
+        for (size_t i = 0; i < bytes; i++){
+            h ^= b[i];
+            h *= 1099511628211ull;
+        }
+    };
+    uint counts[4] = { (uint)planes.size(), (uint)boxes.size(), (uint)triangles.size(), SDF_BAND };
+    hash(counts, sizeof(counts));
+    hash(&cellSize, sizeof(float));
+    hash(planes.data(), planes.size() * sizeof(COLLIDERPLANE));
+    hash(boxes.data(), boxes.size() * sizeof(COLLIDERBOX));
+    hash(triangles.data(), triangles.size() * sizeof(XMFLOAT3));
+    return h;
+}
+
+//--------------------------------------------------------------------------------------
+// Cache: header (magic, version, key, dimensions, origin, cell size), then the samples
+//--------------------------------------------------------------------------------------
+bool StaticColliders::readCache(const std::string& file){
+
+    std::ifstream input(file, std::ios::binary);
+    if (!input)
+        return false;
+    uint magic = 0, version = 0, dims[3] = { 0, 0, 0 };
+    unsigned long long stored = 0;
+    XMFLOAT3 corner;
+    float cell = 0.0f;
+    input.read((char*)&magic, sizeof(uint));
+    input.read((char*)&version, sizeof(uint));
+    input.read((char*)&stored, sizeof(stored));
+    input.read((char*)dims, sizeof(dims));
+    input.read((char*)&corner, sizeof(XMFLOAT3));
+    input.read((char*)&cell, sizeof(float));
+    if (!input || magic != SDF_MAGIC || version != SDF_VERSION || stored != key() || cell != cellSize)
+        return false;
+
+    size_t count = (size_t)dims[0] * dims[1] * dims[2];
+    AlignedVector<float> samples(count);
+    input.read((char*)samples.data(), count * sizeof(float));
+    if (!input)
+        return false;
+    dimX = dims[0];
+    dimY = dims[1];
+    dimZ = dims[2];
+    origin = corner;
+    grid.swap(samples);
+    return true;
+}
+
+void StaticColliders::writeCache(const std::string& file) const {
+
+    std::ofstream output(file, std::ios::binary | std::ios::trunc);
+    if (!output)
+        return;
+    uint magic = SDF_MAGIC, version = SDF_VERSION, dims[3] = { dimX, dimY, dimZ };
+    unsigned long long k = key();
+    output.write((const char*)&magic, sizeof(uint));
+    output.write((const char*)&version, sizeof(uint));
+    output.write((const char*)&k, sizeof(k));
+    output.write((const char*)dims, sizeof(dims));
+    output.write((const char*)&origin, sizeof(XMFLOAT3));
+    output.write((const char*)&cellSize, sizeof(float));
+    output.write((const char*)grid.data(), grid.size() * sizeof(float));
+}
+
+//--------------------------------------------------------------------------------------
+// Bake: bounds of the boxes and meshes, mesh distances per z-slice, mesh signs per
+//       y-row, then the union with the planes and boxes
+//--------------------------------------------------------------------------------------
+void StaticColliders::bake(ThreadPool& pool, const std::string& cacheFile){
+
+    grid.clear();
+    dimX = dimY = dimZ = 0;
+    baked = true;
+    if (boxes.empty() && triangles.empty())
+        return;
+    if (!cacheFile.empty() && readCache(cacheFile))
+        return;
+
+    // grid bounds: boxes and triangles, grown by the band
+    float band = SDF_BAND * cellSize;
+    XMFLOAT3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    auto grow = [&](const XMFLOAT3& a, const XMFLOAT3& b){
+        lo = XMFLOAT3(std::min(lo.x, a.x), std::min(lo.y, a.y), std::min(lo.z, a.z));
+        hi = XMFLOAT3(std::max(hi.x, b.x), std::max(hi.y, b.y), std::max(hi.z, b.z));
+    };
+    for (const COLLIDERBOX& box : boxes)
+        grow(sub3(box.center, box.halfSize), XMFLOAT3(box.center.x + box.halfSize.x, box.center.y + box.halfSize.y, box.center.z + box.halfSize.z));
+    for (const XMFLOAT3& t : triangles)
+        grow(t, t);
+    origin = XMFLOAT3(lo.x - band, lo.y - band, lo.z - band);
+    dimX = (uint)ceilf((hi.x - lo.x + 2 * band) / cellSize) + 1;
+    dimY = (uint)ceilf((hi.y - lo.y + 2 * band) / cellSize) + 1;
+    dimZ = (uint)ceilf((hi.z - lo.z + 2 * band) / cellSize) + 1;
+    if ((double)dimX * dimY * dimZ > SDF_SAMPLES_MAX)
+        throw "StaticColliders: grid too large, increase the cell size";
+    grid.assign((size_t)dimX * dimY * dimZ, band);
+    auto sample = [&](uint x, uint y, uint z){
+        return XMFLOAT3(origin.x + x * cellSize, origin.y + y * cellSize, origin.z + z * cellSize);
+    };
+
+    // unsigned mesh distances within the band of every triangle
+    uint triangleCount = triangles.size() / 3;
+    pool.parallelFor(dimZ, [&](uint z){
+        float pz = origin.z + z * cellSize;
+        for (uint t = 0; t < triangleCount; t++){
+            const XMFLOAT3& a = triangles[3 * t];
+            const XMFLOAT3& b = triangles[3 * t + 1];
+            const XMFLOAT3& c = triangles[3 * t + 2];
+            if (std::min(a.z, std::min(b.z, c.z)) - band > pz || std::max(a.z, std::max(b.z, c.z)) + band < pz)
+                continue;
+            uint x0 = (uint)std::max(0.0f, floorf((std::min(a.x, std::min(b.x, c.x)) - band - origin.x) / cellSize));
+            uint x1 = (uint)std::min((float)dimX - 1, ceilf((std::max(a.x, std::max(b.x, c.x)) + band - origin.x) / cellSize));
+            uint y0 = (uint)std::max(0.0f, floorf((std::min(a.y, std::min(b.y, c.y)) - band - origin.y) / cellSize));
+            uint y1 = (uint)std::min((float)dimY - 1, ceilf((std::max(a.y, std::max(b.y, c.y)) + band - origin.y) / cellSize));
+            for (uint y = y0; y <= y1; y++){
+                float* row = &grid[((size_t)z * dimY + y) * dimX];
+                for (uint x = x0; x <= x1; x++)
+                    row[x] = std::min(row[x], sqrtf(triangleDistanceSq(sample(x, y, z), a, b, c)));
+            }
+        }
+    });
+
+    // signs: triangles crossed by the column below every sample, inside after an odd number
+    if (triangleCount > 0){
+        pool.parallelFor(dimY, [&](uint y){
+            double py = origin.y + y * cellSize;
+            std::vector<std::vector<float>> crossings(dimX);
+            for (uint t = 0; t < triangleCount; t++){
+                const XMFLOAT3& a = triangles[3 * t];
+                const XMFLOAT3& b = triangles[3 * t + 1];
+                const XMFLOAT3& c = triangles[3 * t + 2];
+                if (std::min(a.y, std::min(b.y, c.y)) > py || std::max(a.y, std::max(b.y, c.y)) < py)
+                    continue;
+                uint x0 = (uint)std::max(0.0f, floorf((std::min(a.x, std::min(b.x, c.x)) - origin.x) / cellSize));
+                uint x1 = (uint)std::min((float)dimX - 1, ceilf((std::max(a.x, std::max(b.x, c.x)) - origin.x) / cellSize));
+                for (uint x = x0; x <= x1; x++){
+                    float cz;
+                    if (crossZ((double)origin.x + x * cellSize, py, a, b, c, cz))
+                        crossings[x].push_back(cz);
+                }
+            }
+            for (uint x = 0; x < dimX; x++){
+                std::vector<float>& column = crossings[x];
+                if (column.empty())
+                    continue;
+                std::sort(column.begin(), column.end());
+                uint below = 0;
+                for (uint z = 0; z < dimZ; z++){
+                    float pz = origin.z + z * cellSize;
+                    while (below < column.size() && column[below] <= pz)
+                        below++;
+                    if (below % 2 == 1){
+                        float& d = grid[((size_t)z * dimY + y) * dimX + x];
+                        d = -d;
+                    }
+                }
+            }
+        });
+    }
+
+    // union with the planes and boxes
+    pool.parallelFor(dimZ, [&](uint z){
+        for (uint y = 0; y < dimY; y++){
+            float* row = &grid[((size_t)z * dimY + y) * dimX];
+            for (uint x = 0; x < dimX; x++)
+                row[x] = std::min(row[x], analytic(sample(x, y, z)));
+        }
+    });
+
+    if (!cacheFile.empty())
+        writeCache(cacheFile);
+}
+
+//--------------------------------------------------------------------------------------
+// Distance: trilinear in the grid, the planes and boxes outside of it
+//--------------------------------------------------------------------------------------
+float StaticColliders::distance(const XMFLOAT3& p) const {
+
+    float fx = (p.x - origin.x) / cellSize;
+    float fy = (p.y - origin.y) / cellSize;
+    float fz = (p.z - origin.z) / cellSize;
+    if (grid.empty() || fx < 0.0f || fy < 0.0f || fz < 0.0f || fx > dimX - 1 || fy > dimY - 1 || fz > dimZ - 1)
+        return analytic(p);
+
+    uint x = std::min((uint)fx, dimX - 2);
+    uint y = std::min((uint)fy, dimY - 2);
+    uint z = std::min((uint)fz, dimZ - 2);
+    float tx = fx - x, ty = fy - y, tz = fz - z;
+    const float* c = &grid[((size_t)z * dimY + y) * dimX + x];
+    size_t sy = dimX, sz = (size_t)dimX * dimY;
+    float c00 = c[0] + (c[1] - c[0]) * tx;
+    float c10 = c[sy] + (c[sy + 1] - c[sy]) * tx;
+    float c01 = c[sz] + (c[sz + 1] - c[sz]) * tx;
+    float c11 = c[sz + sy] + (c[sz + sy + 1] - c[sz + sy]) * tx;
+    float c0 = c00 + (c10 - c00) * ty;
+    float c1 = c01 + (c11 - c01) * ty;
+    return c0 + (c1 - c0) * tz;
+}
+
+//--------------------------------------------------------------------------------------
+// Repulsion: outwards along the central difference gradient, exponential in the depth
+//--------------------------------------------------------------------------------------
+XMFLOAT3 StaticColliders::repulsion(const XMFLOAT3& p) const {
+
+    float d = distance(p);
+    if (d >= 0.0f)
+        return XMFLOAT3(0, 0, 0);
+
+    float h = 0.5f * cellSize;
+    XMFLOAT3 n(distance(XMFLOAT3(p.x + h, p.y, p.z)) - distance(XMFLOAT3(p.x - h, p.y, p.z)),
+               distance(XMFLOAT3(p.x, p.y + h, p.z)) - distance(XMFLOAT3(p.x, p.y - h, p.z)),
+               distance(XMFLOAT3(p.x, p.y, p.z + h)) - distance(XMFLOAT3(p.x, p.y, p.z - h)));
+    float len = sqrtf(dot3(n, n));
+    // flat spot (centre of a symmetric collider): straight up
+    if (len == 0.0f)
+        n = XMFLOAT3(0, 1, 0);
+    else
+        n = XMFLOAT3(n.x / len, n.y / len, n.z / len);
+
+    float w = std::min(EXP_MAX, 1000.0f * exp2f(-d) * EXP_MUL);
+    return XMFLOAT3(n.x * w, n.y * w, n.z * w);
+}
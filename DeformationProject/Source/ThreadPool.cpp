@@ -0,0 +1,145 @@
+//--------------------------------------------------------------------------------------
+// File: ThreadPool.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Work-stealing thread pool of the CPU solver (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include "../Headers/ThreadPool.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constructor: start threads - 1 workers
+//--------------------------------------------------------------------------------------
+ThreadPool::ThreadPool(uint threads) : body(nullptr), pending(0), generation(0), stopping(false), stolen(0){
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (uint i = 0; i < threads; i++)
+        queues.push_back(std::unique_ptr<WORKQUEUE>(new WORKQUEUE()));
+    for (uint i = 1; i < threads; i++)
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+//--------------------------------------------------------------------------------------
+// Destructor: stop and join the workers
+//--------------------------------------------------------------------------------------
+ThreadPool::~ThreadPool(){
+
+    {
+        std::lock_guard<std::mutex> lock(batchLock);
+        stopping = true;
+    }
+    batchStart.notify_all();
+    for (uint i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+//--------------------------------------------------------------------------------------
+// Parallel for: distribute the tasks in blocks, work as thread 0, wait for the rest
+//--------------------------------------------------------------------------------------
+void ThreadPool::parallelFor(uint count, const std::function<void(uint)>& body){
+
+    if (count == 0)
+        return;
+
+    // nothing to share
+    if (workers.empty() || count == 1){
+        for (uint i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+
+    // body is set before any task becomes visible through a queue lock
+    this->body = &body;
+    pending = count;
+    uint n = size();
+    for (uint q = 0; q < n; q++){
+        std::lock_guard<std::mutex> lock(queues[q]->lock);
+        for (uint i = q * count / n; i < (q + 1) * count / n; i++)
+            queues[q]->tasks.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(batchLock);
+        generation++;
+    }
+    batchStart.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(batchLock);
+    batchDone.wait(lock, [this]{ return pending == 0; });
+}
+
+//--------------------------------------------------------------------------------------
+// Worker loop: sleep until a batch is posted, then work on it
+//--------------------------------------------------------------------------------------
+void ThreadPool::workerLoop(uint index){
+
+    uint seen = 0;
+    while (true){
+        {
+            std::unique_lock<std::mutex> lock(batchLock);
+            batchStart.wait(lock, [&]{ return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        work(index);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Work: own tasks first, then steal until every queue is empty
+//--------------------------------------------------------------------------------------
+void ThreadPool::work(uint index){
+
+    uint task;
+    while (pop(index, task) || steal(index, task)){
+        (*body)(task);
+        // last task of the batch
+        if (pending.fetch_sub(1) == 1){
+            std::lock_guard<std::mutex> lock(batchLock);
+            batchDone.notify_all();
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Pop: newest task of the own queue
+//--------------------------------------------------------------------------------------
+bool ThreadPool::pop(uint index, uint& task){
+
+    WORKQUEUE& q = *queues[index];
+    std::lock_guard<std::mutex> lock(q.lock);
+    if (q.tasks.empty())
+        return false;
+    task = q.tasks.back();
+    q.tasks.pop_back();
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Steal: oldest task of the next non-empty queue
+//--------------------------------------------------------------------------------------
+bool ThreadPool::steal(uint index, uint& task){
+
+    uint n = size();
+    for (uint k = 1; k < n; k++){
+        WORKQUEUE& q = *queues[(index + k) % n];
+        std::lock_guard<std::mutex> lock(q.lock);
+        if (!q.tasks.empty()){
+            task = q.tasks.front();
+            q.tasks.pop_front();
+            stolen++;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,202 @@
+//--------------------------------------------------------------------------------------
+// File: Voxelizer.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Surface rasterization and outside flood fill of the masscube lattices (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include "../Headers/Voxelizer.h"
+#include "../Headers/ThreadPool.h"
+
+
+//--------------------------------------------------------------------------------------
+// Triangle - box overlap: separating axis test (box axes, triangle normal, 9 edge cross products)
+//--------------------------------------------------------------------------------------
+
+static inline XMFLOAT3 sub3(const XMFLOAT3& a, const XMFLOAT3& b){
+    return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline XMFLOAT3 cross3(const XMFLOAT3& a, const XMFLOAT3& b){
+    return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static inline float dot3(const XMFLOAT3& a, const XMFLOAT3& b){
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// triangle corners relative to the box center, h = half size of the box
+static bool overlaps(const XMFLOAT3 v[3], float h){
+
+    // cross products of the box axes and the edges
+    const XMFLOAT3 axes[3] = { XMFLOAT3(1, 0, 0), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 0, 1) };
+    for (uint e = 0; e < 3; e++){
+        XMFLOAT3 edge = sub3(v[(e + 1) % 3], v[e]);
+        for (uint k = 0; k < 3; k++){
+            XMFLOAT3 a = cross3(axes[k], edge);
+            float p0 = dot3(a, v[0]), p1 = dot3(a, v[1]), p2 = dot3(a, v[2]);
+            float r = h * (fabsf(a.x) + fabsf(a.y) + fabsf(a.z));
+            if (std::min(p0, std::min(p1, p2)) > r || std::max(p0, std::max(p1, p2)) < -r)
+                return false;
+        }
+    }
+
+    // triangle plane
+    XMFLOAT3 n = cross3(sub3(v[1], v[0]), sub3(v[2], v[0]));
+    float d = dot3(n, v[0]);
+    float r = h * (fabsf(n.x) + fabsf(n.y) + fabsf(n.z));
+    return fabsf(d) <= r;
+}
+
+/// Cells in the bounds of a triangle (clamped to the lattice), lo > hi in z if a vertex is missing
+struct CELLRANGE
+{
+    unsigned short lo[3];
+    unsigned short hi[3];
+};
+
+static CELLRANGE cellRange(const Float3Vector& vertices, const XMUINT3& f, const XMFLOAT3& origin, float inv, int cells){
+
+    CELLRANGE r = { { 0, 0, 1 }, { 0, 0, 0 } };
+    if (f.x >= vertices.size() || f.y >= vertices.size() || f.z >= vertices.size())
+        return r;
+    const XMFLOAT3& a = vertices[f.x];
+    const XMFLOAT3& b = vertices[f.y];
+    const XMFLOAT3& c = vertices[f.z];
+    const float mins[3] = { std::min(a.x, std::min(b.x, c.x)), std::min(a.y, std::min(b.y, c.y)), std::min(a.z, std::min(b.z, c.z)) };
+    const float maxs[3] = { std::max(a.x, std::max(b.x, c.x)), std::max(a.y, std::max(b.y, c.y)), std::max(a.z, std::max(b.z, c.z)) };
+    const float base[3] = { origin.x, origin.y, origin.z };
+    for (uint k = 0; k < 3; k++){
+        r.lo[k] = (unsigned short)std::max(0, std::min(cells - 1, (int)floorf((mins[k] - base[k]) * inv - 1e-4f)));
+        r.hi[k] = (unsigned short)std::max(0, std::min(cells - 1, (int)floorf((maxs[k] - base[k]) * inv + 1e-4f)));
+    }
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Rasterize: faces binned by cell slice, cells in the bounds of every triangle,
+//            overlap test, corners to surface
+//--------------------------------------------------------------------------------------
+void Voxelizer::rasterize(const Float3Vector& vertices, const Uint3Vector& faces, const XMFLOAT3& origin, float cell,
+                          int width, std::vector<uint>& states, ThreadPool* pool){
+
+    int cells = width - 1;
+    if (cells < 1 || cell <= 0.0f)
+        return;
+    // cells grown by a margin: a surface through a cell face or corner touches both sides
+    float h = 0.5f * cell * (1.0f + 1e-4f);
+    float inv = 1.0f / cell;
+    auto corners = [&](int x, int y, int z){
+        for (int k = 0; k < 8; k++)
+            states[((z + (k >> 2)) * width + (y + ((k >> 1) & 1))) * width + (x + (k & 1))] = 1;
+    };
+    auto run = [&](uint count, const std::function<void(uint)>& body){
+        if (pool && count > 1)
+            pool->parallelFor(count, body);
+        else
+            for (uint k = 0; k < count; k++)
+                body(k);
+    };
+
+    // cells of every face, blocks in parallel
+    uint n = (uint)faces.size();
+    std::vector<CELLRANGE> ranges(n);
+    run((n + CPU_BUILD_BATCH - 1) / CPU_BUILD_BATCH, [&](uint task){
+        uint end = std::min(n, (task + 1) * CPU_BUILD_BATCH);
+        for (uint i = task * CPU_BUILD_BATCH; i < end; i++)
+            ranges[i] = cellRange(vertices, faces[i], origin, inv, cells);
+    });
+
+    // faces of every slice (counting sort)
+    std::vector<uint> offsets(cells + 1, 0);
+    for (uint i = 0; i < n; i++)
+        for (int z = ranges[i].lo[2]; z <= ranges[i].hi[2]; z++)
+            offsets[z + 1]++;
+    for (int z = 0; z < cells; z++)
+        offsets[z + 1] += offsets[z];
+    std::vector<uint> sliceFaces(offsets[cells]);
+    std::vector<uint> fill(offsets.begin(), offsets.end() - 1);
+    for (uint i = 0; i < n; i++)
+        for (int z = ranges[i].lo[2]; z <= ranges[i].hi[2]; z++)
+            sliceFaces[fill[z]++] = i;
+
+    // slice z writes masspoint planes z and z + 1: even slices in parallel, then odd ones
+    for (int parity = 0; parity < 2; parity++){
+        run((cells - parity + 1) / 2, [&](uint task){
+            int z = 2 * task + parity;
+            for (uint s = offsets[z]; s < offsets[z + 1]; s++){
+                const CELLRANGE& r = ranges[sliceFaces[s]];
+
+                // a triangle within one cell needs no test
+                if (r.lo[0] == r.hi[0] && r.lo[1] == r.hi[1] && r.lo[2] == r.hi[2]){
+                    corners(r.lo[0], r.lo[1], z);
+                    continue;
+                }
+                const XMUINT3& f = faces[sliceFaces[s]];
+                const XMFLOAT3& a = vertices[f.x];
+                const XMFLOAT3& b = vertices[f.y];
+                const XMFLOAT3& c = vertices[f.z];
+                for (int y = r.lo[1]; y <= r.hi[1]; y++){
+                    for (int x = r.lo[0]; x <= r.hi[0]; x++){
+                        XMFLOAT3 center(origin.x + (x + 0.5f) * cell, origin.y + (y + 0.5f) * cell, origin.z + (z + 0.5f) * cell);
+                        const XMFLOAT3 v[3] = { sub3(a, center), sub3(b, center), sub3(c, center) };
+                        if (overlaps(v, h))
+                            corners(x, y, z);
+                    }
+                }
+            }
+        });
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Flood fill: breadth-first from the boundary masspoints that are not surface
+//--------------------------------------------------------------------------------------
+void Voxelizer::floodFill(int width, std::vector<uint>& states){
+
+    std::vector<uint> queue;
+    queue.reserve(states.size());
+    auto visit = [&](int x, int y, int z){
+        uint i = (z * width + y) * width + x;
+        if (states[i] == 0){
+            states[i] = 2;
+            queue.push_back(i);
+        }
+    };
+
+    // seeds: the 6 faces of the lattice
+    for (int u = 0; u < width; u++){
+        for (int v = 0; v < width; v++){
+            visit(0, u, v);
+            visit(width - 1, u, v);
+            visit(u, 0, v);
+            visit(u, width - 1, v);
+            visit(u, v, 0);
+            visit(u, v, width - 1);
+        }
+    }
+
+    for (size_t q = 0; q < queue.size(); q++){
+        int i = queue[q];
+        int x = i % width, y = (i / width) % width, z = i / (width * width);
+        if (x > 0)
+            visit(x - 1, y, z);
+        if (x < width - 1)
+            visit(x + 1, y, z);
+        if (y > 0)
+            visit(x, y - 1, z);
+        if (y < width - 1)
+            visit(x, y + 1, z);
+        if (z > 0)
+            visit(x, y, z - 1);
+        if (z < width - 1)
+            visit(x, y, z + 1);
+    }
+}
@@ -0,0 +1,269 @@
+//--------------------------------------------------------------------------------------
+// File: WideBVH.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// Quantized 4-wide collision trees of the CPU solver (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include "../Headers/WideBVH.h"
+
+
+//--------------------------------------------------------------------------------------
+// Quantization helpers
+//--------------------------------------------------------------------------------------
+
+// quantized lower bound: steps from base, rounded down
+static inline unsigned short quantizeMin(float lo, float base, float step){
+
+    if (step <= 0.0f)
+        return 0;
+    int q = std::max(0, std::min(QBVH_QMAX, (int)floorf((lo - base) / step)));
+    while (q > 0 && base + q * step > lo)
+        q--;
+    return (unsigned short)q;
+}
+
+// quantized upper bound: steps from base, rounded up
+static inline unsigned short quantizeMax(float hi, float base, float step){
+
+    if (step <= 0.0f)
+        return QBVH_QMAX;
+    int q = std::max(0, std::min(QBVH_QMAX, (int)ceilf((hi - base) / step)));
+    while (q < QBVH_QMAX && base + q * step < hi)
+        q++;
+    return (unsigned short)q;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+WideBVH::WideBVH(){
+    nodeOffsets.push_back(0);
+}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+WideBVH::~WideBVH(){}
+
+//--------------------------------------------------------------------------------------
+// Clear: no trees
+//--------------------------------------------------------------------------------------
+void WideBVH::clear(){
+
+    nodes.clear();
+    nodeOffsets.assign(1, 0);
+    roots.clear();
+    scratch.clear();
+}
+
+//--------------------------------------------------------------------------------------
+// Add node: children in the first lanes, the rest empty
+//--------------------------------------------------------------------------------------
+uint WideBVH::addNode(const uint* children, uint count){
+
+    QBVHNODE node;
+    for (uint k = 0; k < 4; k++){
+        node.minX[k] = node.minY[k] = node.minZ[k] = 0;
+        node.maxX[k] = node.maxY[k] = node.maxZ[k] = 0;
+        node.child[k] = k < count ? children[k] : QBVH_EMPTY;
+    }
+    nodes.push_back(node);
+    return (uint)nodes.size() - 1;
+}
+
+//--------------------------------------------------------------------------------------
+// Build: Morton order of the masspoints, 4 per leaf node, then 4 nodes per parent
+//--------------------------------------------------------------------------------------
+void WideBVH::build(const BVHLeafVector& masspoints, uint mass1Offset, uint mass2Offset){
+
+    uint count = masspoints.size();
+    if (count > 0){
+        // codes in the bounds of the masspoints, as in BVHierarchy
+        XMFLOAT3 lo = masspoints[0].pos, hi = masspoints[0].pos;
+        for (const BVHLEAF& m : masspoints){
+            lo = XMFLOAT3(std::min(lo.x, m.pos.x), std::min(lo.y, m.pos.y), std::min(lo.z, m.pos.z));
+            hi = XMFLOAT3(std::max(hi.x, m.pos.x), std::max(hi.y, m.pos.y), std::max(hi.z, m.pos.z));
+        }
+        XMFLOAT3 scale(hi.x > lo.x ? 1.0f / (hi.x - lo.x) : 1.0f, hi.y > lo.y ? 1.0f / (hi.y - lo.y) : 1.0f, hi.z > lo.z ? 1.0f / (hi.z - lo.z) : 1.0f);
+        std::vector<uint> codes(count), order(count);
+        for (uint i = 0; i < count; i++){
+            const XMFLOAT3& p = masspoints[i].pos;
+            codes[i] = BVHierarchy::morton((p.x - lo.x) * scale.x, (p.y - lo.y) * scale.y, (p.z - lo.z) * scale.z);
+            order[i] = i;
+        }
+        BVHierarchy::radixSort(codes, order);
+
+        // children of the current level: masspoints, then the nodes of the level below
+        std::vector<uint> level(count);
+        for (uint i = 0; i < count; i++){
+            const BVHLEAF& m = masspoints[order[i]];
+            level[i] = (m.type == 1 ? mass1Offset + m.id : mass2Offset + m.id) | QBVH_MASSPOINT;
+        }
+        do {
+            std::vector<uint> parents;
+            for (uint i = 0; i < level.size(); i += 4)
+                parents.push_back(addNode(&level[i], std::min(4u, (uint)level.size() - i)));
+            level.swap(parents);
+        } while (level.size() > 1);
+    }
+    nodeOffsets.push_back(nodes.size());
+    roots.push_back(BOUNDS());
+}
+
+//--------------------------------------------------------------------------------------
+// Convert node: the masspoints of a deepest level subtree or the wide nodes of the
+//               4 grandchildren, post-order (children before parents)
+//--------------------------------------------------------------------------------------
+uint WideBVH::convertNode(const BVBOX* tree, uint index, uint level, uint maxlevel, uint mass1Offset, uint mass2Offset){
+
+    const BVBOX& node = tree[index];
+    if (node.leftType == -1 && node.rightType == -1)
+        return QBVH_EMPTY;
+
+    uint children[4];
+    uint count = 0;
+    auto masspoints = [&](const BVBOX& leaf){
+        if (leaf.leftType == 1 || leaf.leftType == 2)
+            children[count++] = ((leaf.leftType == 1 ? mass1Offset : mass2Offset) + leaf.leftID) | QBVH_MASSPOINT;
+        if (leaf.rightType == 1 || leaf.rightType == 2)
+            children[count++] = ((leaf.rightType == 1 ? mass1Offset : mass2Offset) + leaf.rightID) | QBVH_MASSPOINT;
+    };
+
+    // deepest level: its own masspoints; level above: the masspoints of both children
+    if (level == maxlevel - 1)
+        masspoints(node);
+    else if (level == maxlevel - 2){
+        if (node.leftType == 0)
+            masspoints(tree[2 * index + 1]);
+        if (node.rightType == 0)
+            masspoints(tree[2 * index + 2]);
+    }
+    // odd number of levels: the root takes its children, every other node ends at the level above the deepest
+    else if (level == 0 && maxlevel % 2 == 1){
+        for (uint c = 1; c <= 2; c++){
+            uint n = (c == 1 ? node.leftType : node.rightType) == 0 ? convertNode(tree, c, 1, maxlevel, mass1Offset, mass2Offset) : QBVH_EMPTY;
+            if (n != QBVH_EMPTY)
+                children[count++] = n;
+        }
+    }
+    // higher levels: the grandchildren of the valid children
+    else {
+        for (uint k = 0; k < 2; k++){
+            uint c = 2 * index + 1 + k;
+            if ((k == 0 ? node.leftType : node.rightType) != 0)
+                continue;
+            for (uint g = 2 * c + 1; g <= 2 * c + 2; g++){
+                uint n = convertNode(tree, g, level + 2, maxlevel, mass1Offset, mass2Offset);
+                if (n != QBVH_EMPTY)
+                    children[count++] = n;
+            }
+        }
+    }
+    return count > 0 ? addNode(children, count) : QBVH_EMPTY;
+}
+
+//--------------------------------------------------------------------------------------
+// Convert: wide tree of a binary tree in level order (the ctree layout)
+//--------------------------------------------------------------------------------------
+void WideBVH::convert(const BVBoxVector& ctree, uint mass1Offset, uint mass2Offset){
+
+    if (!ctree.empty()){
+        uint maxlevel = (uint)log2((float)(ctree.size() + 1));
+        convertNode(ctree.data(), 0, 0, maxlevel, mass1Offset, mass2Offset);
+    }
+    nodeOffsets.push_back(nodes.size());
+    roots.push_back(BOUNDS());
+}
+
+//--------------------------------------------------------------------------------------
+// Masspoint bounds: position grown by the range (swept: and the next position)
+//--------------------------------------------------------------------------------------
+WideBVH::BOUNDS WideBVH::masspointBounds(const MASSVIEW& v, uint id, float range, bool swept){
+
+    XMFLOAT3 a(v.newX[id], v.newY[id], v.newZ[id]);
+    XMFLOAT3 b = swept ? XMFLOAT3(2 * v.newX[id] - v.oldX[id], 2 * v.newY[id] - v.oldY[id], 2 * v.newZ[id] - v.oldZ[id]) : a;
+    BOUNDS r;
+    r.lo = XMFLOAT3(std::min(a.x, b.x) - range, std::min(a.y, b.y) - range, std::min(a.z, b.z) - range);
+    r.hi = XMFLOAT3(std::max(a.x, b.x) + range, std::max(a.y, b.y) + range, std::max(a.z, b.z) + range);
+    return r;
+}
+
+//--------------------------------------------------------------------------------------
+// Quantize: children of node n in the dequantized bounds of n
+//--------------------------------------------------------------------------------------
+void WideBVH::quantize(uint n, const MASSVIEW& v, float range, bool swept){
+
+    QBVHNODE& node = nodes[n];
+    const BOUNDS& b = scratch[n];
+    XMFLOAT3 step(quantum(b.lo.x, b.hi.x), quantum(b.lo.y, b.hi.y), quantum(b.lo.z, b.hi.z));
+    for (uint k = 0; k < 4; k++){
+        uint c = node.child[k];
+        if (c == QBVH_EMPTY)
+            continue;
+        BOUNDS cb = (c & QBVH_MASSPOINT) ? masspointBounds(v, c & ~QBVH_MASSPOINT, range, swept) : scratch[c];
+        node.minX[k] = quantizeMin(cb.lo.x, b.lo.x, step.x);
+        node.minY[k] = quantizeMin(cb.lo.y, b.lo.y, step.y);
+        node.minZ[k] = quantizeMin(cb.lo.z, b.lo.z, step.z);
+        node.maxX[k] = quantizeMax(cb.hi.x, b.lo.x, step.x);
+        node.maxY[k] = quantizeMax(cb.hi.y, b.lo.y, step.y);
+        node.maxZ[k] = quantizeMax(cb.hi.z, b.lo.z, step.z);
+
+        // the child node is seen through the dequantized bounds, the same ones as a query
+        if (!(c & QBVH_MASSPOINT)){
+            scratch[c].lo = XMFLOAT3(b.lo.x + node.minX[k] * step.x, b.lo.y + node.minY[k] * step.y, b.lo.z + node.minZ[k] * step.z);
+            scratch[c].hi = XMFLOAT3(b.lo.x + node.maxX[k] * step.x, b.lo.y + node.maxY[k] * step.y, b.lo.z + node.maxZ[k] * step.z);
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Refit: exact bounds bottom-up (children come first), then quantization top-down;
+//        objects in parallel
+//--------------------------------------------------------------------------------------
+void WideBVH::refit(const MASSVIEW& v, float range, ThreadPool& pool, bool swept){
+
+    scratch.resize(nodes.size());
+    pool.parallelFor(objects(), [&](uint o){
+        uint first = nodeOffsets[o], last = nodeOffsets[o + 1];
+        if (first == last)
+            return;
+
+        for (uint n = first; n < last; n++){
+            const QBVHNODE& node = nodes[n];
+            BOUNDS b;
+            b.lo = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+            b.hi = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            for (uint k = 0; k < 4 && node.child[k] != QBVH_EMPTY; k++){
+                uint c = node.child[k];
+                BOUNDS cb = (c & QBVH_MASSPOINT) ? masspointBounds(v, c & ~QBVH_MASSPOINT, range, swept) : scratch[c];
+                b.lo = XMFLOAT3(std::min(b.lo.x, cb.lo.x), std::min(b.lo.y, cb.lo.y), std::min(b.lo.z, cb.lo.z));
+                b.hi = XMFLOAT3(std::max(b.hi.x, cb.hi.x), std::max(b.hi.y, cb.hi.y), std::max(b.hi.z, cb.hi.z));
+            }
+            scratch[n] = b;
+        }
+
+        roots[o] = scratch[last - 1];
+        for (uint n = last; n-- > first;)
+            quantize(n, v, range, swept);
+    });
+}
+
+//--------------------------------------------------------------------------------------
+// Bounds: root bounds of the last refit
+//--------------------------------------------------------------------------------------
+bool WideBVH::bounds(uint o, XMFLOAT3& lo, XMFLOAT3& hi) const {
+
+    if (nodeOffsets[o + 1] == nodeOffsets[o])
+        return false;
+    lo = roots[o].lo;
+    hi = roots[o].hi;
+    return true;
+}
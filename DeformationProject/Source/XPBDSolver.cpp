@@ -0,0 +1,148 @@
+//--------------------------------------------------------------------------------------
+// File: XPBDSolver.cpp
+//
+// Project Deformation
+// Object deformation with mass-spring systems
+//
+// XPBD distance constraint solver of the CPU solver (impl)
+//
+// @Copyright (c) pgq
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "../Headers/XPBDSolver.h"
+
+
+//--------------------------------------------------------------------------------------
+// Constructor
+//--------------------------------------------------------------------------------------
+XPBDSolver::XPBDSolver() : maxIterations(0){}
+
+//--------------------------------------------------------------------------------------
+// Destructor
+//--------------------------------------------------------------------------------------
+XPBDSolver::~XPBDSolver(){}
+
+//--------------------------------------------------------------------------------------
+// Build: greedy edge coloring, edges sorted by color
+//--------------------------------------------------------------------------------------
+void XPBDSolver::build(const SpringGraph& graph, const float* rest, const std::vector<uint>& iterations){
+
+    uint edges = graph.edgeCount();
+    colorOffsets.clear();
+    edgeA.resize(edges);
+    edgeB.resize(edges);
+    this->rest.resize(edges);
+    edgeIterations.resize(edges);
+    lambda.assign(edges, 0.0f);
+    maxIterations = 0;
+
+    // lowest color not used by either end point (a lattice masspoint has at most 20 springs,
+    // so greedy coloring needs less than 40 colors)
+    std::vector<uint64_t> used(graph.masspointCount(), 0);
+    std::vector<uint> color(edges);
+    std::vector<uint> count;
+    for (uint e = 0; e < edges; e++){
+        uint64_t taken = used[graph.edgeA[e]] | used[graph.edgeB[e]];
+        if (taken == ~(uint64_t)0)
+            throw "Too many constraint colors";
+        uint c = 0;
+        while (taken & ((uint64_t)1 << c))
+            c++;
+        used[graph.edgeA[e]] |= (uint64_t)1 << c;
+        used[graph.edgeB[e]] |= (uint64_t)1 << c;
+        color[e] = c;
+        if (c >= count.size())
+            count.resize(c + 1, 0);
+        count[c]++;
+    }
+
+    // counting sort, original order inside a color
+    colorOffsets.assign(count.size() + 1, 0);
+    for (uint c = 0; c < count.size(); c++)
+        colorOffsets[c + 1] = colorOffsets[c] + count[c];
+    std::vector<uint> fill(colorOffsets.begin(), colorOffsets.end() - 1);
+    for (uint e = 0; e < edges; e++){
+        uint i = fill[color[e]]++;
+        edgeA[i] = graph.edgeA[e];
+        edgeB[i] = graph.edgeB[e];
+        this->rest[i] = rest[e];
+        edgeIterations[i] = iterations[e];
+        maxIterations = std::max(maxIterations, iterations[e]);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Step: prediction, colored constraint sweeps
+//--------------------------------------------------------------------------------------
+void XPBDSolver::step(const MASSVIEW& v, const SPRINGPARAMS& params, const std::vector<XMFLOAT3>& accel, float dt, ThreadPool& pool){
+
+    uint n = accel.size();
+
+    // predicted positions: inertia + external accelerations (Verlet without springs),
+    // masspoints without neighbours stay in place
+    pool.parallelFor((n + CPU_SOLVER_BATCH - 1) / CPU_SOLVER_BATCH, [&](uint task){
+        uint end = std::min(n, (task + 1) * CPU_SOLVER_BATCH);
+        for (uint i = task * CPU_SOLVER_BATCH; i < end; i++){
+            if ((v.masks[i] & 0xFFFF) == 0){
+                v.nextX[i] = v.newX[i];
+                v.nextY[i] = v.newY[i];
+                v.nextZ[i] = v.newZ[i];
+                continue;
+            }
+            v.nextX[i] = v.newX[i] * 2 - v.oldX[i] + accel[i].x * dt * dt;
+            v.nextY[i] = v.newY[i] * 2 - v.oldY[i] + accel[i].y * dt * dt;
+            v.nextZ[i] = v.newZ[i] * 2 - v.oldZ[i] + accel[i].z * dt * dt;
+        }
+    });
+    if (params.stiffness <= 0.0f || colorOffsets.empty())
+        return;
+
+    // compliance / dt^2, damping of the springs (negative) as constraint damping
+    float alpha = 1.0f / (params.stiffness * dt * dt);
+    float gamma = -params.damping / (params.stiffness * dt);
+    std::fill(lambda.begin(), lambda.end(), 0.0f);
+
+    for (uint it = 0; it < maxIterations; it++){
+        for (uint c = 0; c + 1 < colorOffsets.size(); c++){
+            uint first = colorOffsets[c];
+            uint count = colorOffsets[c + 1] - first;
+            pool.parallelFor((count + CPU_EDGE_BATCH - 1) / CPU_EDGE_BATCH, [&](uint task){
+                uint end = first + std::min(count, (task + 1) * CPU_EDGE_BATCH);
+                for (uint e = first + task * CPU_EDGE_BATCH; e < end; e++){
+                    if (it >= edgeIterations[e])
+                        continue;
+                    uint a = edgeA[e], b = edgeB[e];
+                    float wa = (v.masks[a] & 0xFFFF) ? params.im : 0.0f;
+                    float wb = (v.masks[b] & 0xFFFF) ? params.im : 0.0f;
+                    if (wa + wb == 0.0f)
+                        continue;
+
+                    float dx = v.nextX[a] - v.nextX[b], dy = v.nextY[a] - v.nextY[b], dz = v.nextZ[a] - v.nextZ[b];
+                    float len = sqrtf(dx * dx + dy * dy + dz * dz);
+                    if (len == 0.0f)
+                        continue;
+                    float il = 1.0f / len;
+                    dx *= il; dy *= il; dz *= il;
+
+                    // constraint, relative motion along it in this step
+                    float C = len - rest[e];
+                    float rel = dx * ((v.nextX[a] - v.newX[a]) - (v.nextX[b] - v.newX[b])) +
+                                dy * ((v.nextY[a] - v.newY[a]) - (v.nextY[b] - v.newY[b])) +
+                                dz * ((v.nextZ[a] - v.newZ[a]) - (v.nextZ[b] - v.newZ[b]));
+                    float dl = (-C - alpha * lambda[e] - gamma * rel) / ((1.0f + gamma) * (wa + wb) + alpha);
+                    lambda[e] += dl;
+
+                    v.nextX[a] += wa * dl * dx;
+                    v.nextY[a] += wa * dl * dy;
+                    v.nextZ[a] += wa * dl * dz;
+                    v.nextX[b] -= wb * dl * dx;
+                    v.nextY[b] -= wb * dl * dy;
+                    v.nextZ[b] -= wb * dl * dz;
+                }
+            });
+        }
+    }
+}